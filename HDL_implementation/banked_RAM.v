@@ -0,0 +1,47 @@
+`timescale 1ns / 1ps
+// Banked RAM with one write port per lane and a single wide read port
+// Built from dual_port_RAM, one bank per lane, so that the banks can be written while they are read.
+// Location i is in bank i % 2^lanes_bits,
+// so up to 2^lanes_bits consecutive locations (one packed AXIS word) can be written in one clock,
+// and 2^lanes_bits consecutive locations (one row of X) are read in one clock.
+
+module banked_RAM
+	#(
+		parameter width = 8, 					// width is the number of bits per location
+		parameter depth_bits = 9,				// depth is the number of locations (2^number of address bits), over all banks
+		parameter lanes_bits = 2				// 2^lanes_bits banks
+	)
+	(
+		input clk,
+		input [2**lanes_bits-1:0] write_en,							// one write enable per bank
+		input [depth_bits-lanes_bits-1:0] write_address,			// bank address, common to all banks
+		input [width*2**lanes_bits-1:0] write_data_in,				// bank k is written with bits [width*k +: width]
+		input read_en,
+		input [depth_bits-lanes_bits-1:0] read_address,			// bank address, common to all banks
+		output [width*2**lanes_bits-1:0] read_data_out				// bank k in bits [width*k +: width]
+	);
+
+localparam lanes = 2**lanes_bits;
+
+genvar k;
+generate
+	for (k = 0; k < lanes; k = k+1)
+	begin : bank
+		dual_port_RAM
+		#(
+			.width(width),
+			.depth_bits(depth_bits-lanes_bits)
+		) bank_RAM
+		(
+			.clk(clk),
+			.write_en(write_en[k]),
+			.write_address(write_address),
+			.write_data_in(write_data_in[width*k +: width]),
+			.read_en(read_en),
+			.read_address(read_address),
+			.read_data_out(read_data_out[width*k +: width])
+		);
+	end
+endgenerate
+
+endmodule
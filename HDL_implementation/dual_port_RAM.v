@@ -0,0 +1,31 @@
+`timescale 1ns / 1ps
+// Simple dual port fully synchronous RAM : one write port and one read port, usable in the same clock
+// Same as memory_RAM otherwise. Needed where one half of a ping-pong buffer is written while the other half is read.
+
+module dual_port_RAM
+	#(
+		parameter width = 8, 					// width is the number of bits per location
+		parameter depth_bits = 2				// depth is the number of locations (2^number of address bits)
+	)
+	(
+		input clk,
+		input write_en,
+		input [depth_bits-1:0] write_address,
+		input [width-1:0] write_data_in,
+		input read_en,
+		input [depth_bits-1:0] read_address,
+		output reg [width-1:0] read_data_out
+	);
+
+    reg [width-1:0] RAM [0:2**depth_bits-1];
+
+  	// simple dual port template from the Vivado synthesis manual (read first)
+	always @(posedge clk)
+	begin
+		if (write_en)
+			RAM[write_address] <= write_data_in;
+		if (read_en)
+			read_data_out <= RAM[read_address];
+	end
+
+endmodule
@@ -1,6 +1,6 @@
-`timescale 0.001ns / 1ps
+`timescale 1ns / 1ps
 
-/* 
+/*
 ----------------------------------------------------------------------------------
 --	(c) Rajesh C Panicker, NUS
 --  Description : Template for the Matrix Multiply unit for the AXI Stream Coprocessor
@@ -16,185 +16,339 @@
 */
 
 // those outputs which are assigned in an always block of matrix_multiply shoud be changes to reg (such as output reg Done).
-// multiples a 64*7 matrix with a 8*2 matrix, with the first row of the 8*2 matrix as bias values
-// takes the multipled values or a column, adds the bias, and applies sigmoid function to it through LUT
-// writes the output of the sigmoid function into hRES, which is a 64*2 matrix used by the predictor
+// multiples a 64*8 matrix (X with a leading column of 1s) with a 8*2 matrix, the first row of the 8*2 matrix being the bias values
+// takes the sum for each of the two hidden neurons, and applies sigmoid function to it through LUT
+// writes the output of the sigmoid function into hRES, which is a 64*2 matrix used by the predictor (one location per row, {neuron 2, neuron 1})
+//
+// The 16 weights are read from whid_RAM into registers once per batch (LOAD_W, 16 clocks).
+// After that, a row of X is read in one clock (X_RAM returns all 8 values of a row) and goes through a pipeline:
+//   1 : X row read
+//   2 : mults multipliers, mults/2 per neuron, each multiplying one X value with its weight (registered products)
+//   3 : sum of the products added to the accumulator of each neuron
+//   4 : (sum >> 8) clamped to 0..255 as the sigm_RAM / sigm2_RAM address (one copy per neuron), or the sigmoid value (sigm_mode 1, 2)
+//   5 : both sigmoid values written to hRES
+// With mults = 16, one row enters the pipeline every clock. With fewer multipliers, a row takes 16/mults clocks (passes).
+// mults must be 2, 4, 8 or 16.
+// With zero_skip, a pass whose X values are all 0 is skipped, so a row takes 1 + (passes with a value other than 0) clocks.
+// Pass 0 always runs (it has the leading 1), and the row is known from it on, so the other passes are issued from X_row
+// (X_RAM is only read for pass 0). The last pass of a row is only known once the row is (stage 1), so the sum is
+// complete at the pass that has no value other than 0 after it (s1_end), and the last row flag waits for it too.
+// No row is started while hRES_ready is low, so hRES can be a FIFO with room for the rows in the pipeline (5).
+//
+// With stream_rows, the rows come from a FIFO (X_stream_*) instead of X_RAM, each row being taken at its first pass
+// and kept in X_row for the others. There is no fixed number of rows : the row with X_stream_last is the last one.
+// hRES_write_last is set with the hidden values of the last row, in both modes.
+//
+// sigm_mode selects where the sigmoid values come from (the index is clamped to 0..255 in all modes):
+//   0 : sigm_RAM / sigm2_RAM, written with the model (sigm_read_* ports)
+//   1 : SIG_ROM, loaded from sigmoid.mem at synthesis. The sigm_read_* ports are not used.
+//   2 : linear between the entries of SIG_ROM every 2^sigm_pwl_step_bits (the knots), the last segment ending at
+//       the last entry. Only the knots of SIG_ROM are read, so they are all that is left after synthesis.
+// In modes 1 and 2 the value is registered at stage 4 instead of the RAM address, so the latency is the same.
 
 module hid_layer
 	#(	parameter width = 8, 			// width is the number of bits per location
 		parameter X_depth_bits = 9, 	// depth is the number of locations (2^number of address bits)
+		parameter X_row_bits = 3,		// 2^3 = 8 values per row of X, read together
 		parameter whid_depth_bits = 4,
-		parameter sigm_depth_bits = 8, 
-		parameter hRES_depth_bits = 7
-	) 
+		parameter sigm_depth_bits = 8,
+		parameter hRES_depth_bits = 6,
+		parameter mults = 16,			// parallel multipliers
+		parameter zero_skip = 0,		// 1 : skip the passes whose X values are all 0 (mults < 16)
+		parameter sigm_mode = 0,		// 0 : sigm_RAM, 1 : SIG_ROM, 2 : piecewise linear from SIG_ROM
+		parameter sigm_pwl_step_bits = 4	// 2^4 = 16 entries between knots (sigm_mode 2)
+	)
 	(
-		input clk,										
+		input clk,
 		input Start,
 		output reg Done = 0,
-		
+
 		output reg X_read_en = 0,
-		output reg [X_depth_bits-1:0] X_read_address,
-		input [width-1:0] X_read_data_out,
-		
+		output reg [X_depth_bits-X_row_bits-1:0] X_read_address,	// row
+		input [width*2**X_row_bits-1:0] X_read_data_out,			// value k of the row in bits [width*k +: width]
+
+		input stream_rows,											// rows from X_stream_* instead of X_RAM
+		input X_stream_valid,										// FIFO not empty
+		input [width*2**X_row_bits-1:0] X_stream_data,				// same layout as X_read_data_out
+		input X_stream_last,
+		output reg X_stream_read_en = 0,							// takes X_stream_data at the next clock edge
+
 		output reg whid_read_en = 0,
 		output reg [whid_depth_bits-1:0] whid_read_address,
 		input [width-1:0] whid_read_data_out,
-		
+
 		output reg sigm_read_en = 1,
-		output reg [sigm_depth_bits-1:0] sigm_read_address,
+		output reg [sigm_depth_bits-1:0] sigm_read_address,		// neuron 1
 		input [width-1:0] sigm_read_data_out,
-			
-		output reg hRES_write_en = 0, 							
-		output reg [hRES_depth_bits-1:0] hRES_write_address, 	
-		output reg [width-1:0] hRES_write_data_in 
+		output reg [sigm_depth_bits-1:0] sigm2_read_address,		// neuron 2, to the second copy of sigm_RAM
+		input [width-1:0] sigm2_read_data_out,
+
+		input hRES_ready,
+		output reg hRES_write_en = 0,
+		output reg [hRES_depth_bits-1:0] hRES_write_address,
+		output reg [width*2-1:0] hRES_write_data_in,
+		output reg hRES_write_last = 0
 	);
-	
-// implement the logic to read X_RAM, whid_RAM, wout_RAM, and sigm_RAM
-// do the multiplication of weights and addition of bias
-// apply sigmoid function by looking up sigm_RAM, write the results to RES_RAM
 
 //main states
 localparam RESET 		= 3'b100;
 localparam IDLE 		= 3'b010;
-localparam COMPUTE		= 3'b001; // multiply values from X_RAM (64x7) and whid_RAM (7x2 after skipping bias), store in RES_RAM (64x2)
+localparam COMPUTE		= 3'b001; // multiply values from X_RAM (64x8) and the weights (8x2), write the sigmoid of the sums to hRES_RAM (64x2)
+localparam LOAD_W		= 3'b011; // read whid_RAM (8x2) into W
+
+localparam row_values = 2**X_row_bits;					// 8 values per row (1, then 7 features)
+localparam rows = 2**(X_depth_bits-X_row_bits);			// 64 rows
+localparam lanes = mults/2;								// multipliers per neuron
+localparam passes = row_values/lanes;					// clocks per row
+localparam acc_bits = 2*width+X_row_bits;				// sum of 8 products of two width-bit values
+
+reg [7:0]  state = RESET;
+reg [width-1:0] W [0:2*row_values-1];	// weight of value k for neuron n is W[2*k+n], as in whid_RAM
+reg [whid_depth_bits:0] w_cnt = 0;
+
+// issue (row and pass of the next X_RAM read)
+reg [X_depth_bits-X_row_bits:0] issue_row = 0;
+reg [X_row_bits-1:0] issue_pass = 0;
+reg issuing = 0;
+reg [width*row_values-1:0] X_row = 0;	// row taken from X_stream_data (stream_rows), or from X_RAM at pass 0 (zero_skip)
+reg X_row_last = 0;
+// stage 1 : X row read
+reg s1_valid = 0;
+reg s1_last = 0;						// the row is the last one
+reg [X_row_bits-1:0] s1_pass = 0;
+// row of the passes after pass 0, also that of stage 1
+wire [width*row_values-1:0] cur_row = (~stream_rows && s1_valid && s1_pass == 0) ? X_read_data_out : X_row;
+wire [width*row_values-1:0] s1_row = (stream_rows || zero_skip) ? cur_row : X_read_data_out;
+reg [passes-1:0] nz_mask;				// pass p of cur_row has a value other than 0
+wire s1_end = zero_skip ? ((nz_mask >> s1_pass) == 1) : (s1_pass == passes-1);	// last pass of the row
+// issue : with zero_skip, the next pass of the row that has a value other than 0, or the next row if there is none
+reg [X_row_bits-1:0] skip_pass;			// first pass from issue_pass on with a value other than 0
+wire row_done = zero_skip && issue_pass != 0 && (nz_mask >> issue_pass) == 0;	// nothing left in the row
+wire [X_row_bits-1:0] eff_pass = row_done ? 0 : (zero_skip && issue_pass != 0) ? skip_pass : issue_pass;
+wire [X_depth_bits-X_row_bits:0] eff_row = row_done ? issue_row + 1 : issue_row;
+wire row_last = stream_rows ? X_row_last : (issue_row == rows-1);	// the row of issue_pass (not 0)
+wire issue_last = stream_rows ? ((eff_pass == 0) ? X_stream_last : X_row_last) : (eff_row == rows-1);
+wire pass_end = (eff_pass == passes-1) || (zero_skip && eff_pass != 0 && (nz_mask >> eff_pass) == 1);	// known at issue
+wire issue_ok = issuing && ~(row_done && row_last) && hRES_ready && (~stream_rows || eff_pass != 0 || X_stream_valid);
+// stage 2 : products
+reg s2_valid = 0;
+reg s2_last = 0;
+reg s2_end = 0;
+reg [X_row_bits-1:0] s2_pass = 0;
+reg [2*width-1:0] prod_1 [0:lanes-1];
+reg [2*width-1:0] prod_2 [0:lanes-1];
+// stage 3 : sums
+reg s3_valid = 0;
+reg s3_last = 0;
+reg [acc_bits-1:0] acc_1 = 0, acc_2 = 0;
+// stage 4 : sigmoid lookup
+reg s4_valid = 0;
+reg s4_last = 0;
+reg [hRES_depth_bits:0] s4_row = 0;	// rows are written to hRES in order
+reg last_written = 0;
+
+reg [acc_bits-1:0] tree_1, tree_2;		// sum of the products of the current pass
+reg [acc_bits-width-1:0] index_1, index_2;	// sum >> 8
+reg [sigm_depth_bits-1:0] sigm_index_1, sigm_index_2;	// clamped to the last entry
+reg [width-1:0] sigm_value_1, sigm_value_2;	// looked up at stage 4 (sigm_mode 1, 2)
+integer j, p;
 
-//substates
-localparam READ_A		= 4'b0001;	// read from X and whid (skip bias)
-localparam READ_B		= 4'b0010;	// read from whid, incl bias and storage of two column elements simultaneously
-localparam MULTIPLY  	= 4'b0100;	// multiply A and B1, A and B2
-localparam WRITE_hRES 	= 4'b1000; 	// write final result to hRES_RAM (64x2)
+// built-in sigmoid (sigm_mode 1, 2)
+localparam sigm_step = 2**sigm_pwl_step_bits;
+reg [width-1:0] SIG_ROM [0:2**sigm_depth_bits-1];
+initial
+	$readmemh("sigmoid.mem", SIG_ROM);	// add the .mem file to the project or specify the complete path
 
-reg [15:0] total_1 = 0, total_2 = 0;
-reg [7:0]  state = RESET, substate = READ_A;
-reg [7:0]  A = 0, B1 = 0, B2 = 0; //multiplication placeholder registers
-//reg [7:0]  bias1 = 0, bias2 = 0; //bias registers
-reg [1:0]  neuron_cnt = 0, sigm_wr = 0;
+// knot below index, knot above (the last entry for the last segment), then knot + slope*(index - knot)
+function [width-1:0] sigm_lookup;
+	input [sigm_depth_bits-1:0] index;
+	reg [sigm_depth_bits-1:0] knot;
+	reg [sigm_depth_bits:0] next;
+	reg signed [width+sigm_depth_bits+1:0] delta;
+	begin
+		if(sigm_mode == 1)
+			sigm_lookup = SIG_ROM[index];
+		else
+		begin
+			knot = index >> sigm_pwl_step_bits << sigm_pwl_step_bits;
+			next = knot + sigm_step;
+			if(next > 2**sigm_depth_bits-1)
+				next = 2**sigm_depth_bits-1;
+			delta = ($signed({1'b0, SIG_ROM[next]}) - $signed({1'b0, SIG_ROM[knot]})) * $signed({1'b0, index - knot});
+			delta = delta >>> sigm_pwl_step_bits;
+			sigm_lookup = SIG_ROM[knot] + delta;
+		end
+	end
+endfunction
+
+always@(*)
+begin
+	tree_1 = 0;
+	tree_2 = 0;
+	for(j = 0; j < lanes; j = j+1)
+	begin
+		tree_1 = tree_1 + prod_1[j];
+		tree_2 = tree_2 + prod_2[j];
+	end
+	index_1 = acc_1 >> width;
+	index_2 = acc_2 >> width;
+	skip_pass = passes-1;
+	for(p = passes-1; p > 0; p = p-1)
+	begin
+		nz_mask[p] = (cur_row[width*lanes*p +: width*lanes] != 0);
+		if(p >= issue_pass && nz_mask[p])
+			skip_pass = p;
+	end
+	nz_mask[0] = 1;
+	sigm_index_1 = (index_1 > 2**sigm_depth_bits-1) ? 2**sigm_depth_bits-1 : index_1;
+	sigm_index_2 = (index_2 > 2**sigm_depth_bits-1) ? 2**sigm_depth_bits-1 : index_2;
+end
 
 always@(negedge clk)
 begin
 	case (state)
-		
+
 		RESET:
 			begin
+			X_read_en <= 0;
 			X_read_address <= 0;
+			X_stream_read_en <= 0;
+			whid_read_en <= 0;
 			whid_read_address <= 0;
 			sigm_read_address <= 0;
+			sigm2_read_address <= 0;
 			hRES_write_en <= 0;
 			hRES_write_address <= 0;
 			hRES_write_data_in <= 0;
-			neuron_cnt <= 0;
+			hRES_write_last <= 0;
+			Done <= 0;
 			state <= IDLE;
 			end
 		IDLE:
 		begin
 			if(Start)
 			begin
-				X_read_en <= 1;
+				whid_read_en <= 1;
+				whid_read_address <= 0;
+				w_cnt <= 0;
+				state <= LOAD_W;
+			end
+		end
+		LOAD_W:
+		begin
+			// whid_RAM returns location w_cnt now, and location w_cnt+1 is requested
+			W[w_cnt] <= whid_read_data_out;
+			whid_read_address <= whid_read_address + 1;
+			w_cnt <= w_cnt + 1;
+			if(w_cnt == 2*row_values-1)
+			begin
+				whid_read_en <= 0;
+				issuing <= 1;
+				issue_row <= 0;
+				issue_pass <= 0;
+				s1_valid <= 0;
+				s2_valid <= 0;
+				s3_valid <= 0;
+				s4_valid <= 0;
+				s1_last <= 0;
+				s2_last <= 0;
+				s3_last <= 0;
+				s4_last <= 0;
+				s4_row <= 0;
+				last_written <= 0;
 				state <= COMPUTE;
-				substate <= READ_A;
 			end
 		end
 		COMPUTE:
 		begin
-			case (substate)
-			
-				READ_A:
+			// 1 : read the row issue_row of X (the same row again for each pass, or only for pass 0 with zero_skip),
+			//     or take the next row from X_stream_data
+			X_read_en <= issue_ok && ~stream_rows && (eff_pass == 0 || ~zero_skip);
+			X_read_address <= eff_row;
+			X_stream_read_en <= issue_ok && stream_rows && (eff_pass == 0);
+			s1_valid <= issue_ok;
+			s1_pass <= eff_pass;
+			s1_last <= issue_ok && issue_last;
+			if(zero_skip && ~stream_rows && s1_valid && s1_pass == 0)
+				X_row <= X_read_data_out;
+			if(issue_ok)
+			begin
+				if(stream_rows && eff_pass == 0)
 				begin
-					A = X_read_data_out;
-					X_read_address <= X_read_address + 1;
-					X_read_en <= 0;
-					whid_read_en <= 1;
-					substate <= READ_B;
+					X_row <= X_stream_data;
+					X_row_last <= X_stream_last;
 				end
-				
-				READ_B:
+				if(pass_end)
 				begin
-					if(neuron_cnt == 0)
-					begin
-						B1 = whid_read_data_out;
-						whid_read_address <= whid_read_address + 1;
-						neuron_cnt = 1;
-					end
-					else
-					begin
-						B2 = whid_read_data_out;
-						whid_read_address <= whid_read_address + 1;
-						neuron_cnt <= 0;
-						substate <= MULTIPLY;
-						whid_read_en <= 0;
-					end					
+					issue_pass <= 0;
+					issue_row <= eff_row + 1;
+					if(issue_last)
+						issuing <= 0;
 				end
-				
-				MULTIPLY:
+				else
 				begin
-					total_1 = total_1 + (A*B1);
-					total_2 = total_2 + (A*B2);
-					if(whid_read_address == 0)
-					begin
-						substate <= WRITE_hRES;
-					end
-					else
-					begin
-						X_read_en <= 1;
-						substate <= READ_A;
-					end
+					issue_pass <= eff_pass + 1;
+					issue_row <= eff_row;
 				end
-				
-				WRITE_hRES:
+			end
+			else if(issuing && row_done && row_last)
+				issuing <= 0;	// the rest of the last row is 0s
+
+			// 2 : lanes multipliers per neuron on values s1_pass*lanes .. s1_pass*lanes+lanes-1 of the row
+			s2_valid <= s1_valid;
+			s2_pass <= s1_pass;
+			s2_last <= s1_last && s1_end;
+			s2_end <= s1_end;
+			for(j = 0; j < lanes; j = j+1)
+			begin
+				prod_1[j] <= s1_row[width*(s1_pass*lanes+j) +: width] * W[2*(s1_pass*lanes+j)];
+				prod_2[j] <= s1_row[width*(s1_pass*lanes+j) +: width] * W[2*(s1_pass*lanes+j)+1];
+			end
+
+			// 3 : accumulate; the bias comes in through the leading 1 of the row. The sum is complete after the last pass.
+			s3_valid <= s2_valid && s2_end;
+			s3_last <= s2_last;
+			if(s2_valid)
+			begin
+				acc_1 <= ((s2_pass == 0) ? 0 : acc_1) + tree_1;
+				acc_2 <= ((s2_pass == 0) ? 0 : acc_2) + tree_2;
+			end
+
+			// 4 : sigmoid lookup, index clamped to the last entry. The sums are unsigned, so the index is never below 0.
+			s4_valid <= s3_valid;
+			s4_last <= s3_last;
+			if(s3_valid)
+			begin
+				sigm_read_address <= sigm_index_1;
+				sigm2_read_address <= sigm_index_2;
+				if(sigm_mode != 0)
 				begin
-					if(neuron_cnt == 0)
-					begin
-						if(sigm_wr == 0)
-						begin
-							hRES_write_en <= 0;
-							total_1 = total_1>>8;
-							sigm_read_address <= total_1;
-							sigm_wr <= 1;
-							if(hRES_write_address != 0)
-								hRES_write_address <= hRES_write_address + 1;
-						end
-						else
-						begin
-							hRES_write_en <= 1;
-							hRES_write_data_in <= sigm_read_data_out;
-							sigm_wr <= 0;
-							neuron_cnt <= 1;
-						end
-					end
-					else
-					begin
-						if(sigm_wr == 0)
-						begin
-							hRES_write_en <= 0;
-							total_2 = total_2>>8;
-							sigm_read_address <= total_2;
-							sigm_wr <= 1;
-							hRES_write_address <= hRES_write_address + 1;
-						end
-						else
-						begin
-							hRES_write_en <= 1;
-							hRES_write_data_in <= sigm_read_data_out;
-							sigm_wr <= 0;
-							neuron_cnt <= 0;
-							total_1 <= 0;
-							total_2 <= 0;
-							if(X_read_address == 0)
-							begin
-								Done = 1;
-								state <= RESET;
-								substate <= READ_A;
-							end
-							else
-							begin
-								X_read_en <= 1;
-								substate <= READ_A;
-							end
-						end
-					end
+					sigm_value_1 <= sigm_lookup(sigm_index_1);
+					sigm_value_2 <= sigm_lookup(sigm_index_2);
 				end
-			endcase
+			end
+
+			// 5 : write both hidden values of the row to hRES
+			hRES_write_en <= s4_valid;
+			if(s4_valid)
+			begin
+				hRES_write_address <= s4_row;
+				hRES_write_data_in <= (sigm_mode == 0) ? {sigm2_read_data_out, sigm_read_data_out} : {sigm_value_2, sigm_value_1};
+				hRES_write_last <= s4_last;
+				s4_row <= s4_row + 1;
+				if(s4_last)
+					last_written <= 1;
+			end
+
+			// the write of the last row happens at the clock edge after it was issued
+			if(last_written)
+			begin
+				hRES_write_en <= 0;
+				hRES_write_last <= 0;
+				Done <= 1;
+				state <= RESET;
+			end
 		end
 	endcase
 end
-endmodule
\ No newline at end of file
+endmodule
@@ -0,0 +1,424 @@
+/*
+ * perf_harness.cpp: cycle-accurate performance harness of simple_ML_IP_v1_0, with Verilator
+ *
+ * Build and run from HDL_implementation (Verilator 4.210 or later; -G sets the parameters of the coprocessor) :
+ *   verilator --cc --exe --build -O3 -Wno-fatal --top-module perf_harness [-GNUM_LANES=2 -GSIGM_MODE=1 ...]
+ *       perf_harness.v simple_ML_IP.v hid_layer_v1_0.v predictor.v memory_RAM.v B_RAM.v banked_RAM.v dual_port_RAM.v
+ *       stream_FIFO.v perf_harness.cpp
+ *   obj_dir/Vperf_harness [-b batches] [-r rows] [-p] [-l] [-v P[:L]] [-t P[:L]] [-s seed] [-x] [-m test_input.mem]
+ *       [-j report.json]
+ *
+ * Streams batches back to back through the coprocessor : the first with CMD_LOAD_MODEL (the model of test_input.mem),
+ * the others CMD_INFER_ONLY, all with the same X rows (the 64 rows of test_input.mem over and over, or random rows
+ * with -x) and the same flags :
+ *   -b : batches (PERF_BATCHES)
+ *   -r : 0 : batches of 64 rows (X_RAM); else CMD_STREAM_ROWS batches of that many rows
+ *   -p : CMD_PACKED, -l : CMD_LABELS (threshold DATA_THRESHOLD)
+ *   -v : S_AXIS_TVALID stalls : at each clock the harness has a word to send, a gap of L clocks (1 by default) with
+ *        TVALID low starts with probability 100-P %. Once high, TVALID stays high until the word is taken (AXI).
+ *   -t : M_AXIS_TREADY stalls, the same way
+ * Every result is checked against the model computed here, and TLAST against the last word of each batch (with
+ * SIGM_MODE 2 the sigmoid is approximated, so the mismatches are counted but do not fail the run).
+ *
+ * Each clock is counted in the phases it is in (they overlap, as the banks let a batch be read while the last one is
+ * computed and the one before is sent) : read_inputs (the input state machine in Read_Inputs), compute (hid_layer or
+ * predictor started), hid_layer, predictor, predictor_only (the predictor alone : the end of a batch), write_outputs
+ * (results waiting or being sent), idle (none of these). The input stalls are split into the clocks the IP waited for
+ * TVALID and the clocks TVALID waited for TREADY; the output stalls are the clocks M_AXIS_TVALID waited for TREADY.
+ * "total" is the whole run, "steady" the clocks from the end of batch 0 (the model load) to the last input word (no
+ * fill, no drain) : its beats per clock are the sustained rates. Latency : from the first word of a batch taken to
+ * its last result taken.
+ * The report is printed, and written as JSON with -j, to follow the throughput of the RTL from build to build.
+ *
+ * Measured (logs/perf_harness*.json and .log, 1000 batches, seed 1, all passed with 0 mismatches) :
+ *   -v 75 -t 75                     : 10.72 clocks/row, input 0.748 beats/clock (24.8% waiting for TVALID), compute
+ *                                     13.0% of the clocks, latency 810 / 862 / 1231 clocks (min / mean / max)
+ *   -v 75 -t 75, NUM_LANES = 4      : 10.72 clocks/row, compute 6.0%, latency 763 / 814 / 1180 clocks
+ *   -r 256 -p -x -v 90:4 -t 90:4    : 2.95 clocks/row, input 0.679 beats/clock, compute 99.6%, latency 649 / 758 / 1151
+ * With 64-row batches the IP waits for its input; with packed CMD_STREAM_ROWS batches the hidden layer is the bound.
+ * These runs were not made with Verilator : this file was built with g++ against a stand-in Vperf_harness whose eval()
+ * runs the same RTL files in an event-driven Verilog interpreter, as the tb logs. Rebuild with Verilator to confirm.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <deque>
+#include <random>
+#include <vector>
+#include "verilated.h"
+#include "Vperf_harness.h"
+
+
+/***************** Macros *********************/
+#define PERF_BATCHES 1000	// batches by default
+#define PERF_TIMEOUT 100000	// clocks without a word taken in or out before the run is stopped
+#define PERF_SHOW 8	// mismatches printed
+#define RESET_CLOCKS 4
+#define FEATURES 7
+#define HIDDEN 2
+#define RTL_ROW 8	// values of an X row : 1 (for the bias), then the features
+#define FIXED_ROWS 64	// rows of a batch without CMD_STREAM_ROWS (NUMBER_OF_OUTPUT_VALUES)
+#define FILE_ROWS 64	// rows of test_input.mem
+#define FILE_WORDS 723	// test_input.mem : X (64x7), whid (8x2), wout (3x1), sigm (256)
+#define WHID_OFFSET 448
+#define WOUT_OFFSET 464
+#define SIGM_OFFSET 467
+#define SIG_SIZE 256
+#define PACK_LANES 4	// 8-bit values per word with CMD_PACKED
+#define LABEL_LANES 32	// labels per word with CMD_LABELS
+#define DATA_THRESHOLD 39	// labels.mem is (result > 39) for the rows of test_input.mem
+
+#define CMD_INFER_ONLY 0
+#define CMD_LOAD_MODEL 1
+#define CMD_STREAM_ROWS 2
+#define CMD_PACKED 4
+#define CMD_LABELS 8
+#define LABEL_THRESHOLD_SHIFT 16
+
+// Stalls of TVALID or TREADY (-v, -t)
+struct Gaps{
+	int percent;	// probability (%) of a clock with the signal high, outside of the gaps
+	int length;		// clocks of a gap
+	int left;		// clocks left in the current gap
+	bool high(std::mt19937 &rng){
+		if(left > 0){
+			left--;
+			return false;
+		}
+		if((int)(rng() % 100) < percent)
+			return true;
+		left = length-1;
+		return false;
+	}
+};
+
+// Clocks of each phase and handshakes, over a window of the run
+struct Counters{
+	uint64_t cycles, idle, read_inputs, compute, hid_layer, predictor, predictor_only, write_outputs;
+	uint64_t in_beats, in_no_valid, in_no_ready, out_beats, out_no_ready, rows;
+};
+
+// A batch being sent : its words, and the results expected for it (one per row, or labels)
+struct Batch{
+	std::vector<uint32_t> words;
+	std::vector<int> results;
+	uint64_t start;		// clock its first word was taken
+};
+
+static uint8_t file_memory[FILE_WORDS];
+static int B[(FEATURES+1)*HIDDEN], C[HIDDEN+1], SIG[SIG_SIZE];
+static double main_time = 0;
+
+double sc_time_stamp(){
+	return main_time;
+}
+
+
+/************************** Function Definitions *****************************/
+
+// test_input.mem : hex values separated by blanks
+static int read_mem(const char *path){
+	FILE *in_file = fopen(path, "r");
+	unsigned value;
+	int n = 0;
+	if(in_file == NULL)
+		return -1;
+	while(n < FILE_WORDS && fscanf(in_file, "%x", &value) == 1)
+		file_memory[n++] = value;
+	fclose(in_file);
+	if(n != FILE_WORDS)
+		return -1;
+	for(n=0;n<(FEATURES+1)*HIDDEN;n++)
+		B[n] = file_memory[WHID_OFFSET+n];
+	for(n=0;n<HIDDEN+1;n++)
+		C[n] = file_memory[WOUT_OFFSET+n];
+	for(n=0;n<SIG_SIZE;n++)
+		SIG[n] = file_memory[SIGM_OFFSET+n];
+	return 0;
+}
+
+// Result of a row (x[0] = 1 for the bias), saturated to 8 bits as the coprocessor sends it
+static int row_result(const uint8_t x[RTL_ROW]){
+	int sum = C[0], h, f, acc;
+	for(h=0;h<HIDDEN;h++){
+		acc = 0;
+		for(f=0;f<RTL_ROW;f++)
+			acc += x[f]*B[f*HIDDEN+h];
+		acc /= 256;
+		sum += SIG[(acc > SIG_SIZE-1) ? SIG_SIZE-1 : (acc < 0) ? 0 : acc]*C[h+1];
+	}
+	sum /= 256;
+	return (sum > 255) ? 255 : sum;
+}
+
+// Batch number index : the header, the model (batch 0), then rows rows
+static void make_batch(Batch *batch, long index, int rows, int flags, int sigm_mode, bool random_rows,
+		std::mt19937 &rng, long *next_row){
+	uint8_t x[RTL_ROW];
+	uint32_t word = 0;
+	int r, f, n = 0;
+
+	batch->words.clear();
+	batch->results.clear();
+	batch->words.push_back((index == 0 ? CMD_LOAD_MODEL : CMD_INFER_ONLY) | flags);
+	if(index == 0)
+		for(f=WHID_OFFSET;f<FILE_WORDS-(sigm_mode == 0 ? 0 : SIG_SIZE);f++)
+			batch->words.push_back(file_memory[f]);
+	for(r=0;r<rows;r++){
+		x[0] = 1;
+		for(f=0;f<FEATURES;f++)
+			x[f+1] = random_rows ? rng() & 0xFF : file_memory[(*next_row % FILE_ROWS)*FEATURES+f];
+		(*next_row)++;
+		batch->results.push_back((flags & CMD_LABELS) ? (row_result(x) > DATA_THRESHOLD) : row_result(x));
+		for(f=0;f<RTL_ROW;f++){
+			if(!(flags & CMD_PACKED)){
+				batch->words.push_back(x[f]);
+				continue;
+			}
+			word |= (uint32_t)x[f] << (8*n);
+			if(++n == PACK_LANES){
+				batch->words.push_back(word);
+				word = 0;
+				n = 0;
+			}
+		}
+	}
+}
+
+static void tick(Vperf_harness *top){
+	top->ACLK = 1;
+	top->eval();
+	main_time += 5;
+	top->ACLK = 0;
+	top->eval();
+	main_time += 5;
+}
+
+static double ratio(uint64_t a, uint64_t b){
+	return b ? (double)a / b : 0;
+}
+
+static void count(Counters *c, Vperf_harness *top, bool in_valid){
+	bool compute = top->hid_busy || top->pred_busy;
+	c->cycles++;
+	c->read_inputs += top->read_inputs;
+	c->compute += compute;
+	c->hid_layer += top->hid_busy;
+	c->predictor += top->pred_busy;
+	c->predictor_only += top->pred_busy && !top->hid_busy;
+	c->write_outputs += top->out_busy;
+	c->idle += !top->read_inputs && !compute && !top->out_busy;
+	c->in_beats += in_valid && top->S_AXIS_TREADY;
+	c->in_no_valid += !in_valid && top->S_AXIS_TREADY;
+	c->in_no_ready += in_valid && !top->S_AXIS_TREADY;
+	c->out_beats += top->M_AXIS_TVALID && top->M_AXIS_TREADY;
+	c->out_no_ready += top->M_AXIS_TVALID && !top->M_AXIS_TREADY;
+}
+
+static void print_counters(const char *name, const Counters *c){
+	printf("%s : %llu clocks, %llu rows, %.2f clocks/row\r\n", name, (unsigned long long)c->cycles,
+			(unsigned long long)c->rows, ratio(c->cycles, c->rows));
+	printf("  idle %5.1f%%  read_inputs %5.1f%%  compute %5.1f%% (hid_layer %5.1f%%, predictor %5.1f%%, predictor only %5.1f%%)"
+			"  write_outputs %5.1f%%\r\n", 100*ratio(c->idle, c->cycles), 100*ratio(c->read_inputs, c->cycles),
+			100*ratio(c->compute, c->cycles), 100*ratio(c->hid_layer, c->cycles), 100*ratio(c->predictor, c->cycles),
+			100*ratio(c->predictor_only, c->cycles), 100*ratio(c->write_outputs, c->cycles));
+	printf("  input  %.3f beats/clock, stalled %5.1f%% waiting for TVALID, %5.1f%% waiting for TREADY\r\n",
+			ratio(c->in_beats, c->cycles), 100*ratio(c->in_no_valid, c->cycles), 100*ratio(c->in_no_ready, c->cycles));
+	printf("  output %.3f beats/clock, stalled %5.1f%% waiting for TREADY\r\n",
+			ratio(c->out_beats, c->cycles), 100*ratio(c->out_no_ready, c->cycles));
+}
+
+static void json_counters(FILE *out_file, const char *name, const Counters *c){
+	fprintf(out_file, "  \"%s\": {\"cycles\": %llu, \"rows\": %llu, \"cycles_per_row\": %.4f, \"idle\": %llu, "
+			"\"read_inputs\": %llu, \"compute\": %llu, \"hid_layer\": %llu, \"predictor\": %llu, \"predictor_only\": %llu, "
+			"\"write_outputs\": %llu, \"in_beats\": %llu, \"in_beats_per_cycle\": %.4f, \"in_stall_no_valid\": %llu, "
+			"\"in_stall_no_ready\": %llu, \"out_beats\": %llu, \"out_beats_per_cycle\": %.4f, \"out_stall_no_ready\": %llu},\n",
+			name, (unsigned long long)c->cycles, (unsigned long long)c->rows, ratio(c->cycles, c->rows),
+			(unsigned long long)c->idle, (unsigned long long)c->read_inputs, (unsigned long long)c->compute,
+			(unsigned long long)c->hid_layer, (unsigned long long)c->predictor, (unsigned long long)c->predictor_only,
+			(unsigned long long)c->write_outputs, (unsigned long long)c->in_beats, ratio(c->in_beats, c->cycles),
+			(unsigned long long)c->in_no_valid, (unsigned long long)c->in_no_ready, (unsigned long long)c->out_beats,
+			ratio(c->out_beats, c->cycles), (unsigned long long)c->out_no_ready);
+}
+
+// "P" or "P:L"
+static Gaps parse_gaps(const char *text){
+	Gaps gaps = {100, 1, 0};
+	sscanf(text, "%d:%d", &gaps.percent, &gaps.length);
+	if(gaps.percent < 1)
+		gaps.percent = 1;
+	if(gaps.length < 1)
+		gaps.length = 1;
+	return gaps;
+}
+
+int main(int argc, char *argv[])
+{
+	long batches = PERF_BATCHES, sent = 0, received = 0, next_row = 0, mismatches = 0;
+	int rows = 0, flags = 0, opt;
+	unsigned seed = 1;
+	bool random_rows = false, in_valid = false, timeout = false;
+	const char *mem_path = "test_input.mem", *json_path = NULL;
+	Gaps valid_gaps = {100, 1, 0}, ready_gaps = {100, 1, 0};
+	Counters total, steady;
+	std::deque<Batch> in_flight;	// batches sent (the last one maybe in part) whose results are not all taken
+	size_t in_word = 0, out_result = 0;
+	uint64_t idle_clocks = 0, latency_sum = 0, latency_min = ~0ULL, latency_max = 0;
+	int lanes, k;
+
+	while((opt = getopt(argc, argv, "b:r:plv:t:s:xm:j:")) != -1)
+		switch(opt){
+		case 'b': batches = atol(optarg); break;
+		case 'r': rows = atoi(optarg); break;
+		case 'p': flags |= CMD_PACKED; break;
+		case 'l': flags |= CMD_LABELS | (DATA_THRESHOLD << LABEL_THRESHOLD_SHIFT); break;
+		case 'v': valid_gaps = parse_gaps(optarg); break;
+		case 't': ready_gaps = parse_gaps(optarg); break;
+		case 's': seed = atoi(optarg); break;
+		case 'x': random_rows = true; break;
+		case 'm': mem_path = optarg; break;
+		case 'j': json_path = optarg; break;
+		default:
+			printf("usage : %s [-b batches] [-r rows] [-p] [-l] [-v P[:L]] [-t P[:L]] [-s seed] [-x] [-m test_input.mem]"
+					" [-j report.json]\r\n", argv[0]);
+			return 1;
+		}
+	if(batches < 1 || rows < 0){
+		printf("batches must be 1 or more, rows 0 or more\r\n");
+		return 1;
+	}
+	if(rows > 0)
+		flags |= CMD_STREAM_ROWS;
+	else
+		rows = FIXED_ROWS;
+	if(read_mem(mem_path) != 0){
+		printf("%s : can not read the %d values\r\n", mem_path, FILE_WORDS);
+		return 1;
+	}
+	lanes = (flags & CMD_LABELS) ? LABEL_LANES : (flags & CMD_PACKED) ? PACK_LANES : 1;
+
+	std::mt19937 rng(seed);
+	VerilatedContext *context = new VerilatedContext;
+	Vperf_harness *top = new Vperf_harness(context);
+	memset(&total, 0, sizeof(total));
+	memset(&steady, 0, sizeof(steady));
+
+	top->ACLK = 0;
+	top->ARESETN = 0;
+	top->S_AXIS_TVALID = 0;
+	top->S_AXIS_TLAST = 0;
+	top->S_AXIS_TDATA = 0;
+	top->M_AXIS_TREADY = 0;
+	top->eval();
+	for(k=0;k<RESET_CLOCKS;k++)
+		tick(top);
+	top->ARESETN = 1;
+	top->eval();
+	const int sigm_mode = top->sigm_mode;
+
+	in_flight.emplace_back();
+	make_batch(&in_flight.back(), 0, rows, flags, sigm_mode, random_rows, rng, &next_row);
+	while(received < batches){
+		// the inputs of this clock, then the handshakes as the rising edge will see them
+		if(!in_valid && sent < batches)
+			in_valid = valid_gaps.high(rng);
+		top->S_AXIS_TVALID = in_valid;
+		top->S_AXIS_TDATA = in_valid ? in_flight.back().words[in_word] : 0;
+		top->S_AXIS_TLAST = in_valid && in_word == in_flight.back().words.size()-1;
+		top->M_AXIS_TREADY = ready_gaps.high(rng);
+		top->eval();
+		const bool in_fire = in_valid && top->S_AXIS_TREADY;
+		const bool out_fire = top->M_AXIS_TVALID && top->M_AXIS_TREADY;
+		count(&total, top, in_valid);
+		if(sent >= 1 && sent < batches)
+			count(&steady, top, in_valid);
+
+		if(out_fire){
+			Batch &out_batch = in_flight.front();
+			const uint32_t data = top->M_AXIS_TDATA;
+			for(k=0;k<lanes && out_result < out_batch.results.size();k++, out_result++){
+				int got = (lanes == LABEL_LANES) ? (data >> k) & 1 : (lanes == PACK_LANES) ? (data >> (8*k)) & 0xFF : data;
+				if(got != out_batch.results[out_result] && mismatches++ < PERF_SHOW)
+					printf("batch %ld row %zu : %d instead of %d\r\n", received, out_result, got, out_batch.results[out_result]);
+			}
+			if((bool)top->M_AXIS_TLAST != (out_result == out_batch.results.size()) && mismatches++ < PERF_SHOW)
+				printf("batch %ld : TLAST %s after %zu rows\r\n", received, top->M_AXIS_TLAST ? "set" : "not set", out_result);
+			if(out_result == out_batch.results.size()){
+				const uint64_t latency = total.cycles - out_batch.start;
+				latency_sum += latency;
+				latency_min = (latency < latency_min) ? latency : latency_min;
+				latency_max = (latency > latency_max) ? latency : latency_max;
+				in_flight.pop_front();
+				out_result = 0;
+				received++;
+			}
+		}
+		tick(top);
+
+		if(in_fire){
+			Batch &batch = in_flight.back();
+			if(in_word == 0)
+				batch.start = total.cycles-1;
+			in_valid = false;
+			if(++in_word == batch.words.size()){
+				total.rows += rows;
+				if(sent >= 1)
+					steady.rows += rows;
+				in_word = 0;
+				if(++sent < batches){
+					in_flight.emplace_back();
+					make_batch(&in_flight.back(), sent, rows, flags, sigm_mode, random_rows, rng, &next_row);
+				}
+			}
+		}
+		idle_clocks = (in_fire || out_fire) ? 0 : idle_clocks+1;
+		if(idle_clocks > PERF_TIMEOUT){
+			printf("No word taken for %d clocks after %ld batches sent, %ld received : stopped\r\n", PERF_TIMEOUT, sent, received);
+			timeout = true;
+			break;
+		}
+	}
+	top->final();
+
+	const bool passed = !timeout && (mismatches == 0 || sigm_mode == 2);
+	printf("simple_ML_IP_v1_0 NUM_LANES = %d, SIGM_MODE = %d, HID_MULTS = %d, HID_ZERO_SKIP = %d\r\n",
+			top->num_lanes, top->sigm_mode, top->hid_mults, top->hid_zero_skip);
+	printf("%ld batches of %d rows%s%s%s, TVALID %d%% (gaps of %d), TREADY %d%% (gaps of %d), seed %u\r\n",
+			batches, rows, (flags & CMD_STREAM_ROWS) ? " (CMD_STREAM_ROWS)" : "", (flags & CMD_PACKED) ? " packed" : "",
+			(flags & CMD_LABELS) ? " labels" : "", valid_gaps.percent, valid_gaps.length, ready_gaps.percent,
+			ready_gaps.length, seed);
+	print_counters("total", &total);
+	print_counters("steady", &steady);
+	printf("latency : %llu min, %.1f mean, %llu max clocks\r\n", received ? (unsigned long long)latency_min : 0ULL,
+			ratio(latency_sum, received), (unsigned long long)latency_max);
+	printf("%ld mismatches : %s\r\n", mismatches, passed ? "passed" : "FAILED");
+
+	if(json_path != NULL){
+		FILE *out_file = fopen(json_path, "w");
+		if(out_file == NULL){
+			printf("%s : can not create the file\r\n", json_path);
+			return 1;
+		}
+		fprintf(out_file, "{\n  \"config\": {\"num_lanes\": %d, \"sigm_mode\": %d, \"hid_mults\": %d, \"hid_zero_skip\": %d, "
+				"\"batches\": %ld, \"rows_per_batch\": %d, \"stream_rows\": %s, \"packed\": %s, \"labels\": %s, "
+				"\"random_rows\": %s, \"valid_percent\": %d, \"valid_gap\": %d, \"ready_percent\": %d, \"ready_gap\": %d, "
+				"\"seed\": %u},\n", top->num_lanes, top->sigm_mode, top->hid_mults, top->hid_zero_skip, batches, rows,
+				(flags & CMD_STREAM_ROWS) ? "true" : "false", (flags & CMD_PACKED) ? "true" : "false",
+				(flags & CMD_LABELS) ? "true" : "false", random_rows ? "true" : "false", valid_gaps.percent,
+				valid_gaps.length, ready_gaps.percent, ready_gaps.length, seed);
+		json_counters(out_file, "total", &total);
+		json_counters(out_file, "steady", &steady);
+		fprintf(out_file, "  \"latency\": {\"min\": %llu, \"mean\": %.2f, \"max\": %llu},\n",
+				received ? (unsigned long long)latency_min : 0ULL, ratio(latency_sum, received),
+				(unsigned long long)latency_max);
+		fprintf(out_file, "  \"batches_received\": %ld,\n  \"mismatches\": %ld,\n  \"timeout\": %s,\n  \"passed\": %s\n}\n",
+				received, mismatches, timeout ? "true" : "false", passed ? "true" : "false");
+		fclose(out_file);
+	}
+	delete top;
+	delete context;
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,59 @@
+`timescale 1ns / 1ps
+// Top module of the Verilator harness perf_harness.cpp : simple_ML_IP_v1_0 with its ports, and the internal signals the
+// harness classifies each clock by (taken through hierarchical references, so the harness does not depend on how
+// Verilator names the internal signals).
+
+module perf_harness
+	#(
+		parameter NUM_LANES = 1,
+		parameter SIGM_MODE = 0,
+		parameter HID_MULTS = 16,
+		parameter HID_ZERO_SKIP = 0
+	)
+	(
+		input			ACLK,
+		input			ARESETN,
+		output			S_AXIS_TREADY,
+		input  [31:0]	S_AXIS_TDATA,
+		input			S_AXIS_TLAST,
+		input			S_AXIS_TVALID,
+		output			M_AXIS_TVALID,
+		output [31:0]	M_AXIS_TDATA,
+		output			M_AXIS_TLAST,
+		input			M_AXIS_TREADY,
+		// state of the clock
+		output			read_inputs,	// the input state machine is in Read_Inputs (else Idle)
+		output			hid_busy,		// hid_layer computes (Start_whid)
+		output			pred_busy,		// predictor computes (Start_wout)
+		output			out_busy,		// results waiting to be sent or being sent (RES bank full, output queue, stream batch)
+		// parameters, for the report
+		output [7:0]	num_lanes,
+		output [7:0]	sigm_mode,
+		output [7:0]	hid_mults,
+		output [7:0]	hid_zero_skip
+	);
+
+	simple_ML_IP_v1_0 #(.NUM_LANES(NUM_LANES), .SIGM_MODE(SIGM_MODE), .HID_MULTS(HID_MULTS), .HID_ZERO_SKIP(HID_ZERO_SKIP)) U1 (
+				.ACLK(ACLK),
+				.ARESETN(ARESETN),
+				.S_AXIS_TREADY(S_AXIS_TREADY),
+				.S_AXIS_TDATA(S_AXIS_TDATA),
+				.S_AXIS_TLAST(S_AXIS_TLAST),
+				.S_AXIS_TVALID(S_AXIS_TVALID),
+				.M_AXIS_TVALID(M_AXIS_TVALID),
+				.M_AXIS_TDATA(M_AXIS_TDATA),
+				.M_AXIS_TLAST(M_AXIS_TLAST),
+				.M_AXIS_TREADY(M_AXIS_TREADY)
+	);
+
+	assign read_inputs = (U1.state == 4'b0100);	// Read_Inputs
+	assign hid_busy = U1.Start_whid;
+	assign pred_busy = U1.Start_wout;
+	assign out_busy = (U1.RES_full != 0) || (U1.out_count != 0) || U1.out_stream;
+
+	assign num_lanes = NUM_LANES;
+	assign sigm_mode = SIGM_MODE;
+	assign hid_mults = HID_MULTS;
+	assign hid_zero_skip = HID_ZERO_SKIP;
+
+endmodule
@@ -1,4 +1,4 @@
-`timescale 0.001ns / 1ps
+`timescale 1ns / 1ps
 
 /* 
 ----------------------------------------------------------------------------------
@@ -16,15 +16,27 @@
 */
 
 // those outputs which are assigned in an always block of matrix_multiply shoud be changes to reg (such as output reg Done).
-// reads the 64*2 matrix from hRES, and the 3*1 matrix from wout_RAM
+// takes the 64*2 hidden values row by row, and the 3*1 matrix from wout_RAM
 // multiplies them, taking the first row of wout_RAM as bias
-// adds the bias to the multiplied values of each column
+// adds the bias to the multiplied values of each row, and writes (sum >> 8) to RES_RAM
+//
+// The 3 weights are read from wout_RAM into registers once per batch (LOAD_W).
+// The rows come from hRES_RAM (stream_in = 0, one read per row) or straight from hid_layer through a FIFO
+// (stream_in = 1 : hRES_stream_*, a row is taken whenever the FIFO is not empty).
+// One row per clock either way : row in -> products -> RES write.
+// With stream_rows (stream_in = 1 only), the number of rows is not fixed : the row with hRES_stream_last is the last one.
+// RES_write_last is set with the result of the last row, so that the results can be written to a FIFO instead of RES_RAM.
+// With labels, the label (sum >> 8) > threshold is written instead of the result, in bit 0. The threshold is signed and
+// the sum is not saturated, as in the HLS kernels.
+// There is a single output neuron, so the label is always a threshold (an argmax would need more output neurons).
 
 module predictor
 	#(	parameter width = 8, 			// width is the number of bits per location
 		parameter wout_depth_bits = 2,	// depth is the number of locations (2^number of address bits)
-		parameter hRES_depth_bits = 7,
-		parameter RES_depth_bits = 6
+		parameter hRES_depth_bits = 6,
+		parameter RES_depth_bits = 6,
+		parameter stream_in = 0,		// 1 : rows from hRES_stream_*, 0 : rows from hRES_RAM
+		parameter threshold_bits = 16	// signed label threshold
 	) 
 	(
 		input clk,										
@@ -37,33 +49,48 @@ module predictor
 		
 		output reg hRES_read_en = 0,
 		output reg [hRES_depth_bits-1:0] hRES_read_address,
-		input [width-1:0] hRES_read_data_out,
+		input [width*2-1:0] hRES_read_data_out,			// {neuron 2, neuron 1}
+
+		input hRES_stream_valid,						// FIFO not empty
+		input [width*2-1:0] hRES_stream_data,			// {neuron 2, neuron 1}
+		input hRES_stream_last,
+		input stream_rows,								// rows until hRES_stream_last instead of 2^RES_depth_bits rows
+		input labels,									// write the label of each row instead of its result
+		input signed [threshold_bits-1:0] threshold,	// label 1 if the result is above threshold
+		output reg hRES_stream_read_en = 0,				// takes hRES_stream_data at the next clock edge
 			
-		output reg RES_write_en, 							
+		output reg RES_write_en = 0, 							
 		output reg [RES_depth_bits-1:0] RES_write_address, 	
-		output reg [width-1:0] RES_write_data_in 
+		output reg [width-1:0] RES_write_data_in,
+		output reg RES_write_last = 0
 	);
-	
-// implement the logic to read X_RAM, whid_RAM, wout_RAM, and sigm_RAM
-// do the multiplication of weights and addition of bias
-// apply sigmoid function by looking up sigm_RAM, write the results to RES_RAM
 
 //main states
 localparam RESET 		= 3'b100;
 localparam IDLE 		= 3'b010;
-localparam COMPUTE		= 3'b001; // multiply values stored in hRES_RAM (64x2) and values from wout_RAM (2x1 after skipping bias)
+localparam COMPUTE		= 3'b001; // multiply the hidden values (64x2) and the weights (2x1 after skipping bias)
+localparam LOAD_W		= 3'b011; // read wout_RAM (3x1) into bias1, B1, B2
+
+localparam rows = 2**RES_depth_bits;
 
-//substates
-localparam READ_hRES	= 4'b0001;	// read from hRES
-localparam READ_wout	= 4'b0010;	// read from wout, including bias (first element)
-localparam MULTIPLY  	= 4'b0100;	// multiply A and B
-localparam WRITE_RES 	= 4'b1000; 	// write final result to RES_RAM (64x2, 64x1)
+reg [7:0]  state = RESET;
+reg [7:0]  bias1 = 0, B1 = 0, B2 = 0;	// weights
+reg [wout_depth_bits-1:0] w_cnt = 0;
 
-reg [15:0] total = 0;
-reg [7:0]  state = RESET, substate = READ_wout;
-reg [7:0]  A1 = 0, A2 = 0, B1 = 0, B2 = 0;	//multiplication placeholder registers
-reg [7:0]  bias1 = 0;	//bias registers
-reg [1:0]  neuron_cnt = 0; //flags
+reg [RES_depth_bits:0] issue_row = 0;	// hRES_RAM reads issued (stream_in = 0)
+reg issuing = 0;
+// stage 1 : row in
+reg s1_valid = 0;
+reg s1_last = 0;
+reg [width*2-1:0] s1_row = 0;
+// stage 2 : products
+reg s2_valid = 0;
+reg s2_last = 0;
+reg [2*width-1:0] prod_1 = 0, prod_2 = 0;
+reg [RES_depth_bits:0] RES_cnt = 0;		// rows written to RES_RAM
+reg last_written = 0;
+wire row_last = stream_rows ? s2_last : (RES_cnt == rows-1);
+wire [2*width:0] result = ({1'b0, prod_1} + prod_2 + bias1) >> 8;	// not truncated, for the label
 
 always@(negedge clk)
 begin
@@ -71,11 +98,15 @@ begin
 		
 		RESET:
 			begin
+			hRES_read_en <= 0;
 			hRES_read_address <= 0;
+			hRES_stream_read_en <= 0;
+			wout_read_en <= 0;
 			wout_read_address <= 0;
 			RES_write_en <= 0;
 			RES_write_address <= 0;
 			RES_write_data_in <= 0;
+			RES_write_last <= 0;
 			Done <= 0;
 			state <= IDLE;
 			end
@@ -84,74 +115,85 @@ begin
 			if(Start)
 			begin
 				wout_read_en <= 1;
+				wout_read_address <= 0;
+				w_cnt <= 0;
+				state <= LOAD_W;
+			end
+		end
+		LOAD_W:
+		begin
+			// wout_RAM returns location w_cnt now, and location w_cnt+1 is requested
+			wout_read_address <= wout_read_address + 1;
+			w_cnt <= w_cnt + 1;
+			if(w_cnt == 0)
+				bias1 <= wout_read_data_out;
+			else if(w_cnt == 1)
+				B1 <= wout_read_data_out;
+			else
+			begin
+				B2 <= wout_read_data_out;
+				wout_read_en <= 0;
+				issuing <= 1;
+				issue_row <= 0;
+				s1_valid <= 0;
+				s2_valid <= 0;
+				RES_cnt <= 0;
+				last_written <= 0;
 				state <= COMPUTE;
-				substate <= READ_wout;
 			end
 		end
 		COMPUTE:
 		begin
-			case (substate)
-			
-				READ_wout:
-				begin
-					wout_read_address <= wout_read_address + 1;
-					if(wout_read_address == 0)
-						bias1 = wout_read_data_out;
-					else if(wout_read_address == 1)
-						B1 = wout_read_data_out;
-					else if(wout_read_address == 2)
-					begin
-						B2 = wout_read_data_out;
-						substate <= READ_hRES;
-						hRES_read_en <= 1;
-						wout_read_en <= 0;
-					end
-
-				end
-				
-				READ_hRES:
-				begin
-					hRES_read_address <= hRES_read_address + 1;
-					if(neuron_cnt == 0)
-					begin
-						A1 = hRES_read_data_out;
-						neuron_cnt = 1;
-					end
-					else
-					begin
-						A2 = hRES_read_data_out;
-						neuron_cnt = 0;
-						hRES_read_en <= 0;
-						substate <= MULTIPLY;
-					end
-				end
-				
-				MULTIPLY:
-				begin
-					total = (A1*B1) + (A2*B2);
-					substate <= WRITE_RES;
-				end
-				
-				WRITE_RES:
+			// 1 : next row, from the FIFO or from hRES_RAM (read issued at the previous clock)
+			if(stream_in)
+			begin
+				hRES_stream_read_en <= hRES_stream_valid;
+				s1_valid <= hRES_stream_valid;
+				s1_last <= hRES_stream_valid && hRES_stream_last;
+				s1_row <= hRES_stream_data;
+			end
+			else
+			begin
+				hRES_read_en <= issuing;
+				hRES_read_address <= issue_row;
+				if(issuing)
 				begin
-					RES_write_en <= 1;
-					if(RES_write_en != 0)
-						RES_write_address <= RES_write_address + 1;
-					RES_write_data_in = (total + bias1)>>8;
-					if(hRES_read_address == 0)
-					begin
-						Done <= 1;
-						state <= RESET;
-						substate <= READ_wout;
-					end
-					else
-					begin
-						hRES_read_en <= 1;
-						substate <= READ_hRES;
-					end
+					issue_row <= issue_row + 1;
+					if(issue_row == rows-1)
+						issuing <= 0;
 				end
-			endcase
+				s1_valid <= hRES_read_en;
+				s1_row <= hRES_read_data_out;
+			end
+
+			// 2 : products
+			s2_valid <= s1_valid;
+			s2_last <= s1_last;
+			prod_1 <= s1_row[width-1:0]*B1;
+			prod_2 <= s1_row[2*width-1:width]*B2;
+
+			// 3 : add the bias and write the result (or its label) to RES_RAM
+			RES_write_en <= s2_valid;
+			if(s2_valid)
+			begin
+				RES_write_address <= RES_cnt;
+				RES_write_data_in <= labels ? ($signed({1'b0, result}) > threshold) : (result > {width{1'b1}}) ? {width{1'b1}} : result[width-1:0];	// saturated, as the HLS kernels
+				RES_write_last <= row_last;
+				RES_cnt <= RES_cnt + 1;
+				if(row_last)
+					last_written <= 1;
+			end
+
+			// the write of the last row happens at the clock edge after it was issued
+			if(last_written)
+			begin
+				RES_write_en <= 0;
+				RES_write_last <= 0;
+				hRES_stream_read_en <= 0;
+				Done <= 1;
+				state <= RESET;
+			end
 		end
 	endcase
 end
-endmodule
\ No newline at end of file
+endmodule
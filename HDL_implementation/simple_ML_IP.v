@@ -1,3 +1,5 @@
+`timescale 1ns / 1ps
+
 /* 
 ----------------------------------------------------------------------------------
 --	(c) Rajesh C Panicker, NUS
@@ -32,6 +34,14 @@
 */
 
 module simple_ML_IP_v1_0 
+	#(
+		parameter NUM_LANES = 1,		// hid_layer / predictor pairs (lanes) : 1, 2 or 4
+		parameter SIGM_MODE = 0,		// sigmoid of hid_layer : 0 sigm_RAM (loaded with the model), 1 built-in ROM, 2 piecewise linear
+		parameter SIGM_PWL_STEP_BITS = 4,	// 2^4 = 16 entries between the knots of the piecewise linear sigmoid
+		parameter HID_MULTS = 16,		// multipliers in hid_layer : 2, 4, 8 or 16. 16 : one row per clock
+		parameter HID_ZERO_SKIP = 0,	// 1 : hid_layer skips the passes (16/HID_MULTS per row) whose X values are all 0
+		parameter TELEMETRY = 0			// 1 : performance counters, sent after the results of a batch with CMD_TELEMETRY
+	)
 	(
 		// DO NOT EDIT BELOW THIS LINE ////////////////////
 		ACLK,
@@ -64,91 +74,229 @@ input                          M_AXIS_TREADY;  // Connected slave device is read
 // Implementation Section
 //----------------------------------------
 // This implements a hardware accelerator that does the following:
-// 1. Read all inputs, which are the pre-trained weights and bias
+// 1. Read the command / header word, then all inputs, which are the pre-trained weights and bias (only for CMD_LOAD_MODEL) and X
 // 2. Add each input to the corresponding RAM (X_RAM, whid_RAM, wout_RAM)
 // 3. Compute the prediction and return the predicted labels, 
 //    which should be stored in RES_RAM
+// Steps 1, 2 and 3 of consecutive batches overlap (ping-pong X_RAM and RES_RAM).
+// With CMD_STREAM_ROWS, X does not go to X_RAM : each row goes to hid_layer as soon as it is in,
+// and its result goes out as soon as it is computed, so the number of rows is not bound by the RAMs.
+//
+// There are NUM_LANES hid_layer / predictor pairs. Row r of a batch goes to lane r % NUM_LANES,
+// which has its own X_RAM, RES_RAM and FIFOs, and results are read back from the lanes in the same order.
+// The lanes are started together and load their weights in lockstep : whid_RAM and wout_RAM are read by lane 0
+// for all lanes. They do not always end together (HID_ZERO_SKIP skips a different number of passes in each lane),
+// so the Done of each lane is held (whid_done_lanes, wout_done_lanes) until all of them are done, and a lane
+// that is done is not started again meanwhile.
+// Each lane has its own copies of sigm_RAM (read every clock), all written with the same values.
+// With SIGM_MODE 1 or 2, the sigmoid is built into hid_layer (from sigmoid.mem) : there is no sigm_RAM,
+// and the model has no sigm words.
+// With fewer hid_mults, more lanes make up for the clocks per row of each hid_layer.
 //
 
 // RAM parameters
-localparam X_depth_bits = 9;  		// 2^9 = 512 elements (X is a 64x8 matrix)
+localparam X_depth_bits = 9;  		// 2^9 = 512 elements (X is a 64x8 matrix). X_RAM holds two of them (ping-pong).
 localparam whid_depth_bits = 4; 	// 2^4 =  16 elements (whid is a 8x2 matrix)
 localparam wout_depth_bits = 2; 	// 2^2 =   4 elements (wout is a 3x1 matrix)
 localparam sigm_depth_bits = 8;		// 2^8 = 256 elements (sigm is a 1x256 matrix)
-localparam hRES_depth_bits = 7; 	// 2^7 = 128 elements (hRES is a 64x2 matrix)
-localparam RES_depth_bits = 6;		// 2^6 =  64 elements (RES is a 64x1 matrix)
+localparam hRES_depth_bits = 6; 	// 2^6 =  64 elements (hRES is a 64x2 matrix, one row per location)
+localparam RES_depth_bits = 6;		// 2^6 =  64 elements (RES is a 64x1 matrix). RES_RAM holds two of them (ping-pong).
 localparam width = 8;				// all 8-bit data
+localparam X_lanes_bits = 2;		// 2^2 = 4 X values per input word with CMD_PACKED
+localparam X_lanes = 4;
+localparam X_row_bits = 3;			// 2^3 = 8 X values per row. X_RAM has one bank per value of a row, and hid_layer reads a whole row per clock.
+localparam X_row = 8;
+localparam hid_mults = HID_MULTS;	// multipliers in hid_layer. 16 : one row per clock
+localparam hid_stream = 1;			// 1 : hidden rows go from hid_layer to predictor through hRES_FIFO, and there is no hRES_RAM.
+									// 0 : predictor starts after hid_layer is done, and reads the rows from hRES_RAM. No CMD_STREAM_ROWS.
+localparam hRES_FIFO_depth_bits = 4;	// 16 rows, hid_layer waits when more than 8 are held
+localparam stream_FIFO_depth_bits = 4;	// 16 rows in X_FIFO and in RES_FIFO (CMD_STREAM_ROWS)
+localparam lanes_bits = (NUM_LANES == 4) ? 2 : (NUM_LANES == 2) ? 1 : 0;
+localparam lane_X_depth_bits = X_depth_bits - lanes_bits;		// X_RAM of a lane : rows r with r % NUM_LANES == lane
+localparam lane_RES_depth_bits = RES_depth_bits - lanes_bits;	// RES_RAM of a lane, same rows
+localparam stream_credit = 8*NUM_LANES;	// CMD_STREAM_ROWS : rows in X_FIFO, hid_layer, hRES_FIFO, predictor and RES_FIFO of all lanes
 	
 // wires (or regs) to connect to RAMs and matrix_multiply_0 for assignment 1
 // those which are assigned in an always block of myip_v1_0 shoud be changes to reg.
-reg		X_write_en;									// -> X_RAM. Possibly reg.
-reg		[X_depth_bits-1:0] X_write_address;			// -> X_RAM. Possibly reg. 
-reg		[width-1:0] X_write_data_in;				// -> X_RAM. Possibly reg.
-wire	X_read_en;									// X_RAM ->
-wire	[X_depth_bits-1:0] X_read_address;			// X_RAM ->
-wire	[width-1:0] X_read_data_out;				// X_RAM ->
+reg		[X_row-1:0] X_write_en;						// -> X_RAM of lane X_write_lane. One enable per bank.
+reg		[1:0] X_write_lane;							// -> X_RAM.
+reg		[lane_X_depth_bits-X_row_bits:0] X_write_address;	// -> X_RAM. Bank address ({in_bank, row / NUM_LANES}).
+reg		[width*X_row-1:0] X_write_data_in;			// -> X_RAM. One location per bank.
 reg		whid_write_en;								// -> whid_RAM. Possibly reg.
 reg		[whid_depth_bits-1:0] whid_write_address;	// -> whid_RAM. Possibly reg.
 reg		[width-1:0] whid_write_data_in;				// -> whid_RAM. Possibly reg.
-wire	whid_read_en;								// whid_RAM ->
-wire	[whid_depth_bits-1:0] whid_read_address;	// whid_RAM ->
-wire	[width-1:0] whid_read_data_out;				// whid_RAM ->
+wire	whid_read_en;								// whid_RAM -> from lane 0
+wire	[whid_depth_bits-1:0] whid_read_address;	// whid_RAM -> from lane 0
+wire	[width-1:0] whid_read_data_out;				// whid_RAM -> to all lanes
 reg		wout_write_en;								// -> wout_RAM. Possibly reg.
 reg		[wout_depth_bits-1:0] wout_write_address;	// -> wout_RAM. Possibly reg.
 reg		[width-1:0] wout_write_data_in;				// -> wout_RAM. Possibly reg.
-wire	wout_read_en;								// wout_RAM ->
-wire	[wout_depth_bits-1:0] wout_read_address;	// wout_RAM ->
-wire	[width-1:0] wout_read_data_out;				// wout_RAM ->
-reg		sigm_write_en;								// -> sigm_RAM. Possibly reg.
-reg		[sigm_depth_bits-1:0] sigm_write_address;	// -> sigm_RAM. Possibly reg.
-reg		[width-1:0] sigm_write_data_in;				// -> sigm_RAM. Possibly reg.
-wire	sigm_read_en;								// wout_RAM ->
-wire	[sigm_depth_bits-1:0] sigm_read_address;	// wout_RAM ->
-wire	[width-1:0] sigm_read_data_out;				// wout_RAM ->
-wire	hRES_write_en;								// -> hRES_RAM.
-wire	[hRES_depth_bits-1:0] hRES_write_address;	// -> hRES_RAM.
-wire	[width-1:0] hRES_write_data_in;				// -> hRES_RAM.
-wire 	hRES_read_en;  								// hRES_RAM -> Possibly reg.
-wire	[hRES_depth_bits-1:0] hRES_read_address;	// hRES_RAM -> Possibly reg.
-wire	[width-1:0] hRES_read_data_out;				// hRES_RAM ->
-wire	RES_write_en;								// -> RES_RAM.
-wire	[RES_depth_bits-1:0] RES_write_address;		// -> RES_RAM.
-wire	[width-1:0] RES_write_data_in;				// -> RES_RAM.
-reg		RES_read_en;  								// RES_RAM -> Possibly reg.
-reg		[RES_depth_bits-1:0] RES_read_address;		// RES_RAM -> Possibly reg.
-wire	[width-1:0] RES_read_data_out;				// RES_RAM -> 
+wire	wout_read_en;								// wout_RAM -> from lane 0
+wire	[wout_depth_bits-1:0] wout_read_address;	// wout_RAM -> from lane 0
+wire	[width-1:0] wout_read_data_out;				// wout_RAM -> to all lanes
+reg		sigm_write_en;								// -> sigm_RAM of all lanes. Possibly reg.
+reg		[sigm_depth_bits-1:0] sigm_write_address;	// -> sigm_RAM of all lanes. Possibly reg.
+reg		[width-1:0] sigm_write_data_in;				// -> sigm_RAM of all lanes. Possibly reg.
+reg		X_row_write_en = 0;							// -> X_FIFO of all lanes. One row per lane (CMD_STREAM_ROWS).
+reg		[width*X_row*NUM_LANES-1:0] X_row_write_data_in;	// -> X_FIFO. Row of lane k in bits [width*X_row*k +: width*X_row].
+reg		X_row_write_last;							// -> X_FIFO. Rows with S_AXIS_TLAST.
+wire	[(width+1)*NUM_LANES-1:0] RES_FIFO_data_lanes;	// RES_FIFO of all lanes -> output. {last, result} of lane k.
+wire	[NUM_LANES-1:0] RES_FIFO_empty_lanes;		// RES_FIFO of all lanes -> output.
+wire	[NUM_LANES-1:0] RES_FIFO_read_en_lanes;		// output -> RES_FIFO of all lanes.
+wire	RES_read_en;  								// RES_RAM of all lanes -> Read issued by the output.
+wire	[lane_RES_depth_bits-1:0] RES_read_address;	// RES_RAM of all lanes ->
+wire	[width*NUM_LANES-1:0] RES_read_data_lanes;	// RES_RAM of all lanes -> Lane k in bits [width*k +: width].
+wire	[width-1:0] RES_read_data_out;				// RES_RAM of lane RES_read_lane_sel ->
 
 // wires to connect to predictor
 reg	    Start_whid = 0; 							// Start the hidden layer computation in coprocessor
 reg	    Start_wout = 0; 							// Start the predictor computation in coprocessor
 wire	Done_whid;									// Signal from hidden layer that computation is done 
 wire	Done_wout;									// Signal from predictro that computation is done
+wire	[NUM_LANES-1:0] Done_whid_lanes;			// Done of each lane
+wire	[NUM_LANES-1:0] Done_wout_lanes;
+reg		[NUM_LANES-1:0] whid_done_lanes = 0;		// lanes done since Start_whid, until Done_whid
+reg		[NUM_LANES-1:0] wout_done_lanes = 0;		// lanes done since Start_wout, until Done_wout
 			
 				
-// Total number of input data.
-localparam NUMBER_OF_INPUT_VALUES  = 787; // 2^X_depth_bits + 2^whid_depth_bits + 2^wout_depth_bits + 2^sigm_depth_bits = 788
+// Command / header word, always the first word of the input stream
+// bit CMD_LOAD_MODEL_BIT = 1 : header, whid, wout, sigm (SIGM_MODE 0 only), X. The model RAMs keep their contents for later batches.
+// bit CMD_LOAD_MODEL_BIT = 0 : header, X (CMD_INFER_ONLY). The model loaded by the last CMD_LOAD_MODEL batch is reused.
+// bit CMD_STREAM_ROWS_BIT = 1 : X is any number of rows (of 8 values), ending with the word that has S_AXIS_TLAST.
+//                              There is one result per row, and M_AXIS_TLAST is set with the word holding the last one.
+// bit CMD_PACKED_BIT = 1     : X is packed 4 values per word (first value in bits 7:0), and so are the results.
+//                              The model words (CMD_LOAD_MODEL) are still one value per word.
+// bit CMD_LABELS_BIT = 1     : one label per row instead of the result, 1 if the result (before it is saturated) is
+//                              above the threshold in bits 31:LABEL_THRESHOLD_LSB of the header (signed), as in the
+//                              HLS kernels. The labels are packed 32 per word (first label in bit 0), whether
+//                              CMD_PACKED is set or not (it still packs X).
+// bit CMD_TELEMETRY_BIT = 1  : (TELEMETRY = 1 only) the results are followed by TELEMETRY_WORDS words of counters,
+//                              with M_AXIS_TLAST on the last of them : TELEMETRY_MAGIC, then the counters since reset
+//                              (32 bits, wrapping) : clocks, S_AXIS_TVALID without S_AXIS_TREADY, S_AXIS_TREADY without
+//                              S_AXIS_TVALID, M_AXIS_TVALID without M_AXIS_TREADY, hid_layer clocks (Start_whid),
+//                              predictor clocks (Start_wout), headers read. Taken as the last result word goes out.
+localparam CMD_LOAD_MODEL_BIT = 0;
+localparam CMD_STREAM_ROWS_BIT = 1;
+localparam CMD_PACKED_BIT = 2;
+localparam CMD_LABELS_BIT = 3;
+localparam CMD_TELEMETRY_BIT = 4;
+localparam TELEMETRY_WORDS = 8;
+localparam TELEMETRY_MAGIC = 32'h544C4D01;	// "TLM", version 1
+localparam LABEL_THRESHOLD_LSB = 16;
+localparam LABEL_THRESHOLD_BITS = 16;
+localparam label_lanes_bits = 5;	// 2^5 = 32 labels per output word
+localparam label_lanes = 32;
+
+// Total number of input data (excluding the header word).
 localparam NUMBER_OF_X = 512;
 localparam NUMBER_OF_whid = 16;
 localparam NUMBER_OF_wout = 3;
-localparam NUMBER_OF_sigm = 256;
+localparam NUMBER_OF_sigm = (SIGM_MODE == 0) ? 256 : 0;
+localparam NUMBER_OF_INPUT_VALUES  = NUMBER_OF_X + NUMBER_OF_whid + NUMBER_OF_wout + NUMBER_OF_sigm; // 787 (531 without sigm) with CMD_LOAD_MODEL
 // Total number of output data
 localparam NUMBER_OF_OUTPUT_VALUES = 64; // 2**RES_depth_bits = 64
 
 // Define the states of state machine (one hot encoding)
+// Input (state), compute and output run at the same time, each on its own half of the ping-pong buffers:
+// X_RAM and RES_RAM hold two batches each, the bank being the MSB of the address.
+// Batch b goes to X bank in_bank, is computed from X bank cmp_bank into RES bank cmp_bank, and is sent from RES bank out_bank.
+// Each of them toggles after its part of the batch. X_full / RES_full tell which banks hold a batch not yet computed / sent.
 localparam Idle  		= 4'b1000;
 localparam Read_Inputs 	= 4'b0100;
-localparam Compute 		= 4'b0010;
-localparam Write_Outputs= 4'b0001;
-
-localparam Read_output = 3'b100;
-localparam Write_output = 3'b010;
-localparam Idle_output = 3'b001;
     
 reg [3:0] state;
-reg [2:0] output_state;
-reg write_done  = 0;
-reg [8:0] RES_size;
-reg [31:0] sum;
+reg header_pending = 0;						// the next input word is the command / header word
+reg packed_mode = 0;						// CMD_PACKED was set in the header of the batch being read
+reg stream_mode = 0;						// CMD_STREAM_ROWS was set in the header of the batch being read
+reg labels_mode = 0;						// CMD_LABELS was set in the header of the batch being read
+reg [LABEL_THRESHOLD_BITS-1:0] label_threshold = 0;	// ... with this threshold
+reg telemetry_mode = 0;						// CMD_TELEMETRY was set (and TELEMETRY is 1) in the header of the batch being read
+reg cmp_labels = 0;							// labels / threshold of the batch being computed, for predictor
+reg [LABEL_THRESHOLD_BITS-1:0] cmp_threshold = 0;
+
+// CMD_STREAM_ROWS : the X values are put together into rows (X_stream_row), which go to hid_layer through X_FIFO.
+// The results come back through RES_FIFO and the output queue. X_RAM and RES_RAM are not used.
+// A stream batch is computed once the batches read before it are computed and sent (stream_pending),
+// and no batch is read after it until then, so the results stay in order.
+// At most stream_credit rows are between S_AXIS and the output queue, so none of the FIFOs can overflow.
+// The rows go to the lanes NUM_LANES at a time (X_stream_group), so that every lane gets as many rows, and ends with a last row.
+// If the batch ends part way through a group, the lanes after X_stream_last_lane get a row of 0s, whose result is dropped.
+// A stream batch is not read before the results of the one before are sent, so X_stream_last_lane is still valid then.
+reg [width*X_row-1:0] X_stream_row = 0;		// row being put together
+reg [X_row_bits-1:0] X_stream_col = 0;		// next value of the row
+reg [width*X_row*NUM_LANES-1:0] X_stream_group = 0;	// rows of the lanes before X_stream_lane
+reg [1:0] X_stream_lane = 0;				// lane of the row being put together
+reg [1:0] X_stream_last_lane = 0;			// lane of the last row of the batch
+reg stream_pending = 0;						// a stream batch is read but not yet started
+reg stream_run = 0;							// hid_layer and predictor run a stream batch
+reg out_stream = 0;							// the output takes results from RES_FIFO
+reg out_stream_packed = 0;					// CMD_PACKED of the stream batch being sent
+reg out_stream_labels = 0;					// CMD_LABELS of the stream batch being sent
+reg out_stream_telemetry = 0;				// CMD_TELEMETRY of the stream batch being sent
+reg [stream_FIFO_depth_bits+lanes_bits:0] stream_rows_held = 0;	// rows accepted (with the rows of 0s) and not yet taken from RES_FIFO
+
+// ping-pong banks
+reg in_bank = 0;							// X bank written by the input
+reg cmp_bank = 0;							// X bank read and RES bank written by the computation
+reg out_bank = 0;							// RES bank read by the output
+reg [1:0] X_full = 0;						// X bank holds a batch to be computed
+reg [1:0] X_packed = 0;						// CMD_PACKED of the batch in the X bank
+reg [1:0] X_labels = 0;						// CMD_LABELS of the batch in the X bank
+reg [LABEL_THRESHOLD_BITS-1:0] X_threshold [0:1];	// label threshold of the batch in the X bank
+reg [1:0] RES_full = 0;						// RES bank holds results to be sent
+reg [1:0] RES_packed = 0;					// CMD_PACKED of the results in the RES bank
+reg [1:0] RES_labels = 0;					// the RES bank holds labels (CMD_LABELS)
+reg [1:0] X_telemetry = 0;					// CMD_TELEMETRY of the batch in the X bank
+reg [1:0] RES_telemetry = 0;				// ... and of the results in the RES bank
+
+// Output : RES_RAM reads are issued ahead (prefetch) into a 4-word output queue, whose head drives M_AXIS.
+// A read is issued whenever the queue has room for it, counting the word that may still come from the read of the last clock,
+// so M_AXIS_TVALID can be high every clock and M_AXIS_TREADY can go low at any clock (the queue is the skid buffer).
+localparam out_queue_bits = 2;
+reg [RES_depth_bits:0] RES_issue_cnt = 0;		// results of RES bank out_bank read so far
+reg RES_read_valid = 0;							// RES_read_data_out holds the result read at the last clock
+reg RES_read_last = 0;							// ... which is the last result of the batch
+reg [label_lanes_bits-1:0] RES_read_lane = 0;	// ... and goes to this lane of a packed word (RES_read_lane % X_lanes) or label word
+reg [31:0] pack_word = 0;						// packed word being put together
+reg [1:0] RES_read_lane_sel = 0;				// lane of RES_read_data_out
+reg RES_read_stream = 0;						// RES_read_valid / RES_read_last are from RES_FIFO
+reg [1:0] out_lane = 0;							// lane of the next result from RES_FIFO
+reg [31:0] out_data [0:2**out_queue_bits-1];
+reg out_last [0:2**out_queue_bits-1];
+reg [out_queue_bits-1:0] out_write_ptr = 0, out_read_ptr = 0;
+reg [out_queue_bits:0] out_count = 0;
+
+reg [width-1:0] RES_stream_value = 0;			// result taken from RES_FIFO at the last clock
+
+assign RES_read_data_out = RES_read_data_lanes[width*RES_read_lane_sel +: width];
+wire [width:0] RES_FIFO_data = RES_FIFO_data_lanes[(width+1)*out_lane +: width+1];
+wire RES_FIFO_empty = RES_FIFO_empty_lanes[out_lane];
+wire RES_FIFO_last = RES_FIFO_data[width];
+wire RES_FIFO_pad = RES_FIFO_last && (out_lane > X_stream_last_lane);	// row of 0s, dropped
+
+wire RES_packed_out = RES_read_stream ? out_stream_packed : RES_packed[out_bank];
+wire RES_labels_out = RES_read_stream ? out_stream_labels : RES_labels[out_bank];
+wire RES_telemetry_out = RES_read_stream ? out_stream_telemetry : RES_telemetry[out_bank];
+wire [width-1:0] RES_value = RES_read_stream ? RES_stream_value : RES_read_data_out;
+wire [31:0] RES_word = RES_labels_out ? (pack_word | (RES_value[0] << RES_read_lane))
+					 : RES_packed_out ? (pack_word | (RES_value << (width*RES_read_lane[X_lanes_bits-1:0]))) : RES_value;
+wire RES_lane_last = RES_labels_out ? (RES_read_lane == label_lanes-1) : (RES_read_lane[X_lanes_bits-1:0] == X_lanes-1);
+wire RES_word_done = RES_read_valid && ((~RES_packed_out && ~RES_labels_out) || RES_lane_last || RES_read_last);	// a word goes into the queue
+wire out_pop = M_AXIS_TVALID && M_AXIS_TREADY;
+
+// Telemetry trailer : once the last result word of a CMD_TELEMETRY batch goes into the queue, the counters are copied
+// to tel_snap, and its words follow it into the queue, one per clock with room. No result is read until they are in.
+reg [3:0] trailer_cnt = 0;						// trailer words still to go into the queue
+reg [31:0] tel_snap [0:TELEMETRY_WORDS-1];
+wire trailer_start = RES_word_done && RES_read_last && RES_telemetry_out;
+wire trailer_push = (trailer_cnt != 0) && (out_count < 2**out_queue_bits);
+
+assign RES_read_en = ~out_stream && RES_full[out_bank] && (RES_issue_cnt != NUMBER_OF_OUTPUT_VALUES) && ~RES_read_last
+					&& (trailer_cnt == 0) && (out_count + RES_word_done < 2**out_queue_bits);
+wire RES_stream_read_en = out_stream && ~RES_FIFO_empty && ~RES_read_last
+					&& (trailer_cnt == 0) && (out_count + RES_word_done < 2**out_queue_bits);	// same as RES_read_en, from RES_FIFO of lane out_lane
+assign RES_FIFO_read_en_lanes = RES_stream_read_en << out_lane;
+assign RES_read_address = RES_issue_cnt[RES_depth_bits-1:lanes_bits];
 
 // Counters to store the number inputs read & outputs written
 reg [15:0] nr_of_reads;
@@ -159,19 +307,31 @@ reg [15:0] sigm_of_reads;
 reg [15:0] hRES_of_reads;
 reg [15:0] RES_of_reads;
 reg [15:0] nr_of_writes;
+wire [15:0] X_index = NUMBER_OF_X - X_of_reads;	// location in X_RAM of the next X value
 
-assign S_AXIS_TREADY = (state == Read_Inputs);
-assign M_AXIS_TVALID = (output_state == Write_output);
-assign M_AXIS_TLAST = write_done;
+// The model RAMs are only written when no batch is being or waiting to be computed with the previous model
+wire model_words = (whid_of_reads != 0 || wout_of_reads != 0 || sigm_of_reads != 0);
+wire model_busy = Start_whid || Start_wout || X_full[~in_bank];
+wire stream_words = stream_mode && ~model_words;	// X words of a CMD_STREAM_ROWS batch
+wire stream_full = (stream_rows_held >= stream_credit);
+wire X_stream_row_done = (state == Read_Inputs) && S_AXIS_TVALID && S_AXIS_TREADY && ~header_pending && stream_words
+					&& (S_AXIS_TLAST || X_stream_col + (packed_mode ? X_lanes : 1) == X_row);
+wire [width*X_row-1:0] X_stream_row_next = X_stream_row | (packed_mode ? (S_AXIS_TDATA[width*X_lanes-1:0] << (width*X_stream_col))
+																	   : (S_AXIS_TDATA[width-1:0] << (width*X_stream_col)));
+wire X_stream_group_done = X_stream_row_done && (S_AXIS_TLAST || X_stream_lane == NUM_LANES-1);
+wire [width*X_row*NUM_LANES-1:0] X_stream_group_next = X_stream_group | (X_stream_row_next << (width*X_row*X_stream_lane));
 
-assign M_AXIS_TDATA = sum;
+assign S_AXIS_TREADY = (state == Read_Inputs) && (header_pending || (nr_of_reads != 0 && !(model_words && model_busy) && !(stream_words && stream_full)));
+assign M_AXIS_TVALID = (out_count != 0);
+assign M_AXIS_TLAST = M_AXIS_TVALID && out_last[out_read_ptr];	// set with the word holding result NUMBER_OF_OUTPUT_VALUES-1
+
+assign M_AXIS_TDATA = out_data[out_read_ptr];
 
 always @(posedge ACLK) 
 begin
     /****** Synchronous reset (active low) ******/
 	if (!ARESETN)
    	begin
-    	RES_size     = NUMBER_OF_OUTPUT_VALUES;
         state       <= Idle;
         nr_of_reads <= NUMBER_OF_INPUT_VALUES;
         //reset the write addresses
@@ -179,236 +339,388 @@ begin
         whid_write_address <= 0;
         wout_write_address <= 0;
         sigm_write_address <= 0;
-        RES_read_address   <= 0;
         //Reset the number of reads
         X_of_reads 	  <= NUMBER_OF_X;
         whid_of_reads <= NUMBER_OF_whid;
         wout_of_reads <= NUMBER_OF_wout;
         sigm_of_reads <= NUMBER_OF_sigm;
-        sum           <= 0;
         //set enable bits for read and write
         X_write_en    <= 0;
         whid_write_en <= 0;
         wout_write_en <= 0;
         sigm_write_en <= 0;
-        RES_read_en   <= 0;
         Start_whid    <= 0;
         Start_wout	  <= 0;
+        whid_done_lanes <= 0;
+        wout_done_lanes <= 0;
+        header_pending <= 0;
+        RES_issue_cnt <= 0;
+        RES_read_valid <= 0;
+        RES_read_last <= 0;
+        out_write_ptr <= 0;
+        out_read_ptr  <= 0;
+        out_count     <= 0;
+        in_bank       <= 0;
+        cmp_bank      <= 0;
+        out_bank      <= 0;
+        X_full        <= 0;
+        RES_full      <= 0;
+        stream_mode   <= 0;
+        stream_pending <= 0;
+        stream_run    <= 0;
+        out_stream    <= 0;
+        out_stream_telemetry <= 0;
+        telemetry_mode <= 0;
+        X_telemetry   <= 0;
+        RES_telemetry <= 0;
+        trailer_cnt   <= 0;
+        stream_rows_held <= 0;
+        X_stream_row  <= 0;
+        X_stream_col  <= 0;
+        X_stream_group <= 0;
+        X_stream_lane <= 0;
+        X_row_write_en <= 0;
+        RES_read_stream <= 0;
+        out_lane      <= 0;
      end
-      /************** state machine **************/
      else
+     begin
+      /************** input state machine **************/
+		X_row_write_en <= 0;
      	case (state)
 
         Idle:
-        	if (S_AXIS_TVALID == 1)
+        	// wait for a free X bank, and for the stream batch read last to be started and sent
+        	if (S_AXIS_TVALID == 1 && ~X_full[in_bank] && ~stream_pending && ~out_stream)
             begin
                 nr_of_reads <= NUMBER_OF_INPUT_VALUES;
-            	RES_size 	 = NUMBER_OF_OUTPUT_VALUES;
             	//reset the write addresses
             	X_write_address    <= 0;
             	whid_write_address <= 0;
             	wout_write_address <= 0;
             	sigm_write_address <= 0;
-            	RES_read_address   <= 0;
             	//Reset the number of reads
         		X_of_reads 	  <= NUMBER_OF_X;
         		whid_of_reads <= NUMBER_OF_whid;
         		wout_of_reads <= NUMBER_OF_wout;
         		sigm_of_reads <= NUMBER_OF_sigm;
-            	X_write_en    <= 1;
-                whid_write_en <= 1;
-                wout_write_en <= 1;
-                sigm_write_en <= 1;
-                RES_read_en   <= 0;
-            	sum           <= 0;
-            	state          = Read_Inputs;
-				output_state   = Idle_output;
-				write_done    <= 0;
+            	X_write_en    <= 0;
+                whid_write_en <= 0;
+                wout_write_en <= 0;
+                sigm_write_en <= 0;
+            	header_pending <= 1;
+            	state         <= Read_Inputs;
             end
 
       	  Read_Inputs:
-          if (nr_of_reads == 0)
+          if (nr_of_reads == 0 && ~header_pending)
           begin
-          	state <= Compute;
+          	// the X bank is handed over to the computation (the rows of a stream batch are already on their way)
+          	if(~stream_mode)
+          	begin
+          		X_full[in_bank] <= 1;
+          		X_packed[in_bank] <= packed_mode;
+          		X_labels[in_bank] <= labels_mode;
+          		X_telemetry[in_bank] <= telemetry_mode;
+          		X_threshold[in_bank] <= label_threshold;
+          		in_bank <= ~in_bank;
+          	end
+          	stream_mode <= 0;
+          	state <= Idle;
           	X_write_en <= 0;
 			whid_write_en <= 0;
 			wout_write_en <= 0;
 			sigm_write_en <= 0;
           end
-          else if (S_AXIS_TVALID == 1)
+          else if (S_AXIS_TVALID == 1 && S_AXIS_TREADY == 1)
           begin
-          	if(S_AXIS_TREADY == 1)
-            begin
-            	if(wout_of_reads == 0)
+          	// one RAM write per accepted word; the write itself happens on the next clock edge
+          	X_write_en <= 0;
+			whid_write_en <= 0;
+			wout_write_en <= 0;
+			sigm_write_en <= 0;
+          	if(header_pending)
+          	begin
+          		header_pending <= 0;
+          		packed_mode <= S_AXIS_TDATA[CMD_PACKED_BIT];
+          		stream_mode <= S_AXIS_TDATA[CMD_STREAM_ROWS_BIT];
+          		labels_mode <= S_AXIS_TDATA[CMD_LABELS_BIT];
+          		telemetry_mode <= TELEMETRY && S_AXIS_TDATA[CMD_TELEMETRY_BIT];
+          		label_threshold <= S_AXIS_TDATA[LABEL_THRESHOLD_LSB +: LABEL_THRESHOLD_BITS];
+          		stream_pending <= S_AXIS_TDATA[CMD_STREAM_ROWS_BIT];
+          		X_stream_row <= 0;
+          		X_stream_col <= 0;
+          		X_stream_group <= 0;
+          		X_stream_lane <= 0;
+          		if(S_AXIS_TDATA[CMD_LOAD_MODEL_BIT])
+          		begin
+          			nr_of_reads   <= NUMBER_OF_INPUT_VALUES;
+          			whid_of_reads <= NUMBER_OF_whid;
+          			wout_of_reads <= NUMBER_OF_wout;
+          			sigm_of_reads <= NUMBER_OF_sigm;
+          		end
+          		else
+          		begin
+          			// infer only: skip the model, whid_RAM, wout_RAM and sigm_RAM are not written
+          			nr_of_reads   <= NUMBER_OF_X;
+          			whid_of_reads <= 0;
+          			wout_of_reads <= 0;
+          			sigm_of_reads <= 0;
+          		end
+          	end
+          	else
+          	begin
+            	if(whid_of_reads != 0)
             	begin
-            		wout_write_en <= 0;
-                	sigm_write_data_in = S_AXIS_TDATA[width-1:0];
-                    sigm_write_address <= sigm_write_address + 1;
-                    sigm_of_reads <= sigm_of_reads - 1;
-                    if(sigm_of_reads == 1'b1)
-                    	sigm_write_en <= 0;
+            		whid_write_en <= 1;
+                	whid_write_data_in <= S_AXIS_TDATA[width-1:0];
+                    whid_write_address <= NUMBER_OF_whid - whid_of_reads;
+                    whid_of_reads <= whid_of_reads - 1;
+                    nr_of_reads <= nr_of_reads - 1;
                 end
-                else if(whid_of_reads == 0)
+                else if(wout_of_reads != 0)
                 begin
-                	whid_write_en <= 0;
-                    wout_write_data_in = S_AXIS_TDATA[width-1:0];
-                    wout_write_address <= wout_write_address + 1;
+                	wout_write_en <= 1;
+                    wout_write_data_in <= S_AXIS_TDATA[width-1:0];
+                    wout_write_address <= NUMBER_OF_wout - wout_of_reads;
                     wout_of_reads <= wout_of_reads - 1;
-                    if(wout_of_reads == 1)
-                    	wout_write_en <= 0;
+                    nr_of_reads <= nr_of_reads - 1;
                 end
-                else if(X_of_reads == 0)
+                else if(sigm_of_reads != 0)
                 begin
-                	X_write_en <= 0;
-                    whid_write_data_in = S_AXIS_TDATA[width-1:0];
-                    whid_write_address <= whid_write_address + 1;
-                    whid_of_reads <= whid_of_reads - 1;
-                    if(whid_of_reads == 1)
-                    	whid_write_en <= 0;
+                	sigm_write_en <= 1;
+                    sigm_write_data_in <= S_AXIS_TDATA[width-1:0];
+                    sigm_write_address <= NUMBER_OF_sigm - sigm_of_reads;
+                    sigm_of_reads <= sigm_of_reads - 1;
+                    nr_of_reads <= nr_of_reads - 1;
+                end
+                else if(stream_mode)
+                begin
+                	// the row is complete, or ends with S_AXIS_TLAST (missing values are 0s). No count : TLAST ends the batch.
+                	// The rows go to X_FIFO once there is one for each lane, or with S_AXIS_TLAST.
+                	if(X_stream_row_done)
+                	begin
+                		if(X_stream_group_done)
+                		begin
+                			X_row_write_en <= 1;
+                			X_row_write_data_in <= X_stream_group_next;
+                			X_row_write_last <= S_AXIS_TLAST;
+                			X_stream_group <= 0;
+                			X_stream_lane <= 0;
+                			if(S_AXIS_TLAST)
+                				X_stream_last_lane <= X_stream_lane;
+                		end
+                		else
+                		begin
+                			X_stream_group <= X_stream_group_next;
+                			X_stream_lane <= X_stream_lane + 1;
+                		end
+                		X_stream_row <= 0;
+                		X_stream_col <= 0;
+                	end
+                	else
+                	begin
+                		X_stream_row <= X_stream_row_next;
+                		X_stream_col <= X_stream_col + (packed_mode ? X_lanes : 1);
+                	end
+                	if(S_AXIS_TLAST)
+                		nr_of_reads <= 0;
+                end
+                else if(packed_mode)
+                begin
+                	// X_lanes values in one word, written to X_lanes banks of X_RAM in one clock
+                	X_write_en <= {X_lanes{1'b1}} << X_index[X_row_bits-1:0];
+                    X_write_data_in <= {(X_row/X_lanes){S_AXIS_TDATA[width*X_lanes-1:0]}};
+                    X_write_lane <= (X_index >> X_row_bits) % NUM_LANES;
+                    X_write_address <= {in_bank, X_index[X_depth_bits-1:X_row_bits+lanes_bits]};
+                    X_of_reads <= X_of_reads - X_lanes;
+                    nr_of_reads <= nr_of_reads - X_lanes;
                 end
                 else
                 begin
-                    X_write_data_in = S_AXIS_TDATA[width-1:0];
-                    X_write_address <= X_write_address + 1;
+                	X_write_en <= 1 << X_index[X_row_bits-1:0];
+                    X_write_data_in <= {X_row{S_AXIS_TDATA[width-1:0]}};
+                    X_write_lane <= (X_index >> X_row_bits) % NUM_LANES;
+                    X_write_address <= {in_bank, X_index[X_depth_bits-1:X_row_bits+lanes_bits]};
                     X_of_reads <= X_of_reads - 1;
-                    if(X_of_reads == 1)
-                    	X_write_en <= 0;
+                    nr_of_reads <= nr_of_reads - 1;
                 end
-                nr_of_reads <= nr_of_reads - 1;
             end
           end
-            
-          Compute:
-				// If multiplication is done, write to outputs, else begin multiplication by bring start bit high
-				if(~Start_whid && ~Done_whid)
-				begin
-					X_write_en 	  <= 0;
-					whid_write_en <= 0;
-					wout_write_en <= 0;
-					sigm_write_en <= 0;
-					Start_whid <= 1;
-				end
-				else if(~Start_wout && Done_whid)
-				begin
-					Start_whid <= 0;
-					Start_wout <= 1;
-				end
-				else if(Done_wout)
-				begin
-					Start_wout <= 0;
-					write_done <= 0;
-					RES_read_en <= 1;
-				    state <= Write_Outputs;
-				end
-				
-          Write_Outputs:
-          	begin
-            // If there are writes left, read datat out, else go back to Idle
-            if (M_AXIS_TREADY == 1)
-                case (output_state)               	
-                	Idle_output:
-                		begin
-                		//m_axis_valid <= 0;
-//                		write_done <= 0;
-                		RES_read_en <= 1;
-                		output_state <= Read_output;
-                		end
-           
-                	Read_output:
-                		begin
-                		//m_axis_valid <= 0;
-                    	sum <= RES_read_data_out;
-						if(~write_done)
-                    		RES_read_address <= RES_read_address + 1;
-                    	output_state <= Write_output;
-   						end
-   					Write_output:
-   						begin
-   						//m_axis_valid <= 1;
-   						if(RES_read_address == RES_size-1)
-   							begin
-   							if(write_done)
-   								begin
-   								write_done <= 0;
-   								output_state <= Idle_output;
-   								RES_read_address <= 0;
-   								end
-   							else
-   								begin
-   								write_done <= 1;
-   								output_state <= Read_output;
-   								end
-   							end
-   						else
-   							begin
-   							output_state <= Read_output;
-   							end
-   						end
-   						
-                 endcase
+          else
+          begin
+          	X_write_en <= 0;
+			whid_write_en <= 0;
+			wout_write_en <= 0;
+			sigm_write_en <= 0;
+          end
+        endcase
+
+      /************** computation **************/
+		// Done_whid and Done_wout are one clock pulses. Start_whid / Start_wout stay high while the sub-module runs.
+		// With hid_stream, both are started together and predictor takes each row as hid_layer produces it.
+		// X bank cmp_bank is free again once hid_layer is done; RES bank cmp_bank is full once predictor is done.
+		// A stream batch (stream_run) uses neither, and starts when all the batches before it are sent and its model
+		// words (CMD_LOAD_MODEL) are in : model_busy holds them back once hid_layer runs.
+		// Done_whid / Done_wout are the last lane to be done.
+		whid_done_lanes <= (Done_whid || ~Start_whid) ? 0 : whid_done_lanes | Done_whid_lanes;
+		wout_done_lanes <= (Done_wout || ~Start_wout) ? 0 : wout_done_lanes | Done_wout_lanes;
+		if(Done_wout)
+		begin
+			Start_wout <= 0;
+			if(stream_run)
+				stream_run <= 0;
 			else
-				begin
-				write_done <= 0;
-				//m_axis_valid <= 0;
-				state <= Idle;
-				end
+			begin
+				RES_full[cmp_bank] <= 1;
+				RES_packed[cmp_bank] <= X_packed[cmp_bank];
+				RES_labels[cmp_bank] <= cmp_labels;
+				RES_telemetry[cmp_bank] <= X_telemetry[cmp_bank];
+				cmp_bank <= ~cmp_bank;
 			end
-        endcase
-   end
-	   
+		end
+		else if(Done_whid)
+		begin
+			Start_whid <= 0;
+			Start_wout <= 1;
+			if(~stream_run)
+				X_full[cmp_bank] <= 0;
+		end
+		else if(~Start_whid && ~Start_wout && stream_pending && ~model_words && X_full == 0 && RES_full == 0 && ~out_stream)
+		begin
+			Start_whid <= 1;
+			Start_wout <= 1;
+			stream_run <= 1;
+			stream_pending <= 0;
+			out_stream <= 1;
+			out_stream_packed <= packed_mode;	// still the stream batch, as no batch is read after it before this
+			out_stream_labels <= labels_mode;
+			out_stream_telemetry <= telemetry_mode;
+			cmp_labels <= labels_mode;
+			cmp_threshold <= label_threshold;
+		end
+		else if(~Start_whid && ~Start_wout && X_full[cmp_bank] && ~RES_full[cmp_bank])
+		begin
+			Start_whid <= 1;
+			Start_wout <= hid_stream;
+			cmp_labels <= X_labels[cmp_bank];
+			cmp_threshold <= X_threshold[cmp_bank];
+		end
+
+      /************** output **************/
+		// read issue : RES_issue_cnt is the address of the read (RES_read_en) at this clock
+		// (result RES_issue_cnt is in the RES_RAM of lane RES_issue_cnt % NUM_LANES),
+		// or RES_stream_read_en takes the head of RES_FIFO of lane out_lane, the lanes being taken in turn
+		RES_read_valid <= RES_read_en || (RES_stream_read_en && ~RES_FIFO_pad);
+		RES_read_last <= RES_read_en ? (RES_issue_cnt == NUMBER_OF_OUTPUT_VALUES-1)
+									 : (RES_stream_read_en && RES_FIFO_last && out_lane == X_stream_last_lane);
+		RES_read_stream <= RES_stream_read_en;
+		RES_read_lane_sel <= RES_issue_cnt % NUM_LANES;
+		if(RES_stream_read_en)
+		begin
+			RES_stream_value <= RES_FIFO_data[width-1:0];
+			out_lane <= (out_lane == NUM_LANES-1) ? 0 : out_lane + 1;
+			// the stream batch is over once the last row of every lane is taken
+			if(RES_FIFO_last && out_lane == NUM_LANES-1)
+				out_stream <= 0;
+		end
+		if(RES_read_en || (RES_stream_read_en && ~RES_FIFO_pad))
+		begin
+			RES_issue_cnt <= RES_issue_cnt + 1;
+			RES_read_lane <= RES_issue_cnt[label_lanes_bits-1:0];
+		end
+
+		// read data : packed results (or labels) are put together in pack_word, a full word goes into the queue
+		if(RES_read_valid)
+			pack_word <= RES_lane_last ? 0 : RES_word;
+		if(RES_word_done)
+		begin
+			out_data[out_write_ptr] <= RES_word;
+			out_last[out_write_ptr] <= RES_read_last && ~RES_telemetry_out;
+			out_write_ptr <= out_write_ptr + 1;
+		end
+		else if(trailer_push)
+		begin
+			out_data[out_write_ptr] <= tel_snap[TELEMETRY_WORDS - trailer_cnt];
+			out_last[out_write_ptr] <= (trailer_cnt == 1);
+			out_write_ptr <= out_write_ptr + 1;
+		end
+		trailer_cnt <= trailer_start ? TELEMETRY_WORDS : trailer_cnt - trailer_push;
+		// the last result is read, so the RES bank can take the next batch while the queue drains
+		if(RES_read_last)
+		begin
+			if(~RES_read_stream)
+			begin
+				RES_full[out_bank] <= 0;
+				out_bank <= ~out_bank;
+			end
+			RES_issue_cnt <= 0;
+			pack_word <= 0;
+		end
+
+		// queue head to M_AXIS
+		if(out_pop)
+			out_read_ptr <= out_read_ptr + 1;
+		out_count <= out_count + (RES_word_done || trailer_push) - out_pop;
+
+		stream_rows_held <= stream_rows_held + (X_stream_group_done ? NUM_LANES : 0) - RES_stream_read_en;
+     end
+end
+
+	// Telemetry counters (TELEMETRY = 1), since reset. They are copied to tel_snap when a trailer starts.
+	reg [31:0] tel_cycles = 0, tel_in_no_ready = 0, tel_in_no_valid = 0, tel_out_no_ready = 0;
+	reg [31:0] tel_hid = 0, tel_out = 0, tel_batches = 0;
+	always @(posedge ACLK)
+	begin
+		if(!ARESETN || !TELEMETRY)
+		begin
+			tel_cycles       <= 0;
+			tel_in_no_ready  <= 0;
+			tel_in_no_valid  <= 0;
+			tel_out_no_ready <= 0;
+			tel_hid          <= 0;
+			tel_out          <= 0;
+			tel_batches      <= 0;
+		end
+		else
+		begin
+			tel_cycles       <= tel_cycles + 1;
+			tel_in_no_ready  <= tel_in_no_ready + (S_AXIS_TVALID && ~S_AXIS_TREADY);
+			tel_in_no_valid  <= tel_in_no_valid + (S_AXIS_TREADY && ~S_AXIS_TVALID);
+			tel_out_no_ready <= tel_out_no_ready + (M_AXIS_TVALID && ~M_AXIS_TREADY);
+			tel_hid          <= tel_hid + Start_whid;
+			tel_out          <= tel_out + Start_wout;
+			tel_batches      <= tel_batches + (header_pending && S_AXIS_TVALID && S_AXIS_TREADY);
+		end
+		if(trailer_start)
+		begin
+			tel_snap[0] <= TELEMETRY_MAGIC;
+			tel_snap[1] <= tel_cycles;
+			tel_snap[2] <= tel_in_no_ready;
+			tel_snap[3] <= tel_in_no_valid;
+			tel_snap[4] <= tel_out_no_ready;
+			tel_snap[5] <= tel_hid;
+			tel_snap[6] <= tel_out;
+			tel_snap[7] <= tel_batches;
+		end
+	end
+   
 	// Connection to sub-modules
-	
-//	memory_RAM 
-//	#(
-//		.width(width), 
-//		.depth_bits(X_depth_bits)
-//	) X_RAM 
-//	(
-//		.clk(ACLK),
-//		.write_en(X_write_en),
-//		.write_address(X_write_address),
-//		.write_data_in(X_write_data_in),
-//		.read_en(X_read_en),    
-//		.read_address(X_read_address),
-//		.read_data_out(X_read_data_out)
-//	);
-										
-										
-//	memory_RAM 
-//	#(
-//		.width(width), 
-//		.depth_bits(whid_depth_bits)
-//	) whid_RAM 
-//	(
-//		.clk(ACLK),
-//		.write_en(whid_write_en),
-//		.write_address(whid_write_address),
-//		.write_data_in(whid_write_data_in),
-//		.read_en(whid_read_en),    
-//		.read_address(whid_read_address),
-//		.read_data_out(whid_read_data_out)
-//	);
-
-	B_RAM
+	// whid_RAM and wout_RAM are shared by the lanes. All the other RAMs, the FIFOs, hid_layer and predictor are in each lane.
+
+	memory_RAM 
 	#(
-		.width(width),
-		.depth_bits_a(X_depth_bits),
-		.depth_bits_b(whid_depth_bits)
-	) X_whid_RAM
+		.width(width), 
+		.depth_bits(whid_depth_bits)
+	) whid_RAM 
 	(
 		.clk(ACLK),
-		.write_ena(X_write_en),
-		.write_enb(whid_write_en),
-		.write_addra(X_write_address),
-		.write_addrb(whid_write_address),
-		.write_dia(X_write_data_in),
-		.write_dib(whid_write_data_in),
-		.read_ena(X_read_en),
-		.read_enb(whid_read_en),
-		.read_addra(X_read_address),
-		.read_addrb(whid_read_address),
-		.read_doa(X_read_data_out),
-		.read_dob(whid_read_data_out)
+		.write_en(whid_write_en),
+		.write_address(whid_write_address),
+		.write_data_in(whid_write_data_in),
+		.read_en(whid_read_en),    
+		.read_address(whid_read_address),
+		.read_data_out(whid_read_data_out)
 	);
 	
 	memory_RAM 
@@ -425,106 +737,284 @@ begin
 		.read_address(wout_read_address),
 		.read_data_out(wout_read_data_out)
 	);
-	
-		memory_RAM 
-	#(
-		.width(width), 
-		.depth_bits(sigm_depth_bits)
-	) sigm_RAM 
-	(
-		.clk(ACLK),
-		.write_en(sigm_write_en),
-		.write_address(sigm_write_address),
-		.write_data_in(sigm_write_data_in),
-		.read_en(sigm_read_en),    
-		.read_address(sigm_read_address),
-		.read_data_out(sigm_read_data_out)
-	);
 
-	memory_RAM 
-	#(
-		.width(width), 
-		.depth_bits(hRES_depth_bits)
-	) hRES_RAM 
-	(
-		.clk(ACLK),
-		.write_en(hRES_write_en),
-		.write_address(hRES_write_address),
-		.write_data_in(hRES_write_data_in),
-		.read_en(hRES_read_en),    
-		.read_address(hRES_read_address),
-		.read_data_out(hRES_read_data_out)
-	);
-										
-	memory_RAM 
-	#(
-		.width(width), 
-		.depth_bits(RES_depth_bits)
-	) RES_RAM 
-	(
-		.clk(ACLK),
-		.write_en(RES_write_en),
-		.write_address(RES_write_address),
-		.write_data_in(RES_write_data_in),
-		.read_en(RES_read_en),    
-		.read_address(RES_read_address),
-		.read_data_out(RES_read_data_out)
-	);
-										
-	hid_layer 
-	#(
-		.width(width), 
-		.X_depth_bits(X_depth_bits), 
-		.whid_depth_bits(whid_depth_bits),
-		.sigm_depth_bits(sigm_depth_bits),
-		.hRES_depth_bits(hRES_depth_bits) 
-	) hid_layer
-	(									
-		.clk(ACLK),
-		.Start(Start_whid),
-		.Done(Done_whid),
-		
-		.X_read_en(X_read_en),
-		.X_read_address(X_read_address),
-		.X_read_data_out(X_read_data_out),
-		
-		.whid_read_en(whid_read_en),
-		.whid_read_address(whid_read_address),
-		.whid_read_data_out(whid_read_data_out),
-		
-		.sigm_read_en(sigm_read_en),
-		.sigm_read_address(sigm_read_address),
-		.sigm_read_data_out(sigm_read_data_out),
-		
-		.hRES_write_en(hRES_write_en),
-		.hRES_write_address(hRES_write_address),
-		.hRES_write_data_in(hRES_write_data_in)
-	);
+	assign Done_whid = &(whid_done_lanes | Done_whid_lanes);
+	assign Done_wout = &(wout_done_lanes | Done_wout_lanes);
 
-	predictor
-	#(
-		.width(width), 
-		.wout_depth_bits(wout_depth_bits), 
-		.hRES_depth_bits(hRES_depth_bits),
-		.RES_depth_bits(RES_depth_bits) 
-	) predictor
-	(									
-		.clk(ACLK),
-		.Start(Start_wout),
-		.Done(Done_wout),
-		
-		.wout_read_en(wout_read_en),
-		.wout_read_address(wout_read_address),
-		.wout_read_data_out(wout_read_data_out),
-
-		.hRES_read_en(hRES_read_en),
-		.hRES_read_address(hRES_read_address),
-		.hRES_read_data_out(hRES_read_data_out),
-
-		.RES_write_en(RES_write_en),
-		.RES_write_address(RES_write_address),
-		.RES_write_data_in(RES_write_data_in)
-	);
+	genvar k;
+	generate
+	for (k = 0; k < NUM_LANES; k = k+1)
+	begin : lane
+		wire	X_read_en;
+		wire	[lane_X_depth_bits-X_row_bits-1:0] X_read_address;	// Row of the lane.
+		wire	[width*X_row-1:0] X_read_data_out;		// Whole row.
+		wire	whid_read_en;
+		wire	[whid_depth_bits-1:0] whid_read_address;
+		wire	wout_read_en;
+		wire	[wout_depth_bits-1:0] wout_read_address;
+		wire	sigm_read_en;
+		wire	[sigm_depth_bits-1:0] sigm_read_address;
+		wire	[width-1:0] sigm_read_data_out;
+		wire	[sigm_depth_bits-1:0] sigm2_read_address;	// Second copy of sigm_RAM, one per hidden neuron.
+		wire	[width-1:0] sigm2_read_data_out;
+		wire	hRES_write_en;
+		wire	[hRES_depth_bits-lanes_bits-1:0] hRES_write_address;
+		wire	[width*2-1:0] hRES_write_data_in;		// Both hidden neurons of a row.
+		wire	hRES_write_last;						// Last row of a CMD_STREAM_ROWS batch.
+		wire 	hRES_read_en;
+		wire	[hRES_depth_bits-lanes_bits-1:0] hRES_read_address;
+		wire	[width*2-1:0] hRES_read_data_out;
+		wire	hRES_ready;								// Room for the rows in the hid_layer pipeline.
+		wire	hRES_stream_valid;
+		wire	[width*2-1:0] hRES_stream_data;
+		wire	hRES_stream_last;
+		wire	hRES_stream_read_en;
+		wire	X_FIFO_empty;
+		wire	X_stream_last;
+		wire	[width*X_row-1:0] X_stream_data;
+		wire	X_stream_read_en;
+		wire	RES_write_en;
+		wire	[lane_RES_depth_bits-1:0] RES_write_address;
+		wire	[width-1:0] RES_write_data_in;
+		wire	RES_write_last;
+
+		banked_RAM
+		#(
+			.width(width),
+			.depth_bits(lane_X_depth_bits+1),
+			.lanes_bits(X_row_bits)
+		) X_RAM
+		(
+			.clk(ACLK),
+			.write_en((X_write_lane == k) ? X_write_en : {X_row{1'b0}}),
+			.write_address(X_write_address),
+			.write_data_in(X_write_data_in),
+			.read_en(X_read_en),
+			.read_address({cmp_bank, X_read_address}),
+			.read_data_out(X_read_data_out)
+		);
+
+		if (SIGM_MODE == 0)
+		begin : sigm_tables
+			memory_RAM 
+			#(
+				.width(width), 
+				.depth_bits(sigm_depth_bits)
+			) sigm_RAM 
+			(
+				.clk(ACLK),
+				.write_en(sigm_write_en),
+				.write_address(sigm_write_address),
+				.write_data_in(sigm_write_data_in),
+				.read_en(sigm_read_en),    
+				.read_address(sigm_read_address),
+				.read_data_out(sigm_read_data_out)
+			);
+
+			// second copy of sigm_RAM, written together with it, so that hid_layer looks up both neurons in one clock
+			memory_RAM
+			#(
+				.width(width),
+				.depth_bits(sigm_depth_bits)
+			) sigm2_RAM
+			(
+				.clk(ACLK),
+				.write_en(sigm_write_en),
+				.write_address(sigm_write_address),
+				.write_data_in(sigm_write_data_in),
+				.read_en(sigm_read_en),
+				.read_address(sigm2_read_address),
+				.read_data_out(sigm2_read_data_out)
+			);
+		end
+		else
+		begin : sigm_builtin
+			// hid_layer does not read the sigm_read_* ports
+			assign sigm_read_data_out = 0;
+			assign sigm2_read_data_out = 0;
+		end
+
+		if (hid_stream)
+		begin : hRES_stream
+			wire hRES_FIFO_empty;
+			wire [hRES_FIFO_depth_bits:0] hRES_FIFO_count;
+			stream_FIFO
+			#(
+				.width(width*2+1),
+				.depth_bits(hRES_FIFO_depth_bits)
+			) hRES_FIFO
+			(
+				.clk(ACLK),
+				.reset(!ARESETN),
+				.write_en(hRES_write_en),
+				.write_data_in({hRES_write_last, hRES_write_data_in}),
+				.read_en(hRES_stream_read_en),
+				.read_data_out({hRES_stream_last, hRES_stream_data}),
+				.empty(hRES_FIFO_empty),
+				.count(hRES_FIFO_count)
+			);
+			assign hRES_stream_valid = ~hRES_FIFO_empty;
+			assign hRES_ready = (hRES_FIFO_count <= 2**hRES_FIFO_depth_bits-8);
+			assign hRES_read_data_out = 0;
+		end
+		else
+		begin : hRES_memory
+			memory_RAM 
+			#(
+				.width(width*2), 
+				.depth_bits(hRES_depth_bits-lanes_bits)
+			) hRES_RAM 
+			(
+				.clk(ACLK),
+				.write_en(hRES_write_en),
+				.write_address(hRES_write_address),
+				.write_data_in(hRES_write_data_in),
+				.read_en(hRES_read_en),    
+				.read_address(hRES_read_address),
+				.read_data_out(hRES_read_data_out)
+			);
+			assign hRES_stream_valid = 0;
+			assign hRES_stream_data = 0;
+			assign hRES_stream_last = 0;
+			assign hRES_ready = 1;
+		end
+
+		// CMD_STREAM_ROWS : rows of X to hid_layer, and results from predictor
+		stream_FIFO
+		#(
+			.width(width*X_row+1),
+			.depth_bits(stream_FIFO_depth_bits)
+		) X_FIFO
+		(
+			.clk(ACLK),
+			.reset(!ARESETN),
+			.write_en(X_row_write_en),
+			.write_data_in({X_row_write_last, X_row_write_data_in[width*X_row*k +: width*X_row]}),
+			.read_en(X_stream_read_en),
+			.read_data_out({X_stream_last, X_stream_data}),
+			.empty(X_FIFO_empty),
+			.count()
+		);
+
+		stream_FIFO
+		#(
+			.width(width+1),
+			.depth_bits(stream_FIFO_depth_bits)
+		) RES_FIFO
+		(
+			.clk(ACLK),
+			.reset(!ARESETN),
+			.write_en(RES_write_en && stream_run),
+			.write_data_in({RES_write_last, RES_write_data_in}),
+			.read_en(RES_FIFO_read_en_lanes[k]),
+			.read_data_out(RES_FIFO_data_lanes[(width+1)*k +: width+1]),
+			.empty(RES_FIFO_empty_lanes[k]),
+			.count()
+		);
+
+		dual_port_RAM 
+		#(
+			.width(width), 
+			.depth_bits(lane_RES_depth_bits+1)
+		) RES_RAM 
+		(
+			.clk(ACLK),
+			.write_en(RES_write_en && ~stream_run),
+			.write_address({cmp_bank, RES_write_address}),
+			.write_data_in(RES_write_data_in),
+			.read_en(RES_read_en),    
+			.read_address({out_bank, RES_read_address}),
+			.read_data_out(RES_read_data_lanes[width*k +: width])
+		);
+
+		hid_layer 
+		#(
+			.width(width), 
+			.X_depth_bits(lane_X_depth_bits), 
+			.X_row_bits(X_row_bits),
+			.whid_depth_bits(whid_depth_bits),
+			.sigm_depth_bits(sigm_depth_bits),
+			.hRES_depth_bits(hRES_depth_bits-lanes_bits),
+			.mults(hid_mults),
+			.zero_skip(HID_ZERO_SKIP),
+			.sigm_mode(SIGM_MODE),
+			.sigm_pwl_step_bits(SIGM_PWL_STEP_BITS)
+		) hid_layer
+		(									
+			.clk(ACLK),
+			.Start(Start_whid && ~whid_done_lanes[k]),
+			.Done(Done_whid_lanes[k]),
+			
+			.X_read_en(X_read_en),
+			.X_read_address(X_read_address),
+			.X_read_data_out(X_read_data_out),
+
+			.stream_rows(stream_run),
+			.X_stream_valid(~X_FIFO_empty),
+			.X_stream_data(X_stream_data),
+			.X_stream_last(X_stream_last),
+			.X_stream_read_en(X_stream_read_en),
+			
+			.whid_read_en(whid_read_en),
+			.whid_read_address(whid_read_address),
+			.whid_read_data_out(whid_read_data_out),
+			
+			.sigm_read_en(sigm_read_en),
+			.sigm_read_address(sigm_read_address),
+			.sigm_read_data_out(sigm_read_data_out),
+			.sigm2_read_address(sigm2_read_address),
+			.sigm2_read_data_out(sigm2_read_data_out),
+			
+			.hRES_ready(hRES_ready),
+			.hRES_write_en(hRES_write_en),
+			.hRES_write_address(hRES_write_address),
+			.hRES_write_data_in(hRES_write_data_in),
+			.hRES_write_last(hRES_write_last)
+		);
+
+		predictor
+		#(
+			.width(width), 
+			.wout_depth_bits(wout_depth_bits), 
+			.hRES_depth_bits(hRES_depth_bits-lanes_bits),
+			.RES_depth_bits(lane_RES_depth_bits),
+			.stream_in(hid_stream),
+			.threshold_bits(LABEL_THRESHOLD_BITS)
+		) predictor
+		(									
+			.clk(ACLK),
+			.Start(Start_wout && ~wout_done_lanes[k]),
+			.Done(Done_wout_lanes[k]),
+			
+			.wout_read_en(wout_read_en),
+			.wout_read_address(wout_read_address),
+			.wout_read_data_out(wout_read_data_out),
+
+			.hRES_read_en(hRES_read_en),
+			.hRES_read_address(hRES_read_address),
+			.hRES_read_data_out(hRES_read_data_out),
+
+			.hRES_stream_valid(hRES_stream_valid),
+			.hRES_stream_data(hRES_stream_data),
+			.hRES_stream_last(hRES_stream_last),
+			.hRES_stream_read_en(hRES_stream_read_en),
+			.stream_rows(stream_run),
+			.labels(cmp_labels),
+			.threshold(cmp_threshold),
+
+			.RES_write_en(RES_write_en),
+			.RES_write_address(RES_write_address),
+			.RES_write_data_in(RES_write_data_in),
+			.RES_write_last(RES_write_last)
+		);
+	end
+	endgenerate
+
+	// lane 0 reads whid_RAM and wout_RAM for all lanes
+	assign whid_read_en = lane[0].whid_read_en;
+	assign whid_read_address = lane[0].whid_read_address;
+	assign wout_read_en = lane[0].wout_read_en;
+	assign wout_read_address = lane[0].wout_read_address;
 
 endmodule
 
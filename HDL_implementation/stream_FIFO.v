@@ -0,0 +1,50 @@
+`timescale 1ns / 1ps
+// Synchronous first-word-fall-through FIFO
+// read_data_out is the oldest word whenever empty is low; read_en removes it at the clock edge.
+// count is the number of words held, so that the writer can stop early enough for the words it has in flight.
+
+module stream_FIFO
+	#(
+		parameter width = 16, 					// width is the number of bits per location
+		parameter depth_bits = 4				// 2^depth_bits locations
+	)
+	(
+		input clk,
+		input reset,							// synchronous, empties the FIFO
+		input write_en,
+		input [width-1:0] write_data_in,
+		input read_en,
+		output [width-1:0] read_data_out,
+		output empty,
+		output reg [depth_bits:0] count = 0
+	);
+
+reg [width-1:0] FIFO [0:2**depth_bits-1];
+reg [depth_bits-1:0] write_address = 0;
+reg [depth_bits-1:0] read_address = 0;
+
+assign read_data_out = FIFO[read_address];
+assign empty = (count == 0);
+
+always @(posedge clk)
+begin
+	if (reset)
+	begin
+		write_address <= 0;
+		read_address <= 0;
+		count <= 0;
+	end
+	else
+	begin
+		if (write_en)
+		begin
+			FIFO[write_address] <= write_data_in;
+			write_address <= write_address + 1;
+		end
+		if (read_en && !empty)
+			read_address <= read_address + 1;
+		count <= count + (write_en ? 1 : 0) - ((read_en && !empty) ? 1 : 0);
+	end
+end
+
+endmodule
@@ -0,0 +1,117 @@
+`timescale 1ns / 1ps
+// RTL backend of hls_code/diff_bench_HLS.cpp : runs the stream of diff_bench_input.mem through simple_ML_IP_v1_0
+// and writes the output words to diff_bench_rtl.mem, one hex word per line, then "// cycles <n>" : the clocks from
+// the first input word taken to the last output word taken.
+// diff_bench_input.mem : the number of stream words, then the stream (header, model, X), one hex word per line.
+// TVALID and TREADY are always high, so the cycles are those of the coprocessor alone.
+// The IP is built with TELEMETRY = 1 : a header with CMD_TELEMETRY gets the counter trailer after the results, written
+// to diff_bench_rtl.mem as they are.
+// e.g. iverilog -o tb_diff_bench tb_diff_bench.v simple_ML_IP.v hid_layer_v1_0.v predictor.v memory_RAM.v B_RAM.v
+//      banked_RAM.v dual_port_RAM.v stream_FIFO.v && vvp tb_diff_bench
+
+module tb_diff_bench
+	#(
+		parameter NUM_LANES = 1,
+		parameter SIGM_MODE = 0,
+		parameter HID_MULTS = 16,
+		parameter HID_ZERO_SKIP = 0,
+		parameter TELEMETRY = 1,
+		parameter MAX_WORDS = 1 << 20	// stream words of diff_bench_input.mem, at most
+	)
+	(
+
+	);
+
+	reg                          ACLK = 0;
+	reg                          ARESETN;
+	wire                         S_AXIS_TREADY;
+	reg      [31 : 0]            S_AXIS_TDATA;
+	reg                          S_AXIS_TLAST;
+	reg                          S_AXIS_TVALID;
+	wire                         M_AXIS_TVALID;
+	wire     [31 : 0]            M_AXIS_TDATA;
+	wire                         M_AXIS_TLAST;
+	reg                          M_AXIS_TREADY;
+
+	simple_ML_IP_v1_0 #(.NUM_LANES(NUM_LANES), .SIGM_MODE(SIGM_MODE), .HID_MULTS(HID_MULTS), .HID_ZERO_SKIP(HID_ZERO_SKIP), .TELEMETRY(TELEMETRY)) U1 (
+				.ACLK(ACLK),
+				.ARESETN(ARESETN),
+				.S_AXIS_TREADY(S_AXIS_TREADY),
+				.S_AXIS_TDATA(S_AXIS_TDATA),
+				.S_AXIS_TLAST(S_AXIS_TLAST),
+				.S_AXIS_TVALID(S_AXIS_TVALID),
+				.M_AXIS_TVALID(M_AXIS_TVALID),
+				.M_AXIS_TDATA(M_AXIS_TDATA),
+				.M_AXIS_TLAST(M_AXIS_TLAST),
+				.M_AXIS_TREADY(M_AXIS_TREADY)
+	);
+
+	reg [31:0] input_memory [0:MAX_WORDS];	// the count, then the stream
+	integer words, word_cnt, out_words, out_file;
+	integer cycles = 0;
+	reg counting = 1'b0, done = 1'b0;
+
+	always
+		#50 ACLK = ~ACLK;
+
+	always@(posedge ACLK)
+		if(counting)
+			cycles <= cycles + 1;
+
+	initial
+	begin
+		$readmemh("diff_bench_input.mem", input_memory);
+		words = input_memory[0];
+		out_file = $fopen("diff_bench_rtl.mem", "w");
+		#25
+		ARESETN = 1'b0;
+		S_AXIS_TVALID = 1'b0;
+		S_AXIS_TLAST = 1'b0;
+		M_AXIS_TREADY = 1'b0;
+		#100
+		ARESETN = 1'b1;
+
+		fork
+			begin
+				// input : one word per clock while S_AXIS_TREADY is high, TLAST on the last one
+				word_cnt = 0;
+				S_AXIS_TVALID = 1'b1;
+				while(word_cnt < words)
+				begin
+					if(S_AXIS_TREADY)
+					begin
+						S_AXIS_TDATA = input_memory[1+word_cnt];
+						S_AXIS_TLAST = (word_cnt == words-1);
+						word_cnt = word_cnt+1;
+						counting = 1'b1;
+					end
+					#100;
+				end
+				S_AXIS_TVALID = 1'b0;
+				S_AXIS_TLAST = 1'b0;
+			end
+			begin
+				// output : every word until the one with TLAST
+				out_words = 0;
+				M_AXIS_TREADY = 1'b1;
+				while(!done)
+				begin
+					if(M_AXIS_TVALID && M_AXIS_TREADY)
+					begin
+						$fwrite(out_file, "%h\n", M_AXIS_TDATA);
+						out_words = out_words+1;
+						done = M_AXIS_TLAST;
+					end
+					#100;
+				end
+				M_AXIS_TREADY = 1'b0;
+				counting = 1'b0;
+			end
+		join
+		$fwrite(out_file, "// cycles %0d\n", cycles);
+		$fclose(out_file);
+		$display("%0d input words, %0d output words in %0d cycles.", words, out_words, cycles);
+		$finish;
+	end
+
+endmodule
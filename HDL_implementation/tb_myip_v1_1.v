@@ -16,7 +16,47 @@
 */
 
 
-module tb_myip_v1_1(
+// Run with NUM_LANES = 1, 2 and 4 (e.g. xelab -generic_top "NUM_LANES=2", or iverilog -P tb_myip_v1_1.NUM_LANES=2).
+// Every run checks against the same results, so they are the same for any number of lanes; the cycle counts are printed.
+// SIGM_MODE 1 / 2 (built-in sigmoid) leaves the sigm words out of the model. sigmoid.mem is the sigm of test_input.mem,
+// so SIGM_MODE 1 gives the same results. SIGM_MODE 2 approximates it, so test case 0 is not checked against labels.mem.
+// Every result is also checked against the reference model of the tb (model_result), in all modes.
+// Zero skipping : run HID_MULTS = 2 (8 passes per row) with HID_ZERO_SKIP = 0 and 1, each with NUM_LANES = 1, 2 and 4,
+// and compare the clocks in the hidden layer of the sparse batch. The checksums must be the same. The sparse batch has
+// all 0 rows in lane 0 (rows r % 4 == 0), so with HID_ZERO_SKIP = 1 lane 0 is done long before the other lanes.
+// TELEMETRY = 1 : the counter trailer of two CMD_TELEMETRY batches is checked, and the counters of one batch printed.
+// Clocks of the state machines (NUM_LANES = 1, HID_MULTS = 16 unless said otherwise), as printed by the runs in logs/
+// (tb_myip_v1_1_<parameters>.log, tb_myip_v1_1.log with the defaults) :
+//   test cases 0 to 2 : 16 (weights) + 64 (rows) + 6 (pipeline) = 86 clocks in the hidden layer, 89 computing
+//   HID_MULTS = 2, 4 and 8 : 16 + 64*16/HID_MULTS + 6 = 534, 278 and 150 clocks in the hidden layer
+//   NUM_LANES = 2 and 4 : 16 + 64/NUM_LANES + 6 = 54 and 38 clocks in the hidden layer (57 and 41 computing), and the
+//   results checksum of NUM_LANES = 1, 36276085
+//   SIGM_MODE = 1 and 2 : the clocks of SIGM_MODE = 0. Results checksum 36276085 with SIGM_MODE = 1, a7e76be5 with
+//   SIGM_MODE = 2 (NUM_LANES = 1 and 4), each result being that of model_result
+//   16 back-to-back batches, M_AXIS_TREADY low 1 clock in 4 : 8208 input words in 8419 cycles (0.97 words per cycle),
+//   1424 of them computing. HID_MULTS = 2 : 9212 cycles (0.89), the 534 clocks of a batch in the hidden layer being
+//   more than its 513 input words
+//   output of a test case : 64 words in 66 cycles with M_AXIS_TREADY high and results pending (128 before prefetch)
+//   output of the back-to-back batches, M_AXIS_TREADY low 1 clock in 4 : 1024 words in 1043 cycles with it high and
+//   results pending (0.98 words per cycle)
+//   CMD_STREAM_ROWS batches, S_AXIS_TVALID and M_AXIS_TREADY low 1 clock in 4 : 0.73 to 0.75 input words per cycle for
+//   any NUM_LANES with HID_MULTS = 16, that is the words offered
+//   HID_MULTS = 2, HID_ZERO_SKIP = 0 : 16 + 64/NUM_LANES*8 + 6 clocks in the hidden layer, 534, 278 and 150 clocks
+//   for NUM_LANES = 1, 2 and 4
+//   HID_MULTS = 2, HID_ZERO_SKIP = 1 : 419, 276 and 150 clocks in the hidden layer for the sparse batch with
+//   NUM_LANES = 1, 2 and 4, and 531, 277 and 150 for the test cases, with the same checksum. The 0 rows are all in
+//   lane 0, so with more lanes the layer waits for the other lanes and zero skipping saves almost nothing
+//   TELEMETRY = 1 : the trailer of a batch of test case 1 gives 704 clocks, input stalls 1 / 0, output stalls 25,
+//   hid_layer 86 and predictor 89 clocks (663, 1 / 0, 33, 38 and 41 with NUM_LANES = 4)
+module tb_myip_v1_1
+	#(
+		parameter NUM_LANES = 1,
+		parameter SIGM_MODE = 0,
+		parameter HID_MULTS = 16,
+		parameter HID_ZERO_SKIP = 0,
+		parameter TELEMETRY = 0
+	)
+	(
 
     );
     
@@ -31,10 +71,9 @@ module tb_myip_v1_1(
     wire                         M_AXIS_TVALID;  // Data out is valid
     wire     [31 : 0]            M_AXIS_TDATA;   // Data out
     wire                         M_AXIS_TLAST;   // Optional data out qualifier
-    wire                         M_AXIS_TLAST;   // Optional data out qualifier
     reg                          M_AXIS_TREADY;  // Connected slave device is ready to accept data out
     
-    simple_ML_IP_v1_0 U1 ( 
+    simple_ML_IP_v1_0 #(.NUM_LANES(NUM_LANES), .SIGM_MODE(SIGM_MODE), .HID_MULTS(HID_MULTS), .HID_ZERO_SKIP(HID_ZERO_SKIP), .TELEMETRY(TELEMETRY)) U1 ( 
                 .ACLK(ACLK),
                 .ARESETN(ARESETN),
                 .S_AXIS_TREADY(S_AXIS_TREADY),
@@ -47,29 +86,173 @@ module tb_myip_v1_1(
                 .M_AXIS_TREADY(M_AXIS_TREADY)
 	);
 	
-	localparam NUMBER_OF_INPUT_WORDS  = 723;  // length of an input vector
+	localparam NUMBER_OF_FILE_WORDS  = 723;  // test_input.mem : X (64x7), whid (8x2), wout (3x1), sigm (256)
+	localparam NUMBER_OF_INPUT_WORDS  = 788;  // length of an input vector with CMD_LOAD_MODEL : header, whid, wout, sigm (SIGM_MODE 0), X (64x8)
+	localparam NUMBER_OF_INFER_WORDS  = 513;  // length of an input vector with CMD_INFER_ONLY : header, X (64x8)
 	localparam NUMBER_OF_OUTPUT_WORDS  = 64;  // length of an output vector
-	localparam NUMBER_OF_TEST_VECTORS  = 1;  // number of such test vectors (cases)
+	localparam NUMBER_OF_TEST_VECTORS  = 3;  // number of such test vectors (cases). Case 0 loads the model, case 1 reuses it, case 2 reuses it with packed X and results
 	localparam width  = 8;  // width of an input vector
+	localparam CMD_INFER_ONLY = 0;
+	localparam CMD_LOAD_MODEL = 1;
+	localparam CMD_PACKED = 4;
+	localparam CMD_LABELS = 8;  // labels (result > header bits 31:16, signed), 32 per output word
+	localparam DATA_THRESHOLD = 39;  // labels.mem is (result > 39) for the rows of test_input.mem
+	localparam PACKED_TEST_VECTOR = 2;
+	localparam NUMBER_OF_B2B_BATCHES = 16;  // batches of test case 1 sent back-to-back at the end, while the results are received
+	localparam CMD_STREAM_ROWS = 2;
+	localparam NUMBER_OF_STREAM_ROWS = 201;  // rows of a CMD_STREAM_ROWS batch (the rows of test case 1 over and over), more than X_RAM holds
+	localparam CMD_TELEMETRY = 16;
+	localparam TELEMETRY_WORDS = 8;  // trailer of a CMD_TELEMETRY batch : magic, clocks, input stalls (no TREADY, no TVALID), output stalls, hid_layer, predictor, headers
+	localparam TELEMETRY_MAGIC = 32'h544C4D01;
 	          
-	reg [width-1:0] test_input_memory [0:NUMBER_OF_TEST_VECTORS*NUMBER_OF_INPUT_WORDS-1]; // 4 inputs * 2
+	reg [width-1:0] test_input_memory [0:NUMBER_OF_FILE_WORDS-1];
+	reg [31:0] stream_memory [0:NUMBER_OF_TEST_VECTORS*NUMBER_OF_INPUT_WORDS-1]; // words sent to the coprocessor for each test case
+	integer stream_length [0:NUMBER_OF_TEST_VECTORS-1];
 	reg [width-1:0] test_result_expected_memory [0:NUMBER_OF_TEST_VECTORS*NUMBER_OF_OUTPUT_WORDS-1]; // 4 outputs *2
 	reg [width-1:0] result_memory [0:NUMBER_OF_TEST_VECTORS*NUMBER_OF_OUTPUT_WORDS-1]; // same size as test_result_expected_memory
 	
-	integer word_cnt, test_case_cnt;
+	integer word_cnt, test_case_cnt, row, col, base, lane;
+	integer batch_in, batch_out, res_cnt, b2b_words, stream_packed, model_words, next_cnt, label_case, threshold;
+	reg [31:0] checksum;
+	reg [31:0] telemetry [0:2*TELEMETRY_WORDS-1];	// trailers of the two CMD_TELEMETRY batches
+	reg [31:0] zero_result;	// result of an all 0 row (sparse batch)
+	integer saturated;		// rows whose result is above 255 (saturation)
 	reg success = 1'b1;
+	reg held;	// S_AXIS word not taken yet
     reg M_AXIS_TLAST_prev = 1'b0;
+
+	// Reference model (MLP_Forward of c_code) : the result of a row {x7, ..., x1, 1} with the model of model_whid,
+	// model_wout and the sigm of test_input.mem, not saturated. With SIGM_MODE 2, sigm is linear between every
+	// SIGM_PWL_STEP-th entry, as in sigm_lookup of hid_layer.
+	localparam SIGM_PWL_STEP_BITS = 4;	// as in simple_ML_IP
+	localparam SIGM_PWL_STEP = 2**SIGM_PWL_STEP_BITS;
+	integer model_whid [0:15];
+	integer model_wout [0:2];
+
+	function integer model_sigm;
+		input integer index;	// sum >> 8
+		integer entry, knot, next, low, high;
+		begin
+			entry = (index > 255) ? 255 : index;
+			knot = entry/SIGM_PWL_STEP*SIGM_PWL_STEP;
+			next = (knot+SIGM_PWL_STEP > 255) ? 255 : knot+SIGM_PWL_STEP;
+			low = test_input_memory[467+knot];
+			high = test_input_memory[467+next];
+			if(SIGM_MODE == 2)
+				model_sigm = (low + (((high-low)*(entry-knot)) >>> SIGM_PWL_STEP_BITS)) & 255;
+			else
+				model_sigm = test_input_memory[467+entry];
+		end
+	endfunction
+
+	function integer model_result;
+		input [8*width-1:0] x;	// value k of the row in bits [width*k +: width]
+		integer k, sum_1, sum_2;
+		begin
+			sum_1 = 0;
+			sum_2 = 0;
+			for(k=0; k < 8; k=k+1)
+			begin
+				sum_1 = sum_1 + x[width*k +: width]*model_whid[2*k];
+				sum_2 = sum_2 + x[width*k +: width]*model_whid[2*k+1];
+			end
+			model_result = (model_wout[0] + model_sigm(sum_1 >> 8)*model_wout[1] + model_sigm(sum_2 >> 8)*model_wout[2]) >> 8;
+		end
+	endfunction
+
+	// result word of a row, saturated to 8 bits as in predictor
+	function integer model_output;
+		input [8*width-1:0] x;
+		begin
+			model_output = model_result(x);
+			if(model_output > 255)
+				model_output = 255;
+		end
+	endfunction
+
+	// row r of test_input.mem, with the leading 1
+	function [8*width-1:0] model_row;
+		input integer r;
+		integer k;
+		begin
+			model_row = 1;
+			for(k=0; k < 7; k=k+1)
+				model_row[width*(k+1) +: width] = test_input_memory[r*7+k];
+		end
+	endfunction
 	
 	always@(posedge ACLK)
 		M_AXIS_TLAST_prev <= M_AXIS_TLAST;    
+
+	// cycle counts of the current test case : from the first input word to the last output word,
+	// with the hidden layer or the predictor started, and with the hidden layer started
+	// Output throughput : words sent, against the clocks with M_AXIS_TREADY high while the coprocessor had results to send.
+	integer cycles_total = 0, cycles_compute = 0, cycles_hid = 0, out_beats = 0, out_ready_cycles = 0;
+	reg counting = 1'b0;
+	always@(posedge ACLK)
+	begin
+		if(counting)
+			cycles_total <= cycles_total + 1;
+		if(M_AXIS_TVALID && M_AXIS_TREADY)
+			out_beats <= out_beats + 1;
+		if(M_AXIS_TREADY && (U1.RES_full != 0 || U1.out_count != 0))
+			out_ready_cycles <= out_ready_cycles + 1;
+		if(U1.Start_whid || U1.Start_wout)
+			cycles_compute <= cycles_compute + 1;
+		if(U1.Start_whid)
+			cycles_hid <= cycles_hid + 1;
+	end
 		  
 	always
 		#50 ACLK = ~ACLK;
              
            initial
            begin
-               	$display("Loading Memory.");
+               	$display("Loading Memory. NUM_LANES = %0d, SIGM_MODE = %0d, HID_MULTS = %0d, HID_ZERO_SKIP = %0d.",
+               			NUM_LANES, SIGM_MODE, HID_MULTS, HID_ZERO_SKIP);
         		$readmemh("test_input.mem", test_input_memory); // v2: add the .mem file to the project or specify the complete path
+        		for(col=0; col < 16; col=col+1)
+        			model_whid[col] = test_input_memory[448+col];
+        		for(col=0; col < 3; col=col+1)
+        			model_wout[col] = test_input_memory[464+col];
+        		// build the streams : the header word, the model (only for CMD_LOAD_MODEL), then X with a leading column of 1s for the bias
+        		for(test_case_cnt=0; test_case_cnt < NUMBER_OF_TEST_VECTORS; test_case_cnt=test_case_cnt+1)
+        		begin
+        			base = test_case_cnt*NUMBER_OF_INPUT_WORDS;
+        			word_cnt = 1;
+        			if(test_case_cnt == 0)
+        			begin
+        				stream_memory[base] = CMD_LOAD_MODEL;
+        				for(col=448; col < NUMBER_OF_FILE_WORDS-((SIGM_MODE == 0) ? 0 : 256); col=col+1)
+        				begin
+        					stream_memory[base+word_cnt] = test_input_memory[col];
+        					word_cnt = word_cnt+1;
+        				end
+        			end
+        			else if(test_case_cnt == PACKED_TEST_VECTOR)
+        				stream_memory[base] = CMD_INFER_ONLY | CMD_PACKED;
+        			else
+        				stream_memory[base] = CMD_INFER_ONLY;
+        			for(row=0; row < NUMBER_OF_OUTPUT_WORDS; row=row+1)
+        			begin
+        				stream_memory[base+word_cnt] = 1;
+        				word_cnt = word_cnt+1;
+        				for(col=0; col < 7; col=col+1)
+        				begin
+        					stream_memory[base+word_cnt] = test_input_memory[row*7+col];
+        					word_cnt = word_cnt+1;
+        				end
+        			end
+        			if(test_case_cnt == PACKED_TEST_VECTOR)
+        			begin
+        				// pack X 4 values per word, first value in bits 7:0
+        				for(col=0; col < (word_cnt-1)/4; col=col+1)
+        					stream_memory[base+1+col] = {stream_memory[base+1+col*4+3][7:0], stream_memory[base+1+col*4+2][7:0],
+        												 stream_memory[base+1+col*4+1][7:0], stream_memory[base+1+col*4][7:0]};
+        				word_cnt = 1+(word_cnt-1)/4;
+        			end
+        			stream_length[test_case_cnt] = word_cnt;
+        		end
         		$readmemh("labels.mem", test_result_expected_memory); // v2 : add the .mem file to the project or specify the complete path
         		#25						//just so that the input data changes at a time which is not a clock edge, to avoid confision
                	ARESETN = 1'b0; 		// apply reset (active low)
@@ -86,13 +269,19 @@ module tb_myip_v1_1(
                	
                	//// Input 
 					word_cnt=0;
+					cycles_total = 0;
+					cycles_compute = 0;
+					cycles_hid = 0;
+					out_beats = 0;
+					out_ready_cycles = 0;
+					counting = 1'b1;
 					S_AXIS_TVALID = 1'b1;   // data is ready at the input of the coprocessor.
-					while(word_cnt < NUMBER_OF_INPUT_WORDS)
+					while(word_cnt < stream_length[test_case_cnt])
 					begin
 						if(S_AXIS_TREADY)	// S_AXIS_TREADY is asserted by the coprocessor in response to S_AXIS_TVALID
 						begin
-							S_AXIS_TDATA = test_input_memory[word_cnt+test_case_cnt*NUMBER_OF_INPUT_WORDS]; // set the next data ready
-							if(word_cnt == NUMBER_OF_INPUT_WORDS)
+							S_AXIS_TDATA = stream_memory[word_cnt+test_case_cnt*NUMBER_OF_INPUT_WORDS]; // set the next data ready
+							if(word_cnt == stream_length[test_case_cnt]-1)
 								S_AXIS_TLAST = 1'b1; 
 							else
 								S_AXIS_TLAST = 1'b0;
@@ -109,7 +298,13 @@ module tb_myip_v1_1(
 					M_AXIS_TREADY = 1'b1;	// we are now ready to receive data
 					while(M_AXIS_TLAST | ~M_AXIS_TLAST_prev) // receive data until the falling edge of M_AXIS_TLAST
 					begin
-						if(M_AXIS_TVALID)
+						if(M_AXIS_TVALID && test_case_cnt == PACKED_TEST_VECTOR)
+						begin
+							for(lane=0; lane < 4; lane=lane+1)
+								result_memory[word_cnt*4+lane+test_case_cnt*NUMBER_OF_OUTPUT_WORDS] = M_AXIS_TDATA[lane*8 +: 8];
+							word_cnt = word_cnt+1;
+						end
+						else if(M_AXIS_TVALID)
 						begin
 							result_memory[word_cnt+test_case_cnt*NUMBER_OF_OUTPUT_WORDS] = M_AXIS_TDATA;
 							word_cnt = word_cnt+1;
@@ -117,11 +312,365 @@ module tb_myip_v1_1(
 						#100;
 					end						// receive loop
 					M_AXIS_TREADY = 1'b0;	// not ready to receive data from the co-processor anymore.				
+					counting = 1'b0;
+					$display("Test case %0d : %0d cycles in total, %0d in Compute, %0d in the hidden layer, %0d output words in %0d cycles.",
+							test_case_cnt, cycles_total, cycles_compute, cycles_hid, out_beats, out_ready_cycles);
 				end							// next test vector
 				
-				// checking correctness of results
+				// back-to-back batches : input, computation and output of consecutive batches overlap.
+				// M_AXIS_TREADY is low at random (1 clock in 4 on average). Every batch must give the results of test case 1.
+				b2b_words = 0;
+				cycles_total = 0;
+				cycles_compute = 0;
+				cycles_hid = 0;
+				out_beats = 0;
+				out_ready_cycles = 0;
+				counting = 1'b1;
+				fork
+					begin
+						S_AXIS_TVALID = 1'b1;
+						for(batch_in=0; batch_in < NUMBER_OF_B2B_BATCHES; batch_in=batch_in+1)
+						begin
+							word_cnt = 0;
+							while(word_cnt < stream_length[1])
+							begin
+								if(S_AXIS_TREADY)	// the word placed now is taken at the next clock edge
+								begin
+									S_AXIS_TDATA = stream_memory[word_cnt+NUMBER_OF_INPUT_WORDS];
+									S_AXIS_TLAST = (word_cnt == stream_length[1]-1);
+									word_cnt = word_cnt+1;
+									b2b_words = b2b_words+1;
+								end
+								#100;
+							end
+						end
+						S_AXIS_TVALID = 1'b0;
+						S_AXIS_TLAST = 1'b0;
+					end
+					begin
+						for(batch_out=0; batch_out < NUMBER_OF_B2B_BATCHES; batch_out=batch_out+1)
+						begin
+							res_cnt = 0;
+							while(res_cnt < NUMBER_OF_OUTPUT_WORDS)
+							begin
+								M_AXIS_TREADY = ($random & 3) != 0;
+								if(M_AXIS_TVALID && M_AXIS_TREADY)	// the word on M_AXIS now is taken at the next clock edge
+								begin
+									success = success & (M_AXIS_TDATA == result_memory[NUMBER_OF_OUTPUT_WORDS+res_cnt]);
+									success = success & (M_AXIS_TLAST == (res_cnt == NUMBER_OF_OUTPUT_WORDS-1));
+									res_cnt = res_cnt+1;
+								end
+								#100;
+							end
+						end
+					end
+				join
+				M_AXIS_TREADY = 1'b0;
+				counting = 1'b0;
+				$display("%0d back-to-back batches : %0d input words in %0d cycles (%0d.%02d words per cycle), %0d cycles computing.",
+						NUMBER_OF_B2B_BATCHES, b2b_words, cycles_total, b2b_words/cycles_total, (b2b_words*100/cycles_total)%100, cycles_compute);
+				$display("Output : %0d words in %0d cycles with M_AXIS_TREADY high and results pending (%0d.%02d words per cycle).",
+						out_beats, out_ready_cycles, out_beats/out_ready_cycles, (out_beats*100/out_ready_cycles)%100);
+
+				// CMD_STREAM_ROWS batches, one value per word, packed, packed with CMD_LABELS (stream_packed = 2), and packed
+				// with CMD_LOAD_MODEL (stream_packed = 3, the model words of test case 0 before X) :
+				// TLAST on the last input word ends the batch, and each result must be the one of the same row in test case 1
+				// (its label : result > DATA_THRESHOLD). S_AXIS_TVALID and M_AXIS_TREADY are low at random.
+				for(stream_packed=0; stream_packed < 4; stream_packed=stream_packed+1)
+				begin
+					cycles_total = 0;
+					out_beats = 0;
+					out_ready_cycles = 0;
+					counting = 1'b1;
+					fork
+						begin
+							held = 1'b0;
+							b2b_words = 0;
+							model_words = (stream_packed == 3) ? stream_length[0]-NUMBER_OF_INFER_WORDS : 0;
+							word_cnt = -1-model_words;	// header, then the model words
+							while(word_cnt < NUMBER_OF_STREAM_ROWS*8)
+							begin
+								// a word placed now is taken at the next clock edge if S_AXIS_TREADY is high (it does not depend on
+								// S_AXIS_TVALID in this clock). One that is not stays until it is.
+								if(~held)
+								begin
+									S_AXIS_TVALID = ($random & 3) != 0;
+									next_cnt = word_cnt+1;
+									if(word_cnt == -1-model_words)
+										S_AXIS_TDATA = ((stream_packed == 3) ? CMD_LOAD_MODEL : CMD_INFER_ONLY) | CMD_STREAM_ROWS | (stream_packed ? CMD_PACKED : 0)
+													   | ((stream_packed == 2) ? (CMD_LABELS | (DATA_THRESHOLD << 16)) : 0);
+									else if(word_cnt < 0)
+										S_AXIS_TDATA = stream_memory[model_words+1+word_cnt];
+									else
+									begin
+										row = word_cnt/8;
+										col = word_cnt%8;
+										base = NUMBER_OF_INPUT_WORDS+1+(row%NUMBER_OF_OUTPUT_WORDS)*8+col;
+										if(stream_packed)
+										begin
+											S_AXIS_TDATA = {stream_memory[base+3][7:0], stream_memory[base+2][7:0], stream_memory[base+1][7:0], stream_memory[base][7:0]};
+											next_cnt = word_cnt+4;
+										end
+										else
+											S_AXIS_TDATA = stream_memory[base];
+									end
+									S_AXIS_TLAST = (next_cnt == NUMBER_OF_STREAM_ROWS*8);
+								end
+								held = S_AXIS_TVALID && ~S_AXIS_TREADY;
+								if(S_AXIS_TVALID && S_AXIS_TREADY)
+								begin
+									word_cnt = next_cnt;
+									b2b_words = b2b_words+1;
+								end
+								#100;
+							end
+							S_AXIS_TVALID = 1'b0;
+							S_AXIS_TLAST = 1'b0;
+						end
+						begin
+							res_cnt = 0;
+							while(res_cnt < NUMBER_OF_STREAM_ROWS)
+							begin
+								M_AXIS_TREADY = ($random & 3) != 0;
+								if(M_AXIS_TVALID && M_AXIS_TREADY)
+								begin
+									for(lane=0; lane < ((stream_packed == 2) ? 32 : stream_packed ? 4 : 1); lane=lane+1)
+										if(res_cnt < NUMBER_OF_STREAM_ROWS && stream_packed == 2)
+										begin
+											success = success & (M_AXIS_TDATA[lane] == (result_memory[NUMBER_OF_OUTPUT_WORDS+res_cnt%NUMBER_OF_OUTPUT_WORDS] > DATA_THRESHOLD));
+											res_cnt = res_cnt+1;
+										end
+										else if(res_cnt < NUMBER_OF_STREAM_ROWS)
+										begin
+											success = success & (M_AXIS_TDATA[lane*8 +: 8] == result_memory[NUMBER_OF_OUTPUT_WORDS+res_cnt%NUMBER_OF_OUTPUT_WORDS]);
+											res_cnt = res_cnt+1;
+										end
+									success = success & (M_AXIS_TLAST == (res_cnt == NUMBER_OF_STREAM_ROWS));
+								end
+								#100;
+							end
+						end
+					join
+					M_AXIS_TREADY = 1'b0;
+					counting = 1'b0;
+					$display("CMD_STREAM_ROWS (packed %0d) : %0d rows, %0d input words in %0d cycles (%0d.%02d words per cycle), %0d output words.",
+							stream_packed, NUMBER_OF_STREAM_ROWS, b2b_words, cycles_total, b2b_words/cycles_total, (b2b_words*100/cycles_total)%100, out_beats);
+				end
+
+				// CMD_LABELS batches of the rows of test case 1, X packed in label_case 1 and 3 : 64 labels in 2 words, with TLAST
+				// on the second. The threshold (header bits 31:16) is signed and compared with the result before it is saturated :
+				// DATA_THRESHOLD (the labels must also be those of labels.mem, not with SIGM_MODE 2), -1 (all 1s), and 295, whose
+				// bits 7:0 are those of DATA_THRESHOLD.
+				for(label_case=0; label_case < 4; label_case=label_case+1)
+				begin
+					threshold = (label_case < 2) ? DATA_THRESHOLD : (label_case == 2) ? -1 : 295;
+					base = (label_case%2) ? PACKED_TEST_VECTOR*NUMBER_OF_INPUT_WORDS : NUMBER_OF_INPUT_WORDS;
+					S_AXIS_TVALID = 1'b1;
+					word_cnt = 0;
+					while(word_cnt < stream_length[(label_case%2) ? PACKED_TEST_VECTOR : 1])
+					begin
+						if(S_AXIS_TREADY)
+						begin
+							S_AXIS_TDATA = (word_cnt == 0) ? (CMD_INFER_ONLY | CMD_LABELS | ((label_case%2) ? CMD_PACKED : 0) | (threshold << 16))
+														   : stream_memory[base+word_cnt];
+							S_AXIS_TLAST = (word_cnt == stream_length[(label_case%2) ? PACKED_TEST_VECTOR : 1]-1);
+							word_cnt = word_cnt+1;
+						end
+						#100;
+					end
+					S_AXIS_TVALID = 1'b0;
+					S_AXIS_TLAST = 1'b0;
+					M_AXIS_TREADY = 1'b1;
+					res_cnt = 0;
+					while(res_cnt < NUMBER_OF_OUTPUT_WORDS)
+					begin
+						if(M_AXIS_TVALID)
+						begin
+							for(lane=0; lane < 32; lane=lane+1)
+								success = success & (M_AXIS_TDATA[lane] == (model_result(model_row(res_cnt+lane)) > threshold))
+												  & (SIGM_MODE == 2 || threshold != DATA_THRESHOLD || M_AXIS_TDATA[lane] == test_result_expected_memory[res_cnt+lane]);
+							res_cnt = res_cnt+32;
+							success = success & (M_AXIS_TLAST == (res_cnt == NUMBER_OF_OUTPUT_WORDS));
+						end
+						#100;
+					end
+					M_AXIS_TREADY = 1'b0;
+					$display("CMD_LABELS (threshold %0d%s) : %0d labels in %0d output words.", threshold, (label_case%2) ? ", packed" : "",
+							NUMBER_OF_OUTPUT_WORDS, NUMBER_OF_OUTPUT_WORDS/32);
+				end
+
+				// Sparse batch : row r is all 0s (but the bias) if r % 4 == 0, else row 63-r of test case 1, so that its result is
+				// not the one left in RES_RAM by the batches before. The other results must be those of test case 1, and the
+				// results of the 0 rows all the same.
+				cycles_total = 0;
+				cycles_hid = 0;
+				counting = 1'b1;
+				S_AXIS_TVALID = 1'b1;
+				word_cnt = 0;
+				while(word_cnt < stream_length[1])
+				begin
+					if(S_AXIS_TREADY)
+					begin
+						row = (word_cnt-1)/8;
+						col = (word_cnt-1)%8;
+						if(word_cnt == 0)
+							S_AXIS_TDATA = CMD_INFER_ONLY;
+						else if(col == 0)
+							S_AXIS_TDATA = 1;
+						else
+							S_AXIS_TDATA = (row%4 == 0) ? 0 : stream_memory[NUMBER_OF_INPUT_WORDS+1+(NUMBER_OF_OUTPUT_WORDS-1-row)*8+col];
+						S_AXIS_TLAST = (word_cnt == stream_length[1]-1);
+						word_cnt = word_cnt+1;
+					end
+					#100;
+				end
+				S_AXIS_TVALID = 1'b0;
+				S_AXIS_TLAST = 1'b0;
+				M_AXIS_TREADY = 1'b1;
+				res_cnt = 0;
+				while(res_cnt < NUMBER_OF_OUTPUT_WORDS)
+				begin
+					if(M_AXIS_TVALID)
+					begin
+						if(res_cnt == 0)
+							zero_result = M_AXIS_TDATA;
+						if(res_cnt%4 == 0)
+							success = success & (M_AXIS_TDATA == zero_result) & (M_AXIS_TDATA == model_output(1));
+						else
+							success = success & (M_AXIS_TDATA == result_memory[NUMBER_OF_OUTPUT_WORDS+NUMBER_OF_OUTPUT_WORDS-1-res_cnt]);
+						res_cnt = res_cnt+1;
+						success = success & (M_AXIS_TLAST == (res_cnt == NUMBER_OF_OUTPUT_WORDS));
+					end
+					#100;
+				end
+				M_AXIS_TREADY = 1'b0;
+				counting = 1'b0;
+				$display("Sparse batch : %0d cycles in total, %0d in the hidden layer.", cycles_total, cycles_hid);
+
+				// TELEMETRY = 1 : two CMD_TELEMETRY batches of the rows of test case 1, M_AXIS_TREADY low at random. Each gives its
+				// results, then the trailer, with TLAST on the last trailer word only. Between the two trailers one header is read,
+				// and the clocks and the clocks of hid_layer and predictor go up.
+				for(batch_in=0; batch_in < 2*TELEMETRY; batch_in=batch_in+1)
+				begin
+					S_AXIS_TVALID = 1'b1;
+					word_cnt = 0;
+					while(word_cnt < stream_length[1])
+					begin
+						if(S_AXIS_TREADY)
+						begin
+							S_AXIS_TDATA = (word_cnt == 0) ? (CMD_INFER_ONLY | CMD_TELEMETRY) : stream_memory[word_cnt+NUMBER_OF_INPUT_WORDS];
+							S_AXIS_TLAST = (word_cnt == stream_length[1]-1);
+							word_cnt = word_cnt+1;
+						end
+						#100;
+					end
+					S_AXIS_TVALID = 1'b0;
+					S_AXIS_TLAST = 1'b0;
+					res_cnt = 0;
+					while(res_cnt < NUMBER_OF_OUTPUT_WORDS+TELEMETRY_WORDS)
+					begin
+						M_AXIS_TREADY = ($random & 3) != 0;
+						if(M_AXIS_TVALID && M_AXIS_TREADY)
+						begin
+							if(res_cnt < NUMBER_OF_OUTPUT_WORDS)
+								success = success & (M_AXIS_TDATA == result_memory[NUMBER_OF_OUTPUT_WORDS+res_cnt]);
+							else
+								telemetry[batch_in*TELEMETRY_WORDS+res_cnt-NUMBER_OF_OUTPUT_WORDS] = M_AXIS_TDATA;
+							res_cnt = res_cnt+1;
+							success = success & (M_AXIS_TLAST == (res_cnt == NUMBER_OF_OUTPUT_WORDS+TELEMETRY_WORDS));
+						end
+						#100;
+					end
+					M_AXIS_TREADY = 1'b0;
+				end
+				if(TELEMETRY)
+				begin
+					success = success & (telemetry[0] == TELEMETRY_MAGIC) & (telemetry[TELEMETRY_WORDS] == TELEMETRY_MAGIC)
+									  & (telemetry[TELEMETRY_WORDS+7] - telemetry[7] == 1) & (telemetry[TELEMETRY_WORDS+1] > telemetry[1])
+									  & (telemetry[TELEMETRY_WORDS+5] > telemetry[5]) & (telemetry[TELEMETRY_WORDS+6] > telemetry[6]);
+					$display("CMD_TELEMETRY : %0d clocks, input stalls %0d (no TREADY) / %0d (no TVALID), output stalls %0d, hid_layer %0d, predictor %0d clocks.",
+							telemetry[TELEMETRY_WORDS+1] - telemetry[1], telemetry[TELEMETRY_WORDS+2] - telemetry[2],
+							telemetry[TELEMETRY_WORDS+3] - telemetry[3], telemetry[TELEMETRY_WORDS+4] - telemetry[4],
+							telemetry[TELEMETRY_WORDS+5] - telemetry[5], telemetry[TELEMETRY_WORDS+6] - telemetry[6]);
+				end
+
+				// Saturation : the model of test case 0 with whid doubled and wout = 255, 255, 255 (CMD_LOAD_MODEL, X packed), then
+				// the same rows one value per word, then their labels above 300 (label_case 0, 1, 2). The results above 255 must
+				// be 255, and the labels those of the results before they are saturated.
+				for(col=0; col < 16; col=col+1)
+					model_whid[col] = 2*test_input_memory[448+col];
+				for(col=0; col < 3; col=col+1)
+					model_wout[col] = 255;
+				model_words = stream_length[0]-NUMBER_OF_INFER_WORDS;
+				saturated = 0;
+				for(label_case=0; label_case < 3; label_case=label_case+1)
+				begin
+					S_AXIS_TVALID = 1'b1;
+					word_cnt = 0;
+					while(word_cnt < ((label_case == 0) ? model_words+stream_length[PACKED_TEST_VECTOR] : stream_length[1]))
+					begin
+						if(S_AXIS_TREADY)
+						begin
+							if(word_cnt == 0)
+								S_AXIS_TDATA = (label_case == 0) ? (CMD_LOAD_MODEL | CMD_PACKED) : (label_case == 1) ? CMD_INFER_ONLY : (CMD_LABELS | (300 << 16));
+							else if(label_case == 0 && word_cnt <= model_words)
+								S_AXIS_TDATA = (word_cnt <= 16) ? model_whid[word_cnt-1] : (word_cnt <= 19) ? model_wout[word_cnt-17] : stream_memory[word_cnt];
+							else if(label_case == 0)
+								S_AXIS_TDATA = stream_memory[PACKED_TEST_VECTOR*NUMBER_OF_INPUT_WORDS+word_cnt-model_words];
+							else
+								S_AXIS_TDATA = stream_memory[NUMBER_OF_INPUT_WORDS+word_cnt];
+							S_AXIS_TLAST = (word_cnt == ((label_case == 0) ? model_words+stream_length[PACKED_TEST_VECTOR] : stream_length[1])-1);
+							word_cnt = word_cnt+1;
+						end
+						#100;
+					end
+					S_AXIS_TVALID = 1'b0;
+					S_AXIS_TLAST = 1'b0;
+					M_AXIS_TREADY = 1'b1;
+					res_cnt = 0;
+					while(res_cnt < NUMBER_OF_OUTPUT_WORDS)
+					begin
+						if(M_AXIS_TVALID)
+						begin
+							for(lane=0; lane < ((label_case == 2) ? 32 : (label_case == 0) ? 4 : 1); lane=lane+1)
+							begin
+								if(label_case == 2)
+									success = success & (M_AXIS_TDATA[lane] == (model_result(model_row(res_cnt)) > 300));
+								else if(label_case == 1)
+									success = success & (M_AXIS_TDATA == model_output(model_row(res_cnt)));
+								else
+									success = success & (M_AXIS_TDATA[lane*8 +: 8] == model_output(model_row(res_cnt)));
+								saturated = saturated + (label_case == 1 && model_result(model_row(res_cnt)) > 255);
+								res_cnt = res_cnt+1;
+							end
+							success = success & (M_AXIS_TLAST == (res_cnt == NUMBER_OF_OUTPUT_WORDS));
+						end
+						#100;
+					end
+					M_AXIS_TREADY = 1'b0;
+				end
+				success = success & (saturated > 0) & (saturated < NUMBER_OF_OUTPUT_WORDS);
+				$display("Saturation : %0d of %0d results above 255.", saturated, NUMBER_OF_OUTPUT_WORDS);
+				for(col=0; col < 16; col=col+1)
+					model_whid[col] = test_input_memory[448+col];
+				for(col=0; col < 3; col=col+1)
+					model_wout[col] = test_input_memory[464+col];
+
+				// checking correctness of results : labels.mem has their labels (result > DATA_THRESHOLD), for the exact
+				// sigmoid (not SIGM_MODE 2)
+				for(word_cnt=0; word_cnt < NUMBER_OF_OUTPUT_WORDS && SIGM_MODE != 2; word_cnt=word_cnt+1)
+						success = success & ((result_memory[word_cnt] > DATA_THRESHOLD) == test_result_expected_memory[word_cnt]);
+				// every result must be the one of the reference model
+				for(word_cnt=0; word_cnt < NUMBER_OF_TEST_VECTORS*NUMBER_OF_OUTPUT_WORDS; word_cnt=word_cnt+1)
+						success = success & (result_memory[word_cnt] == model_output(model_row(word_cnt%NUMBER_OF_OUTPUT_WORDS)));
+				// CMD_INFER_ONLY (packed or not) must give the same outputs as CMD_LOAD_MODEL
+				for(word_cnt=NUMBER_OF_OUTPUT_WORDS; word_cnt < NUMBER_OF_TEST_VECTORS*NUMBER_OF_OUTPUT_WORDS; word_cnt=word_cnt+1)
+						success = success & (result_memory[word_cnt] == result_memory[word_cnt-NUMBER_OF_OUTPUT_WORDS]);
+				// to compare the runs with different NUM_LANES
+				checksum = 0;
 				for(word_cnt=0; word_cnt < NUMBER_OF_TEST_VECTORS*NUMBER_OF_OUTPUT_WORDS; word_cnt=word_cnt+1)
-						success = success & (result_memory[word_cnt] == test_result_expected_memory[word_cnt]);
+					checksum = {checksum[30:0], checksum[31]} ^ result_memory[word_cnt];
+				$display("NUM_LANES = %0d : results checksum %h.", NUM_LANES, checksum);
 				if(success)
 					$display("Test Passed.");
 				else
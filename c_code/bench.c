@@ -0,0 +1,469 @@
+/*
+ * bench.c: Node_Multiply against Node_Multiply_Sparse (zero skipping), and the whole model
+ * with Node_Multiply against MLP_Forward, on the host
+ *
+ * Build and run from c_code (the files are read from the paths given, in ../ by default):
+ *   gcc -O2 -pthread -o bench bench.c node_multiply.c mlp_forward.c mlp_simd.c mlp_batch.c && ./bench [X.csv [w_hid.csv [w_out.csv [sigmoid.csv]]]]
+ *
+ * Real data : the 64 rows of X.csv with both hidden nodes, BENCH_REPEATS times.
+ * Synthetic : BENCH_ROWS random rows with a given share of 0s, with the same weights.
+ * For each, the time and cycle counter ticks per row of both kernels, and the time to compress the rows
+ * (once per data set). The results of both kernels must be the same. Each kernel is run once before it is timed,
+ * and the best of BENCH_TRIES runs is kept.
+ * Sparse    : the whole 7-2-1 model on the synthetic rows, MLP_Forward against Compress_Rows + MLP_Forward_Sparse
+ * (what main.c would do, as X is read once), and the lowest share of 0s from which each sparse kernel was faster
+ * than the dense one at every share tried (SPARSE_MIN_ZEROS in node_multiply.h is the one of Node_Multiply_Sparse).
+ * Model     : the same data through the 7-2-1 model, as main.c did it (Node_Multiply for each hidden node,
+ * the sigmoid, the hidden values copied into one array, Node_Multiply for the output) and with MLP_Forward.
+ * MLP_Forward of the larger 16-8-1 and 64-32-2 shapes is checked against a plain loop on random models.
+ * SIMD      : MLP_Simd_Forward with each instruction set of this CPU on SIMD_ROWS random 8-bit rows (GB/s of X),
+ * and on X.csv and the other shapes, against MLP_Forward.
+ * Batch     : MLP_Batch_Forward of BATCH_ROWS random rows with 1, 2, 4 .. threads (at least up to 4, and up to
+ * the number of CPUs), against MLP_Simd_Forward.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "node_multiply.h"
+#include "mlp_batch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define read_ticks() __rdtsc()			// time stamp counter
+#elif defined(__aarch64__)
+static inline unsigned long long read_ticks(void){
+	unsigned long long t;
+	__asm__ volatile("mrs %0, cntvct_el0" : "=r"(t));	// generic timer, not the CPU clock
+	return t;
+}
+#else
+#define read_ticks() 0ULL				// no cycle counter
+#endif
+
+#define FEATURES 7
+#define X_ROWS 64
+#define W_WORDS (2*(FEATURES+1))	// w_hid.csv : bias, then one weight per feature, 2 nodes per line
+#define BENCH_REPEATS 20000
+#define BENCH_ROWS 200000
+#define BENCH_TRIES 5
+#define HIDDEN 2
+#define OUTPUT_WORDS (HIDDEN+1)
+#define SHAPE_ROWS 1000
+#define SIMD_ROWS 4000000
+#define SIMD_REPEATS 5
+#define BATCH_ROWS 8000000L
+#define BATCH_REPEATS 3
+
+typedef struct {
+	double ns;
+	unsigned long long ticks;
+} Bench_Time;
+
+static double now_ns(void){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec*1e9 + t.tv_nsec;
+}
+
+// Reads up to count integers from a csv file. Returns the number read, or -1.
+static int read_csv(const char *path, int out[], int count){
+	FILE *in_file = fopen(path, "r");
+	int n = 0;
+	if(in_file == NULL)
+		return -1;
+	while(n < count && fscanf(in_file, "%d,", &out[n]) == 1)
+		n++;
+	fclose(in_file);
+	return n;
+}
+
+// Both hidden nodes of rows rows, repeats times, dense (sparse == NULL) or from the compressed rows
+static Bench_Time run(int arrA[], const Sparse_Rows *sparse, int rows, int w1[], int w2[], int res1[], int res2[], int repeats){
+	Bench_Time t;
+	double start = now_ns();
+	unsigned long long start_ticks = read_ticks();
+	int r;
+	for(r=0;r<repeats;r++){
+		if(sparse){
+			Node_Multiply_Sparse(sparse, w1, res1);
+			Node_Multiply_Sparse(sparse, w2, res2);
+		}
+		else{
+			Node_Multiply(arrA, w1, res1, rows*FEATURES, FEATURES+1, rows);
+			Node_Multiply(arrA, w2, res2, rows*FEATURES, FEATURES+1, rows);
+		}
+	}
+	t.ticks = read_ticks() - start_ticks;
+	t.ns = now_ns() - start;
+	return t;
+}
+
+// run after a first run (page faults, caches), the best of BENCH_TRIES
+static Bench_Time best_run(int arrA[], const Sparse_Rows *sparse, int rows, int w1[], int w2[], int res1[], int res2[], int repeats){
+	Bench_Time t, best;
+	int i;
+	run(arrA, sparse, rows, w1, w2, res1, res2, 1);
+	best = run(arrA, sparse, rows, w1, w2, res1, res2, repeats);
+	for(i=1;i<BENCH_TRIES;i++){
+		t = run(arrA, sparse, rows, w1, w2, res1, res2, repeats);
+		if(t.ns < best.ns)
+			best = t;
+	}
+	return best;
+}
+
+// Runs both kernels on arrA and prints a line. Returns 1 if Node_Multiply_Sparse was faster, 0 if not, -1 if the
+// results differ.
+static int compare(const char *name, int arrA[], int rows, int w1[], int w2[], int repeats){
+	int *dense1 = malloc(rows*sizeof(int)), *dense2 = malloc(rows*sizeof(int));
+	int *sparse1 = malloc(rows*sizeof(int)), *sparse2 = malloc(rows*sizeof(int));
+	Sparse_Rows sparse;
+	Bench_Time dense_t, sparse_t;
+	double compress_ns;
+	int r, zeros = 0, errors = 0;
+
+	if(dense1 == NULL || dense2 == NULL || sparse1 == NULL || sparse2 == NULL){
+		printf("%s : out of memory\n", name);
+		return -1;
+	}
+	compress_ns = now_ns();
+	if(Compress_Rows(arrA, rows, FEATURES, &sparse) != 0){
+		printf("%s : out of memory\n", name);
+		return -1;
+	}
+	compress_ns = now_ns() - compress_ns;
+	for(r=0;r<rows*FEATURES;r++)
+		zeros += (arrA[r] == 0);
+
+	dense_t = best_run(arrA, NULL, rows, w1, w2, dense1, dense2, repeats);
+	sparse_t = best_run(arrA, &sparse, rows, w1, w2, sparse1, sparse2, repeats);
+	for(r=0;r<rows;r++)
+		errors += (dense1[r] != sparse1[r]) + (dense2[r] != sparse2[r]);
+
+	printf("%-14s %5.1f%% 0s : dense %7.2f ns %8.1f ticks, sparse %7.2f ns %8.1f ticks per row (%.2fx), compress %.2f ns per row%s\n",
+			name, 100.0*zeros/(rows*FEATURES),
+			dense_t.ns/((double)rows*repeats), (double)dense_t.ticks/((double)rows*repeats),
+			sparse_t.ns/((double)rows*repeats), (double)sparse_t.ticks/((double)rows*repeats),
+			dense_t.ns/sparse_t.ns, compress_ns/rows, errors ? " MISMATCH" : "");
+
+	Free_Rows(&sparse);
+	free(dense1);
+	free(dense2);
+	free(sparse1);
+	free(sparse2);
+	return (errors != 0) ? -1 : (sparse_t.ns < dense_t.ns);
+}
+
+// The model as main.c computed it before MLP_Forward, with the hidden values of each row next to each other
+static void chained(int arrA[], int rows, int w1[], int w2[], int w_out[], const int SIG[], int *h1, int *h2, int *total, int res[]){
+	int r, j;
+	Node_Multiply(arrA, w1, h1, rows*FEATURES, FEATURES+1, rows);
+	Node_Multiply(arrA, w2, h2, rows*FEATURES, FEATURES+1, rows);
+	for(r=0;r<rows;r++){
+		j = h1[r] < 0 ? 0 : (h1[r] > MLP_SIG_SIZE-1 ? MLP_SIG_SIZE-1 : h1[r]);
+		total[2*r] = SIG[j];
+		j = h2[r] < 0 ? 0 : (h2[r] > MLP_SIG_SIZE-1 ? MLP_SIG_SIZE-1 : h2[r]);
+		total[2*r+1] = SIG[j];
+	}
+	Node_Multiply(total, w_out, res, rows*HIDDEN, HIDDEN+1, rows);
+}
+
+// Runs both versions of the model on arrA and prints a line. Returns 0 if the results are the same.
+static int compare_model(const char *name, int arrA[], int rows, int w_hid[], int w1[], int w2[], int w_out[], const int SIG[], int repeats){
+	int *h1 = malloc(rows*sizeof(int)), *h2 = malloc(rows*sizeof(int)), *total = malloc(rows*HIDDEN*sizeof(int));
+	int *chained_res = malloc(rows*sizeof(int)), *fused_res = malloc(rows*sizeof(int));
+	MLP_Model model = {FEATURES, HIDDEN, 1, w_hid, w_out, SIG};
+	double chained_ns, fused_ns;
+	unsigned long long chained_ticks, fused_ticks;
+	int r, errors = 0;
+
+	if(h1 == NULL || h2 == NULL || total == NULL || chained_res == NULL || fused_res == NULL){
+		printf("%s : out of memory\n", name);
+		return -1;
+	}
+	chained_ns = now_ns();
+	chained_ticks = read_ticks();
+	for(r=0;r<repeats;r++)
+		chained(arrA, rows, w1, w2, w_out, SIG, h1, h2, total, chained_res);
+	chained_ticks = read_ticks() - chained_ticks;
+	chained_ns = now_ns() - chained_ns;
+
+	fused_ns = now_ns();
+	fused_ticks = read_ticks();
+	for(r=0;r<repeats;r++)
+		MLP_Forward(&model, arrA, rows, fused_res);
+	fused_ticks = read_ticks() - fused_ticks;
+	fused_ns = now_ns() - fused_ns;
+
+	for(r=0;r<rows;r++)
+		errors += (chained_res[r] != fused_res[r]);
+	printf("%-14s model : Node_Multiply %7.2f ns %8.1f ticks, MLP_Forward %7.2f ns %8.1f ticks per row (%.2fx)%s\n",
+			name, chained_ns/((double)rows*repeats), (double)chained_ticks/((double)rows*repeats),
+			fused_ns/((double)rows*repeats), (double)fused_ticks/((double)rows*repeats),
+			chained_ns/fused_ns, errors ? " MISMATCH" : "");
+
+	free(h1);
+	free(h2);
+	free(total);
+	free(chained_res);
+	free(fused_res);
+	return errors != 0;
+}
+
+// The whole model on arrA with MLP_Forward and with Compress_Rows + MLP_Forward_Sparse (the rows are compressed at
+// each run, as X is read once), best of BENCH_TRIES after a first run. Prints a line. Returns 1 if the sparse path
+// was faster, 0 if not, -1 if the results differ.
+static int compare_sparse_model(const char *name, const MLP_Model *model, const int arrA[], int rows){
+	int *dense_res = malloc(rows*sizeof(int)), *sparse_res = malloc(rows*sizeof(int));
+	Sparse_Rows sparse;
+	double dense_ns = 0, sparse_ns = 0, ns;
+	int i, r, errors = 0;
+
+	if(dense_res == NULL || sparse_res == NULL){
+		printf("%s : out of memory\n", name);
+		return -1;
+	}
+	for(i=0;i<=BENCH_TRIES;i++){
+		ns = now_ns();
+		MLP_Forward(model, arrA, rows, dense_res);
+		ns = now_ns() - ns;
+		if(i == 1 || (i > 1 && ns < dense_ns))
+			dense_ns = ns;
+		ns = now_ns();
+		if(Compress_Rows(arrA, rows, model->features, &sparse) != 0){
+			printf("%s : out of memory\n", name);
+			return -1;
+		}
+		MLP_Forward_Sparse(model, &sparse, sparse_res);
+		Free_Rows(&sparse);
+		ns = now_ns() - ns;
+		if(i == 1 || (i > 1 && ns < sparse_ns))
+			sparse_ns = ns;
+	}
+	for(r=0;r<rows;r++)
+		errors += (dense_res[r] != sparse_res[r]);
+	printf("%-14s model : MLP_Forward %7.2f ns, Compress_Rows + MLP_Forward_Sparse %7.2f ns per row (%.2fx)%s\n",
+			name, dense_ns/rows, sparse_ns/rows, dense_ns/sparse_ns, errors ? " MISMATCH" : "");
+	free(dense_res);
+	free(sparse_res);
+	return errors ? -1 : (sparse_ns < dense_ns);
+}
+
+// MLP_Simd_Forward of rows rows of X with each instruction set against MLP_Forward. Prints the time of each
+// when repeats is not 0. Returns 0 if all the results are the same.
+static int check_simd(const char *name, const MLP_Model *model, const int X[], int rows, int repeats){
+	static MLP_Simd_Model simd;
+	uint8_t *X8 = malloc(rows*model->features);
+	int *expected = malloc(rows*model->outputs*sizeof(int)), *res = malloc(rows*model->outputs*sizeof(int));
+	double ns;
+	int isa, r, errors, failed = 0;
+
+	if(X8 == NULL || expected == NULL || res == NULL || MLP_Simd_Prepare(model, &simd) != 0){
+		printf("%s : out of memory or not an 8-bit model\n", name);
+		return -1;
+	}
+	for(r=0;r<rows*model->features;r++)
+		X8[r] = X[r];
+	ns = now_ns();
+	for(r=0;r<(repeats ? repeats : 1);r++)
+		MLP_Forward(model, X, rows, expected);
+	ns = now_ns() - ns;
+	if(repeats)
+		printf("%-14s SIMD  : MLP_Forward  %7.2f ns per row, %6.2f GB/s\n", name, ns/((double)rows*repeats),
+				(double)rows*model->features*repeats/ns);
+	for(isa=MLP_ISA_SCALAR;isa<=MLP_ISA_AVX512_VNNI;isa++){
+		if(!MLP_Simd_Supported((MLP_Isa)isa))
+			continue;
+		ns = now_ns();
+		for(r=0;r<(repeats ? repeats : 1);r++)
+			MLP_Simd_Forward(&simd, (MLP_Isa)isa, X8, rows, res);
+		ns = now_ns() - ns;
+		errors = 0;
+		for(r=0;r<rows*model->outputs;r++)
+			errors += (res[r] != expected[r]);
+		failed |= (errors != 0);
+		if(repeats || errors)
+			printf("%-14s SIMD  : %-12s %7.2f ns per row, %6.2f GB/s%s\n", name, MLP_Simd_Isa_Name((MLP_Isa)isa),
+					ns/((double)rows*(repeats ? repeats : 1)), (double)rows*model->features*(repeats ? repeats : 1)/ns,
+					errors ? " MISMATCH" : "");
+	}
+	free(X8);
+	free(expected);
+	free(res);
+	return failed;
+}
+
+// MLP_Forward and MLP_Forward_Sparse of a random features-hidden-outputs model against a plain loop.
+// Returns 0 if all the results are the same.
+static int check_shape(int features, int hidden, int outputs, const int SIG[]){
+	static int X[SHAPE_ROWS*64], B[65*MLP_MAX_HIDDEN], C[(MLP_MAX_HIDDEN+1)*MLP_MAX_OUTPUTS];
+	static int res[SHAPE_ROWS*MLP_MAX_OUTPUTS], sparse_res[SHAPE_ROWS*MLP_MAX_OUTPUTS];
+	MLP_Model model = {features, hidden, outputs, B, C, SIG};
+	Sparse_Rows sparse;
+	int act[MLP_MAX_HIDDEN];
+	int r, f, h, o, sum, errors = 0;
+
+	for(r=0;r<SHAPE_ROWS*features;r++)
+		X[r] = (rand()%4 == 0) ? 0 : rand()%256;
+	for(r=0;r<(features+1)*hidden;r++)
+		B[r] = rand()%256;
+	for(r=0;r<(hidden+1)*outputs;r++)
+		C[r] = rand()%256;
+	if(MLP_Forward(&model, X, SHAPE_ROWS, res) != 0 || Compress_Rows(X, SHAPE_ROWS, features, &sparse) != 0)
+		return -1;
+	MLP_Forward_Sparse(&model, &sparse, sparse_res);
+	Free_Rows(&sparse);
+
+	for(r=0;r<SHAPE_ROWS;r++){
+		for(h=0;h<hidden;h++){
+			sum = B[h];
+			for(f=0;f<features;f++)
+				sum += X[r*features+f]*B[(f+1)*hidden+h];
+			sum = sum/256;
+			act[h] = SIG[sum < 0 ? 0 : (sum > MLP_SIG_SIZE-1 ? MLP_SIG_SIZE-1 : sum)];
+		}
+		for(o=0;o<outputs;o++){
+			sum = C[o];
+			for(h=0;h<hidden;h++)
+				sum += act[h]*C[(h+1)*outputs+o];
+			errors += (res[r*outputs+o] != sum/256) + (sparse_res[r*outputs+o] != sum/256);
+		}
+	}
+	printf("%d-%d-%d model : MLP_Forward %s\n", features, hidden, outputs, errors ? "MISMATCH" : "same");
+	return (errors != 0) | check_simd("shape", &model, X, SHAPE_ROWS, 0);
+}
+
+// MLP_Batch_Forward of BATCH_ROWS random rows through the 7-2-1 model with more and more threads.
+// Returns 0 if all the results are the same as MLP_Simd_Forward.
+static int check_batch(const MLP_Model *model){
+	static MLP_Simd_Model simd;
+	const MLP_Isa isa = MLP_Simd_Isa();
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN), r, errors;
+	uint8_t *X8 = malloc(BATCH_ROWS*model->features);
+	int *expected = malloc(BATCH_ROWS*sizeof(int)), *res = malloc(BATCH_ROWS*sizeof(int));
+	double ns, one_thread_ns = 0;
+	int threads, i, failed = 0;
+
+	if(X8 == NULL || expected == NULL || res == NULL || MLP_Simd_Prepare(model, &simd) != 0){
+		printf("batch : out of memory\n");
+		return -1;
+	}
+	for(r=0;r<BATCH_ROWS*model->features;r++)
+		X8[r] = rand()%256;
+	MLP_Simd_Forward(&simd, isa, X8, BATCH_ROWS, expected);
+	// 1, 2, 4 .. threads, at least up to 4, and up to the number of CPUs (which is also tried)
+	for(threads=1;threads<=(cpus > 4 ? cpus : 4);threads = (threads < cpus && 2*threads > cpus) ? cpus : 2*threads){
+		MLP_Pool *pool = MLP_Pool_Create(threads);
+		if(pool == NULL){
+			printf("batch : out of memory\n");
+			return -1;
+		}
+		for(r=0;r<BATCH_ROWS;r++)
+			res[r] = -1;
+		ns = now_ns();
+		for(i=0;i<BATCH_REPEATS;i++)
+			MLP_Batch_Forward(pool, &simd, isa, X8, BATCH_ROWS, res);
+		ns = (now_ns() - ns)/BATCH_REPEATS;
+		if(threads == 1)
+			one_thread_ns = ns;
+		errors = 0;
+		for(r=0;r<BATCH_ROWS;r++)
+			errors += (res[r] != expected[r]);
+		failed |= (errors != 0);
+		printf("batch %2d threads (%ld CPUs) : %7.1f M rows/s, %6.2f GB/s, %.2fx of 1 thread, %ld tiles stolen%s\n",
+				MLP_Pool_Threads(pool), cpus, BATCH_ROWS/ns*1e3, BATCH_ROWS*model->features/ns, one_thread_ns/ns,
+				MLP_Pool_Steals(pool), errors ? " MISMATCH" : "");
+		MLP_Pool_Destroy(pool);
+	}
+	free(X8);
+	free(expected);
+	free(res);
+	return failed;
+}
+
+int main(int argc, char *argv[])
+{
+	static int X[X_ROWS*FEATURES];
+	int w_hid[W_WORDS], w1[FEATURES+1], w2[FEATURES+1], w_out[OUTPUT_WORDS], SIG[MLP_SIG_SIZE];
+	int *synthetic;
+	int i, zero_percent, failed = 0, faster, model_faster;
+	int kernel_from = -1, model_from = -1;	// share of 0s from which the sparse kernel / model was always faster
+	const int sparsity[] = {0, 25, 50, 75, 90, 95, 97, 99, 100};
+	const char *X_path = (argc > 1) ? argv[1] : "../X.csv";
+	const char *w_path = (argc > 2) ? argv[2] : "../w_hid.csv";
+	const char *w_out_path = (argc > 3) ? argv[3] : "../w_out.csv";
+	const char *SIG_path = (argc > 4) ? argv[4] : "../sigmoid.csv";
+
+	if(read_csv(X_path, X, X_ROWS*FEATURES) != X_ROWS*FEATURES || read_csv(w_path, w_hid, W_WORDS) != W_WORDS
+			|| read_csv(w_out_path, w_out, OUTPUT_WORDS) != OUTPUT_WORDS || read_csv(SIG_path, SIG, MLP_SIG_SIZE) != MLP_SIG_SIZE){
+		printf("Could not read %s, %s, %s and %s\n", X_path, w_path, w_out_path, SIG_path);
+		return 1;
+	}
+	for(i=0;i<FEATURES+1;i++){
+		w1[i] = w_hid[2*i];
+		w2[i] = w_hid[2*i+1];
+	}
+
+	failed |= compare("X.csv", X, X_ROWS, w1, w2, BENCH_REPEATS) < 0;
+	failed |= compare_model("X.csv", X, X_ROWS, w_hid, w1, w2, w_out, SIG, BENCH_REPEATS);
+	MLP_Model model = {FEATURES, HIDDEN, 1, w_hid, w_out, SIG};
+	failed |= check_simd("X.csv", &model, X, X_ROWS, 0);
+
+	synthetic = malloc(BENCH_ROWS*FEATURES*sizeof(int));
+	if(synthetic == NULL){
+		printf("Out of memory\n");
+		return 1;
+	}
+	srand(1);
+	for(i=0;i<(int)(sizeof(sparsity)/sizeof(sparsity[0]));i++){
+		char name[32];
+		int k;
+		zero_percent = sparsity[i];
+		for(k=0;k<BENCH_ROWS*FEATURES;k++)
+			synthetic[k] = (rand()%100 < zero_percent) ? 0 : 1 + rand()%255;
+		sprintf(name, "synthetic %d%%", zero_percent);
+		faster = compare(name, synthetic, BENCH_ROWS, w1, w2, 1);
+		model_faster = compare_sparse_model(name, &model, synthetic, BENCH_ROWS);
+		failed |= (faster < 0) | (model_faster < 0);
+		if(faster <= 0)
+			kernel_from = -1;
+		else if(kernel_from < 0)
+			kernel_from = zero_percent;
+		if(model_faster <= 0)
+			model_from = -1;
+		else if(model_from < 0)
+			model_from = zero_percent;
+		if(zero_percent == 0)
+			failed |= compare_model(name, synthetic, BENCH_ROWS, w_hid, w1, w2, w_out, SIG, 1);
+	}
+	free(synthetic);
+	if(kernel_from < 0)
+		printf("Node_Multiply_Sparse : not faster than Node_Multiply at the highest share of 0s tried\n");
+	else
+		printf("Node_Multiply_Sparse : faster than Node_Multiply from %d%% 0s (SPARSE_MIN_ZEROS %d)\n", kernel_from, SPARSE_MIN_ZEROS);
+	if(model_from < 0)
+		printf("MLP_Forward_Sparse : not faster than MLP_Forward at the highest share of 0s tried\n");
+	else
+		printf("MLP_Forward_Sparse : faster than MLP_Forward from %d%% 0s\n", model_from);
+
+	synthetic = malloc(SIMD_ROWS*FEATURES*sizeof(int));
+	if(synthetic == NULL){
+		printf("Out of memory\n");
+		return 1;
+	}
+	for(i=0;i<SIMD_ROWS*FEATURES;i++)
+		synthetic[i] = rand()%256;
+	printf("SIMD : best instruction set %s\n", MLP_Simd_Isa_Name(MLP_Simd_Isa()));
+	failed |= check_simd("synthetic", &model, synthetic, SIMD_ROWS, SIMD_REPEATS);
+	free(synthetic);
+	failed |= check_batch(&model);
+
+	failed |= check_shape(16, 8, 1, SIG);
+	failed |= check_shape(64, 32, 2, SIG);
+	failed |= check_shape(10, 13, 3, SIG);
+
+	printf(failed ? "Test Failed\n" : "Test Success\n");
+	return failed;
+}
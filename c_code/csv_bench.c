@@ -0,0 +1,221 @@
+/*
+ * csv_bench.c: CSV_Load_U8 against the scanf loop of input() in main.c, and both against a .mlpb file (mlp_file.h)
+ *
+ * Build and run from c_code (the files of the model are read from ../) :
+ *   gcc -O2 -pthread -o csv_bench csv_bench.c csv_load.c mlp_file.c && ./csv_bench [MB [file]]
+ *
+ * Writes a file of random X rows (7 values of 0..255 per line) of about MB megabytes (1024 by default) to file
+ * (/tmp/csv_bench_X.csv by default), reads it back with fscanf("%d,") as input() does and with CSV_Load_U8,
+ * and prints the MB/s of both. Both must read the same values. The file is read once before, so both read
+ * it from the page cache. The default file is removed at the end.
+ * The same rows are then written to a .mlpb file, and mapped by MLP_File_Open with and without MLP_FILE_VERIFY
+ * (each byte of X is then read once, as the csv values were), in MB/s of the csv file for the same rows.
+ * Startup : the time to read X.csv, w_hid.csv, w_out.csv, sigmoid.csv and labels.csv against the time to open
+ * the same in one .mlpb file, STARTUP_REPEATS times.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "csv_load.h"
+#include "mlp_file.h"
+
+#define FEATURES 7
+#define STARTUP_REPEATS 1000
+
+static double now_ns(void){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec*1e9 + t.tv_nsec;
+}
+
+// Writes rows of random values until about bytes. Returns the number of rows, or -1.
+static long write_rows(const char *path, long bytes){
+	FILE *out_file = fopen(path, "w");
+	long rows = 0, written = 0;
+	int f;
+	if(out_file == NULL)
+		return -1;
+	srand(1);
+	while(written < bytes){
+		for(f=0;f<FEATURES;f++)
+			written += fprintf(out_file, f == FEATURES-1 ? "%d\n" : "%d,", rand()%256);
+		rows++;
+	}
+	fclose(out_file);
+	return rows;
+}
+
+// The loop of input() in main.c, on a file
+static long scanf_rows(const char *path, uint8_t out[], long count){
+	FILE *in_file = fopen(path, "r");
+	long n = 0;
+	int value;
+	if(in_file == NULL)
+		return -1;
+	while(n < count && fscanf(in_file, "%d,", &value) == 1)
+		out[n++] = value;
+	fclose(in_file);
+	return n;
+}
+
+// Sum of the bytes, for every page of a mapped file to be read
+static unsigned long touch(const uint8_t data[], long bytes){
+	unsigned long sum = 0;
+	long i;
+	for(i=0;i<bytes;i++)
+		sum += data[i];
+	return sum;
+}
+
+// The rows of X (from CSV_Load_U8) through a .mlpb file. Returns 0 if the file gives the same rows.
+static int bench_file(const uint8_t X[], long rows, long bytes){
+	static const uint8_t model[24] = {0};
+	const char *path = "/tmp/csv_bench_X.mlpb", *what;
+	MLP_File file;
+	unsigned long sum;
+	double ns;
+	int flags, fail = 0;
+
+	memset(&file, 0, sizeof(file));
+	file.features = FEATURES;
+	file.hidden = 2;
+	file.outputs = 1;
+	file.sig_size = 1;
+	file.rows = rows;
+	file.B = file.C = file.SIG = model;
+	file.X = X;
+	if(MLP_File_Write(path, &file, &what) != 0){
+		printf("%s : %s\n", path, what);
+		return 1;
+	}
+	for(flags=0;flags<=MLP_FILE_VERIFY && !fail;flags+=MLP_FILE_VERIFY){
+		ns = now_ns();
+		if(MLP_File_Open(path, &file, flags, &what) != 0){
+			printf("%s : %s\n", path, what);
+			fail = 1;
+			break;
+		}
+		sum = touch(file.X, rows*FEATURES);
+		ns = now_ns() - ns;
+		printf("MLP_File_Open%s : %ld rows, %8.1f MB/s (of the csv), %.1f ms (sum %lu)\n",
+			flags ? " (verify)" : "         ", file.rows, bytes/ns*1e3, ns/1e6, sum);
+		fail = (file.rows != rows || memcmp(file.X, X, rows*FEATURES) != 0);
+		MLP_File_Close(&file);
+	}
+	remove(path);
+	return fail;
+}
+
+// Reads the csv files of the model and the data as main.c does (CSV_FILES), and the same from a .mlpb file
+static int bench_startup(void){
+	const char *path[5] = {"../X.csv", "../w_hid.csv", "../w_out.csv", "../sigmoid.csv", "../labels.csv"};
+	const long count[5] = {64*FEATURES, 16, 3, 256, 64};
+	const int columns[5] = {FEATURES, 2, 1, 0, 1};
+	const char *mlpb = "/tmp/csv_bench_model.mlpb", *what;
+	uint8_t values[5][64*FEATURES];
+	uint32_t words[2];
+	MLP_File file;
+	CSV_Error err;
+	double ns;
+	int i, k, fail = 0;
+
+	for(i=0;i<5;i++)
+		if(CSV_Load_U8(path[i], values[i], count[i], columns[i], &err) < 0){
+			printf("%s line %ld value %ld : %s (startup not measured)\n", path[i], err.line, err.column, err.what);
+			return 0;
+		}
+	memset(&file, 0, sizeof(file));
+	file.features = FEATURES;
+	file.hidden = 2;
+	file.outputs = 1;
+	file.sig_size = 256;
+	file.rows = 64;
+	file.label_bits = 1;
+	file.label_threshold = 39;
+	file.X = values[0];
+	file.B = values[1];
+	file.C = values[2];
+	file.SIG = values[3];
+	MLP_Pack_Labels(values[4], 64, 1, words);
+	file.labels = words;
+	if(MLP_File_Write(mlpb, &file, &what) != 0){
+		printf("%s : %s\n", mlpb, what);
+		return 1;
+	}
+
+	ns = now_ns();
+	for(k=0;k<STARTUP_REPEATS && !fail;k++)
+		for(i=0;i<5;i++)
+			fail |= CSV_Load_U8(path[i], values[i], count[i], columns[i], &err) < 0;
+	ns = now_ns() - ns;
+	printf("Startup, 5 csv files    : %8.1f us\n", ns/STARTUP_REPEATS/1e3);
+	for(i=0;i<=MLP_FILE_VERIFY && !fail;i+=MLP_FILE_VERIFY){
+		ns = now_ns();
+		for(k=0;k<STARTUP_REPEATS && !fail;k++){
+			fail = MLP_File_Open(mlpb, &file, i, &what) != 0;
+			MLP_File_Close(&file);
+		}
+		ns = now_ns() - ns;
+		printf("Startup, .mlpb%s : %8.1f us\n", i ? " (verify)" : "         ", ns/STARTUP_REPEATS/1e3);
+	}
+	if(!fail && MLP_File_Open(mlpb, &file, MLP_FILE_VERIFY, &what) == 0){
+		fail = memcmp(file.X, values[0], count[0]) || memcmp(file.B, values[1], count[1])
+			|| memcmp(file.C, values[2], count[2]) || memcmp(file.SIG, values[3], count[3]);
+		for(k=0;k<64;k++)
+			fail |= MLP_Label(file.labels, k, 1) != values[4][k];
+		MLP_File_Close(&file);
+	}
+	remove(mlpb);
+	return fail;
+}
+
+int main(int argc, char *argv[])
+{
+	long megabytes = (argc > 1) ? atol(argv[1]) : 1024;
+	const char *path = (argc > 2) ? argv[2] : "/tmp/csv_bench_X.csv";
+	long rows, bytes, n;
+	uint8_t *scanf_X, *X;
+	double ns;
+	CSV_Error err;
+	FILE *in_file;
+
+	printf("Writing %ld MB to %s\n", megabytes, path);
+	rows = write_rows(path, megabytes*1024*1024);
+	scanf_X = malloc(rows*FEATURES);
+	X = malloc(rows*FEATURES);
+	if(rows < 0 || scanf_X == NULL || X == NULL){
+		printf("Could not write %s\n", path);
+		return 1;
+	}
+	in_file = fopen(path, "r");
+	fseek(in_file, 0, SEEK_END);
+	bytes = ftell(in_file);
+	fclose(in_file);
+	scanf_rows(path, scanf_X, rows*FEATURES);	// into the page cache
+
+	ns = now_ns();
+	n = scanf_rows(path, scanf_X, rows*FEATURES);
+	ns = now_ns() - ns;
+	printf("scanf       : %ld values, %8.1f MB/s\n", n, bytes/ns*1e3);
+
+	ns = now_ns();
+	n = CSV_Load_U8(path, X, rows*FEATURES, FEATURES, &err);
+	ns = now_ns() - ns;
+	if(n < 0){
+		printf("CSV_Load_U8 : line %ld value %ld : %s\n", err.line, err.column, err.what);
+		return 1;
+	}
+	printf("CSV_Load_U8 : %ld values, %8.1f MB/s\n", n, bytes/ns*1e3);
+
+	n = memcmp(scanf_X, X, rows*FEATURES);
+	n |= bench_file(X, rows, bytes);
+	n |= bench_startup();
+	printf(n ? "Test Failed\n" : "Test Success\n");
+	free(scanf_X);
+	free(X);
+	if(argc <= 2)
+		remove(path);
+	return n != 0;
+}
@@ -0,0 +1,227 @@
+/*
+ * csv_load.c: reads the csv files of the model and the data from their paths (see csv_load.h)
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "csv_load.h"
+
+#define CSV_MAX_INT 100000000		// larger values are reported, before they can overflow
+
+static long csv_error(CSV_Error *err, long line, long column, const char *what){
+	if(err != NULL){
+		err->line = line;
+		err->column = column;
+		err->what = what;
+	}
+	return -1;
+}
+
+// Number of digits (0 .. 4) at the start of the 4 bytes at p, and their value. 4 : there may be more.
+static inline int csv_digits4(const char *p, unsigned *value){
+	uint32_t w, t, other;
+	int n;
+	memcpy(&w, p, 4);
+	// bytes past the first one that is not a digit can be wrong (borrows and carries), which does not matter
+	t = w - 0x30303030u;
+	other = (t | (t + 0x76767676u)) & 0x80808080u;
+	n = other ? __builtin_ctz(other) >> 3 : 4;
+	if(n == 0)
+		return 0;
+	if(n < 4)
+		t <<= 8*(4-n);		// the n digits in the high bytes, the first the lowest
+	t = (t*10 + (t >> 8)) & 0x00FF00FFu;
+	*value = (t*100 + (t >> 16)) & 0xFFFFu;
+	return n;
+}
+
+// The parser of CSV_Parse_U8 (u8 != 0, out is uint8_t[]) and CSV_Parse_Int (out is int[]), inlined into each
+static inline __attribute__((always_inline))
+long csv_parse(const char *p, size_t size, void *out, const int u8, long count, int columns, CSV_Error *err){
+	const char *end = p + size;
+	long n = 0, line = 1, column = 0;
+	unsigned value, digit;
+	int negative, digits;
+
+	while(p < end){
+		// most values : 1 to 3 digits, then a comma or the end of the line
+		while(end - p >= 8 && n < count){
+			digits = csv_digits4(p, &value);
+			if(digits == 0 || digits == 4 || (u8 && value > 255))
+				break;
+			if(p[digits] == ','){
+				column++;
+			}
+			else if(p[digits] == '\n'){
+				if(columns != 0 && column+1 != columns)
+					break;
+				line++;
+				column = 0;
+			}
+			else
+				break;
+			if(u8)
+				((uint8_t *)out)[n] = (uint8_t)value;
+			else
+				((int *)out)[n] = (int)value;
+			n++;
+			p += digits+1;
+		}
+		// anything else, one value or end of line at a time
+		while(p < end && (*p == ' ' || *p == '\t'))
+			p++;
+		if(p == end)
+			break;
+		if(*p == '\n' || *p == '\r'){
+			// end of line, and of its last value
+			if(column != 0 && columns != 0 && column != columns)
+				return csv_error(err, line, column, "wrong number of values on the line");
+			if(*p == '\r' && p+1 < end && p[1] == '\n')
+				p++;
+			p++;
+			line++;
+			column = 0;
+			continue;
+		}
+
+		column++;
+		negative = (!u8 && *p == '-');
+		p += negative;
+		digits = 0;
+		value = 0;
+		if(end - p >= 4)
+			digits = csv_digits4(p, &value);
+		p += digits;
+		if(digits == 4 || end - p < 4)
+			while(p < end && (digit = (unsigned)(*p - '0')) < 10){
+				value = value*10 + digit;
+				digits++;
+				p++;
+				if(value > CSV_MAX_INT)
+					return csv_error(err, line, column, "value too large");
+			}
+		if(digits == 0)
+			return csv_error(err, line, column, "not a number");
+		if(u8 && value > 255)
+			return csv_error(err, line, column, "value outside 0..255");
+		if(n == count)
+			return csv_error(err, line, column, "more values than expected");
+		if(u8)
+			((uint8_t *)out)[n] = (uint8_t)value;
+		else
+			((int *)out)[n] = negative ? -(int)value : (int)value;
+		n++;
+
+		while(p < end && (*p == ' ' || *p == '\t'))
+			p++;
+		if(p < end && *p == ',')
+			p++;
+		else if(p < end && *p != '\n' && *p != '\r')
+			return csv_error(err, line, column, "not a number");
+	}
+	if(column != 0 && columns != 0 && column != columns)
+		return csv_error(err, line, column, "wrong number of values on the line");
+	if(n != count)
+		return csv_error(err, line, column, "fewer values than expected");
+	return n;
+}
+
+long CSV_Parse_U8(const char *data, size_t size, uint8_t out[], long count, int columns, CSV_Error *err){
+	return csv_parse(data, size, out, 1, count, columns, err);
+}
+
+long CSV_Parse_Int(const char *data, size_t size, int out[], long count, int columns, CSV_Error *err){
+	return csv_parse(data, size, out, 0, count, columns, err);
+}
+
+long CSV_Count_Data(const char *p, size_t size, int *columns, CSV_Error *err){
+	const char *end = p + size;
+	long n = 0, line = 1, column = 0;
+	*columns = 0;
+	while(p < end){
+		if(*p == '-' || (unsigned)(*p - '0') < 10){
+			column++;
+			n++;
+			p += (*p == '-');
+			if(p == end || (unsigned)(*p - '0') >= 10)
+				return csv_error(err, line, column, "not a number");
+			while(p < end && (unsigned)(*p - '0') < 10)
+				p++;
+		}
+		else if(*p == '\n'){
+			if(*columns == 0)
+				*columns = column;
+			line++;
+			column = 0;
+			p++;
+		}
+		else if(*p == ',' || *p == ' ' || *p == '\t' || *p == '\r')
+			p++;
+		else
+			return csv_error(err, line, column+1, "not a number");
+	}
+	if(*columns == 0)
+		*columns = column;
+	return n;
+}
+
+// The file at path mapped, with data NULL if it is empty. Returns 0, or -1 with err filled.
+static int csv_map(const char *path, void **data, size_t *size, CSV_Error *err){
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+
+	*data = NULL;
+	if(fd < 0)
+		return csv_error(err, 0, 0, "can not open the file");
+	if(fstat(fd, &st) != 0){
+		close(fd);
+		return csv_error(err, 0, 0, "can not read the file");
+	}
+	*size = st.st_size;
+	if(st.st_size > 0){
+		*data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(*data == MAP_FAILED){
+			*data = NULL;
+			close(fd);
+			return csv_error(err, 0, 0, "can not map the file");
+		}
+		madvise(*data, st.st_size, MADV_SEQUENTIAL);
+	}
+	close(fd);
+	return 0;
+}
+
+long CSV_Count(const char *path, int *columns, CSV_Error *err){
+	void *data;
+	size_t size;
+	long n;
+	if(csv_map(path, &data, &size, err) != 0)
+		return -1;
+	n = CSV_Count_Data(data, size, columns, err);
+	if(data != NULL)
+		munmap(data, size);
+	return n;
+}
+
+static long csv_load(const char *path, void *out, int u8, long count, int columns, CSV_Error *err){
+	void *data;
+	size_t size;
+	long n;
+	if(csv_map(path, &data, &size, err) != 0)
+		return -1;
+	n = csv_parse(data, size, out, u8, count, columns, err);
+	if(data != NULL)
+		munmap(data, size);
+	return n;
+}
+
+long CSV_Load_U8(const char *path, uint8_t out[], long count, int columns, CSV_Error *err){
+	return csv_load(path, out, 1, count, columns, err);
+}
+
+long CSV_Load_Int(const char *path, int out[], long count, int columns, CSV_Error *err){
+	return csv_load(path, out, 0, count, columns, err);
+}
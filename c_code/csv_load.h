@@ -0,0 +1,35 @@
+/*
+ * csv_load.h: reads X.csv, w_hid.csv, w_out.csv and sigmoid.csv from their paths
+ *
+ * The file is memory-mapped and parsed in place : up to 4 digits of a value are read at once (SWAR), and the values
+ * go straight into 8-bit (X, as used by MLP_Simd_Forward) or int arrays. The first malformed value or line is
+ * reported with its line and column. Needs POSIX (mmap) : Linux on the Zynq, or the host.
+ */
+
+#ifndef CSV_LOAD_H
+#define CSV_LOAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+	long line;			// 1 is the first line; 0 if the file could not be read
+	long column;		// 1 is the first value of the line
+	const char *what;
+} CSV_Error;
+
+// Reads the count values of the file at path into out, with columns values per line (0 : any number per line).
+// Lines with no values are skipped; a comma may end a line. Returns count, or -1 with err filled if the file can not
+// be read, a value is not a number (or outside 0..255 for CSV_Load_U8), a line does not have columns values,
+// or the file does not have count values.
+long CSV_Load_U8(const char *path, uint8_t out[], long count, int columns, CSV_Error *err);
+long CSV_Load_Int(const char *path, int out[], long count, int columns, CSV_Error *err);
+// Number of values of the file at path, and in *columns the number on its first line with values (to size the arrays
+// of the other functions). Returns -1 with err filled if the file can not be read or has something other than numbers.
+long CSV_Count(const char *path, int *columns, CSV_Error *err);
+// The same from size bytes in memory
+long CSV_Parse_U8(const char *data, size_t size, uint8_t out[], long count, int columns, CSV_Error *err);
+long CSV_Parse_Int(const char *data, size_t size, int out[], long count, int columns, CSV_Error *err);
+long CSV_Count_Data(const char *data, size_t size, int *columns, CSV_Error *err);
+
+#endif
@@ -0,0 +1,229 @@
+/*
+ * dma_bench.c: the DMA driver (mlp_dma.h) on the simulated device, with 1, 2 and 4 batches in flight
+ *
+ * Build and run from c_code (the files of the model are read from ../), with the include directory of Vivado HLS :
+ *   gcc -O2 -c dma_bench.c mlp_dma.c mlp_forward.c node_multiply.c csv_load.c
+ *   g++ -O2 -I<Vivado HLS>/include -I. -c ../hls_code/dma_sim_HLS.cpp ../hls_code/myip_v1_0_HLS.cpp
+ *   g++ -pthread -o dma_bench dma_bench.o mlp_dma.o mlp_forward.o node_multiply.o csv_load.o dma_sim_HLS.o
+ *       myip_v1_0_HLS.o && ./dma_bench [rows [batch_rows [clock_MHz]]]
+ *
+ * rows rows (DMA_ROWS by default : the rows of X.csv, then random ones) go through the driver in batches of
+ * batch_rows (DMA_BATCH_ROWS), with 1 slot (each batch is filled, sent and waited for in turn), then 2 and 4 (the
+ * next batches are filled while the device computes), waiting on the interrupt, then polling the descriptors.
+ * The device holds each batch for the clocks the coprocessor would take at clock_MHz (DMA_CLOCK_MHZ; 0 : as fast
+ * as the C simulation runs). Filling a batch is converting its rows from int, as main.c reads them, and every
+ * result is compared with MLP_Forward (saturated to 8 bits, as the packed results).
+ * Prints rows/s, and the share of the time the device had a batch. Then the same with a random model (loaded with
+ * the first batch), and the rows of X.csv with CMD_LABELS against labels.csv. Any mismatch fails the test.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "mlp_dma.h"
+#include "csv_load.h"
+
+#define FEATURES 7
+#define HIDDEN 2
+#define FILE_ROWS 64			// rows of X.csv
+#define B_WORDS ((FEATURES+1)*HIDDEN)
+#define C_WORDS (HIDDEN+1)
+#define DMA_ROWS 99999			// not a whole number of batches, nor of words
+#define DMA_BATCH_ROWS 1024
+#define DMA_CLOCK_MHZ 100
+#define DMA_TIMEOUT_MS 10000
+#define DATA_THRESHOLD 39		// labels.csv is (result > 39) for the rows of X.csv
+
+static double now_seconds(void){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+// rows rows of X from row first into batch
+static void fill(MLP_Dma_Batch *batch, const int X[], long first, long rows){
+	long r;
+	int f;
+	for(r = 0; r < rows; r++){
+		uint8_t *row = MLP_Dma_Row(batch, r);
+		for(f = 0; f < FEATURES; f++)
+			row[f] = X[(first+r)*FEATURES+f];
+	}
+}
+
+// Rows of batch that differ from ref (its rows), the first of them printed
+static long check(const MLP_Dma_Batch *batch, const int ref[], long first){
+	long r, mismatches = 0;
+	int expected;
+	for(r = 0; r < batch->rows; r++){
+		expected = (ref[r] > 255) ? 255 : ref[r];
+		if(batch->results[r] != expected && mismatches++ == 0)
+			printf("  row %ld : %d (expected %d)\r\n", first+r, batch->results[r], expected);
+	}
+	return mismatches + (batch->error ? 1 : 0);
+}
+
+// All the rows through the driver. Returns the number of mismatches, or -1 if the driver can not run.
+static long run(void *device, const MLP_Model *model, const int X[], const int ref[], long rows, long batch_rows,
+		int slots, int irq){
+	MLP_Dma_Config config = {FEATURES, 1, 0, batch_rows, slots, 0, irq};
+	MLP_Dma *dma = MLP_Dma_Open(&MLP_Dma_Sim_Backend, device, &config);
+	MLP_Dma_Batch *batch;
+	long first = 0, done = 0, mismatches = 0, n;
+	double seconds, busy;
+
+	if(dma == NULL || MLP_Dma_Load_Model(dma, model, MLP_DMA_SIG_WORDS) != 0){
+		printf("  Can not open the driver\r\n");
+		return -1;
+	}
+	busy = MLP_Dma_Sim_Busy(device);
+	seconds = now_seconds();
+	while(done < rows){
+		// the next batches are filled while the device has the oldest one
+		while(first < rows && (batch = MLP_Dma_Get(dma)) != NULL){
+			n = (rows - first < batch_rows) ? rows - first : batch_rows;
+			fill(batch, X, first, n);
+			MLP_Dma_Submit(dma, batch, n);
+			first += n;
+		}
+		batch = MLP_Dma_Wait(dma, DMA_TIMEOUT_MS);
+		if(batch == NULL){
+			printf("  Timeout after %ld rows\r\n", done);
+			return -1;
+		}
+		mismatches += check(batch, ref + done, done);
+		done += batch->rows;
+		MLP_Dma_Release(dma, batch);
+	}
+	seconds = now_seconds() - seconds;
+	busy = MLP_Dma_Sim_Busy(device) - busy;
+	printf("  %5d %-9s %14.0f %12.1f%% %10ld\r\n", slots, irq ? "interrupt" : "polling", rows/seconds,
+			100*busy/seconds, mismatches);
+	MLP_Dma_Close(dma);
+	return mismatches;
+}
+
+static long run_model(const char *title, void *device, const MLP_Model *model, const int X[], long rows,
+		long batch_rows){
+	static const int slots[3] = {1, 2, 4};
+	int *ref = (int *)malloc(rows*sizeof(int));
+	long mismatches = 0, m;
+	int s, irq;
+	if(ref == NULL || MLP_Forward(model, X, rows, ref) != 0){
+		printf("Out of memory\r\n");
+		exit(1);
+	}
+	printf("%s : %ld rows, batches of %ld\r\n  slots wait              rows/s  device busy mismatches\r\n",
+			title, rows, batch_rows);
+	for(irq = 1; irq >= 0; irq--)
+		for(s = 0; s < 3; s++){
+			m = run(device, model, X, ref, rows, batch_rows, slots[s], irq);
+			mismatches += (m < 0) ? rows : m;
+		}
+	free(ref);
+	return mismatches;
+}
+
+// The rows of X.csv in one CMD_LABELS batch : one bit per row
+static long run_labels(void *device, const MLP_Model *model, const int X[], const uint8_t labels[]){
+	MLP_Dma_Config config = {FEATURES, 1, 0, FILE_ROWS, 1, CMD_LABELS | (DATA_THRESHOLD << LABEL_THRESHOLD_SHIFT), 1};
+	MLP_Dma *dma = MLP_Dma_Open(&MLP_Dma_Sim_Backend, device, &config);
+	MLP_Dma_Batch *batch;
+	long mismatches = 0, r;
+	int label;
+
+	if(dma == NULL || MLP_Dma_Load_Model(dma, model, MLP_DMA_SIG_WORDS) != 0 || (batch = MLP_Dma_Get(dma)) == NULL){
+		printf("  Can not open the driver\r\n");
+		return FILE_ROWS;
+	}
+	fill(batch, X, 0, FILE_ROWS);
+	MLP_Dma_Submit(dma, batch, FILE_ROWS);
+	batch = MLP_Dma_Wait(dma, DMA_TIMEOUT_MS);
+	if(batch == NULL){
+		printf("  Timeout\r\n");
+		return FILE_ROWS;
+	}
+	for(r = 0; r < FILE_ROWS; r++){
+		label = (batch->results[r/8] >> (r%8)) & 1;
+		if(label != labels[r] && mismatches++ == 0)
+			printf("  row %ld : label %d (expected %d)\r\n", r, label, labels[r]);
+	}
+	printf("Labels of X.csv (CMD_LABELS) : %ld of %d rows differ from labels.csv\r\n", mismatches, FILE_ROWS);
+	MLP_Dma_Release(dma, batch);
+	MLP_Dma_Close(dma);
+	return mismatches;
+}
+
+int main(int argc, char *argv[])
+{
+	long rows = (argc > 1) ? atol(argv[1]) : DMA_ROWS;
+	long batch_rows = (argc > 2) ? atol(argv[2]) : DMA_BATCH_ROWS;
+	double clock_mhz = (argc > 3) ? atof(argv[3]) : DMA_CLOCK_MHZ;
+	static int B[B_WORDS], C[C_WORDS], SIG[MLP_SIG_SIZE], random_B[B_WORDS], random_C[C_WORDS];
+	static uint8_t labels[FILE_ROWS];
+	const char *path[5] = {"../X.csv", "../w_hid.csv", "../w_out.csv", "../sigmoid.csv", "../labels.csv"};
+	CSV_Error err;
+	void *device;
+	int *X;
+	long mismatches, row;
+	int i, f, kind, failed = 0;
+
+	if(rows < FILE_ROWS)
+		rows = FILE_ROWS;
+	if(batch_rows < 1)
+		batch_rows = DMA_BATCH_ROWS;
+	X = (int *)malloc(rows*FEATURES*sizeof(int));
+	if(X == NULL){
+		printf("Out of memory\r\n");
+		return 1;
+	}
+	if(CSV_Load_Int(path[0], X, FILE_ROWS*FEATURES, FEATURES, &err) < 0)
+		failed = 1;
+	else if(CSV_Load_Int(path[1], B, B_WORDS, HIDDEN, &err) < 0)
+		failed = 2;
+	else if(CSV_Load_Int(path[2], C, C_WORDS, 1, &err) < 0)
+		failed = 3;
+	else if(CSV_Load_Int(path[3], SIG, MLP_SIG_SIZE, 0, &err) < 0)
+		failed = 4;
+	else if(CSV_Load_U8(path[4], labels, FILE_ROWS, 1, &err) < 0)
+		failed = 5;
+	if(failed){
+		printf("%s line %ld value %ld : %s\r\n", path[failed-1], err.line, err.column, err.what);
+		return 1;
+	}
+	// then random rows : 1 in 16 all 0s, 1 in 16 all 255s, the others with about 1 value in 4 at 0
+	srand(1);
+	for(row = FILE_ROWS; row < rows; row++){
+		kind = rand() % 16;
+		for(f = 0; f < FEATURES; f++)
+			X[row*FEATURES+f] = (kind == 0) ? 0 : (kind == 1) ? 255 : (rand() % 4 == 0) ? 0 : rand() % 256;
+	}
+
+	device = MLP_Dma_Sim_Open(clock_mhz * 1e6);
+	if(device == NULL){
+		printf("Can not start the simulated device\r\n");
+		return 1;
+	}
+	printf("Device : %s, %.0f MHz\r\n", MLP_Dma_Sim_Backend.name, clock_mhz);
+	MLP_Model model = {FEATURES, HIDDEN, 1, B, C, SIG};
+	mismatches = run_model("Model of w_hid.csv / w_out.csv", device, &model, X, rows, batch_rows);
+
+	// outputs up to about 500 (saturated), as in diff_bench_HLS.cpp
+	for(i = 0; i < B_WORDS; i++)
+		random_B[i] = rand() % 32;
+	for(i = 0; i < C_WORDS; i++)
+		random_C[i] = 128 + rand() % 128;
+	MLP_Model random_model = {FEATURES, HIDDEN, 1, random_B, random_C, SIG};
+	mismatches += run_model("Random model", device, &random_model, X, rows, batch_rows);
+
+	mismatches += run_labels(device, &model, X, labels);
+
+	MLP_Dma_Sim_Close(device);
+	free(X);
+	if(mismatches != 0){
+		printf("%ld mismatching rows\r\nTest Failed\r\n", mismatches);
+		return 1;
+	}
+	printf("Test Success\r\n");
+	return 0;
+}
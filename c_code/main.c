@@ -1,162 +1,333 @@
-/******************************************************************************
-*
-* Copyright (C) 2009 - 2014 Xilinx, Inc.  All rights reserved.
-*
-* Permission is hereby granted, free of charge, to any person obtaining a copy
-* of this software and associated documentation files (the "Software"), to deal
-* in the Software without restriction, including without limitation the rights
-* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
-* copies of the Software, and to permit persons to whom the Software is
-* furnished to do so, subject to the following conditions:
-*
-* The above copyright notice and this permission notice shall be included in
-* all copies or substantial portions of the Software.
-*
-* Use of the Software is limited solely to applications:
-* (a) running on a Xilinx device, or
-* (b) that interact with a Xilinx device through a bus or interconnect.
-*
-* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
-* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
-* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
-* XILINX  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
-* WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
-* OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
-* SOFTWARE.
-*
-* Except as contained in this notice, the name of the Xilinx shall not be used
-* in advertising or otherwise to promote the sale, use or other dealings in
-* this Software without prior written authorization from Xilinx.
-*
-******************************************************************************/
-
-/*
- * helloworld.c: simple test application
- *
- * This application configures UART 16550 to baud rate 9600.
- * PS7 UART (Zynq) is not initialized by this application, since
- * bootrom/bsp configures it to baud rate 115200
- *
- * ------------------------------------------------
- * | UART TYPE   BAUD RATE                        |
- * ------------------------------------------------
- *   uartns550   9600
- *   uartlite    Configurable only in HW design
- *   ps7_uart    115200 (configured by bootrom/bsp)
- */
-
-#include <stdio.h>
-#include "platform.h"
-#include "xil_types.h"
-#include "xplatform_info.h"
-#include "xparameters.h"
-
-#include "xil_io.h"
-#include "xil_types.h"
-#include "xil_assert.h"
-#include "xstatus.h"
-
-#include "xuartps.h"
-#include "xuartps_hw.h"
-
-#include "xil_printf.h"
-
-#include <stdlib.h>
-#include <string.h>
-#include <math.h>
-
-#define UART_DEVICE_ID1 0
-
-XUartPs UART_PS;
-
-int input(int size, int out[]);
-int Node_Multiply(int arrA[], int arrB[], int arrRES[], int sizeA, int sizeB, int sizeRES);
-int sigmoid(int arr1[], int arr2[], int arrsig[], int size1);
-
-int main(void)
-{
-	int size1_1=64, size1_2=7, size2=8, size2_2=2, size1=size1_1*size1_2, size3=size2*size2_2;
-	int sig_size = 	256;
-	int sig_array[sig_size];
-	int arr1[size1], arr2[size3], arr3[size1_1], arr4[size1_1];
-	int size4 = 3;
-	int arr5[size4];
-	int arrRES[size1_1];
-
-	input(size1,arr1);
-	input(size3,arr2);
-	input(sig_size,sig_array);
-	input(size4,arr5);
-
-	int arr2_1[size2], arr2_2[size2], i, a=0, b=0;
-	for(i=0;i<size3;i++){
-		if(i%2==0){
-			arr2_1[a] = arr2[i];
-			a++;
-		}
-		else{
-			arr2_2[b] = arr2[i];
-			b++;
-		}
-	}
-
-	Node_Multiply(arr1, arr2_1, arr3, size1, size2, size1_1);
-	Node_Multiply(arr1, arr2_2, arr4, size1, size2, size1_1);
-
-	int n1[size1_1], n2[size1_1];
-
-	sigmoid(arr3, n1,sig_array, size1_1);
-	sigmoid(arr4, n2,sig_array, size1_1);
-
-	int* total = malloc(128 * sizeof(int));
-
-	memcpy(total,		n1, 64 * sizeof(float));
-	memcpy(total + 64, 	n2, 64 * sizeof(float));
-
-	Node_Multiply(total, arr5, arrRES, 128, size4, size1_1);
-
-	int k;
-	for(k=0;k<sizeof(arrRES);k++){
-		printf("%d\n",arrRES[k]);
-	}
-
-	return 0;
-}
-
-int input(int size, int out[]){
-	int Count = 0;
-	while (Count < size) {
-		scanf("%d,",&out[Count]);
-		Count++;
-	}
-	return 0;
-}
-
-int sigmoid(int arr1[], int arr2[],int arrsig[], int size1){
-	int i = 0, j=0;
-	for(;i<size1;i++){
-		j=arr1[i];
-		if(j>256)
-			j=256;
-		arr2[i]=arrsig[j];
-	}
-	return 0;
-}
-
-int Node_Multiply(int arrA[], int arrB[], int arrRES[], int sizeA, int sizeB, int sizeRES){
-	int i=0,j=0,k=0,sum=0;
-	while(i<sizeA){
-		for(j=0;j<sizeB;j++){
-			if(j==0){
-				sum += 1*arrB[j];
-			}else{
-				sum += arrA[i]*arrB[j];
-				i++;
-			}
-		}
-		arrRES[k] = sum/256;
-		sum = 0;
-		k++;
-	}
-	return 0;
-}
+/******************************************************************************
+*
+* Copyright (C) 2009 - 2014 Xilinx, Inc.  All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* Use of the Software is limited solely to applications:
+* (a) running on a Xilinx device, or
+* (b) that interact with a Xilinx device through a bus or interconnect.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+* XILINX  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+* WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+* OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+* Except as contained in this notice, the name of the Xilinx shall not be used
+* in advertising or otherwise to promote the sale, use or other dealings in
+* this Software without prior written authorization from Xilinx.
+*
+******************************************************************************/
+
+/*
+ * helloworld.c: simple test application
+ *
+ * This application configures UART 16550 to baud rate 9600.
+ * PS7 UART (Zynq) is not initialized by this application, since
+ * bootrom/bsp configures it to baud rate 115200
+ *
+ * ------------------------------------------------
+ * | UART TYPE   BAUD RATE                        |
+ * ------------------------------------------------
+ *   uartns550   9600
+ *   uartlite    Configurable only in HW design
+ *   ps7_uart    115200 (configured by bootrom/bsp)
+ */
+
+#include <stdio.h>
+#include "platform.h"
+#include "xil_types.h"
+#include "xplatform_info.h"
+#include "xparameters.h"
+
+#include "xil_io.h"
+#include "xil_types.h"
+#include "xil_assert.h"
+#include "xstatus.h"
+
+#include "xuartps.h"
+#include "xuartps_hw.h"
+
+#include "xil_printf.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// 1 : X.csv, w_hid.csv, w_out.csv and sigmoid.csv are read from the paths given on the command line
+// (main X.csv w_hid.csv w_out.csv sigmoid.csv, by default in the current directory) by csv_load.c,
+// instead of from the UART in that fixed order. Needs POSIX files (Linux on the Zynq, or the host).
+#ifndef CSV_FILES
+#define CSV_FILES 0
+#endif
+
+// 1 : X and the model are read from one .mlpb file (mlp_file.h, made by mlp_convert.c) given on the command line
+// (main model.mlpb, by default X.mlpb), mapped and used as they are. Needs POSIX files, as CSV_FILES.
+#ifndef MLPB_FILE
+#define MLPB_FILE 0
+#endif
+
+// 1 : the results are computed by myip_v1_0_HLS behind the AXI DMA XPAR_AXI_DMA_0_BASEADDR (scatter-gather mode), through
+// mlp_dma.h, instead of in software; 2 : the same with simple_ML_IP_v1_0 (a 1 before each row for the bias).
+// The results are then saturated to 8 bits (packed), and SIGMOID_MODE must be the one of the coprocessor.
+#ifndef COPROCESSOR
+#define COPROCESSOR 0
+#endif
+
+#include "mlp_simd.h"
+#if COPROCESSOR
+#include "mlp_dma.h"
+#include "xil_cache.h"
+#endif
+#if CSV_FILES
+#include "csv_load.h"
+#endif
+#if MLPB_FILE
+#include "mlp_file.h"
+#endif
+
+#define UART_DEVICE_ID1 0
+
+// 1 : the model is computed by MLP_Simd_Forward with the best instruction set of the CPU (NEON if built with
+// -mfpu=neon), when X and the model are 8-bit. Same results as MLP_Forward.
+#ifndef SIMD
+#define SIMD 1
+#endif
+
+// Sigmoid table filled by sigmoid(), as in the coprocessors (SIGMOID_MODE of myip_v1_0_HLS.h, SIGM_MODE of hid_layer) :
+// 0 : the 256 values read with the inputs, 1 : sigmoid.csv (built in, not read),
+// 2 : linear between every 2^SIGMOID_PWL_STEP_BITS-th value of sigmoid.csv (not read)
+#ifndef SIGMOID_MODE
+#define SIGMOID_MODE 0
+#endif
+#ifndef SIGMOID_PWL_STEP_BITS
+#define SIGMOID_PWL_STEP_BITS 4
+#endif
+
+const int sigmoid_rom[256] = {
+#include "../sigmoid.csv"
+};
+
+XUartPs UART_PS;
+
+int input(int size, int out[]);
+int load_files(int argc, char *argv[], uint8_t X8[], int size1, int arr2[], int size3, int arr5[], int size4, int arrsig[], int sig_size);
+int load_mlpb(int argc, char *argv[], uint8_t X8[], int size1, int arr2[], int size3, int arr5[], int size4, int arrsig[], int sig_size);
+int sigmoid(int arrsig[], int size);
+int coprocessor(const MLP_Model *model, const int X[], int rows, int RES[]);
+
+int main(int argc, char *argv[])
+{
+	int size1_1=64, size1_2=7, size2=8, size2_2=2, size1=size1_1*size1_2, size3=size2*size2_2;
+	int sig_size = 	256;
+	int sig_array[sig_size];
+	int arr1[size1], arr2[size3];
+	int size4 = 3;
+	int arr5[size4];
+	int arrRES[size1_1];
+
+	uint8_t X8[size1];
+	int k;
+
+	if(MLPB_FILE){
+		if(load_mlpb(argc, argv, X8, size1, arr2, size3, arr5, size4, sig_array, sig_size) != 0)
+			return 1;
+		for(k=0;k<size1;k++)
+			arr1[k] = X8[k];
+	}
+	else if(CSV_FILES){
+		if(load_files(argc, argv, X8, size1, arr2, size3, arr5, size4, sig_array, sig_size) != 0)
+			return 1;
+		for(k=0;k<size1;k++)
+			arr1[k] = X8[k];
+	}
+	else{
+		input(size1,arr1);
+		input(size3,arr2);
+		if(SIGMOID_MODE == 0)
+			input(sig_size,sig_array);
+		input(size4,arr5);
+	}
+	sigmoid(sig_array, sig_size);
+
+	// arr2 and arr5 are used as read : bias first, then one line per feature / hidden node
+	MLP_Model model = {size1_2, size2_2, 1, arr2, arr5, sig_array};
+
+	static MLP_Simd_Model simd;
+	int simd_ok = SIMD && MLP_Simd_Prepare(&model, &simd) == 0;
+	for(k=0;k<size1 && simd_ok;k++){
+		simd_ok = (arr1[k] >= 0 && arr1[k] <= 255);
+		X8[k] = arr1[k];
+	}
+	if(COPROCESSOR){
+		if(coprocessor(&model, arr1, size1_1, arrRES) != 0)
+			return 1;
+	}
+	else if(simd_ok)
+		MLP_Simd_Forward(&simd, MLP_Simd_Isa(), X8, size1_1, arrRES);
+	else
+		MLP_Forward(&model, arr1, size1_1, arrRES);
+
+	for(k=0;k<size1_1;k++){
+		printf("%d\n",arrRES[k]);
+	}
+
+	return 0;
+}
+
+int input(int size, int out[]){
+	int Count = 0;
+	while (Count < size) {
+		scanf("%d,",&out[Count]);
+		Count++;
+	}
+	return 0;
+}
+
+// Reads the files given in argv (see CSV_FILES), X as 8-bit values. sigmoid.csv is only read with SIGMOID_MODE 0.
+// Returns 0, or -1 after printing the first error.
+int load_files(int argc, char *argv[], uint8_t X8[], int size1, int arr2[], int size3, int arr5[], int size4, int arrsig[], int sig_size){
+#if CSV_FILES
+	const char *path[4] = {"X.csv", "w_hid.csv", "w_out.csv", "sigmoid.csv"};
+	CSV_Error err;
+	int i, failed = 0;
+	for(i=0;i<4 && i+1<argc;i++)
+		path[i] = argv[i+1];
+	// X.csv : one row of 7 features per line, w_hid.csv : one line per feature (bias first) with a weight per hidden node
+	if(!failed && CSV_Load_U8(path[0], X8, size1, 7, &err) < 0)
+		failed = 1;
+	if(!failed && CSV_Load_Int(path[1], arr2, size3, 2, &err) < 0)
+		failed = 2;
+	if(!failed && CSV_Load_Int(path[2], arr5, size4, 1, &err) < 0)
+		failed = 3;
+	if(!failed && SIGMOID_MODE == 0 && CSV_Load_Int(path[3], arrsig, sig_size, 0, &err) < 0)
+		failed = 4;
+	if(failed){
+		printf("%s line %ld value %ld : %s\n", path[failed-1], err.line, err.column, err.what);
+		return -1;
+	}
+	return 0;
+#else
+	(void)argc; (void)argv; (void)X8; (void)size1; (void)arr2; (void)size3; (void)arr5; (void)size4; (void)arrsig; (void)sig_size;
+	printf("Built without CSV_FILES\n");
+	return -1;
+#endif
+}
+
+// Reads the .mlpb file given in argv (see MLPB_FILE), which must have X and the model in the sizes of main().
+// The sigmoid table of the file is only used with SIGMOID_MODE 0. Returns 0, or -1 after printing the error.
+int load_mlpb(int argc, char *argv[], uint8_t X8[], int size1, int arr2[], int size3, int arr5[], int size4, int arrsig[], int sig_size){
+#if MLPB_FILE
+	const char *path = (argc > 1) ? argv[1] : "X.mlpb", *what;
+	MLP_File file;
+	MLP_Model model;
+	int i;
+	if(MLP_File_Open(path, &file, MLP_FILE_VERIFY, &what) != 0){
+		printf("%s : %s\n", path, what);
+		return -1;
+	}
+	if(file.X == NULL || file.rows*file.features != size1 || (file.features+1)*file.hidden != size3
+			|| (file.hidden+1)*file.outputs != size4 || file.outputs != 1
+			|| MLP_File_Model(&file, arr2, arr5, arrsig, &model) != 0 || file.sig_size != sig_size){
+		printf("%s : not 64 rows of the 7-2-1 model\n", path);
+		MLP_File_Close(&file);
+		return -1;
+	}
+	for(i=0;i<size1;i++)
+		X8[i] = file.X[i];
+	MLP_File_Close(&file);
+	return 0;
+#else
+	(void)argc; (void)argv; (void)X8; (void)size1; (void)arr2; (void)size3; (void)arr5; (void)size4; (void)arrsig; (void)sig_size;
+	printf("Built without MLPB_FILE\n");
+	return -1;
+#endif
+}
+
+// Fills the size entries of arrsig used by the model : left as read with SIGMOID_MODE 0, else from sigmoid.csv.
+int sigmoid(int arrsig[], int size){
+	int j, lo, hi;
+	if(SIGMOID_MODE == 0)
+		return 0;
+	for(j=0;j<size;j++){
+		lo = j >> SIGMOID_PWL_STEP_BITS << SIGMOID_PWL_STEP_BITS;
+		hi = lo + (1 << SIGMOID_PWL_STEP_BITS);
+		if(hi>size-1)
+			hi=size-1;
+		if(SIGMOID_MODE == 1)
+			arrsig[j]=sigmoid_rom[j];
+		else
+			arrsig[j]=sigmoid_rom[lo] + (((sigmoid_rom[hi]-sigmoid_rom[lo])*(j-lo)) >> SIGMOID_PWL_STEP_BITS);
+	}
+	return 0;
+}
+
+#if COPROCESSOR
+static void dma_flush(const void *mem, size_t bytes){
+	Xil_DCacheFlushRange((UINTPTR)mem, bytes);
+}
+
+static void dma_invalidate(const void *mem, size_t bytes){
+	Xil_DCacheInvalidateRange((UINTPTR)mem, bytes);
+}
+#endif
+
+// The rows of X (0..255) through the coprocessor (see COPROCESSOR), the model with them, in one batch, polling.
+// Returns 0, or -1 after printing the error.
+int coprocessor(const MLP_Model *model, const int X[], int rows, int RES[]){
+#if COPROCESSOR
+	static uint8_t mem[64*1024] __attribute__((aligned(MLP_DMA_ALIGN)));	// the descriptors and buffers
+	static MLP_Dma_Axi axi;
+	MLP_Dma_Config config = {model->features, model->outputs, COPROCESSOR == 2, rows, 1, 0, 0};
+	MLP_Dma *dma;
+	MLP_Dma_Batch *batch;
+	int r, f, error;
+
+	axi.regs = (volatile uint32_t *)XPAR_AXI_DMA_0_BASEADDR;
+	axi.mem = mem;
+	axi.mem_addr = (UINTPTR)mem;
+	axi.mem_size = sizeof(mem);
+	axi.flush = dma_flush;
+	axi.invalidate = dma_invalidate;
+	if(MLP_Dma_Axi_Reset(&axi) != 0){
+		printf("The AXI DMA does not come out of reset\n");
+		return -1;
+	}
+	dma = MLP_Dma_Open(&MLP_Dma_Axi_Backend, &axi, &config);
+	if(dma == NULL || MLP_Dma_Load_Model(dma, model, SIGMOID_MODE == 0 ? MLP_DMA_SIG_WORDS : 0) != 0){
+		printf("Not enough memory for the DMA\n");
+		return -1;
+	}
+	batch = MLP_Dma_Get(dma);
+	for(r=0;r<rows;r++)
+		for(f=0;f<model->features;f++)
+			MLP_Dma_Row(batch, r)[f] = X[r*model->features+f];
+	MLP_Dma_Submit(dma, batch, rows);
+	batch = MLP_Dma_Wait(dma, -1);
+	error = batch->error;
+	for(r=0;r<rows;r++)
+		RES[r] = batch->results[r*model->outputs];
+	MLP_Dma_Release(dma, batch);
+	MLP_Dma_Close(dma);
+	if(error){
+		printf("DMA error\n");
+		return -1;
+	}
+	return 0;
+#else
+	(void)model; (void)X; (void)rows; (void)RES;
+	printf("Built without COPROCESSOR\n");
+	return -1;
+#endif
+}
@@ -0,0 +1,212 @@
+/*
+ * mlp_batch.c: MLP_Simd_Forward of any number of rows over a pool of threads (see mlp_batch.h)
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "mlp_batch.h"
+
+// Tiles next .. end-1 of a thread : the owner takes next, a thief moves end back
+typedef struct {
+	pthread_mutex_t lock;
+	long next;
+	long end;
+	long steals;
+	char pad[64];		// the shares of two threads not in one cache line
+} MLP_Share;
+
+typedef struct {
+	MLP_Pool *pool;
+	int index;
+} MLP_Thread;
+
+struct MLP_Pool {
+	int threads;
+	pthread_t *thread;
+	MLP_Thread *arg;
+	MLP_Share *share;
+	pthread_mutex_t lock;
+	pthread_cond_t start;
+	pthread_cond_t done;
+	long batch;			// counts the batches, for the threads to see a new one
+	int running;		// threads still working on the batch
+	int quit;
+	// the batch
+	const MLP_Simd_Model *model;
+	MLP_Isa isa;
+	const uint8_t *X;
+	long rows;
+	long tile_rows;
+	int *RES;
+};
+
+// Next tile of thread t : its own, or the back half of the share of another. -1 when there are none left.
+static long mlp_next_tile(MLP_Pool *pool, int t){
+	MLP_Share *own = &pool->share[t], *victim;
+	long tile = -1, half;
+	int i;
+
+	pthread_mutex_lock(&own->lock);
+	if(own->next < own->end)
+		tile = own->next++;
+	pthread_mutex_unlock(&own->lock);
+	for(i=1;i<pool->threads && tile < 0;i++){
+		victim = &pool->share[(t+i) % pool->threads];
+		pthread_mutex_lock(&victim->lock);
+		if(victim->next < victim->end){
+			half = (victim->end - victim->next + 1)/2;
+			victim->end -= half;
+			tile = victim->end;
+		}
+		pthread_mutex_unlock(&victim->lock);
+		if(tile >= 0){
+			// only t takes from the front of its share, and it is empty : thieves see next == end until here
+			pthread_mutex_lock(&own->lock);
+			own->next = tile+1;
+			own->end = tile+half;
+			own->steals++;
+			pthread_mutex_unlock(&own->lock);
+		}
+	}
+	return tile;
+}
+
+static void mlp_run(MLP_Pool *pool, int t){
+	const int F = pool->model->features, O = pool->model->outputs;
+	long tile, first, rows;
+	while((tile = mlp_next_tile(pool, t)) >= 0){
+		first = tile*pool->tile_rows;
+		rows = (pool->rows - first < pool->tile_rows) ? pool->rows - first : pool->tile_rows;
+		MLP_Simd_Forward(pool->model, pool->isa, pool->X + first*F, rows, pool->RES + first*O);
+	}
+}
+
+static void *mlp_thread(void *arg){
+	MLP_Pool *pool = ((MLP_Thread *)arg)->pool;
+	int t = ((MLP_Thread *)arg)->index;
+	long seen = 0;
+	for(;;){
+		pthread_mutex_lock(&pool->lock);
+		while(pool->batch == seen && !pool->quit)
+			pthread_cond_wait(&pool->start, &pool->lock);
+		if(pool->quit){
+			pthread_mutex_unlock(&pool->lock);
+			return NULL;
+		}
+		seen = pool->batch;
+		pthread_mutex_unlock(&pool->lock);
+
+		mlp_run(pool, t);
+
+		pthread_mutex_lock(&pool->lock);
+		if(--pool->running == 0)
+			pthread_cond_signal(&pool->done);
+		pthread_mutex_unlock(&pool->lock);
+	}
+}
+
+MLP_Pool *MLP_Pool_Create(int threads){
+	MLP_Pool *pool = calloc(1, sizeof(MLP_Pool));
+	int t;
+
+	if(pool == NULL)
+		return NULL;
+	if(threads < 1)
+		threads = 1;
+	pool->thread = calloc(threads, sizeof(pthread_t));
+	pool->arg = calloc(threads, sizeof(MLP_Thread));
+	pool->share = calloc(threads, sizeof(MLP_Share));
+	if(pool->thread == NULL || pool->arg == NULL || pool->share == NULL){
+		free(pool->thread);
+		free(pool->arg);
+		free(pool->share);
+		free(pool);
+		return NULL;
+	}
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->start, NULL);
+	pthread_cond_init(&pool->done, NULL);
+	for(t=0;t<threads;t++)
+		pthread_mutex_init(&pool->share[t].lock, NULL);
+	// thread 0 is the caller of MLP_Batch_Forward. If a thread can not be started, the pool has fewer.
+	pool->threads = 1;
+	for(t=1;t<threads;t++){
+		pool->arg[t].pool = pool;
+		pool->arg[t].index = t;
+		if(pthread_create(&pool->thread[t], NULL, mlp_thread, &pool->arg[t]) != 0)
+			break;
+		pool->threads++;
+	}
+	return pool;
+}
+
+void MLP_Pool_Destroy(MLP_Pool *pool){
+	int t;
+	if(pool == NULL)
+		return;
+	pthread_mutex_lock(&pool->lock);
+	pool->quit = 1;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->lock);
+	for(t=1;t<pool->threads;t++)
+		pthread_join(pool->thread[t], NULL);
+	for(t=0;t<pool->threads;t++)
+		pthread_mutex_destroy(&pool->share[t].lock);
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->start);
+	pthread_cond_destroy(&pool->done);
+	free(pool->thread);
+	free(pool->arg);
+	free(pool->share);
+	free(pool);
+}
+
+int MLP_Pool_Threads(const MLP_Pool *pool){
+	return pool->threads;
+}
+
+long MLP_Pool_Steals(const MLP_Pool *pool){
+	long steals = 0;
+	int t;
+	for(t=0;t<pool->threads;t++)
+		steals += pool->share[t].steals;
+	return steals;
+}
+
+int MLP_Batch_Forward(MLP_Pool *pool, const MLP_Simd_Model *model, MLP_Isa isa, const uint8_t X[], long rows, int RES[]){
+	long tiles;
+	int t;
+
+	if(!MLP_Simd_Supported(isa))
+		return -1;
+	if(rows <= 0)
+		return 0;
+	// whole steps of the widest kernel (16 rows) in a tile
+	pool->tile_rows = (MLP_TILE_BYTES / model->features) & ~15L;
+	if(pool->tile_rows < 16)
+		pool->tile_rows = 16;
+	tiles = (rows + pool->tile_rows - 1) / pool->tile_rows;
+	pool->model = model;
+	pool->isa = isa;
+	pool->X = X;
+	pool->rows = rows;
+	pool->RES = RES;
+	for(t=0;t<pool->threads;t++){
+		pool->share[t].next = tiles*t/pool->threads;
+		pool->share[t].end = tiles*(t+1)/pool->threads;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->running = pool->threads - 1;
+	pool->batch++;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->lock);
+
+	mlp_run(pool, 0);
+
+	pthread_mutex_lock(&pool->lock);
+	while(pool->running > 0)
+		pthread_cond_wait(&pool->done, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+	return 0;
+}
@@ -0,0 +1,31 @@
+/*
+ * mlp_batch.h: MLP_Simd_Forward of any number of rows over a pool of threads
+ *
+ * X is cut into tiles of about MLP_TILE_BYTES (rows of a tile stay in L1 / L2 while they are read). Each thread
+ * starts with an equal share of the tiles and takes them from the front; a thread with none left takes the back
+ * half of the share of another (work stealing), so slow tiles or threads do not hold up the batch.
+ * The model is shared read-only, and each tile writes only its own rows of RES.
+ * Needs pthreads (Linux on the Zynq, or the host); the standalone main.c does not use it.
+ */
+
+#ifndef MLP_BATCH_H
+#define MLP_BATCH_H
+
+#include "mlp_simd.h"
+
+#define MLP_TILE_BYTES (32*1024)
+
+typedef struct MLP_Pool MLP_Pool;
+
+// threads threads, the caller being one of them (threads-1 are started). Returns NULL if out of memory.
+MLP_Pool *MLP_Pool_Create(int threads);
+void MLP_Pool_Destroy(MLP_Pool *pool);
+int MLP_Pool_Threads(const MLP_Pool *pool);
+// Tiles taken from another thread, since the pool was created
+long MLP_Pool_Steals(const MLP_Pool *pool);
+
+// rows rows of model->features bytes of X give rows x model->outputs results in RES, as MLP_Simd_Forward.
+// Returns 0, or -1 if isa can not be used.
+int MLP_Batch_Forward(MLP_Pool *pool, const MLP_Simd_Model *model, MLP_Isa isa, const uint8_t X[], long rows, int RES[]);
+
+#endif
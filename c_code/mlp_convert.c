@@ -0,0 +1,332 @@
+/*
+ * mlp_convert.c: converts the csv and .mem files of the model and the data to and from a .mlpb file (see mlp_file.h)
+ *
+ * Build from c_code :
+ *   gcc -O2 -pthread -o mlp_convert mlp_convert.c mlp_file.c csv_load.c
+ *
+ *   mlp_convert to-bin  out.mlpb X.csv w_hid.csv w_out.csv sigmoid.csv [labels.csv]
+ *   mlp_convert to-csv  in.mlpb  X.csv w_hid.csv w_out.csv sigmoid.csv [labels.csv]
+ *   mlp_convert from-mem out.mlpb test_input.mem labels.mem [FxHxO]
+ *   mlp_convert to-mem  in.mlpb  test_input.mem [labels.mem]
+ *   mlp_convert info    in.mlpb
+ *
+ * The shape is taken from the csv files (the values per line of X.csv, w_hid.csv and w_out.csv). test_input.mem has
+ * X, w_hid, w_out and sigmoid one after the other as in tb_myip_v1_1.v, so its shape is given (7x2x1 by default) and
+ * the rows are what is left for X. The files are written as those of the repo : the csv files with commas and \n,
+ * the .mem files in upper case hex with tabs and \r\n. A file name of - is skipped (no labels).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "csv_load.h"
+#include "mlp_file.h"
+
+#define LABEL_THRESHOLD 39		// labels.csv is (result > 39)
+
+static int failed(const char *path, const char *what){
+	printf("%s : %s\n", path, what);
+	return 1;
+}
+
+static int csv_failed(const char *path, const CSV_Error *err){
+	printf("%s line %ld value %ld : %s\n", path, err->line, err->column, err->what);
+	return 1;
+}
+
+static int to_bin(char *argv[], int argc){
+	const char *out = argv[0], *path_labels = (argc > 5) ? argv[5] : "-";
+	MLP_File file;
+	CSV_Error err;
+	uint8_t *B = NULL, *C = NULL, *SIG = NULL, *X = NULL, *labels = NULL;
+	uint32_t *words = NULL;
+	const char *what;
+	long n[5];
+	int columns[5], i, result = 1;
+
+	memset(&file, 0, sizeof(file));
+	for(i=0;i<4 || (i == 4 && strcmp(path_labels, "-") != 0);i++)
+		if((n[i] = CSV_Count(argv[i+1], &columns[i], &err)) < 0)
+			return csv_failed(argv[i+1], &err);
+	file.features = columns[0];
+	file.hidden = columns[1];
+	file.outputs = columns[2];
+	file.sig_size = n[3];
+	file.rows = file.features ? n[0] / file.features : 0;
+	file.label_bits = MLP_Label_Bits(file.outputs);
+	file.label_threshold = LABEL_THRESHOLD;
+	if(file.features < 1 || file.hidden < 1 || file.outputs < 1 || n[1] != (long)(file.features+1)*file.hidden
+			|| n[2] != (long)(file.hidden+1)*file.outputs || (i == 5 && n[4] != file.rows)){
+		printf("The shapes of the files do not match : X %ld x %d, w_hid %ld x %d, w_out %ld x %d\n",
+			file.rows, file.features, n[1] / (file.hidden ? file.hidden : 1), file.hidden,
+			n[2] / (file.outputs ? file.outputs : 1), file.outputs);
+		return 1;
+	}
+	X = malloc(n[0] + 1);
+	B = malloc(n[1]);
+	C = malloc(n[2]);
+	SIG = malloc(n[3] + 1);
+	if(i == 5){
+		labels = malloc(file.rows + 1);
+		words = malloc(MLP_Label_Words(file.rows, file.label_bits)*4 + 4);
+	}
+	if(X == NULL || B == NULL || C == NULL || SIG == NULL || (i == 5 && (labels == NULL || words == NULL)))
+		printf("Out of memory\n");
+	else if(CSV_Load_U8(argv[1], X, n[0], file.features, &err) < 0)
+		csv_failed(argv[1], &err);
+	else if(CSV_Load_U8(argv[2], B, n[1], file.hidden, &err) < 0)
+		csv_failed(argv[2], &err);
+	else if(CSV_Load_U8(argv[3], C, n[2], file.outputs, &err) < 0)
+		csv_failed(argv[3], &err);
+	else if(CSV_Load_U8(argv[4], SIG, n[3], 0, &err) < 0)
+		csv_failed(argv[4], &err);
+	else if(i == 5 && CSV_Load_U8(path_labels, labels, file.rows, 1, &err) < 0)
+		csv_failed(path_labels, &err);
+	else{
+		if(i == 5)
+			MLP_Pack_Labels(labels, file.rows, file.label_bits, words);
+		file.B = B;
+		file.C = C;
+		file.SIG = SIG;
+		file.X = X;
+		file.labels = words;
+		if(MLP_File_Write(out, &file, &what) != 0)
+			failed(out, what);
+		else
+			result = 0;
+	}
+	free(X);
+	free(B);
+	free(C);
+	free(SIG);
+	free(labels);
+	free(words);
+	return result;
+}
+
+// count values of data, columns per line (0 : all on one line), as csv or .mem
+static void write_values(FILE *out_file, const uint8_t data[], long count, int columns, int mem){
+	const char *sep = mem ? "\t" : ",", *eol = mem ? "\r\n" : "\n";
+	long i;
+	if(columns == 0)
+		columns = count;
+	for(i=0;i<count;i++){
+		fprintf(out_file, mem ? "%X" : "%d", data[i]);
+		fputs((i+1) % columns ? sep : eol, out_file);
+	}
+}
+
+static int write_labels(const char *path, const MLP_File *file, int mem){
+	FILE *out_file;
+	long r;
+	if(file->labels == NULL)
+		return failed(path, "the .mlpb file has no labels");
+	out_file = fopen(path, "wb");
+	if(out_file == NULL)
+		return failed(path, "can not create the file");
+	for(r=0;r<file->rows;r++)
+		fprintf(out_file, mem ? "%X\r\n" : "%d\n", MLP_Label(file->labels, r, file->label_bits));
+	if(fclose(out_file) != 0)
+		return failed(path, "can not write the file");
+	return 0;
+}
+
+static int to_csv(const MLP_File *file, char *argv[], int argc){
+	const uint8_t *data[4] = {file->X, file->B, file->C, file->SIG};
+	const long count[4] = {file->rows*file->features, (long)(file->features+1)*file->hidden,
+		(long)(file->hidden+1)*file->outputs, file->sig_size};
+	const int columns[4] = {file->features, file->hidden, file->outputs, 0};
+	FILE *out_file;
+	int i;
+
+	for(i=0;i<4;i++){
+		if(strcmp(argv[i], "-") == 0)
+			continue;
+		if(data[i] == NULL)
+			return failed(argv[i], "not in the .mlpb file");
+		out_file = fopen(argv[i], "wb");
+		if(out_file == NULL)
+			return failed(argv[i], "can not create the file");
+		write_values(out_file, data[i], count[i], columns[i], 0);
+		if(fclose(out_file) != 0)
+			return failed(argv[i], "can not write the file");
+	}
+	if(argc > 4 && strcmp(argv[4], "-") != 0)
+		return write_labels(argv[4], file, 0);
+	return 0;
+}
+
+static int to_mem(const MLP_File *file, char *argv[], int argc){
+	const char *path = argv[0];
+	FILE *out_file;
+	long pos;
+	if(file->X == NULL || file->B == NULL || file->C == NULL || file->SIG == NULL)
+		return failed(path, "the .mlpb file needs X and the whole model");
+	out_file = fopen(path, "wb");
+	if(out_file == NULL)
+		return failed(path, "can not create the file");
+	write_values(out_file, file->X, file->rows*file->features, file->features, 1);
+	write_values(out_file, file->B, (long)(file->features+1)*file->hidden, file->hidden, 1);
+	write_values(out_file, file->C, (long)(file->hidden+1)*file->outputs, file->outputs, 1);
+	write_values(out_file, file->SIG, file->sig_size, 0, 1);
+	// as test_input.mem : no \r\n after the last line
+	pos = ftell(out_file);
+	if(fclose(out_file) != 0 || truncate(path, pos - 2) != 0)
+		return failed(path, "can not write the file");
+	if(argc > 1 && strcmp(argv[1], "-") != 0)
+		return write_labels(argv[1], file, 1);
+	return 0;
+}
+
+// The hex values of the .mem file at path (// comments skipped) into a new array. Returns the count, or -1.
+static long read_mem(const char *path, uint8_t **out){
+	FILE *in_file = fopen(path, "rb");
+	uint8_t *grown;
+	long n = 0, size = 0;
+	unsigned value;
+	int c;
+	*out = NULL;
+	if(in_file == NULL)
+		return failed(path, "can not open the file"), -1;
+	for(;;){
+		c = fgetc(in_file);
+		if(c == '/'){
+			while(c != '\n' && c != EOF)
+				c = fgetc(in_file);
+		}
+		if(c == EOF)
+			break;
+		if(c == ' ' || c == '\t' || c == '\r' || c == '\n')
+			continue;
+		ungetc(c, in_file);
+		if(fscanf(in_file, "%x", &value) != 1 || value > 255){
+			fclose(in_file);
+			free(*out);
+			printf("%s value %ld : not a hex byte\n", path, n+1);
+			return -1;
+		}
+		if(n == size){
+			size = size ? 2*size : 1024;
+			grown = realloc(*out, size);
+			if(grown == NULL){
+				fclose(in_file);
+				free(*out);
+				return failed(path, "out of memory"), -1;
+			}
+			*out = grown;
+		}
+		(*out)[n++] = value;
+	}
+	fclose(in_file);
+	return n;
+}
+
+static int from_mem(char *argv[], int argc){
+	const char *out = argv[0];
+	MLP_File file;
+	uint8_t *words = NULL, *labels = NULL;
+	uint32_t *packed = NULL;
+	const char *what;
+	long n, n_labels, model;
+	int result = 1, ok = 1;
+
+	memset(&file, 0, sizeof(file));
+	file.features = 7;
+	file.hidden = 2;
+	file.outputs = 1;
+	if(argc > 3 && sscanf(argv[3], "%dx%dx%d", &file.features, &file.hidden, &file.outputs) != 3)
+		return failed(argv[3], "not a shape FxHxO");
+	file.sig_size = MLP_SIG_SIZE;
+	file.label_bits = MLP_Label_Bits(file.outputs);
+	file.label_threshold = LABEL_THRESHOLD;
+	if(file.features < 1 || file.hidden < 1 || file.outputs < 1)
+		return failed(argv[3], "not a shape FxHxO");
+	model = (long)(file.features+1)*file.hidden + (long)(file.hidden+1)*file.outputs + file.sig_size;
+	if((n = read_mem(argv[1], &words)) < 0)
+		return 1;
+	if(n < model || (n - model) % file.features != 0){
+		free(words);
+		printf("%s : %ld values, not rows of %d and a %dx%dx%d model\n", argv[1], n, file.features,
+			file.features, file.hidden, file.outputs);
+		return 1;
+	}
+	file.rows = (n - model) / file.features;
+	file.X = words;
+	file.B = file.X + file.rows*file.features;
+	file.C = file.B + (file.features+1)*file.hidden;
+	file.SIG = file.C + (file.hidden+1)*file.outputs;
+	if(argc > 2 && strcmp(argv[2], "-") != 0){
+		if((n_labels = read_mem(argv[2], &labels)) < 0){
+			free(words);
+			return 1;
+		}
+		packed = malloc(MLP_Label_Words(file.rows, file.label_bits)*4 + 4);
+		ok = 0;
+		if(n_labels != file.rows)
+			printf("%s : %ld labels for %ld rows\n", argv[2], n_labels, file.rows);
+		else if(packed == NULL)
+			printf("Out of memory\n");
+		else{
+			MLP_Pack_Labels(labels, file.rows, file.label_bits, packed);
+			file.labels = packed;
+			ok = 1;
+		}
+	}
+	if(ok){
+		if(MLP_File_Write(out, &file, &what) != 0)
+			failed(out, what);
+		else
+			result = 0;
+	}
+	free(words);
+	free(labels);
+	free(packed);
+	return result;
+}
+
+static int info(const MLP_File *file){
+	const MLP_File_Header *h = file->header;
+	const char *name[MLP_SECTIONS] = {"B", "C", "SIG", "X", "LABELS"};
+	int i;
+	printf("version %d, %dx%dx%d, %ld rows, %d-bit X, %d-bit weights, %d-bit sigmoid (%d entries), %d-bit labels,"
+		" sums / %d, label threshold %d\n", h->version, file->features, file->hidden, file->outputs, file->rows,
+		h->data_bits, h->weight_bits, h->sig_bits, file->sig_size, h->label_bits, 1 << h->scale_shift,
+		file->label_threshold);
+	for(i=0;i<MLP_SECTIONS;i++)
+		if(h->section[i].offset != 0)
+			printf("%-6s : offset %8llu, %10llu bytes, CRC-32 %08X\n", name[i], (unsigned long long)h->section[i].offset,
+				(unsigned long long)h->section[i].bytes, h->section[i].crc);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	MLP_File file;
+	const char *what;
+	int result;
+
+	if(argc >= 7 && strcmp(argv[1], "to-bin") == 0)
+		return to_bin(argv+2, argc-2);
+	if(argc >= 4 && strcmp(argv[1], "from-mem") == 0)
+		return from_mem(argv+2, argc-2);
+	if(argc >= 3 && (strcmp(argv[1], "info") == 0 || (argc >= 7 && strcmp(argv[1], "to-csv") == 0)
+			|| (argc >= 4 && strcmp(argv[1], "to-mem") == 0))){
+		if(MLP_File_Open(argv[2], &file, MLP_FILE_VERIFY, &what) != 0)
+			return failed(argv[2], what);
+		if(strcmp(argv[1], "to-csv") == 0)
+			result = to_csv(&file, argv+3, argc-3);
+		else if(strcmp(argv[1], "to-mem") == 0)
+			result = to_mem(&file, argv+3, argc-3);
+		else
+			result = info(&file);
+		MLP_File_Close(&file);
+		return result;
+	}
+	printf("mlp_convert to-bin   out.mlpb X.csv w_hid.csv w_out.csv sigmoid.csv [labels.csv]\n"
+		"mlp_convert to-csv   in.mlpb X.csv w_hid.csv w_out.csv sigmoid.csv [labels.csv]\n"
+		"mlp_convert from-mem out.mlpb test_input.mem labels.mem [FxHxO]\n"
+		"mlp_convert to-mem   in.mlpb test_input.mem [labels.mem]\n"
+		"mlp_convert info     in.mlpb\n");
+	return 1;
+}
@@ -0,0 +1,329 @@
+/*
+ * mlp_dma.c: driver of the coprocessors through an AXI DMA (see mlp_dma.h)
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "mlp_dma.h"
+
+#define ROUND_UP(n, to) (((n) + (to) - 1) / (to) * (to))
+#define CHUNKS(bytes) (((bytes) + MLP_DMA_CHUNK_BYTES - 1) / MLP_DMA_CHUNK_BYTES)
+
+enum { SLOT_FREE, SLOT_FILLING, SLOT_BUSY, SLOT_DONE };
+
+// Descriptors of a batch on MM2S (header, model, X) and S2MM (results)
+typedef struct {
+	MLP_Dma_Desc *tx, *rx;
+	uint64_t tx_addr, rx_addr;
+} MLP_Dma_Chain;
+
+typedef struct {
+	MLP_Dma_Batch batch;
+	int state;
+	MLP_Dma_Chain *chain;	// of the batch in flight
+	int tx_used, rx_used;
+	uint32_t *header;
+	uint64_t header_addr, X_addr;
+	uint8_t *res;
+	uint64_t res_addr;
+	size_t res_bytes;		// of the batch in flight, telemetry included
+} MLP_Dma_Slot;
+
+struct MLP_Dma {
+	const MLP_Dma_Backend *backend;
+	void *device;
+	MLP_Dma_Config config;
+	int row_bytes;
+	int tx_count, rx_count;		// descriptors of a chain
+	int chains;					// the batches take the chains in turn
+	MLP_Dma_Chain *chain;
+	size_t X_bytes, res_bytes;	// buffers of a slot
+	uint8_t *mem;
+	uint64_t mem_addr;
+	MLP_Dma_Slot *slot;
+	uint32_t *model;			// words of the last MLP_Dma_Load_Model
+	uint64_t model_addr;
+	int model_words;
+	int model_pending;			// to send with the next batch
+	int next_get;				// slot MLP_Dma_Get gives next
+	int next_submit;			// slot to submit next : batches go in the order of the slots
+	int next_done;				// oldest slot in flight
+	int in_flight;
+	long submitted, completed;
+};
+
+static size_t label_words(int outputs, long rows){
+	int bits = 1;
+	while((1 << bits) < outputs)
+		bits++;
+	return (rows + 32/bits - 1) / (32/bits);
+}
+
+size_t MLP_Dma_Result_Bytes(const MLP_Dma *dma, long rows){
+	if(dma->config.command & CMD_LABELS)
+		return label_words(dma->config.outputs, rows) * 4;
+	return ROUND_UP(rows * dma->config.outputs, 4);
+}
+
+long MLP_Dma_Submitted(const MLP_Dma *dma){
+	return dma->submitted;
+}
+
+long MLP_Dma_Completed(const MLP_Dma *dma){
+	return dma->completed;
+}
+
+static void flush(MLP_Dma *dma, const void *mem, size_t bytes){
+	if(dma->backend->flush != NULL)
+		dma->backend->flush(dma->device, mem, bytes);
+}
+
+static void invalidate(MLP_Dma *dma, const void *mem, size_t bytes){
+	if(dma->backend->invalidate != NULL)
+		dma->backend->invalidate(dma->device, mem, bytes);
+}
+
+MLP_Dma *MLP_Dma_Open(const MLP_Dma_Backend *backend, void *device, const MLP_Dma_Config *config){
+	MLP_Dma *dma;
+	size_t desc_bytes, slot_bytes;
+	uint8_t *mem;
+	uint64_t addr;
+	int s;
+
+	if(config->features < 1 || config->outputs < 1 || config->rows_max < 1 || config->slots < 1)
+		return NULL;
+	dma = (MLP_Dma *)calloc(1, sizeof(MLP_Dma));
+	if(dma == NULL)
+		return NULL;
+	// One chain more than the slots : the DMA goes on from the next of the last descriptor it took, which may not be
+	// taken from a chain that is written again, nor be the tail again (a full ring)
+	dma->chains = config->slots + 1;
+	dma->slot = (MLP_Dma_Slot *)calloc(config->slots, sizeof(MLP_Dma_Slot));
+	dma->chain = (MLP_Dma_Chain *)calloc(dma->chains, sizeof(MLP_Dma_Chain));
+	if(dma->slot == NULL || dma->chain == NULL){
+		free(dma->slot);
+		free(dma->chain);
+		free(dma);
+		return NULL;
+	}
+	dma->backend = backend;
+	dma->device = device;
+	dma->config = *config;
+	dma->row_bytes = config->features + (config->bias_column ? 1 : 0);
+	dma->X_bytes = ROUND_UP(ROUND_UP(config->rows_max * dma->row_bytes, 4), MLP_DMA_ALIGN);
+	dma->res_bytes = ROUND_UP(MLP_Dma_Result_Bytes(dma, config->rows_max) + MLP_TELEMETRY_WORDS*4, MLP_DMA_ALIGN);
+	// header, the model (up to 2 chunks until it is loaded, see MLP_Dma_Load_Model), X
+	dma->tx_count = 1 + 2 + CHUNKS(dma->X_bytes);
+	dma->rx_count = CHUNKS(dma->res_bytes);
+
+	// One block : the descriptors of all the chains, then the header, X and results of each slot
+	desc_bytes = (size_t)dma->chains * (dma->tx_count + dma->rx_count) * sizeof(MLP_Dma_Desc);
+	slot_bytes = MLP_DMA_ALIGN + dma->X_bytes + dma->res_bytes;
+	mem = (uint8_t *)backend->alloc(device, desc_bytes + config->slots*slot_bytes, &addr);
+	if(mem == NULL){
+		free(dma->slot);
+		free(dma->chain);
+		free(dma);
+		return NULL;
+	}
+	memset(mem, 0, desc_bytes);
+	dma->mem = mem;
+	dma->mem_addr = addr;
+	for(s = 0; s < dma->chains; s++){
+		MLP_Dma_Chain *chain = &dma->chain[s];
+		size_t desc = (size_t)s * (dma->tx_count + dma->rx_count) * sizeof(MLP_Dma_Desc);
+		chain->tx = (MLP_Dma_Desc *)(mem + desc);
+		chain->tx_addr = addr + desc;
+		chain->rx = chain->tx + dma->tx_count;
+		chain->rx_addr = chain->tx_addr + dma->tx_count*sizeof(MLP_Dma_Desc);
+	}
+	for(s = 0; s < config->slots; s++){
+		MLP_Dma_Slot *slot = &dma->slot[s];
+		size_t buffers = desc_bytes + s*slot_bytes;
+		slot->header = (uint32_t *)(mem + buffers);
+		slot->header_addr = addr + buffers;
+		slot->batch.X = mem + buffers + MLP_DMA_ALIGN;
+		slot->X_addr = slot->header_addr + MLP_DMA_ALIGN;
+		slot->res = slot->batch.X + dma->X_bytes;
+		slot->res_addr = slot->X_addr + dma->X_bytes;
+		slot->batch.row_bytes = dma->row_bytes;
+		slot->batch.bias = config->bias_column ? 1 : 0;
+		slot->batch.index = s;
+		memset(slot->batch.X, 0, dma->X_bytes);
+	}
+	return dma;
+}
+
+void MLP_Dma_Close(MLP_Dma *dma){
+	while(dma->in_flight > 0 && MLP_Dma_Wait(dma, -1) != NULL)
+		;
+	dma->backend->stop(dma->device);
+	if(dma->model != NULL)
+		dma->backend->free(dma->device, dma->model);
+	dma->backend->free(dma->device, dma->mem);
+	free(dma->slot);
+	free(dma->chain);
+	free(dma);
+}
+
+int MLP_Dma_Load_Model(MLP_Dma *dma, const MLP_Model *model, int sig_words){
+	const int B_words = (model->features+1)*model->hidden, C_words = (model->hidden+1)*model->outputs;
+	const int words = B_words + C_words + sig_words;
+	uint64_t addr;
+	int i;
+
+	if(dma->in_flight > 0 || model->features != dma->config.features || model->outputs != dma->config.outputs
+			|| sig_words < 0 || sig_words > MLP_SIG_SIZE || words*4 > 2*MLP_DMA_CHUNK_BYTES)
+		return -1;
+	if(dma->model != NULL)
+		dma->backend->free(dma->device, dma->model);
+	dma->model = (uint32_t *)dma->backend->alloc(dma->device, ROUND_UP(words*4, MLP_DMA_ALIGN), &addr);
+	if(dma->model == NULL)
+		return -1;
+	for(i = 0; i < B_words; i++)
+		dma->model[i] = model->B[i];
+	for(i = 0; i < C_words; i++)
+		dma->model[B_words+i] = model->C[i];
+	for(i = 0; i < sig_words; i++)
+		dma->model[B_words+C_words+i] = model->SIG[i];
+	flush(dma, dma->model, words*4);
+	dma->model_addr = addr;
+	dma->model_words = words;
+	dma->model_pending = 1;
+	return 0;
+}
+
+MLP_Dma_Batch *MLP_Dma_Get(MLP_Dma *dma){
+	MLP_Dma_Slot *slot = &dma->slot[dma->next_get];
+	if(slot->state != SLOT_FREE)
+		return NULL;
+	slot->state = SLOT_FILLING;
+	dma->next_get = (dma->next_get + 1) % dma->config.slots;
+	return &slot->batch;
+}
+
+// Descriptors of bytes bytes at addr, from desc[*used] (at desc_addr), MLP_DMA_CHUNK_BYTES at most each
+static void add_chunks(MLP_Dma_Desc desc[], uint64_t desc_addr, int *used, uint64_t addr, size_t bytes){
+	size_t n;
+	for(; bytes > 0; bytes -= n, addr += n){
+		MLP_Dma_Desc *d = &desc[(*used)++];
+		uint64_t next = desc_addr + *used * sizeof(MLP_Dma_Desc);
+		n = (bytes < MLP_DMA_CHUNK_BYTES) ? bytes : MLP_DMA_CHUNK_BYTES;
+		d->next = (uint32_t)next;
+		d->next_msb = (uint32_t)(next >> 32);
+		d->buffer = (uint32_t)addr;
+		d->buffer_msb = (uint32_t)(addr >> 32);
+		d->control = n;
+		d->status = 0;	// the DMA stops on a descriptor already complete
+	}
+}
+
+// Links the last descriptor used to next, which the DMA fetches after it (the first of the next chain)
+static void link_last(MLP_Dma_Desc desc[], int used, uint64_t next){
+	desc[used-1].next = (uint32_t)next;
+	desc[used-1].next_msb = (uint32_t)(next >> 32);
+}
+
+int MLP_Dma_Submit(MLP_Dma *dma, MLP_Dma_Batch *batch, long rows){
+	MLP_Dma_Slot *slot = &dma->slot[batch->index];
+	MLP_Dma_Chain *chain = &dma->chain[dma->submitted % dma->chains];
+	MLP_Dma_Chain *next = &dma->chain[(dma->submitted + 1) % dma->chains];
+	size_t X_bytes = ROUND_UP(rows * dma->row_bytes, 4), res_bytes;
+	long r;
+
+	if(slot->state != SLOT_FILLING || batch->index != dma->next_submit || rows < 1 || rows > dma->config.rows_max)
+		return -1;
+	slot->header[0] = CMD_STREAM_ROWS | CMD_PACKED | dma->config.command | (dma->model_pending ? CMD_LOAD_MODEL : 0);
+	for(r = 0; batch->bias && r < rows; r++)
+		batch->X[r*dma->row_bytes] = 1;
+	memset(batch->X + rows*dma->row_bytes, 0, X_bytes - rows*dma->row_bytes);	// the unused lanes of the last word
+	res_bytes = MLP_Dma_Result_Bytes(dma, rows) + ((dma->config.command & CMD_TELEMETRY) ? MLP_TELEMETRY_WORDS*4 : 0);
+
+	slot->chain = chain;
+	slot->tx_used = 0;
+	add_chunks(chain->tx, chain->tx_addr, &slot->tx_used, slot->header_addr, 4);
+	if(dma->model_pending)
+		add_chunks(chain->tx, chain->tx_addr, &slot->tx_used, dma->model_addr, dma->model_words*4);
+	add_chunks(chain->tx, chain->tx_addr, &slot->tx_used, slot->X_addr, X_bytes);
+	chain->tx[0].control |= MLP_DESC_SOF;
+	chain->tx[slot->tx_used-1].control |= MLP_DESC_EOF;
+	link_last(chain->tx, slot->tx_used, next->tx_addr);
+	// exactly the bytes of the results : the S2MM descriptors left over would take the start of the next batch
+	slot->rx_used = 0;
+	add_chunks(chain->rx, chain->rx_addr, &slot->rx_used, slot->res_addr, res_bytes);
+	link_last(chain->rx, slot->rx_used, next->rx_addr);
+	slot->res_bytes = res_bytes;
+
+	batch->rows = rows;
+	batch->results = NULL;
+	batch->telemetry = NULL;
+	batch->error = 0;
+	flush(dma, slot->header, 4);
+	flush(dma, batch->X, X_bytes);
+	flush(dma, chain->tx, (dma->tx_count + dma->rx_count) * sizeof(MLP_Dma_Desc));
+	invalidate(dma, slot->res, res_bytes);	// no dirty line of the results is written back over them
+
+	slot->state = SLOT_BUSY;
+	dma->model_pending = 0;
+	dma->next_submit = (dma->next_submit + 1) % dma->config.slots;
+	dma->in_flight++;
+	dma->submitted++;
+	// S2MM first, so that the results have somewhere to go
+	dma->backend->start(dma->device, MLP_DMA_S2MM, chain->rx_addr,
+			chain->rx_addr + (slot->rx_used-1)*sizeof(MLP_Dma_Desc));
+	dma->backend->start(dma->device, MLP_DMA_MM2S, chain->tx_addr,
+			chain->tx_addr + (slot->tx_used-1)*sizeof(MLP_Dma_Desc));
+	return 0;
+}
+
+static uint32_t desc_status(const MLP_Dma_Desc *d){
+	return __atomic_load_n(&d->status, __ATOMIC_ACQUIRE);
+}
+
+MLP_Dma_Batch *MLP_Dma_Poll(MLP_Dma *dma){
+	MLP_Dma_Slot *slot = &dma->slot[dma->next_done];
+	MLP_Dma_Chain *chain = slot->chain;
+	int i;
+
+	if(dma->in_flight == 0)
+		return NULL;
+	invalidate(dma, chain->tx, (dma->tx_count + dma->rx_count) * sizeof(MLP_Dma_Desc));
+	// the results come after all the input is read, so the last S2MM descriptor is the last one done
+	if(!(desc_status(&chain->rx[slot->rx_used-1]) & MLP_DESC_CMPLT)
+			|| !(desc_status(&chain->tx[slot->tx_used-1]) & MLP_DESC_CMPLT))
+		return NULL;
+	for(i = 0; i < slot->tx_used; i++)
+		if(chain->tx[i].status & MLP_DESC_ERRORS)
+			slot->batch.error = -1;
+	for(i = 0; i < slot->rx_used; i++)
+		if(chain->rx[i].status & MLP_DESC_ERRORS)
+			slot->batch.error = -1;
+	invalidate(dma, slot->res, slot->res_bytes);
+	slot->batch.results = slot->res;
+	if(dma->config.command & CMD_TELEMETRY)
+		slot->batch.telemetry = (const uint32_t *)(slot->res + slot->res_bytes - MLP_TELEMETRY_WORDS*4);
+
+	slot->state = SLOT_DONE;
+	dma->next_done = (dma->next_done + 1) % dma->config.slots;
+	dma->in_flight--;
+	dma->completed++;
+	return &slot->batch;
+}
+
+MLP_Dma_Batch *MLP_Dma_Wait(MLP_Dma *dma, int timeout_ms){
+	MLP_Dma_Batch *batch;
+	while((batch = MLP_Dma_Poll(dma)) == NULL){
+		if(dma->in_flight == 0)
+			return NULL;
+		// an interrupt since the last wait returns at once, so a batch done after the poll is not missed
+		if(dma->config.irq && dma->backend->wait != NULL && dma->backend->wait(dma->device, timeout_ms) != 0)
+			return MLP_Dma_Poll(dma);
+	}
+	return batch;
+}
+
+void MLP_Dma_Release(MLP_Dma *dma, MLP_Dma_Batch *batch){
+	MLP_Dma_Slot *slot = &dma->slot[batch->index];
+	if(slot->state == SLOT_DONE)
+		slot->state = SLOT_FREE;
+}
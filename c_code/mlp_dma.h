@@ -0,0 +1,176 @@
+/*
+ * mlp_dma.h: driver of the coprocessors through an AXI DMA in scatter-gather mode
+ *
+ * Batches of X rows go to S_AXIS on the MM2S channel and their results come back from M_AXIS on S2MM, as
+ * CMD_STREAM_ROWS | CMD_PACKED batches (any number of rows, 4 values per word). A ring of config.slots batch buffers
+ * (2 : double buffering) is in flight at once : the caller fills batch N+1 (MLP_Dma_Get, MLP_Dma_Submit) while the
+ * coprocessor computes batch N, and takes the batches back in order (MLP_Dma_Poll, MLP_Dma_Wait, MLP_Dma_Release).
+ * A batch is a chain of descriptors on each channel (MLP_Dma_Desc, the layout of the AXI DMA) : the header word, the
+ * model (with the first batch after MLP_Dma_Load_Model), then X in MLP_DMA_CHUNK_BYTES pieces; and the results.
+ * The chains (one more than the slots) are linked in a ring, so a submitted batch only moves the tail of each channel.
+ *
+ * The device behind the DMA is a backend (MLP_Dma_Backend) :
+ *   MLP_Dma_Axi_Backend (mlp_dma_axi.c) : the registers of an AXI DMA, standalone or mapped on Linux
+ *   MLP_Dma_Sim_Backend (hls_code/dma_sim_HLS.cpp) : the DMA and myip_v1_0_HLS (its C simulation) in a thread, to
+ *       build, test and time the driver on any Linux host (see dma_bench.c)
+ */
+
+#ifndef MLP_DMA_H
+#define MLP_DMA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "mlp_forward.h"
+#include "mlp_telemetry.h"
+
+// Header bits, as in myip_v1_0_HLS.h (CMD_TELEMETRY is in mlp_telemetry.h)
+#define CMD_INFER_ONLY 0
+#define CMD_LOAD_MODEL 1
+#define CMD_STREAM_ROWS 2
+#define CMD_PACKED 4
+#define CMD_LABELS 8
+#define LABEL_THRESHOLD_SHIFT 16
+
+#define MLP_DMA_ALIGN 64			// descriptors and buffers (cache lines are never shared with the CPU)
+#define MLP_DMA_CHUNK_BYTES 8192	// bytes of a descriptor at most (the buffer length register is 14 bits by default)
+#define MLP_DMA_SIG_WORDS 256		// SIG words of a model for SIGMOID_TABLE / SIGM_MODE 0, else 0
+
+// Channels
+#define MLP_DMA_MM2S 0
+#define MLP_DMA_S2MM 1
+
+// Scatter-gather descriptor of the AXI DMA (PG021), MLP_DMA_ALIGN aligned
+typedef struct {
+	uint32_t next;			// address of the next descriptor
+	uint32_t next_msb;
+	uint32_t buffer;		// address of the buffer
+	uint32_t buffer_msb;
+	uint32_t reserved[2];
+	uint32_t control;		// bytes of the buffer, MLP_DESC_SOF / MLP_DESC_EOF on MM2S
+	uint32_t status;		// written by the DMA : bytes moved, MLP_DESC_CMPLT, errors, MLP_DESC_SOF / EOF on S2MM
+	uint32_t app[5];
+	uint32_t pad[3];
+} MLP_Dma_Desc;
+
+#define MLP_DESC_BYTES 0x3FFFFFFu
+#define MLP_DESC_EOF (1u << 26)
+#define MLP_DESC_SOF (1u << 27)
+#define MLP_DESC_ERRORS (7u << 28)
+#define MLP_DESC_CMPLT (1u << 31)
+
+typedef struct {
+	const char *name;
+	// Memory the DMA can reach, MLP_DMA_ALIGN aligned, and its address for the DMA in *addr. NULL if there is none.
+	void *(*alloc)(void *device, size_t bytes, uint64_t *addr);
+	void (*free)(void *device, void *mem);
+	// Cache maintenance before the DMA reads bytes at mem / before the CPU reads what it wrote. NULL if coherent.
+	void (*flush)(void *device, const void *mem, size_t bytes);
+	void (*invalidate)(void *device, const void *mem, size_t bytes);
+	// Gives the descriptors up to tail to channel. first is the first of them, where a channel not running yet starts.
+	void (*start)(void *device, int channel, uint64_t first, uint64_t tail);
+	// Halts both channels once idle, so that the next start begins at its first descriptor (MLP_Dma_Close)
+	void (*stop)(void *device);
+	// Waits up to timeout_ms (< 0 : no limit) for an S2MM interrupt since the last call. 0, or -1 on timeout.
+	// NULL if the backend has no interrupts.
+	int (*wait)(void *device, int timeout_ms);
+} MLP_Dma_Backend;
+
+typedef struct {
+	int features;		// values of a row of X
+	int outputs;		// results of a row
+	int bias_column;	// 1 : rows are sent with a 1 before the features (simple_ML_IP_v1_0), 0 : not (myip_v1_0_HLS)
+	long rows_max;		// rows of a batch, at most
+	int slots;			// batches in flight, at most
+	int command;		// header bits of every batch : CMD_LABELS | threshold << LABEL_THRESHOLD_SHIFT, CMD_TELEMETRY
+	int irq;			// 1 : MLP_Dma_Wait sleeps on the backend interrupt, 0 : it polls the descriptors
+} MLP_Dma_Config;
+
+typedef struct {
+	uint8_t *X;				// rows_max rows of row_bytes bytes, filled by the caller (see MLP_Dma_Row)
+	int row_bytes;			// features, plus bias
+	int bias;				// 1 with the bias column : each row starts with a 1 (written by the driver), else 0
+	long rows;				// rows submitted
+	const uint8_t *results;	// once complete : rows x outputs results (saturated to 8 bits), or the labels packed
+							// 32 / label bits per word (CMD_LABELS)
+	const uint32_t *telemetry;	// once complete, with CMD_TELEMETRY : the MLP_TELEMETRY_WORDS trailer words, else NULL
+	int error;				// once complete : 0, or -1 if a descriptor came back with an error
+	int index;				// slot
+	void *user;				// for the caller
+} MLP_Dma_Batch;
+
+typedef struct MLP_Dma MLP_Dma;
+
+// A driver of the device behind backend. Returns NULL if the backend has not enough memory or config is not valid.
+MLP_Dma *MLP_Dma_Open(const MLP_Dma_Backend *backend, void *device, const MLP_Dma_Config *config);
+// Waits for the batches in flight, stops the DMA, then frees the memory (the backend itself is closed by its owner)
+void MLP_Dma_Close(MLP_Dma *dma);
+
+// Sends model (B, C, then sig_words of SIG) with the next batch. Returns 0, or -1 if batches are in flight (the
+// buffer of the model is replaced), the shape of model is not the one of config, it is over 2 MLP_DMA_CHUNK_BYTES
+// descriptors, or there is no memory.
+int MLP_Dma_Load_Model(MLP_Dma *dma, const MLP_Model *model, int sig_words);
+
+// The next free batch, for the caller to fill, or NULL if all the slots are in flight or not released yet
+MLP_Dma_Batch *MLP_Dma_Get(MLP_Dma *dma);
+// Row r of batch (its features)
+static inline uint8_t *MLP_Dma_Row(MLP_Dma_Batch *batch, long r){
+	return batch->X + r*batch->row_bytes + batch->bias;
+}
+// Sends the first rows rows of batch. Returns 0, or -1 if rows is not 1..rows_max or batch is not the oldest one
+// from MLP_Dma_Get not submitted yet (batches go in the order they were taken).
+int MLP_Dma_Submit(MLP_Dma *dma, MLP_Dma_Batch *batch, long rows);
+
+// The oldest batch in flight if it is complete, else NULL
+MLP_Dma_Batch *MLP_Dma_Poll(MLP_Dma *dma);
+// The oldest batch in flight once complete, or NULL if none is in flight or on timeout (timeout_ms < 0 : no limit;
+// only with interrupts, polling has no clock to count on standalone)
+MLP_Dma_Batch *MLP_Dma_Wait(MLP_Dma *dma, int timeout_ms);
+// Gives back a complete batch (its results are read), for MLP_Dma_Get
+void MLP_Dma_Release(MLP_Dma *dma, MLP_Dma_Batch *batch);
+
+// Bytes of the results of rows rows (words, without the telemetry)
+size_t MLP_Dma_Result_Bytes(const MLP_Dma *dma, long rows);
+// Batches submitted / complete since the driver was opened
+long MLP_Dma_Submitted(const MLP_Dma *dma);
+long MLP_Dma_Completed(const MLP_Dma *dma);
+
+/* Register backend (mlp_dma_axi.c) : an AXI DMA with scatter-gather (no Micro DMA), filled by the caller, then
+ * MLP_Dma_Axi_Reset, then MLP_Dma_Open(&MLP_Dma_Axi_Backend, &axi, ...).
+ * Standalone : regs = XPAR_AXI_DMA_0_BASEADDR, mem any static array (addr = its address), flush / invalidate
+ * calling Xil_DCacheFlushRange / Xil_DCacheInvalidateRange, no irq_wait (polling).
+ * Linux : regs mapped from a UIO device (or /dev/mem), mem a udmabuf or reserved memory opened with O_SYNC (no cache
+ * maintenance needed), irq_wait writing 1 to the UIO device (unmask), then poll() and read() on it.
+ */
+typedef struct {
+	volatile uint32_t *regs;	// the registers, mapped
+	uint8_t *mem;				// physically contiguous memory for the descriptors and buffers
+	uint64_t mem_addr;			// its physical address
+	size_t mem_size;
+	void (*flush)(const void *mem, size_t bytes);		// NULL : mem is not cached
+	void (*invalidate)(const void *mem, size_t bytes);
+	int (*irq_wait)(void *arg, int timeout_ms);	// waits for the interrupt of S2MM, 0 or -1 on timeout; NULL : polling
+	void *irq_arg;
+	// used by the backend
+	size_t used;
+	int allocs;
+	int started[2];
+} MLP_Dma_Axi;
+
+extern const MLP_Dma_Backend MLP_Dma_Axi_Backend;
+// Resets the DMA (both channels) and forgets the memory in use. Returns 0, or -1 if the reset does not end.
+int MLP_Dma_Axi_Reset(MLP_Dma_Axi *axi);
+
+/* Simulated backend (hls_code/dma_sim_HLS.cpp, C++ with the HLS headers, pthreads) : a thread takes the MM2S
+ * descriptors as the DMA would, runs each packet through myip_v1_0_HLS, and writes the results to the S2MM
+ * descriptors, their status and an interrupt. clock_hz > 0 holds each batch until the time the coprocessor
+ * would take at that clock (one word in or out per clock), so the host sees the timing of the fabric instead of
+ * the speed of the C simulation; 0 : as fast as it runs. The memory is plain host memory (addresses are pointers).
+ * One device per process (the model of myip_v1_0_HLS is static).
+ */
+extern const MLP_Dma_Backend MLP_Dma_Sim_Backend;
+void *MLP_Dma_Sim_Open(double clock_hz);
+void MLP_Dma_Sim_Close(void *device);
+// Seconds the thread spent on batches (computing them, or holding them with clock_hz)
+double MLP_Dma_Sim_Busy(void *device);
+
+#endif
@@ -0,0 +1,130 @@
+/*
+ * mlp_dma_axi.c: the register backend of mlp_dma.h, an AXI DMA (PG021) in scatter-gather mode
+ *
+ * Both channels run from the first submitted batch on : MLP_Dma_Submit only writes the tail descriptor, the DMA
+ * stops (Idle) at it and goes on from there at the next write. Only the S2MM interrupt on completion is enabled,
+ * with a threshold of 1 (every descriptor). The memory is handed out from axi->mem in order, and given back once it
+ * is all free or on reset.
+ *
+ * Compiled only : it has not been run on the board, and dma_bench uses the simulated device, not this backend.
+ */
+
+#include "mlp_dma.h"
+
+// Registers, in words; the S2MM ones are at S2MM_REGS words from the MM2S ones
+#define DMACR 0
+#define DMASR 1
+#define CURDESC 2
+#define CURDESC_MSB 3
+#define TAILDESC 4
+#define TAILDESC_MSB 5
+#define S2MM_REGS 12
+
+#define DMACR_RS (1u << 0)
+#define DMACR_RESET (1u << 2)
+#define DMACR_IOC_IRQ_EN (1u << 12)
+#define DMACR_ERR_IRQ_EN (1u << 14)
+#define DMACR_THRESHOLD(n) ((uint32_t)(n) << 16)
+#define DMASR_HALTED (1u << 0)
+#define DMASR_IOC_IRQ (1u << 12)
+#define DMASR_DLY_IRQ (1u << 13)
+#define DMASR_ERR_IRQ (1u << 14)
+
+#define RESET_POLLS 100000
+
+static volatile uint32_t *channel_regs(MLP_Dma_Axi *axi, int channel){
+	return axi->regs + (channel == MLP_DMA_S2MM ? S2MM_REGS : 0);
+}
+
+int MLP_Dma_Axi_Reset(MLP_Dma_Axi *axi){
+	int i;
+	axi->regs[DMACR] = DMACR_RESET;	// resets both channels
+	for(i = 0; i < RESET_POLLS && (axi->regs[DMACR] & DMACR_RESET); i++)
+		;
+	axi->used = 0;
+	axi->allocs = 0;
+	axi->started[MLP_DMA_MM2S] = axi->started[MLP_DMA_S2MM] = 0;
+	return (axi->regs[DMACR] & DMACR_RESET) ? -1 : 0;
+}
+
+static void *axi_alloc(void *device, size_t bytes, uint64_t *addr){
+	MLP_Dma_Axi *axi = (MLP_Dma_Axi *)device;
+	size_t first = (axi->used + MLP_DMA_ALIGN - 1) / MLP_DMA_ALIGN * MLP_DMA_ALIGN;
+	if(first + bytes > axi->mem_size)
+		return NULL;
+	axi->used = first + bytes;
+	axi->allocs++;
+	*addr = axi->mem_addr + first;
+	return axi->mem + first;
+}
+
+// The memory is given back once all of it is free
+static void axi_free(void *device, void *mem){
+	MLP_Dma_Axi *axi = (MLP_Dma_Axi *)device;
+	(void)mem;
+	if(--axi->allocs == 0)
+		axi->used = 0;
+}
+
+static void axi_flush(void *device, const void *mem, size_t bytes){
+	MLP_Dma_Axi *axi = (MLP_Dma_Axi *)device;
+	if(axi->flush != NULL)
+		axi->flush(mem, bytes);
+}
+
+static void axi_invalidate(void *device, const void *mem, size_t bytes){
+	MLP_Dma_Axi *axi = (MLP_Dma_Axi *)device;
+	if(axi->invalidate != NULL)
+		axi->invalidate(mem, bytes);
+}
+
+static void axi_start(void *device, int channel, uint64_t first, uint64_t tail){
+	MLP_Dma_Axi *axi = (MLP_Dma_Axi *)device;
+	volatile uint32_t *regs = channel_regs(axi, channel);
+	if(!axi->started[channel]){
+		// CURDESC is only written while the channel is halted
+		regs[CURDESC] = (uint32_t)first;
+		if(first >> 32)
+			regs[CURDESC_MSB] = (uint32_t)(first >> 32);
+		regs[DMACR] = DMACR_RS | DMACR_ERR_IRQ_EN | DMACR_THRESHOLD(1)
+				| (channel == MLP_DMA_S2MM && axi->irq_wait != NULL ? DMACR_IOC_IRQ_EN : 0);
+		axi->started[channel] = 1;
+	}
+	if(tail >> 32)
+		regs[TAILDESC_MSB] = (uint32_t)(tail >> 32);
+	regs[TAILDESC] = (uint32_t)tail;	// the DMA moves on when the low word is written
+}
+
+static void axi_stop(void *device){
+	MLP_Dma_Axi *axi = (MLP_Dma_Axi *)device;
+	int channel, i;
+	for(channel = MLP_DMA_MM2S; channel <= MLP_DMA_S2MM; channel++){
+		volatile uint32_t *regs = channel_regs(axi, channel);
+		regs[DMACR] = 0;
+		for(i = 0; i < RESET_POLLS && !(regs[DMASR] & DMASR_HALTED); i++)
+			;
+		axi->started[channel] = 0;
+	}
+}
+
+static int axi_wait(void *device, int timeout_ms){
+	MLP_Dma_Axi *axi = (MLP_Dma_Axi *)device;
+	volatile uint32_t *regs = channel_regs(axi, MLP_DMA_S2MM);
+	int result;
+	if(axi->irq_wait == NULL)
+		return 0;
+	result = axi->irq_wait(axi->irq_arg, timeout_ms);
+	regs[DMASR] = DMASR_IOC_IRQ | DMASR_DLY_IRQ | DMASR_ERR_IRQ;	// write 1 to clear
+	return result;
+}
+
+const MLP_Dma_Backend MLP_Dma_Axi_Backend = {
+	"AXI DMA",
+	axi_alloc,
+	axi_free,
+	axi_flush,
+	axi_invalidate,
+	axi_start,
+	axi_stop,
+	axi_wait
+};
@@ -0,0 +1,259 @@
+/*
+ * mlp_file.c: the .mlpb file of the model and the data (see mlp_file.h)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mlp_file.h"
+
+_Static_assert(sizeof(MLP_File_Header) == 176, "MLP_File_Header has padding");
+
+static int mlp_error(const char **what, const char *text){
+	if(what != NULL)
+		*what = text;
+	return -1;
+}
+
+// Slicing by 8 : 8 bytes per step, from 8 tables of 256
+static uint32_t crc_table[8][256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_init(void){
+	uint32_t c;
+	int i, k;
+	for(i=0;i<256;i++){
+		c = i;
+		for(k=0;k<8;k++)
+			c = (c >> 1) ^ (0xEDB88320u & -(c & 1));
+		crc_table[0][i] = c;
+	}
+	for(i=0;i<256;i++)
+		for(k=1;k<8;k++)
+			crc_table[k][i] = (crc_table[k-1][i] >> 8) ^ crc_table[0][crc_table[k-1][i] & 0xFF];
+}
+
+uint32_t MLP_Crc32(uint32_t crc, const void *data, size_t bytes){
+	const uint8_t *p = data;
+	uint32_t lo, hi;
+	pthread_once(&crc_once, crc_init);
+	crc = ~crc;
+	for(;bytes >= 8;bytes-=8, p+=8){
+		memcpy(&lo, p, 4);
+		memcpy(&hi, p+4, 4);
+		lo ^= crc;		// little-endian
+		crc = crc_table[7][lo & 0xFF] ^ crc_table[6][(lo >> 8) & 0xFF] ^ crc_table[5][(lo >> 16) & 0xFF]
+			^ crc_table[4][lo >> 24] ^ crc_table[3][hi & 0xFF] ^ crc_table[2][(hi >> 8) & 0xFF]
+			^ crc_table[1][(hi >> 16) & 0xFF] ^ crc_table[0][hi >> 24];
+	}
+	for(;bytes > 0;bytes--, p++)
+		crc = (crc >> 8) ^ crc_table[0][(crc ^ *p) & 0xFF];
+	return ~crc;
+}
+
+int MLP_Label_Bits(int outputs){
+	int bits = 0;
+	if(outputs == 1)
+		return 1;
+	while((1 << bits) < outputs)
+		bits++;
+	return bits;
+}
+
+long MLP_Label_Words(long rows, int bits){
+	const int lanes = 32 / bits;
+	return (rows + lanes - 1) / lanes;
+}
+
+void MLP_Pack_Labels(const uint8_t labels[], long rows, int bits, uint32_t words[]){
+	const int lanes = 32 / bits;
+	long r;
+	memset(words, 0, MLP_Label_Words(rows, bits)*4);
+	for(r=0;r<rows;r++)
+		words[r / lanes] |= (uint32_t)(labels[r] & ((1u << bits) - 1)) << (r % lanes * bits);
+}
+
+// Bytes of each section for the shape of file, 0 for the ones that are NULL
+static void section_bytes(const MLP_File *file, uint64_t bytes[MLP_SECTIONS]){
+	bytes[MLP_SECTION_B] = file->B ? (uint64_t)(file->features+1) * file->hidden : 0;
+	bytes[MLP_SECTION_C] = file->C ? (uint64_t)(file->hidden+1) * file->outputs : 0;
+	bytes[MLP_SECTION_SIG] = file->SIG ? (uint64_t)file->sig_size : 0;
+	bytes[MLP_SECTION_X] = file->X ? (uint64_t)file->rows * file->features : 0;
+	bytes[MLP_SECTION_LABELS] = file->labels ? (uint64_t)MLP_Label_Words(file->rows, file->label_bits) * 4 : 0;
+}
+
+int MLP_File_Open(const char *path, MLP_File *file, int flags, const char **what){
+	const MLP_File_Header *h;
+	const MLP_Section *s;
+	const uint8_t *base;
+	struct stat st;
+	void *map;
+	uint64_t bytes[MLP_SECTIONS];
+	size_t page;
+	int fd, i;
+
+	memset(file, 0, sizeof(MLP_File));
+	fd = open(path, O_RDONLY);
+	if(fd < 0)
+		return mlp_error(what, "can not open the file");
+	if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(MLP_File_Header)){
+		close(fd);
+		return mlp_error(what, "not a .mlpb file");
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED)
+		return mlp_error(what, "can not map the file");
+	file->map = map;
+	file->size = st.st_size;
+	base = map;
+	h = map;
+
+	if(h->magic != MLP_FILE_MAGIC){
+		MLP_File_Close(file);
+		return mlp_error(what, h->magic == __builtin_bswap32(MLP_FILE_MAGIC) ? "file of the other byte order" : "not a .mlpb file");
+	}
+	if(h->version != MLP_FILE_VERSION || h->header_bytes != sizeof(MLP_File_Header)){
+		MLP_File_Close(file);
+		return mlp_error(what, "other version of the .mlpb format");
+	}
+	if(h->header_crc != MLP_Crc32(0, h, offsetof(MLP_File_Header, header_crc))){
+		MLP_File_Close(file);
+		return mlp_error(what, "the header does not match its CRC");
+	}
+	if(h->data_bits != 8 || h->weight_bits != 8 || h->sig_bits != 8 || h->scale_shift != 8
+			|| h->label_bits != MLP_Label_Bits(h->outputs) || h->features < 1 || h->hidden < 1 || h->outputs < 1
+			|| h->sig_size < 1 || h->rows > (uint64_t)(~0UL >> 1) / h->features){
+		MLP_File_Close(file);
+		return mlp_error(what, "shape or bits not supported");
+	}
+	file->header = h;
+	file->features = h->features;
+	file->hidden = h->hidden;
+	file->outputs = h->outputs;
+	file->sig_size = h->sig_size;
+	file->rows = h->rows;
+	file->label_bits = h->label_bits;
+	file->label_threshold = h->label_threshold;
+
+	// all the sections set, for section_bytes() to give the size of each
+	file->B = file->C = file->SIG = file->X = base;
+	file->labels = map;
+	section_bytes(file, bytes);
+	for(i=0;i<MLP_SECTIONS;i++){
+		s = &h->section[i];
+		if(s->offset == 0)
+			continue;
+		if(s->offset % MLP_FILE_ALIGN != 0 || s->offset > file->size || s->bytes != bytes[i]
+				|| s->bytes > file->size - s->offset){
+			MLP_File_Close(file);
+			return mlp_error(what, "a section is outside the file or of the wrong size");
+		}
+		if((flags & MLP_FILE_VERIFY) && s->crc != MLP_Crc32(0, base + s->offset, s->bytes)){
+			MLP_File_Close(file);
+			return mlp_error(what, "a section does not match its CRC");
+		}
+	}
+	s = h->section;
+	file->B = s[MLP_SECTION_B].offset ? base + s[MLP_SECTION_B].offset : NULL;
+	file->C = s[MLP_SECTION_C].offset ? base + s[MLP_SECTION_C].offset : NULL;
+	file->SIG = s[MLP_SECTION_SIG].offset ? base + s[MLP_SECTION_SIG].offset : NULL;
+	file->X = s[MLP_SECTION_X].offset ? base + s[MLP_SECTION_X].offset : NULL;
+	file->labels = s[MLP_SECTION_LABELS].offset ? (const uint32_t *)(base + s[MLP_SECTION_LABELS].offset) : NULL;
+	if(file->X != NULL){
+		page = file->X - (const uint8_t *)((uintptr_t)file->X & ~(uintptr_t)(sysconf(_SC_PAGESIZE)-1));
+		madvise((void *)(file->X - page), s[MLP_SECTION_X].bytes + page, MADV_SEQUENTIAL);
+	}
+	return 0;
+}
+
+void MLP_File_Close(MLP_File *file){
+	if(file->map != NULL)
+		munmap(file->map, file->size);
+	memset(file, 0, sizeof(MLP_File));
+}
+
+int MLP_File_Write(const char *path, const MLP_File *file, const char **what){
+	static const uint8_t zeros[MLP_FILE_ALIGN];
+	const void *data[MLP_SECTIONS] = {file->B, file->C, file->SIG, file->X, file->labels};
+	MLP_File_Header h;
+	uint64_t bytes[MLP_SECTIONS], offset;
+	FILE *out_file;
+	int i, failed;
+
+	if(file->features < 1 || file->hidden < 1 || file->outputs < 1 || file->sig_size < 1 || file->rows < 0
+			|| (file->labels != NULL && file->label_bits != MLP_Label_Bits(file->outputs)))
+		return mlp_error(what, "shape not supported");
+	memset(&h, 0, sizeof(h));
+	h.magic = MLP_FILE_MAGIC;
+	h.version = MLP_FILE_VERSION;
+	h.header_bytes = sizeof(MLP_File_Header);
+	h.features = file->features;
+	h.hidden = file->hidden;
+	h.outputs = file->outputs;
+	h.sig_size = file->sig_size;
+	h.rows = (file->X != NULL || file->labels != NULL) ? file->rows : 0;
+	h.data_bits = 8;
+	h.weight_bits = 8;
+	h.sig_bits = 8;
+	h.label_bits = MLP_Label_Bits(file->outputs);
+	h.scale_shift = 8;
+	h.label_threshold = file->label_threshold;
+	section_bytes(file, bytes);
+	offset = (sizeof(MLP_File_Header) + MLP_FILE_ALIGN-1) & ~(uint64_t)(MLP_FILE_ALIGN-1);
+	for(i=0;i<MLP_SECTIONS;i++){
+		if(data[i] == NULL)
+			continue;
+		h.section[i].offset = offset;
+		h.section[i].bytes = bytes[i];
+		h.section[i].crc = MLP_Crc32(0, data[i], bytes[i]);
+		offset = (offset + bytes[i] + MLP_FILE_ALIGN-1) & ~(uint64_t)(MLP_FILE_ALIGN-1);
+	}
+	h.header_crc = MLP_Crc32(0, &h, offsetof(MLP_File_Header, header_crc));
+
+	out_file = fopen(path, "wb");
+	if(out_file == NULL)
+		return mlp_error(what, "can not create the file");
+	failed = fwrite(&h, sizeof(h), 1, out_file) != 1;
+	offset = sizeof(h);
+	for(i=0;i<MLP_SECTIONS && !failed;i++){
+		if(data[i] == NULL)
+			continue;
+		failed = fwrite(zeros, 1, h.section[i].offset - offset, out_file) != h.section[i].offset - offset
+			|| fwrite(data[i], 1, bytes[i], out_file) != bytes[i];
+		offset = h.section[i].offset + bytes[i];
+	}
+	// the last words of X (or of any section) are whole words of the file, in 0s
+	if(!failed && offset % MLP_FILE_ALIGN != 0)
+		failed = fwrite(zeros, 1, MLP_FILE_ALIGN - offset % MLP_FILE_ALIGN, out_file) != MLP_FILE_ALIGN - offset % MLP_FILE_ALIGN;
+	if(fclose(out_file) != 0 || failed){
+		remove(path);
+		return mlp_error(what, "can not write the file");
+	}
+	return 0;
+}
+
+int MLP_File_Model(const MLP_File *file, int B[], int C[], int SIG[], MLP_Model *model){
+	int i;
+	if(file->B == NULL || file->C == NULL || file->SIG == NULL || file->hidden > MLP_MAX_HIDDEN
+			|| file->outputs > MLP_MAX_OUTPUTS || file->sig_size != MLP_SIG_SIZE)
+		return -1;
+	for(i=0;i<(file->features+1)*file->hidden;i++)
+		B[i] = file->B[i];
+	for(i=0;i<(file->hidden+1)*file->outputs;i++)
+		C[i] = file->C[i];
+	for(i=0;i<file->sig_size;i++)
+		SIG[i] = file->SIG[i];
+	model->features = file->features;
+	model->hidden = file->hidden;
+	model->outputs = file->outputs;
+	model->B = B;
+	model->C = C;
+	model->SIG = SIG;
+	return 0;
+}
@@ -0,0 +1,121 @@
+/*
+ * mlp_file.h: the model and the data in one binary file (.mlpb), in place of X.csv, w_hid.csv, w_out.csv,
+ * sigmoid.csv and labels.csv
+ *
+ * A header (MLP_File_Header) gives the shape, the bits of each value, the scale of the sums (shift 8 : / 256) and
+ * where each section is, with a CRC-32 of each. The sections are 8-bit values, each at a multiple of MLP_FILE_ALIGN
+ * bytes from the start of the file and followed by 0s up to the next one :
+ *   B      : (features+1) x hidden, bias first (w_hid.csv)
+ *   C      : (hidden+1) x outputs, bias first (w_out.csv)
+ *   SIG    : sig_size entries (sigmoid.csv)
+ *   X      : rows x features. Read as 32-bit little-endian words, these are the A words of the coprocessors
+ *            with CMD_PACKED (4 values per word, the first in the lowest bits), so X can be sent as it is.
+ *   LABELS : one per row (labels.csv), packed 32 / label_bits per 32-bit word as the coprocessors give them with
+ *            CMD_LABELS. A row is labelled 1 if its result is above label_threshold (one output), else with the
+ *            output of the largest result.
+ * The file is mapped (mmap) and the sections are used in place : nothing is parsed or copied. The fields are in
+ * the byte order of the CPU that wrote the file (little-endian on the Zynq and the host); a file of the other
+ * order is rejected. Needs POSIX (mmap) : Linux on the Zynq, or the host.
+ * mlp_convert.c converts the csv and .mem files to and from this format.
+ */
+
+#ifndef MLP_FILE_H
+#define MLP_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "mlp_forward.h"
+
+#define MLP_FILE_MAGIC 0x42504C4Du		// "MLPB"
+#define MLP_FILE_VERSION 1
+#define MLP_FILE_ALIGN 64				// a cache line, and more than the AXI DMA needs
+
+// 1 : the CRC-32 of each section is checked by MLP_File_Open (the header is always checked)
+#define MLP_FILE_VERIFY 1
+
+enum {
+	MLP_SECTION_B,
+	MLP_SECTION_C,
+	MLP_SECTION_SIG,
+	MLP_SECTION_X,
+	MLP_SECTION_LABELS,
+	MLP_SECTIONS
+};
+
+typedef struct {
+	uint64_t offset;		// from the start of the file; 0 : not in the file
+	uint64_t bytes;
+	uint32_t crc;			// CRC-32 (as zlib) of the bytes
+	uint32_t reserved;
+} MLP_Section;
+
+typedef struct {
+	uint32_t magic;			// MLP_FILE_MAGIC
+	uint16_t version;		// MLP_FILE_VERSION
+	uint16_t header_bytes;	// sizeof(MLP_File_Header)
+	uint32_t features;
+	uint32_t hidden;
+	uint32_t outputs;
+	uint32_t sig_size;
+	uint64_t rows;
+	uint8_t data_bits;		// X : 8
+	uint8_t weight_bits;	// B and C : 8
+	uint8_t sig_bits;		// SIG : 8
+	uint8_t label_bits;		// 1 with one output, else ceil(log2(outputs)), as LABEL_BITS of the HLS code
+	uint8_t scale_shift;	// the sums of the hidden and output nodes are divided by 2^scale_shift : 8
+	uint8_t reserved[3];
+	int32_t label_threshold;
+	uint32_t reserved2;
+	MLP_Section section[MLP_SECTIONS];
+	uint32_t header_crc;	// CRC-32 of the bytes above
+	uint32_t reserved3;
+} MLP_File_Header;
+
+// A mapped file (MLP_File_Open), or the sections of a file to write (MLP_File_Write). NULL : not in the file.
+typedef struct {
+	int features;
+	int hidden;
+	int outputs;
+	int sig_size;
+	long rows;
+	int label_bits;
+	int label_threshold;
+	const uint8_t *B;
+	const uint8_t *C;
+	const uint8_t *SIG;
+	const uint8_t *X;
+	const uint32_t *labels;
+	// set by MLP_File_Open
+	const MLP_File_Header *header;
+	void *map;
+	size_t size;
+} MLP_File;
+
+// Maps the file at path and fills file. flags : 0 or MLP_FILE_VERIFY. Returns 0, or -1 with *what set (if not NULL)
+// if the file can not be read, is not a .mlpb file of this version, or a section is outside the file or
+// (MLP_FILE_VERIFY) does not match its CRC.
+int MLP_File_Open(const char *path, MLP_File *file, int flags, const char **what);
+void MLP_File_Close(MLP_File *file);
+// Writes the sections of file that are not NULL to path, with the header. rows, label_bits and label_threshold are
+// only used with X or labels. Returns 0, or -1 with *what set (if not NULL).
+int MLP_File_Write(const char *path, const MLP_File *file, const char **what);
+
+// The model of the file in int arrays, for MLP_Forward and MLP_Simd_Prepare : B, C and SIG must have the room for
+// the sections. Returns 0, or -1 if the file has no model or a larger one than MLP_Forward can compute.
+int MLP_File_Model(const MLP_File *file, int B[], int C[], int SIG[], MLP_Model *model);
+
+// Bits of a label for outputs outputs (LABEL_BITS of the HLS code)
+int MLP_Label_Bits(int outputs);
+// Words of rows labels of bits bits
+long MLP_Label_Words(long rows, int bits);
+// rows labels (one per byte) packed into words, and the label of a row from them
+void MLP_Pack_Labels(const uint8_t labels[], long rows, int bits, uint32_t words[]);
+static inline int MLP_Label(const uint32_t words[], long row, int bits){
+	const int lanes = 32 / bits;
+	return (words[row / lanes] >> (row % lanes * bits)) & ((1u << bits) - 1);
+}
+
+// CRC-32 (as zlib) of bytes bytes, continuing from crc (0 to start)
+uint32_t MLP_Crc32(uint32_t crc, const void *data, size_t bytes);
+
+#endif
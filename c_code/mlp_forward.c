@@ -0,0 +1,107 @@
+/*
+ * mlp_forward.c: fused forward pass of the whole model (see mlp_forward.h)
+ */
+
+#include "mlp_forward.h"
+
+static inline int mlp_sigmoid(const int SIG[], int sum){
+	sum = sum/256;
+	if(sum > MLP_SIG_SIZE-1)
+		sum = MLP_SIG_SIZE-1;
+	if(sum < 0)
+		sum = 0;
+	return SIG[sum];
+}
+
+static int mlp_check(const MLP_Model *model){
+	if(model->features < 0 || model->hidden < 1 || model->hidden > MLP_MAX_HIDDEN
+			|| model->outputs < 1 || model->outputs > MLP_MAX_OUTPUTS)
+		return -1;
+	return 0;
+}
+
+// Output nodes of one row from the hidden values act
+static inline void mlp_output(const MLP_Model *model, const int act[], int res[]){
+	const int H = model->hidden, O = model->outputs;
+	const int *C = model->C;
+	int sum[MLP_MAX_OUTPUTS];
+	int h, o;
+	for(o=0;o<O;o++)
+		sum[o] = C[o];
+	for(h=0;h<H;h++)
+		for(o=0;o<O;o++)
+			sum[o] += act[h]*C[(h+1)*O+o];
+	for(o=0;o<O;o++)
+		res[o] = sum[o]/256;
+}
+
+// The shipped 7-2-1 shape (any number of features) : both hidden sums and the output in registers
+static void mlp_forward_2_1(const MLP_Model *model, const int X[], int rows, int RES[]){
+	const int F = model->features;
+	const int *B = model->B, *C = model->C, *SIG = model->SIG;
+	int r, f;
+	for(r=0;r<rows;r++){
+		const int *x = X + r*F;
+		int h0 = B[0], h1 = B[1];
+		for(f=0;f<F;f++){
+			h0 += x[f]*B[2*(f+1)];
+			h1 += x[f]*B[2*(f+1)+1];
+		}
+		RES[r] = (C[0] + mlp_sigmoid(SIG, h0)*C[1] + mlp_sigmoid(SIG, h1)*C[2])/256;
+	}
+}
+
+int MLP_Forward(const MLP_Model *model, const int X[], int rows, int RES[]){
+	const int F = model->features, H = model->hidden;
+	const int *B = model->B;
+	int act[MLP_MAX_HIDDEN];
+	int r, f, k, first;
+
+	if(mlp_check(model) != 0)
+		return -1;
+	if(H == 2 && model->outputs == 1){
+		mlp_forward_2_1(model, X, rows, RES);
+		return 0;
+	}
+	for(r=0;r<rows;r++){
+		const int *x = X + r*F;
+		for(first=0;first<H;first+=MLP_HIDDEN_BLOCK){
+			int acc[MLP_HIDDEN_BLOCK];
+			int n = (H-first < MLP_HIDDEN_BLOCK) ? H-first : MLP_HIDDEN_BLOCK;
+			for(k=0;k<n;k++)
+				acc[k] = B[first+k];
+			for(f=0;f<F;f++){
+				const int *w = B + (f+1)*H + first;
+				for(k=0;k<n;k++)
+					acc[k] += x[f]*w[k];
+			}
+			for(k=0;k<n;k++)
+				act[first+k] = mlp_sigmoid(model->SIG, acc[k]);
+		}
+		mlp_output(model, act, RES + r*model->outputs);
+	}
+	return 0;
+}
+
+int MLP_Forward_Sparse(const MLP_Model *model, const Sparse_Rows *rows, int RES[]){
+	const int H = model->hidden;
+	const int *B = model->B;
+	int act[MLP_MAX_HIDDEN];
+	int r, i, h;
+
+	if(mlp_check(model) != 0 || rows->features != model->features)
+		return -1;
+	for(r=0;r<rows->rows;r++){
+		for(h=0;h<H;h++)
+			act[h] = B[h];
+		for(i=rows->row_start[r];i<rows->row_start[r+1];i++){
+			const int *w = B + (rows->col[i]+1)*H;
+			for(h=0;h<H;h++)
+				act[h] += rows->val[i]*w[h];
+		}
+		for(h=0;h<H;h++)
+			act[h] = mlp_sigmoid(model->SIG, act[h]);
+		mlp_output(model, act, RES + r*model->outputs);
+	}
+	return 0;
+}
@@ -0,0 +1,39 @@
+/*
+ * mlp_forward.h: fused forward pass of the whole model, one row at a time
+ *
+ * Each row of X is read once: all the hidden nodes, their sigmoid and the output nodes are computed
+ * before the next row, with no intermediate arrays and nothing allocated. Same results as the coprocessors :
+ *   h = SIG[clamp((B[0][h] + sum x[f]*B[f+1][h]) / 256, 0..255)]
+ *   out = (C[0][o] + sum h*C[h+1][o]) / 256
+ * B and C are in the order of w_hid.csv and w_out.csv (and of the HLS model words) : the biases first,
+ * then one line per feature (per hidden node for C) with a weight for each node.
+ */
+
+#ifndef MLP_FORWARD_H
+#define MLP_FORWARD_H
+
+#include "node_multiply.h"
+
+#define MLP_SIG_SIZE 256
+#define MLP_MAX_HIDDEN 64		// as the 64-32-2 coprocessor; the hidden values of a row are on the stack
+#define MLP_MAX_OUTPUTS 16
+#define MLP_HIDDEN_BLOCK 8		// hidden nodes summed together, each in a register. The row is in L1 after the first block.
+
+typedef struct {
+	int features;
+	int hidden;
+	int outputs;
+	const int *B;		// (features+1) x hidden
+	const int *C;		// (hidden+1) x outputs
+	const int *SIG;		// MLP_SIG_SIZE entries
+} MLP_Model;
+
+// rows rows of model->features values of X give rows x model->outputs results in RES.
+// Return 0, or -1 if the model is larger than MLP_MAX_HIDDEN / MLP_MAX_OUTPUTS.
+int MLP_Forward(const MLP_Model *model, const int X[], int rows, int RES[]);
+// The same from the rows of Compress_Rows, skipping the values that are 0. With Compress_Rows it was slower than
+// MLP_Forward at every share of 0s tried in bench.c (0 to 100 %) : it is the software form of the zero skipping of
+// hid_layer (HID_ZERO_SKIP), not a faster path.
+int MLP_Forward_Sparse(const MLP_Model *model, const Sparse_Rows *rows, int RES[]);
+
+#endif
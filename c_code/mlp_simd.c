@@ -0,0 +1,412 @@
+/*
+ * mlp_simd.c: vector versions of MLP_Forward for 8-bit rows (see mlp_simd.h)
+ *
+ * The x86 kernels are built with target attributes, so the file builds with plain -O2 and MLP_Simd_Isa
+ * picks the kernel from cpuid. The NEON kernel is built when the compiler targets NEON (-mfpu=neon on the A9).
+ * The kernels read 8*chunks bytes from the start of each row (past the row, with weights 0) :
+ * the last rows, where that would read past X, are done by the scalar kernel.
+ */
+
+#include <string.h>
+#include "mlp_simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MLP_SIMD_X86 1
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define MLP_SIMD_NEON 1
+#endif
+
+int MLP_Simd_Prepare(const MLP_Model *model, MLP_Simd_Model *out){
+	const int F = model->features, H = model->hidden, O = model->outputs;
+	int f, h, o, i;
+
+	if(F < 1 || F > 8*MLP_SIMD_MAX_CHUNKS || H < 1 || H > MLP_MAX_HIDDEN || O < 1 || O > MLP_MAX_OUTPUTS)
+		return -1;
+	for(i=0;i<(F+1)*H;i++)
+		if(model->B[i] < 0 || model->B[i] > 255)
+			return -1;
+	for(i=0;i<(H+1)*O;i++)
+		if(model->C[i] < 0 || model->C[i] > 255)
+			return -1;
+	for(i=0;i<MLP_SIG_SIZE;i++)
+		if(model->SIG[i] < 0 || model->SIG[i] > 255)
+			return -1;
+
+	memset(out, 0, sizeof(*out));
+	out->features = F;
+	out->hidden = H;
+	out->outputs = O;
+	out->chunks = (F+7)/8;
+	for(h=0;h<H;h++){
+		out->bias[h] = model->B[h];
+		for(f=0;f<F;f++)
+			out->W[h][f] = model->B[(f+1)*H+h];
+		// pairs of bytes 0 2, 1 3, 4 6, 5 7 of each chunk
+		for(f=0;f<8*out->chunks;f++)
+			out->Wp[h][f/8][(f%8)/4*2 + f%2] |= out->W[h][f] << ((f%4)/2*16);
+	}
+	for(o=0;o<O;o++){
+		out->C0[o] = model->C[o];
+		for(h=0;h<H;h++){
+			out->C[o][h] = model->C[(h+1)*O+o];
+			out->Cp[o][h/2] |= out->C[o][h] << (h%2*16);
+		}
+	}
+	for(i=0;i<MLP_SIG_SIZE;i++){
+		out->SIG[i] = model->SIG[i];
+		out->SIG8[i] = model->SIG[i];
+	}
+	return 0;
+}
+
+// Reference for the vector kernels, and the rows they can not read
+static void mlp_simd_scalar(const MLP_Simd_Model *m, const uint8_t X[], int rows, int RES[]){
+	const int F = m->features, H = m->hidden, O = m->outputs;
+	int act[MLP_MAX_HIDDEN];
+	int r, f, h, o, sum;
+	for(r=0;r<rows;r++){
+		const uint8_t *x = X + r*F;
+		for(h=0;h<H;h++){
+			sum = m->bias[h];
+			for(f=0;f<F;f++)
+				sum += x[f]*m->W[h][f];
+			sum = sum >> 8;
+			act[h] = m->SIG[sum > MLP_SIG_SIZE-1 ? MLP_SIG_SIZE-1 : sum];
+		}
+		for(o=0;o<O;o++){
+			sum = m->C0[o];
+			for(h=0;h<H;h++)
+				sum += act[h]*m->C[o][h];
+			RES[r*O+o] = sum >> 8;
+		}
+	}
+}
+
+#ifdef MLP_SIMD_X86
+
+static inline long long mlp_load8(const uint8_t *p){
+	long long v;
+	memcpy(&v, p, 8);
+	return v;
+}
+
+// The x86 kernels share one body, for STEP rows per vector : 4 (SSE4.1), 8 (AVX2) or 16 (AVX-512). It is inlined
+// with C (chunks), H and O constant for the 7-2-1 model, so that its loops unroll. LOAD_ROWS puts the bytes 0..3
+// and 4..7 of a chunk of the STEP rows in 32-bit lanes (lo, hi); the other names are the vector type and the
+// operations of the instruction set.
+#define MLP_X86_ROWS(STEP, LOAD_ROWS, VEC, SET1, AND, SRLI, SLLI, OR, MIN, MADD_ADD, GATHER, STORE)		\
+	const int F = m->features;																\
+	const VEC mask = SET1(0x00FF00FF), top = SET1(MLP_SIG_SIZE-1);							\
+	VEC x[MLP_SIMD_MAX_CHUNKS][4], act[MLP_MAX_HIDDEN/2], lo, hi, sum;						\
+	int32_t out[STEP];																		\
+	int r, k, h, o, j;																		\
+	for(r=0;r+STEP<=rows;r+=STEP){															\
+		for(k=0;k<C;k++){																	\
+			LOAD_ROWS(X + r*F + 8*k, F, &lo, &hi);											\
+			x[k][0] = AND(lo, mask);														\
+			x[k][1] = AND(SRLI(lo, 8), mask);												\
+			x[k][2] = AND(hi, mask);														\
+			x[k][3] = AND(SRLI(hi, 8), mask);												\
+		}																					\
+		for(h=0;h<H;h++){																	\
+			sum = SET1(m->bias[h]);															\
+			for(k=0;k<C;k++){																\
+				sum = MADD_ADD(sum, x[k][0], SET1(m->Wp[h][k][0]));							\
+				sum = MADD_ADD(sum, x[k][1], SET1(m->Wp[h][k][1]));							\
+				sum = MADD_ADD(sum, x[k][2], SET1(m->Wp[h][k][2]));							\
+				sum = MADD_ADD(sum, x[k][3], SET1(m->Wp[h][k][3]));							\
+			}																				\
+			sum = GATHER(m->SIG, MIN(SRLI(sum, 8), top));									\
+			/* hidden values in 16-bit pairs for the output sums (the high half 0 with H odd) */	\
+			act[h/2] = (h%2) ? OR(act[h/2], SLLI(sum, 16)) : sum;							\
+		}																					\
+		for(o=0;o<O;o++){																	\
+			sum = SET1(m->C0[o]);															\
+			for(h=0;h<(H+1)/2;h++)															\
+				sum = MADD_ADD(sum, act[h], SET1(m->Cp[o][h]));								\
+			sum = SRLI(sum, 8);																\
+			if(O == 1){																		\
+				STORE(RES + r, sum);														\
+				continue;																	\
+			}																				\
+			STORE(out, sum);																\
+			for(j=0;j<STEP;j++)																\
+				RES[(r+j)*O+o] = out[j];													\
+		}																					\
+	}
+
+// SSE4.1 : 4 rows, the sigmoid read lane by lane
+__attribute__((target("sse4.1"), always_inline))
+static inline void mlp_sse4_load(const uint8_t *p, int F, __m128i *lo, __m128i *hi){
+	__m128 a = _mm_castsi128_ps(_mm_set_epi64x(mlp_load8(p+F), mlp_load8(p)));
+	__m128 b = _mm_castsi128_ps(_mm_set_epi64x(mlp_load8(p+3*F), mlp_load8(p+2*F)));
+	*lo = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0)));
+	*hi = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3,1,3,1)));
+}
+__attribute__((target("sse4.1"), always_inline))
+static inline __m128i mlp_sse4_madd_add(__m128i sum, __m128i a, __m128i b){
+	return _mm_add_epi32(sum, _mm_madd_epi16(a, b));
+}
+__attribute__((target("sse4.1"), always_inline))
+static inline __m128i mlp_sse4_gather(const int32_t *table, __m128i index){
+	return _mm_set_epi32(table[_mm_extract_epi32(index, 3)], table[_mm_extract_epi32(index, 2)],
+			table[_mm_extract_epi32(index, 1)], table[_mm_cvtsi128_si32(index)]);
+}
+__attribute__((target("sse4.1"), always_inline))
+static inline void mlp_sse4_store(int *p, __m128i v){
+	_mm_storeu_si128((__m128i *)p, v);
+}
+
+__attribute__((target("sse4.1"), always_inline))
+static inline void mlp_sse4_rows(const MLP_Simd_Model *m, const uint8_t X[], int rows, int RES[], const int C, const int H, const int O){
+	MLP_X86_ROWS(4, mlp_sse4_load, __m128i, _mm_set1_epi32, _mm_and_si128, _mm_srli_epi32, _mm_slli_epi32,
+			_mm_or_si128, _mm_min_epi32, mlp_sse4_madd_add, mlp_sse4_gather, mlp_sse4_store)
+}
+
+// AVX2 : 8 rows, rows 0 1 4 5 and 2 3 6 7 loaded together so that the shuffle (in each 128-bit half) gives 0 .. 7
+__attribute__((target("avx2"), always_inline))
+static inline void mlp_avx2_load(const uint8_t *p, int F, __m256i *lo, __m256i *hi){
+	__m256 a = _mm256_castsi256_ps(_mm256_set_epi64x(mlp_load8(p+5*F), mlp_load8(p+4*F), mlp_load8(p+F), mlp_load8(p)));
+	__m256 b = _mm256_castsi256_ps(_mm256_set_epi64x(mlp_load8(p+7*F), mlp_load8(p+6*F), mlp_load8(p+3*F), mlp_load8(p+2*F)));
+	*lo = _mm256_castps_si256(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0)));
+	*hi = _mm256_castps_si256(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3,1,3,1)));
+}
+__attribute__((target("avx2"), always_inline))
+static inline __m256i mlp_avx2_madd_add(__m256i sum, __m256i a, __m256i b){
+	return _mm256_add_epi32(sum, _mm256_madd_epi16(a, b));
+}
+__attribute__((target("avx2"), always_inline))
+static inline __m256i mlp_avx2_gather(const int32_t *table, __m256i index){
+	return _mm256_i32gather_epi32(table, index, 4);
+}
+__attribute__((target("avx2"), always_inline))
+static inline void mlp_avx2_store(int *p, __m256i v){
+	_mm256_storeu_si256((__m256i *)p, v);
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline void mlp_avx2_rows(const MLP_Simd_Model *m, const uint8_t X[], int rows, int RES[], const int C, const int H, const int O){
+	MLP_X86_ROWS(8, mlp_avx2_load, __m256i, _mm256_set1_epi32, _mm256_and_si256, _mm256_srli_epi32, _mm256_slli_epi32,
+			_mm256_or_si256, _mm256_min_epi32, mlp_avx2_madd_add, mlp_avx2_gather, mlp_avx2_store)
+}
+
+// AVX-512 : 16 rows, in the same order as AVX2 in each 256-bit half, summed with vpdpwssd
+#define MLP_AVX512 __attribute__((target("avx512f,avx512bw,avx512vnni"), always_inline))
+MLP_AVX512
+static inline void mlp_avx512_load(const uint8_t *p, int F, __m512i *lo, __m512i *hi){
+	__m512 a = _mm512_castsi512_ps(_mm512_set_epi64(mlp_load8(p+13*F), mlp_load8(p+12*F), mlp_load8(p+9*F), mlp_load8(p+8*F),
+			mlp_load8(p+5*F), mlp_load8(p+4*F), mlp_load8(p+F), mlp_load8(p)));
+	__m512 b = _mm512_castsi512_ps(_mm512_set_epi64(mlp_load8(p+15*F), mlp_load8(p+14*F), mlp_load8(p+11*F), mlp_load8(p+10*F),
+			mlp_load8(p+7*F), mlp_load8(p+6*F), mlp_load8(p+3*F), mlp_load8(p+2*F)));
+	*lo = _mm512_castps_si512(_mm512_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0)));
+	*hi = _mm512_castps_si512(_mm512_shuffle_ps(a, b, _MM_SHUFFLE(3,1,3,1)));
+}
+MLP_AVX512
+static inline __m512i mlp_avx512_set1(int v){
+	return _mm512_set1_epi32(v);
+}
+MLP_AVX512
+static inline __m512i mlp_avx512_srli(__m512i v, const int n){
+	return _mm512_srli_epi32(v, n);
+}
+MLP_AVX512
+static inline __m512i mlp_avx512_slli(__m512i v, const int n){
+	return _mm512_slli_epi32(v, n);
+}
+MLP_AVX512
+static inline __m512i mlp_avx512_madd_add(__m512i sum, __m512i a, __m512i b){
+	return _mm512_dpwssd_epi32(sum, a, b);
+}
+MLP_AVX512
+static inline __m512i mlp_avx512_gather(const int32_t *table, __m512i index){
+	return _mm512_i32gather_epi32(index, table, 4);
+}
+MLP_AVX512
+static inline void mlp_avx512_store(int *p, __m512i v){
+	_mm512_storeu_si512(p, v);
+}
+
+MLP_AVX512
+static inline void mlp_avx512_rows(const MLP_Simd_Model *m, const uint8_t X[], int rows, int RES[], const int C, const int H, const int O){
+	MLP_X86_ROWS(16, mlp_avx512_load, __m512i, mlp_avx512_set1, _mm512_and_si512, mlp_avx512_srli, mlp_avx512_slli,
+			_mm512_or_si512, _mm512_min_epi32, mlp_avx512_madd_add, mlp_avx512_gather, mlp_avx512_store)
+}
+
+__attribute__((target("sse4.1")))
+static void mlp_simd_sse4(const MLP_Simd_Model *m, const uint8_t X[], int rows, int RES[]){
+	if(m->chunks == 1 && m->hidden == 2 && m->outputs == 1)
+		mlp_sse4_rows(m, X, rows, RES, 1, 2, 1);
+	else
+		mlp_sse4_rows(m, X, rows, RES, m->chunks, m->hidden, m->outputs);
+}
+
+__attribute__((target("avx2")))
+static void mlp_simd_avx2(const MLP_Simd_Model *m, const uint8_t X[], int rows, int RES[]){
+	if(m->chunks == 1 && m->hidden == 2 && m->outputs == 1)
+		mlp_avx2_rows(m, X, rows, RES, 1, 2, 1);
+	else
+		mlp_avx2_rows(m, X, rows, RES, m->chunks, m->hidden, m->outputs);
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vnni")))
+static void mlp_simd_avx512(const MLP_Simd_Model *m, const uint8_t X[], int rows, int RES[]){
+	if(m->chunks == 1 && m->hidden == 2 && m->outputs == 1)
+		mlp_avx512_rows(m, X, rows, RES, 1, 2, 1);
+	else
+		mlp_avx512_rows(m, X, rows, RES, m->chunks, m->hidden, m->outputs);
+}
+
+#endif
+
+#ifdef MLP_SIMD_NEON
+
+// 8 rows : the 8x8 bytes of chunk k of the rows are transposed with vtrn, so that x[8k+f] holds feature 8k+f of the rows.
+// The sigmoid is looked up with vtbl / vtbx over the 8 32-byte parts of SIG8.
+static void mlp_simd_neon(const MLP_Simd_Model *m, const uint8_t X[], int rows, int RES[]){
+	const int F = m->features, H = m->hidden, O = m->outputs, C = m->chunks;
+	const uint32x4_t top = vdupq_n_u32(MLP_SIG_SIZE-1);
+	uint16x8_t x[8*MLP_SIMD_MAX_CHUNKS], act[MLP_MAX_HIDDEN];
+	uint8x8x4_t table[MLP_SIG_SIZE/32];
+	uint8x8x2_t t01, t23, t45, t67;
+	uint16x4x2_t b0, b1, c0, c1;
+	uint32x2x2_t d;
+	uint32x4_t lo, hi;
+	uint8x8_t index, value;
+	uint32_t out[8];
+	int r, k, f, h, o, j, t;
+
+	for(t=0;t<MLP_SIG_SIZE/32;t++){
+		table[t].val[0] = vld1_u8(m->SIG8+32*t);
+		table[t].val[1] = vld1_u8(m->SIG8+32*t+8);
+		table[t].val[2] = vld1_u8(m->SIG8+32*t+16);
+		table[t].val[3] = vld1_u8(m->SIG8+32*t+24);
+	}
+	for(r=0;r+8<=rows;r+=8){
+		for(k=0;k<C;k++){
+			const uint8_t *p = X + r*F + 8*k;
+			t01 = vtrn_u8(vld1_u8(p), vld1_u8(p+F));
+			t23 = vtrn_u8(vld1_u8(p+2*F), vld1_u8(p+3*F));
+			t45 = vtrn_u8(vld1_u8(p+4*F), vld1_u8(p+5*F));
+			t67 = vtrn_u8(vld1_u8(p+6*F), vld1_u8(p+7*F));
+			b0 = vtrn_u16(vreinterpret_u16_u8(t01.val[0]), vreinterpret_u16_u8(t23.val[0]));	// features 0 4, 2 6 of rows 0..3
+			b1 = vtrn_u16(vreinterpret_u16_u8(t01.val[1]), vreinterpret_u16_u8(t23.val[1]));	// 1 5, 3 7
+			c0 = vtrn_u16(vreinterpret_u16_u8(t45.val[0]), vreinterpret_u16_u8(t67.val[0]));	// the same of rows 4..7
+			c1 = vtrn_u16(vreinterpret_u16_u8(t45.val[1]), vreinterpret_u16_u8(t67.val[1]));
+			d = vtrn_u32(vreinterpret_u32_u16(b0.val[0]), vreinterpret_u32_u16(c0.val[0]));
+			x[8*k+0] = vmovl_u8(vreinterpret_u8_u32(d.val[0]));
+			x[8*k+4] = vmovl_u8(vreinterpret_u8_u32(d.val[1]));
+			d = vtrn_u32(vreinterpret_u32_u16(b1.val[0]), vreinterpret_u32_u16(c1.val[0]));
+			x[8*k+1] = vmovl_u8(vreinterpret_u8_u32(d.val[0]));
+			x[8*k+5] = vmovl_u8(vreinterpret_u8_u32(d.val[1]));
+			d = vtrn_u32(vreinterpret_u32_u16(b0.val[1]), vreinterpret_u32_u16(c0.val[1]));
+			x[8*k+2] = vmovl_u8(vreinterpret_u8_u32(d.val[0]));
+			x[8*k+6] = vmovl_u8(vreinterpret_u8_u32(d.val[1]));
+			d = vtrn_u32(vreinterpret_u32_u16(b1.val[1]), vreinterpret_u32_u16(c1.val[1]));
+			x[8*k+3] = vmovl_u8(vreinterpret_u8_u32(d.val[0]));
+			x[8*k+7] = vmovl_u8(vreinterpret_u8_u32(d.val[1]));
+		}
+		for(h=0;h<H;h++){
+			lo = hi = vdupq_n_u32(m->bias[h]);
+			for(f=0;f<F;f++){
+				lo = vmlal_n_u16(lo, vget_low_u16(x[f]), m->W[h][f]);
+				hi = vmlal_n_u16(hi, vget_high_u16(x[f]), m->W[h][f]);
+			}
+			// out of range indexes leave the value of vtbx as it is
+			index = vmovn_u16(vcombine_u16(vmovn_u32(vminq_u32(vshrq_n_u32(lo, 8), top)), vmovn_u32(vminq_u32(vshrq_n_u32(hi, 8), top))));
+			value = vtbl4_u8(table[0], index);
+			for(t=1;t<MLP_SIG_SIZE/32;t++){
+				index = vsub_u8(index, vdup_n_u8(32));
+				value = vtbx4_u8(value, table[t], index);
+			}
+			act[h] = vmovl_u8(value);
+		}
+		for(o=0;o<O;o++){
+			lo = hi = vdupq_n_u32(m->C0[o]);
+			for(h=0;h<H;h++){
+				lo = vmlal_n_u16(lo, vget_low_u16(act[h]), m->C[o][h]);
+				hi = vmlal_n_u16(hi, vget_high_u16(act[h]), m->C[o][h]);
+			}
+			vst1q_u32(out, vshrq_n_u32(lo, 8));
+			vst1q_u32(out+4, vshrq_n_u32(hi, 8));
+			for(j=0;j<8;j++)
+				RES[(r+j)*O+o] = out[j];
+		}
+	}
+}
+
+#endif
+
+int MLP_Simd_Supported(MLP_Isa isa){
+	switch(isa){
+	case MLP_ISA_SCALAR:
+		return 1;
+#ifdef MLP_SIMD_NEON
+	case MLP_ISA_NEON:
+		return 1;
+#endif
+#ifdef MLP_SIMD_X86
+	case MLP_ISA_SSE4:
+		return __builtin_cpu_supports("sse4.1");
+	case MLP_ISA_AVX2:
+		return __builtin_cpu_supports("avx2");
+	case MLP_ISA_AVX512_VNNI:
+		return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vnni");
+#endif
+	default:
+		return 0;
+	}
+}
+
+MLP_Isa MLP_Simd_Isa(void){
+	int isa;
+	for(isa=MLP_ISA_AVX512_VNNI;isa>MLP_ISA_SCALAR;isa--)
+		if(MLP_Simd_Supported((MLP_Isa)isa))
+			return (MLP_Isa)isa;
+	return MLP_ISA_SCALAR;
+}
+
+const char *MLP_Simd_Isa_Name(MLP_Isa isa){
+	static const char *names[] = {"scalar", "NEON", "SSE4.1", "AVX2", "AVX-512 VNNI"};
+	return (isa >= MLP_ISA_SCALAR && isa <= MLP_ISA_AVX512_VNNI) ? names[isa] : "?";
+}
+
+int MLP_Simd_Forward(const MLP_Simd_Model *model, MLP_Isa isa, const uint8_t X[], int rows, int RES[]){
+	const int F = model->features;
+	// rows that can be read 8*chunks bytes from their start (those of a whole kernel step are done by the kernel)
+	int safe = rows - (8*model->chunks + F-1)/F + 1;
+	int done = 0;
+
+	if(!MLP_Simd_Supported(isa))
+		return -1;
+	if(safe < 0)
+		safe = 0;
+	switch(isa){
+#ifdef MLP_SIMD_NEON
+	case MLP_ISA_NEON:
+		done = safe & ~7;
+		mlp_simd_neon(model, X, done, RES);
+		break;
+#endif
+#ifdef MLP_SIMD_X86
+	case MLP_ISA_SSE4:
+		done = safe & ~3;
+		mlp_simd_sse4(model, X, done, RES);
+		break;
+	case MLP_ISA_AVX2:
+		done = safe & ~7;
+		mlp_simd_avx2(model, X, done, RES);
+		break;
+	case MLP_ISA_AVX512_VNNI:
+		done = safe & ~15;
+		mlp_simd_avx512(model, X, done, RES);
+		break;
+#endif
+	default:
+		break;
+	}
+	mlp_simd_scalar(model, X + done*F, rows - done, RES + done*model->outputs);
+	return 0;
+}
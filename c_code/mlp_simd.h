@@ -0,0 +1,58 @@
+/*
+ * mlp_simd.h: vector versions of MLP_Forward for 8-bit rows, with the instruction set picked at run time
+ *
+ * The model is prepared once by MLP_Simd_Prepare, which checks that B, C and SIG are 0..255 (8-bit, as in the
+ * coprocessors) and lays the weights out for the kernels. The sums are then never negative, so (sum / 256) is a shift,
+ * and every kernel gives the same results as MLP_Forward.
+ * Each lane of a kernel is a row (4 rows per vector with SSE4.1, 8 with AVX2 and NEON, 16 with AVX-512), so there
+ * are no sums across lanes : the bytes of 8 features of the rows are put in 16-bit lanes, summed into 32-bit lanes
+ * (pmaddwd, vpdpwssd, vmlal_n_u16), and the sigmoid of each hidden node is looked up for all the rows at once
+ * (gather, vtbl on NEON).
+ */
+
+#ifndef MLP_SIMD_H
+#define MLP_SIMD_H
+
+#include <stdint.h>
+#include "mlp_forward.h"
+
+#define MLP_SIMD_MAX_CHUNKS 8		// 8 features per chunk : up to 64 features
+
+typedef enum {
+	MLP_ISA_SCALAR,
+	MLP_ISA_NEON,
+	MLP_ISA_SSE4,
+	MLP_ISA_AVX2,
+	MLP_ISA_AVX512_VNNI
+} MLP_Isa;
+
+// Built by MLP_Simd_Prepare. About 21 KB : keep it static on the Zynq (the standalone stack is 8 KB by default).
+typedef struct {
+	int features;
+	int hidden;
+	int outputs;
+	int chunks;				// features / 8, rounded up
+	// Wp[h][k] : the weights of hidden node h for features 8k .. 8k+7 in 16-bit pairs, for the bytes 0 2, 1 3, 4 6, 5 7
+	int32_t Wp[MLP_MAX_HIDDEN][MLP_SIMD_MAX_CHUNKS][4];
+	uint16_t W[MLP_MAX_HIDDEN][8*MLP_SIMD_MAX_CHUNKS];		// 0 past the features
+	int32_t bias[MLP_MAX_HIDDEN];
+	// Cp[o][p] : the weights of output node o for hidden nodes 2p and 2p+1 in 16-bit pairs
+	int32_t Cp[MLP_MAX_OUTPUTS][MLP_MAX_HIDDEN/2];
+	uint16_t C[MLP_MAX_OUTPUTS][MLP_MAX_HIDDEN];
+	int32_t C0[MLP_MAX_OUTPUTS];
+	int32_t SIG[MLP_SIG_SIZE];
+	uint8_t SIG8[MLP_SIG_SIZE];	// for vtbl
+} MLP_Simd_Model;
+
+// Returns 0, or -1 if the model is too large or has values outside 0..255.
+int MLP_Simd_Prepare(const MLP_Model *model, MLP_Simd_Model *out);
+// The best instruction set of this CPU (NEON if built for it)
+MLP_Isa MLP_Simd_Isa(void);
+// 1 if isa can be used on this CPU
+int MLP_Simd_Supported(MLP_Isa isa);
+const char *MLP_Simd_Isa_Name(MLP_Isa isa);
+// rows rows of model->features bytes of X give rows x model->outputs results in RES, as MLP_Forward.
+// Returns 0, or -1 if isa can not be used.
+int MLP_Simd_Forward(const MLP_Simd_Model *model, MLP_Isa isa, const uint8_t X[], int rows, int RES[]);
+
+#endif
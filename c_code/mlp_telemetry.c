@@ -0,0 +1,44 @@
+/*
+ * mlp_telemetry.c: decoding of the counter trailer of the coprocessors (see mlp_telemetry.h)
+ */
+
+#include <stdio.h>
+#include "mlp_telemetry.h"
+
+int MLP_Telemetry_Decode(const uint32_t words[MLP_TELEMETRY_WORDS], MLP_Telemetry *t){
+	if(words[0] != MLP_TELEMETRY_MAGIC)
+		return -1;
+	t->cycles = words[1];
+	t->in_no_ready = words[2];
+	t->in_no_valid = words[3];
+	t->out_no_ready = words[4];
+	t->hid_cycles = words[5];
+	t->out_cycles = words[6];
+	t->batches = words[7];
+	return 0;
+}
+
+void MLP_Telemetry_Delta(const MLP_Telemetry *now, const MLP_Telemetry *before, MLP_Telemetry *delta){
+	delta->cycles = now->cycles - before->cycles;
+	delta->in_no_ready = now->in_no_ready - before->in_no_ready;
+	delta->in_no_valid = now->in_no_valid - before->in_no_valid;
+	delta->out_no_ready = now->out_no_ready - before->out_no_ready;
+	delta->hid_cycles = now->hid_cycles - before->hid_cycles;
+	delta->out_cycles = now->out_cycles - before->out_cycles;
+	delta->batches = now->batches - before->batches;
+}
+
+// Tenths of a percent of cycles, without floating point (xil_printf has no %f)
+static unsigned share(uint32_t count, uint32_t cycles){
+	return cycles ? (unsigned)((uint64_t)count*1000 / cycles) : 0;
+}
+
+void MLP_Telemetry_Print(const MLP_Telemetry *delta, long batch){
+	const uint32_t c = delta->cycles;
+	printf("batch %ld : %lu clocks, hidden layer %u.%u%%, output layer %u.%u%%, input stalled %u.%u%% (no TVALID) / %u.%u%% (no TREADY), output stalled %u.%u%%\r\n",
+			batch, (unsigned long)c, share(delta->hid_cycles, c)/10, share(delta->hid_cycles, c)%10,
+			share(delta->out_cycles, c)/10, share(delta->out_cycles, c)%10,
+			share(delta->in_no_valid, c)/10, share(delta->in_no_valid, c)%10,
+			share(delta->in_no_ready, c)/10, share(delta->in_no_ready, c)%10,
+			share(delta->out_no_ready, c)/10, share(delta->out_no_ready, c)%10);
+}
@@ -0,0 +1,36 @@
+/*
+ * mlp_telemetry.h: the counters of the coprocessors (TELEMETRY = 1 in simple_ML_IP_v1_0, TELEMETRY 1 in myip_v1_0_HLS)
+ *
+ * A batch sent with CMD_TELEMETRY in its header gets MLP_TELEMETRY_WORDS words after its results, the last of them
+ * with TLAST : MLP_TELEMETRY_MAGIC, then the counters in the order of MLP_Telemetry. They count from reset and wrap
+ * at 32 bits, so the clocks of a batch are the difference between its trailer and the one before
+ * (MLP_Telemetry_Delta, modulo 2^32).
+ */
+
+#ifndef MLP_TELEMETRY_H
+#define MLP_TELEMETRY_H
+
+#include <stdint.h>
+
+#define CMD_TELEMETRY 16
+#define MLP_TELEMETRY_WORDS 8
+#define MLP_TELEMETRY_MAGIC 0x544C4D01u	// "TLM", version 1
+
+typedef struct {
+	uint32_t cycles;
+	uint32_t in_no_ready;	// S_AXIS TVALID without TREADY : the coprocessor holds the input back
+	uint32_t in_no_valid;	// S_AXIS TREADY without TVALID : the coprocessor waits for input
+	uint32_t out_no_ready;	// M_AXIS TVALID without TREADY : the results wait for the DMA
+	uint32_t hid_cycles;	// hidden layer computing
+	uint32_t out_cycles;	// output layer (predictor) computing
+	uint32_t batches;		// headers read
+} MLP_Telemetry;
+
+// Fills t from the trailer words. Returns 0, or -1 if words is not a trailer (no magic).
+int MLP_Telemetry_Decode(const uint32_t words[MLP_TELEMETRY_WORDS], MLP_Telemetry *t);
+// delta = now - before, counter by counter
+void MLP_Telemetry_Delta(const MLP_Telemetry *now, const MLP_Telemetry *before, MLP_Telemetry *delta);
+// Prints the counters of batch batch (a delta) : the clocks, and each counter as a share of them
+void MLP_Telemetry_Print(const MLP_Telemetry *delta, long batch);
+
+#endif
@@ -0,0 +1,75 @@
+/*
+ * node_multiply.c: multiply-accumulate kernels of the hidden and output layers (see node_multiply.h)
+ */
+
+#include <stdlib.h>
+#include "node_multiply.h"
+
+int Node_Multiply(int arrA[], int arrB[], int arrRES[], int sizeA, int sizeB, int sizeRES){
+	int i=0,j=0,k=0,sum=0;
+	while(i<sizeA){
+		for(j=0;j<sizeB;j++){
+			if(j==0){
+				sum += 1*arrB[j];
+			}else{
+				sum += arrA[i]*arrB[j];
+				i++;
+			}
+		}
+		arrRES[k] = sum/256;
+		sum = 0;
+		k++;
+	}
+	return 0;
+}
+
+// Returns 0, or -1 if out of memory.
+int Compress_Rows(const int arrA[], int rows, int features, Sparse_Rows *out){
+	int r, f, n = 0;
+	for(r=0;r<rows*features;r++)
+		if(arrA[r] != 0)
+			n++;
+	out->rows = rows;
+	out->features = features;
+	out->row_start = malloc((rows+1) * sizeof(int));
+	out->col = malloc((n ? n : 1) * sizeof(int));
+	out->val = malloc((n ? n : 1) * sizeof(int));
+	if(out->row_start == NULL || out->col == NULL || out->val == NULL){
+		Free_Rows(out);
+		return -1;
+	}
+	n = 0;
+	for(r=0;r<rows;r++){
+		out->row_start[r] = n;
+		for(f=0;f<features;f++){
+			if(arrA[r*features+f] != 0){
+				out->col[n] = f;
+				out->val[n] = arrA[r*features+f];
+				n++;
+			}
+		}
+	}
+	out->row_start[rows] = n;
+	return 0;
+}
+
+void Free_Rows(Sparse_Rows *rows){
+	free(rows->row_start);
+	free(rows->col);
+	free(rows->val);
+	rows->row_start = NULL;
+	rows->col = NULL;
+	rows->val = NULL;
+}
+
+// arrB holds the bias, then one weight per feature, as for Node_Multiply.
+int Node_Multiply_Sparse(const Sparse_Rows *rows, const int arrB[], int arrRES[]){
+	int r, k, sum;
+	for(r=0;r<rows->rows;r++){
+		sum = arrB[0];
+		for(k=rows->row_start[r];k<rows->row_start[r+1];k++)
+			sum += rows->val[k]*arrB[rows->col[k]+1];
+		arrRES[r] = sum/256;
+	}
+	return 0;
+}
@@ -0,0 +1,33 @@
+/*
+ * node_multiply.h: multiply-accumulate kernels of the hidden and output layers
+ *
+ * Node_Multiply : rows of sizeB-1 values of arrA, each with a leading 1 (bias), times the sizeB weights of arrB.
+ * Node_Multiply_Sparse : the same from the compressed rows of Compress_Rows, skipping the values that are 0.
+ * Both write (sum / 256) of each row to arrRES.
+ *
+ * Node_Multiply_Sparse is no faster than Node_Multiply unless nearly all of X is 0 : on the host (bench.c) it lost
+ * at 25-90 % of 0s (branch misses) and won from SPARSE_MIN_ZEROS percent. Compress_Rows costs more than a dense
+ * pass, so the compressed rows only pay when they are used many times.
+ */
+
+#ifndef NODE_MULTIPLY_H
+#define NODE_MULTIPLY_H
+
+#define SPARSE_MIN_ZEROS 95	// share of 0s (percent) from which Node_Multiply_Sparse was faster (bench.c)
+
+// Values other than 0 of the rows of a rows x features matrix (row-major), with the feature of each.
+// The values of row r are val[row_start[r]] .. val[row_start[r+1]-1]. Built once per data set and used for every node.
+typedef struct {
+	int rows;
+	int features;
+	int *row_start;		// rows+1 entries
+	int *col;			// row_start[rows] entries
+	int *val;
+} Sparse_Rows;
+
+int Node_Multiply(int arrA[], int arrB[], int arrRES[], int sizeA, int sizeB, int sizeRES);
+int Compress_Rows(const int arrA[], int rows, int features, Sparse_Rows *out);
+void Free_Rows(Sparse_Rows *rows);
+int Node_Multiply_Sparse(const Sparse_Rows *rows, const int arrB[], int arrRES[]);
+
+#endif
@@ -0,0 +1,538 @@
+/*
+----------------------------------------------------------------------------------
+--	(c) Rajesh C Panicker, NUS,
+--  Description : Differential benchmark of the C code, the HLS kernels (C simulation) and the RTL on the same data
+--	License terms :
+--	You are free to use this code as long as you
+--		(i) DO NOT post a modified version of this on any public repository;
+--		(ii) use it only for educational purposes;
+--		(iii) accept the responsibility to ensure that your implementation does not violate any intellectual property of any entity.
+--		(iv) accept that the program is provided "as is" without warranty of any kind or assurance regarding its suitability for any particular purpose;
+--		(v) send an email to rajesh.panicker@ieee.org briefly mentioning its use (except when used for the course EE4218 at the National University of Singapore);
+--		(vi) retain this notice in this file or any files derived from this.
+----------------------------------------------------------------------------------
+*/
+// Build and run from hls_code, with the include directory of Vivado HLS (for hls_stream.h and ap_int.h) :
+//   gcc -O2 -c ../c_code/mlp_forward.c ../c_code/mlp_simd.c ../c_code/mlp_batch.c ../c_code/node_multiply.c ../c_code/csv_load.c
+//       ../c_code/mlp_telemetry.c
+//   g++ -O2 -I<Vivado HLS>/include -I../c_code -pthread -o diff_bench diff_bench_HLS.cpp myip_v1_0_HLS.cpp
+//       mlp_forward.o mlp_simd.o mlp_batch.o node_multiply.o csv_load.o mlp_telemetry.o
+//   ./diff_bench [rows [seed [rtl_command [cosim_report]]]]
+//
+// The data set : the 64 rows of X.csv, then rows-64 random rows (DIFF_ROWS by default; some all 0s, some all 255s,
+// the others with a share of 0s), with the model of w_hid.csv / w_out.csv / sigmoid.csv, and again with a random
+// 8-bit model. Every backend gets the same rows; its results are compared, row by row, with MLP_Forward (the C
+// reference), and the first DIFF_SHOW rows that differ are printed with their values.
+//   C    : MLP_Forward, MLP_Simd_Forward with each instruction set of this CPU, MLP_Batch_Forward with a thread per CPU
+//          (samples/s)
+//   HLS  : C simulation of myip_v1_0_HLS (CMD_STREAM_ROWS batches of DIFF_HLS_BATCH rows), myip_mm_HLS (MM_ROWS
+//          rows per call) and myip_rows_HLS, on the first DIFF_SIM_ROWS rows, all packed (results saturated to 8 bits).
+//          Cycles/sample from the C/RTL co-simulation report given as cosim_report (<solution>/sim/report/<top>_cosim.rpt,
+//          made with this file as the test bench) : average interval / rows per call of the top function of the report.
+//   RTL  : the first DIFF_SIM_ROWS rows in one CMD_LOAD_MODEL | CMD_STREAM_ROWS | CMD_PACKED | CMD_TELEMETRY batch,
+//          written to diff_bench_input.mem. rtl_command (e.g. "cd ../HDL_implementation && vvp tb_diff_bench", see
+//          tb_diff_bench.v) is run, and the results and cycles are read back from diff_bench_rtl.mem. The counter
+//          trailer after the results is decoded with c_code/mlp_telemetry.c and printed; it must be there, count one
+//          batch, and the cycles of the run.
+// Accuracy : the labels (result > DATA_THRESHOLD) of the rows of X.csv against labels.csv, for each backend.
+// The RTL is skipped without rtl_command. Any mismatch fails the test, and so does a backend that was run but gave
+// fewer results than rows (the missing rows count as mismatches) or whose command failed.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "myip_v1_0_HLS.h"
+extern "C" {
+#include "mlp_batch.h"
+#include "csv_load.h"
+#include "mlp_telemetry.h"
+}
+
+
+/***************** Macros *********************/
+#define DIFF_ROWS (1 << 20)	// rows of the data set by default
+#define DIFF_SIM_ROWS 4096	// rows run through the HLS C simulation and the RTL
+#define DIFF_HLS_BATCH 1024	// rows of a CMD_STREAM_ROWS batch of myip_v1_0_HLS and myip_rows_HLS
+#define DIFF_SHOW 8	// mismatching rows printed per backend
+#define MM_ROWS 1000	// rows per call of myip_mm_HLS (MM_MAX_ROWS of myip_v1_0_HLS.cpp)
+#define FEATURES 7
+#define HIDDEN 2
+#define FILE_ROWS 64	// rows of X.csv
+#define B_WORDS ((FEATURES+1)*HIDDEN)
+#define C_WORDS (HIDDEN+1)
+#define PACK_LANES 4	// 8-bit values per word with CMD_PACKED
+#define RTL_ROW 8	// values of an X row of the RTL : 1 (for the bias), then the features
+#define DATA_THRESHOLD 39	// labels.csv is (result > 39) for the rows of X.csv
+#define RTL_INPUT "diff_bench_input.mem"
+#define RTL_OUTPUT "diff_bench_rtl.mem"
+
+struct Backend{
+	const char *name;
+	int *res;			// one result per row
+	long rows;			// rows run; 0 : skipped
+	long expected;		// rows it was given : the ones past rows are missing
+	bool failed;		// did not run through (rtl_command failed, no diff_bench_rtl.mem, no telemetry trailer)
+	bool saturated;		// the results are saturated to 8 bits (packed)
+	double seconds;
+	double cycles;		// per row, -1 if not known
+};
+
+
+/************************** Function Definitions *****************************/
+
+static double now_seconds(void){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+// The rows of X.csv first, then random rows : 1 in 16 all 0s, 1 in 16 all 255s, the others with about 1 value in 4 at 0
+static void make_rows(uint8_t X[], const uint8_t file_X[], long rows, unsigned seed){
+	long row;
+	int f, kind;
+	srand(seed);
+	for(row = 0; row < rows; row++){
+		kind = rand() % 16;
+		for(f = 0; f < FEATURES; f++)
+			X[row*FEATURES+f] = (row < FILE_ROWS) ? file_X[row*FEATURES+f] : (kind == 0) ? 0 : (kind == 1) ? 255
+				: (rand() % 4 == 0) ? 0 : rand() % 256;
+	}
+}
+
+// Model words as the kernels read them : B, C, then SIG (with SIGMOID_TABLE)
+static void model_words(const MLP_Model *model, int words[]){
+	int i;
+	for(i = 0; i < B_WORDS; i++)
+		words[i] = model->B[i];
+	for(i = 0; i < C_WORDS; i++)
+		words[B_WORDS+i] = model->C[i];
+	for(i = 0; i < SIG_SIZE; i++)
+		words[B_WORDS+C_WORDS+i] = model->SIG[i];
+}
+
+// Words of rows rows of X from row first, packed PACK_LANES values per word (row_values values per row, the first one
+// being 1 if row_values > FEATURES). Returns the number of words.
+static long pack_rows(const uint8_t X[], long first, long rows, int row_values, int words[]){
+	long value, values = rows*row_values;
+	int v;
+	for(value = 0; value < values; value += PACK_LANES)
+		words[value/PACK_LANES] = 0;
+	for(value = 0; value < values; value++){
+		v = value % row_values - (row_values - FEATURES);
+		words[value/PACK_LANES] |= ((v < 0) ? 1 : X[(first + value/row_values)*FEATURES+v]) << (8*(value%PACK_LANES));
+	}
+	return (values+PACK_LANES-1)/PACK_LANES;
+}
+
+static void run_c(Backend *b, const MLP_Model *model, const uint8_t X[], long rows){
+	static int *X_int = NULL;
+	static long X_int_rows = 0;
+	long i;
+	if(X_int_rows != rows){
+		free(X_int);
+		X_int = (int *)malloc(rows*FEATURES*sizeof(int));
+		X_int_rows = rows;
+	}
+	for(i = 0; i < rows*FEATURES; i++)
+		X_int[i] = X[i];
+	b->seconds = now_seconds();
+	MLP_Forward(model, X_int, rows, b->res);
+	b->seconds = now_seconds() - b->seconds;
+	b->rows = rows;
+}
+
+static void run_simd(Backend *b, const MLP_Simd_Model *simd, MLP_Isa isa, const uint8_t X[], long rows){
+	long first, n;
+	b->seconds = now_seconds();
+	for(first = 0; first < rows; first += n){	// MLP_Simd_Forward takes an int count of rows
+		n = (rows - first < (1L << 30)) ? rows - first : (1L << 30);
+		MLP_Simd_Forward(simd, isa, X + first*FEATURES, n, b->res + first);
+	}
+	b->seconds = now_seconds() - b->seconds;
+	b->rows = rows;
+}
+
+static void run_batch(Backend *b, const MLP_Simd_Model *simd, const uint8_t X[], long rows){
+	MLP_Pool *pool = MLP_Pool_Create(sysconf(_SC_NPROCESSORS_ONLN));
+	b->expected = rows;
+	if(pool == NULL){
+		b->failed = true;
+		return;
+	}
+	b->seconds = now_seconds();
+	MLP_Batch_Forward(pool, simd, MLP_Simd_Isa(), X, rows, b->res);
+	b->seconds = now_seconds() - b->seconds;
+	b->rows = rows;
+	MLP_Pool_Destroy(pool);
+}
+
+// myip_v1_0_HLS : the model with the first batch, CMD_STREAM_ROWS | CMD_PACKED batches of DIFF_HLS_BATCH rows
+static void run_hls_stream(Backend *b, const int model[], const uint8_t X[], long rows){
+	static int words[(DIFF_HLS_BATCH*FEATURES+PACK_LANES-1)/PACK_LANES];
+	hls::stream<AXIS_wLAST> S_AXIS, M_AXIS;
+	AXIS_wLAST word;
+	long first, n, w, count, r;
+	int command, i;
+
+	b->seconds = now_seconds();
+	for(first = 0; first < rows; first += n){
+		n = (rows - first < DIFF_HLS_BATCH) ? rows - first : DIFF_HLS_BATCH;
+		command = ((first == 0) ? CMD_LOAD_MODEL : CMD_INFER_ONLY) | CMD_STREAM_ROWS | CMD_PACKED;
+		word.data = command;
+		word.last = 0;
+		S_AXIS.write(word);
+		for(i = 0; (command & CMD_LOAD_MODEL) && i < B_WORDS+C_WORDS+SIG_WORDS; i++){
+			word.data = model[i];
+			S_AXIS.write(word);
+		}
+		count = pack_rows(X, first, n, FEATURES, words);
+		for(w = 0; w < count; w++){
+			word.data = words[w];
+			word.last = (w == count-1);
+			S_AXIS.write(word);
+		}
+		myip_v1_0_HLS(S_AXIS, M_AXIS);
+		for(r = 0; r < n; r++){
+			if(r % PACK_LANES == 0)
+				word = M_AXIS.read();
+			b->res[first+r] = (word.data >> (8*(r%PACK_LANES))) & 0xFF;
+		}
+		while(!M_AXIS.empty())
+			M_AXIS.read();
+	}
+	b->seconds = now_seconds() - b->seconds;
+	b->rows = rows;
+}
+
+// myip_mm_HLS : MM_ROWS rows per call, the model with the first one, packed
+static void run_hls_mm(Backend *b, const int model[], const uint8_t X[], long rows){
+	static int words[(MM_ROWS*FEATURES+PACK_LANES-1)/PACK_LANES], RES[(MM_ROWS+PACK_LANES-1)/PACK_LANES];
+	long first, n, r;
+
+	b->seconds = now_seconds();
+	for(first = 0; first < rows; first += n){
+		n = (rows - first < MM_ROWS) ? rows - first : MM_ROWS;
+		pack_rows(X, first, n, FEATURES, words);
+		myip_mm_HLS(model, words, RES, n, ((first == 0) ? CMD_LOAD_MODEL : CMD_INFER_ONLY) | CMD_PACKED);
+		for(r = 0; r < n; r++)
+			b->res[first+r] = (RES[r/PACK_LANES] >> (8*(r%PACK_LANES))) & 0xFF;
+	}
+	b->seconds = now_seconds() - b->seconds;
+	b->rows = rows;
+}
+
+// myip_rows_HLS : ROWS_PER_CYCLE rows per word, CMD_STREAM_ROWS batches of DIFF_HLS_BATCH rows, the last word
+// padded with rows of 0s
+static void run_hls_rows(Backend *b, const int model[], const uint8_t X[], long rows){
+	hls::stream<AXIS_ROWS_IN> S_AXIS;
+	hls::stream<AXIS_ROWS_OUT> M_AXIS;
+	AXIS_ROWS_IN word;
+	AXIS_ROWS_OUT result;
+	long first, n, w, count, r;
+	int command, i, f, lane;
+
+	b->seconds = now_seconds();
+	for(first = 0; first < rows; first += n){
+		n = (rows - first < DIFF_HLS_BATCH) ? rows - first : DIFF_HLS_BATCH;
+		command = ((first == 0) ? CMD_LOAD_MODEL : CMD_INFER_ONLY) | CMD_STREAM_ROWS;
+		word.data = command;
+		word.last = 0;
+		S_AXIS.write(word);
+		for(i = 0; (command & CMD_LOAD_MODEL) && i < B_WORDS+C_WORDS+SIG_WORDS; i++){
+			word.data = model[i];
+			S_AXIS.write(word);
+		}
+		count = (n+ROWS_PER_CYCLE-1)/ROWS_PER_CYCLE;
+		for(w = 0; w < count; w++){
+			word.data = 0;
+			for(lane = 0; lane < ROWS_PER_CYCLE && w*ROWS_PER_CYCLE+lane < n; lane++)
+				for(f = 0; f < FEATURES; f++)
+					word.data.range((lane*FEATURES+f)*8+7, (lane*FEATURES+f)*8) = X[(first+w*ROWS_PER_CYCLE+lane)*FEATURES+f];
+			word.last = (w == count-1);
+			S_AXIS.write(word);
+		}
+		myip_rows_HLS(S_AXIS, M_AXIS);
+		for(r = 0; r < n; r++){
+			if(r % ROWS_PER_CYCLE == 0)
+				result = M_AXIS.read();
+			b->res[first+r] = result.data.range((r%ROWS_PER_CYCLE)*8+7, (r%ROWS_PER_CYCLE)*8);
+		}
+		while(!M_AXIS.empty())
+			M_AXIS.read();
+	}
+	b->seconds = now_seconds() - b->seconds;
+	b->rows = rows;
+}
+
+// Cycles per row from a co-simulation report of top : the average interval of the Verilog (or VHDL) run, over the
+// rows of one call of top. -1 if the report is not there, or not of top.
+static double cosim_cycles(const char *path, const char *top, long rows_per_call){
+	FILE *in_file;
+	char line[512], *p;
+	long v[6];
+	double cycles = -1;
+	if(path == NULL || strstr(path, top) == NULL || strstr(path, top)[strlen(top)] != '_'
+			|| (in_file = fopen(path, "r")) == NULL)
+		return -1;
+	while(cycles < 0 && fgets(line, sizeof(line), in_file) != NULL){
+		if((strstr(line, "Verilog") == NULL && strstr(line, "VHDL") == NULL) || strstr(line, "Pass") == NULL)
+			continue;
+		for(p = line; *p; p++)
+			if(*p == '|')
+				*p = ' ';
+		p = strstr(line, "Pass") + 4;
+		// latency min avg max, interval min avg max
+		if(sscanf(p, "%ld %ld %ld %ld %ld %ld", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5]) == 6)
+			cycles = (double)v[4] / rows_per_call;
+	}
+	fclose(in_file);
+	return cycles;
+}
+
+// The RTL (tb_diff_bench.v) : the model and the rows in one packed CMD_STREAM_ROWS batch, with the telemetry trailer
+static void run_rtl(Backend *b, const int model[], const uint8_t X[], long rows, const char *command){
+	FILE *file;
+	int *words = (int *)malloc((rows*RTL_ROW/PACK_LANES + 2) * sizeof(int));
+	char line[128];
+	unsigned value;
+	uint32_t trailer[MLP_TELEMETRY_WORDS];
+	MLP_Telemetry counters;
+	long count, w, r = 0, cycles = -1, out = 0, result_words = (rows + PACK_LANES-1) / PACK_LANES;
+	int i;
+
+	b->expected = rows;
+	file = fopen(RTL_INPUT, "w");
+	if(words == NULL || file == NULL){
+		printf(" Can not write %s\r\n", RTL_INPUT);
+		free(words);
+		if(file != NULL)
+			fclose(file);
+		b->failed = true;
+		return;
+	}
+	count = pack_rows(X, 0, rows, RTL_ROW, words);
+	// the SIG words are in the model with SIGM_MODE 0, the default of tb_diff_bench
+	fprintf(file, "%lx\n%x\n", 1 + B_WORDS+C_WORDS+SIG_SIZE + count, CMD_LOAD_MODEL | CMD_STREAM_ROWS | CMD_PACKED | CMD_TELEMETRY);
+	for(i = 0; i < B_WORDS+C_WORDS+SIG_SIZE; i++)
+		fprintf(file, "%x\n", model[i]);
+	for(w = 0; w < count; w++)
+		fprintf(file, "%x\n", words[w]);
+	fclose(file);
+	free(words);
+
+	remove(RTL_OUTPUT);
+	b->seconds = now_seconds();
+	if(system(command) != 0){
+		printf(" %s failed\r\n", command);
+		b->failed = true;
+	}
+	b->seconds = now_seconds() - b->seconds;
+	file = fopen(RTL_OUTPUT, "r");
+	if(file == NULL){
+		printf(" No %s from %s\r\n", RTL_OUTPUT, command);
+		b->failed = true;
+		return;
+	}
+	while(fgets(line, sizeof(line), file) != NULL){
+		if(sscanf(line, "// cycles %ld", &cycles) == 1)
+			continue;
+		if(sscanf(line, "%x", &value) != 1)
+			continue;
+		if(out >= result_words && out < result_words + MLP_TELEMETRY_WORDS)
+			trailer[out - result_words] = value;
+		out++;
+		for(i = 0; i < PACK_LANES && r < rows; i++)
+			b->res[r++] = (value >> (8*i)) & 0xFF;
+	}
+	fclose(file);
+	// The counters count from reset, and this is the first batch. They are taken as the last result word goes out, so
+	// their clocks are those of the run less the trailer words, give or take the clocks around reset.
+	if(out != result_words + MLP_TELEMETRY_WORDS || MLP_Telemetry_Decode(trailer, &counters) != 0){
+		printf(" No telemetry trailer after the results in %s\r\n", RTL_OUTPUT);
+		b->failed = true;
+	}
+	else{
+		printf(" %s : ", b->name);
+		MLP_Telemetry_Print(&counters, 0);
+		if(counters.batches != 1 || labs(cycles - MLP_TELEMETRY_WORDS - (long)counters.cycles) > 2
+				|| counters.hid_cycles == 0 || counters.out_cycles == 0){
+			printf(" Telemetry trailer of %s does not match the run (%ld cycles)\r\n", b->name, cycles);
+			b->failed = true;
+		}
+	}
+	b->rows = r;
+	b->cycles = (cycles > 0 && r == rows) ? (double)cycles / r : -1;	// only for a full run
+}
+
+// Rows of b that differ from the reference (saturated like b), the first DIFF_SHOW of them printed, and the rows it
+// was given but gave no result for
+static long compare(const Backend *b, const int ref[], const uint8_t X[]){
+	long row, mismatches = 0;
+	int expected, f;
+	if(b->expected > b->rows){
+		printf("  %-32s %ld results for %ld rows\r\n", b->name, b->rows, b->expected);
+		mismatches = b->expected - b->rows;
+	}
+	for(row = 0; row < b->rows; row++){
+		expected = (b->saturated && ref[row] > 255) ? 255 : ref[row];
+		if(b->res[row] == expected)
+			continue;
+		if(mismatches++ < DIFF_SHOW){
+			printf("  %-32s row %8ld : %4d (expected %4d), X =", b->name, row, b->res[row], expected);
+			for(f = 0; f < FEATURES; f++)
+				printf(" %3d", X[row*FEATURES+f]);
+			printf("\r\n");
+		}
+	}
+	return mismatches;
+}
+
+// Runs all the backends on rows rows of X with model. Returns the number of mismatching (or missing) rows, and adds
+// the backends that failed to failures.
+static long run_model(const char *title, const MLP_Model *model, const uint8_t X[], long rows, long sim_rows,
+		const uint8_t labels[], const char *rtl_command, const char *cosim_report, int *failures){
+	static MLP_Simd_Model simd;
+	static const MLP_Isa isas[4] = {MLP_ISA_NEON, MLP_ISA_SSE4, MLP_ISA_AVX2, MLP_ISA_AVX512_VNNI};
+	static char isa_names[4][48];
+	Backend backends[16];
+	int words[B_WORDS+C_WORDS+SIG_SIZE], n = 0, i, correct, r;
+	long mismatches[16], total = 0;
+
+	model_words(model, words);
+	memset(backends, 0, sizeof(backends));
+	backends[n++].name = "C MLP_Forward (reference)";
+	if(MLP_Simd_Prepare(model, &simd) == 0){
+		backends[n++].name = "C MLP_Simd_Forward scalar";
+		for(i = 0; i < 4; i++)
+			if(MLP_Simd_Supported(isas[i])){
+				snprintf(isa_names[i], sizeof(isa_names[i]), "C MLP_Simd_Forward %s", MLP_Simd_Isa_Name(isas[i]));
+				backends[n++].name = isa_names[i];
+			}
+		backends[n++].name = "C MLP_Batch_Forward";
+	}
+	backends[n++].name = "HLS C-sim myip_v1_0_HLS";
+	backends[n++].name = "HLS C-sim myip_mm_HLS";
+	backends[n++].name = "HLS C-sim myip_rows_HLS";
+	backends[n++].name = "RTL simple_ML_IP_v1_0";
+	for(i = 0; i < n; i++){
+		backends[i].res = (int *)malloc(rows*sizeof(int));
+		backends[i].cycles = -1;
+		backends[i].saturated = (strncmp(backends[i].name, "C ", 2) != 0);
+		if(backends[i].res == NULL){
+			printf("Out of memory\r\n");
+			exit(1);
+		}
+	}
+
+	printf("%s : %ld rows (%ld through the HLS C simulation and the RTL)\r\n", title, rows, sim_rows);
+	i = 0;
+	run_c(&backends[i++], model, X, rows);
+	if(strncmp(backends[i].name, "C MLP_Simd", 10) == 0){
+		run_simd(&backends[i++], &simd, MLP_ISA_SCALAR, X, rows);
+		for(r = 0; r < 4; r++)
+			if(MLP_Simd_Supported(isas[r]))
+				run_simd(&backends[i++], &simd, isas[r], X, rows);
+		run_batch(&backends[i++], &simd, X, rows);
+	}
+	run_hls_stream(&backends[i], words, X, sim_rows);
+	backends[i++].cycles = cosim_cycles(cosim_report, "myip_v1_0_HLS", DIFF_HLS_BATCH);
+	run_hls_mm(&backends[i], words, X, sim_rows);
+	backends[i++].cycles = cosim_cycles(cosim_report, "myip_mm_HLS", MM_ROWS);
+	run_hls_rows(&backends[i], words, X, sim_rows);
+	backends[i++].cycles = cosim_cycles(cosim_report, "myip_rows_HLS", DIFF_HLS_BATCH);
+	if(rtl_command != NULL)
+		run_rtl(&backends[i], words, X, sim_rows, rtl_command);
+	i++;
+
+	mismatches[0] = 0;
+	for(i = 1; i < n; i++){
+		mismatches[i] = compare(&backends[i], backends[0].res, X);
+		total += mismatches[i];
+		*failures += backends[i].failed;
+	}
+	printf("  %-32s %9s %10s %14s %14s %10s\r\n", "backend", "rows", "mismatches", "samples/s", "cycles/sample", "accuracy");
+	for(i = 0; i < n; i++){
+		if(backends[i].failed || (backends[i].rows == 0 && backends[i].expected == 0)){
+			printf("  %-32s %9s\r\n", backends[i].name, backends[i].failed ? "FAILED" : "skipped");
+			continue;
+		}
+		printf("  %-32s %9ld %10ld %14.0f ", backends[i].name, backends[i].rows, mismatches[i],
+				backends[i].rows / (backends[i].seconds > 0 ? backends[i].seconds : 1e-9));
+		if(backends[i].cycles >= 0)
+			printf("%14.2f ", backends[i].cycles);
+		else
+			printf("%14s ", "-");
+		if(labels != NULL && backends[i].rows >= FILE_ROWS){
+			for(r = correct = 0; r < FILE_ROWS; r++)
+				correct += (backends[i].res[r] > DATA_THRESHOLD) == labels[r];
+			printf("%3d/%d (%5.1f%%)", correct, FILE_ROWS, 100.0*correct/FILE_ROWS);
+		}
+		printf("\r\n");
+	}
+	for(i = 0; i < n; i++)
+		free(backends[i].res);
+	return total;
+}
+
+/*****************************************************************************
+* Main function
+******************************************************************************/
+int main(int argc, char *argv[])
+{
+	long rows = (argc > 1) ? atol(argv[1]) : DIFF_ROWS, sim_rows;
+	unsigned seed = (argc > 2) ? atoi(argv[2]) : 1;
+	const char *rtl_command = (argc > 3 && strcmp(argv[3], "-") != 0) ? argv[3] : NULL;
+	const char *cosim_report = (argc > 4) ? argv[4] : NULL;
+	static uint8_t file_X[FILE_ROWS*FEATURES], labels[FILE_ROWS];
+	static int B[B_WORDS], C[C_WORDS], SIG[SIG_SIZE], random_B[B_WORDS], random_C[C_WORDS];
+	const char *path[5] = {"../X.csv", "../w_hid.csv", "../w_out.csv", "../sigmoid.csv", "../labels.csv"};
+	CSV_Error err;
+	uint8_t *X;
+	long mismatches;
+	int i, failed = 0, failures = 0;
+
+	if(CSV_Load_U8(path[0], file_X, FILE_ROWS*FEATURES, FEATURES, &err) < 0)
+		failed = 1;
+	else if(CSV_Load_Int(path[1], B, B_WORDS, HIDDEN, &err) < 0)
+		failed = 2;
+	else if(CSV_Load_Int(path[2], C, C_WORDS, 1, &err) < 0)
+		failed = 3;
+	else if(CSV_Load_Int(path[3], SIG, SIG_SIZE, 0, &err) < 0)
+		failed = 4;
+	else if(CSV_Load_U8(path[4], labels, FILE_ROWS, 1, &err) < 0)
+		failed = 5;
+	if(failed){
+		printf("%s line %ld value %ld : %s\r\n", path[failed-1], err.line, err.column, err.what);
+		return 1;
+	}
+	if(rows < FILE_ROWS)
+		rows = FILE_ROWS;
+	sim_rows = (rows < DIFF_SIM_ROWS) ? rows : DIFF_SIM_ROWS;
+	X = (uint8_t *)malloc(rows*FEATURES);
+	if(X == NULL){
+		printf("Out of memory\r\n");
+		return 1;
+	}
+	make_rows(X, file_X, rows, seed);
+
+	MLP_Model model = {FEATURES, HIDDEN, 1, B, C, SIG};
+	mismatches = run_model("Model of w_hid.csv / w_out.csv", &model, X, rows, sim_rows, labels, rtl_command, cosim_report, &failures);
+
+	// hidden sums spread over the sigmoid table, outputs up to about 500 (saturated when packed)
+	srand(seed);
+	for(i = 0; i < B_WORDS; i++)
+		random_B[i] = rand() % 32;
+	for(i = 0; i < C_WORDS; i++)
+		random_C[i] = 128 + rand() % 128;
+	MLP_Model random_model = {FEATURES, HIDDEN, 1, random_B, random_C, SIG};
+	mismatches += run_model("Random model", &random_model, X, rows, sim_rows, NULL, rtl_command, cosim_report, &failures);
+
+	free(X);
+	if(mismatches != 0 || failures != 0){
+		printf("%ld mismatching or missing rows, %d backend runs failed\r\nTest Failed\r\n", mismatches, failures);
+		return 1;
+	}
+	printf("Test Success\r\n");
+	return 0;
+}
@@ -0,0 +1,250 @@
+/*
+----------------------------------------------------------------------------------
+--	(c) Rajesh C Panicker, NUS,
+--  Description : Simulated device of the DMA driver (c_code/mlp_dma.h) : an AXI DMA and myip_v1_0_HLS in a thread
+--	License terms :
+--	You are free to use this code as long as you
+--		(i) DO NOT post a modified version of this on any public repository;
+--		(ii) use it only for educational purposes;
+--		(iii) accept the responsibility to ensure that your implementation does not violate any intellectual property of any entity.
+--		(iv) accept that the program is provided "as is" without warranty of any kind or assurance regarding its suitability for any particular purpose;
+--		(v) send an email to rajesh.panicker@ieee.org briefly mentioning its use (except when used for the course EE4218 at the National University of Singapore);
+--		(vi) retain this notice in this file or any files derived from this.
+----------------------------------------------------------------------------------
+*/
+// Not a top function : linked with the driver on the host, with the include directory of Vivado HLS (see
+// c_code/dma_bench.c). The thread does what the DMA does with the descriptors : it takes the MM2S chain of a packet
+// (SOF to EOF) as S_AXIS words, TLAST on the last one, writing each status; runs myip_v1_0_HLS on them (one call,
+// one batch); then writes M_AXIS to the S2MM descriptors up to the word with TLAST (MLP_DESC_EOF in its status) and
+// raises the interrupt. Descriptors are only read up to the tail given by start, and the status words are written
+// last (release), so the driver sees the data of a complete descriptor.
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <vector>
+#include "myip_v1_0_HLS.h"
+extern "C" {
+#include "mlp_dma.h"
+}
+
+struct Dma_Sim{
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t work;	// a tail moved, or quit
+	pthread_cond_t irq;		// irqs moved
+	uint64_t first[2], tail[2], done[2];	// done : last descriptor taken, 0 before the first one
+	int started[2];
+	int quit;
+	unsigned long irqs, irqs_seen;
+	double ns_per_clock;	// 0 : not paced
+	double busy;			// seconds
+};
+
+static double now_seconds(void){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+static MLP_Dma_Desc *desc_at(uint64_t addr){
+	return (MLP_Dma_Desc *)(uintptr_t)addr;
+}
+
+// The next descriptor of channel, once the driver has given it; NULL on quit
+static MLP_Dma_Desc *next_desc(Dma_Sim *sim, int channel){
+	MLP_Dma_Desc *d = NULL;
+	pthread_mutex_lock(&sim->lock);
+	while(!sim->quit && (!sim->started[channel] || sim->done[channel] == sim->tail[channel]))
+		pthread_cond_wait(&sim->work, &sim->lock);
+	if(!sim->quit){
+		uint64_t addr = (sim->done[channel] == 0) ? sim->first[channel]
+				: ((uint64_t)desc_at(sim->done[channel])->next_msb << 32) | desc_at(sim->done[channel])->next;
+		d = desc_at(addr);
+		sim->done[channel] = addr;
+	}
+	pthread_mutex_unlock(&sim->lock);
+	return d;
+}
+
+static uint8_t *buffer_of(const MLP_Dma_Desc *d){
+	return (uint8_t *)(uintptr_t)(((uint64_t)d->buffer_msb << 32) | d->buffer);
+}
+
+static void *sim_thread(void *arg){
+	Dma_Sim *sim = (Dma_Sim *)arg;
+	hls::stream<AXIS_wLAST> S_AXIS, M_AXIS;
+	std::vector<uint8_t> packet;
+	std::vector<AXIS_wLAST> results;
+	AXIS_wLAST word;
+	MLP_Dma_Desc *d;
+	uint32_t control, bytes, status, moved;
+	size_t w, clocks;
+	double start;
+
+	for(;;){
+		// MM2S : one packet
+		packet.clear();
+		do{
+			if((d = next_desc(sim, MLP_DMA_MM2S)) == NULL)
+				return NULL;
+			control = d->control;
+			bytes = control & MLP_DESC_BYTES;
+			packet.insert(packet.end(), buffer_of(d), buffer_of(d) + bytes);
+			__atomic_store_n(&d->status, bytes | MLP_DESC_CMPLT, __ATOMIC_RELEASE);
+		}while(!(control & MLP_DESC_EOF));
+		start = now_seconds();
+		clocks = packet.size()/4;
+		for(w = 0; w < packet.size()/4; w++){
+			memcpy(&word.data, &packet[w*4], 4);
+			word.last = (w == packet.size()/4 - 1);
+			S_AXIS.write(word);
+		}
+
+		myip_v1_0_HLS(S_AXIS, M_AXIS);
+		results.clear();
+		while(!M_AXIS.empty())
+			results.push_back(M_AXIS.read());
+
+		// the results are out when the coprocessor would have them : a word in or out per clock at best
+		clocks += results.size();
+		if(sim->ns_per_clock > 0){
+			double until = start + clocks*sim->ns_per_clock*1e-9;
+			struct timespec t;
+			t.tv_sec = (time_t)until;
+			t.tv_nsec = (long)((until - t.tv_sec)*1e9);
+			while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) == EINTR)
+				;
+		}
+
+		pthread_mutex_lock(&sim->lock);
+		sim->busy += now_seconds() - start;
+		pthread_mutex_unlock(&sim->lock);
+
+		// S2MM : up to TLAST, a descriptor at a time
+		status = MLP_DESC_SOF;
+		word.last = 0;
+		for(w = 0; !word.last && w < results.size(); ){
+			if((d = next_desc(sim, MLP_DMA_S2MM)) == NULL)
+				return NULL;
+			bytes = d->control & MLP_DESC_BYTES;
+			for(moved = 0; moved + 4 <= bytes && !word.last && w < results.size(); moved += 4){
+				word = results[w++];
+				memcpy(buffer_of(d) + moved, &word.data, 4);
+			}
+			__atomic_store_n(&d->status, status | moved | MLP_DESC_CMPLT | (word.last ? MLP_DESC_EOF : 0), __ATOMIC_RELEASE);
+			status = 0;
+		}
+		pthread_mutex_lock(&sim->lock);
+		sim->irqs++;
+		pthread_cond_broadcast(&sim->irq);
+		pthread_mutex_unlock(&sim->lock);
+	}
+}
+
+static void *sim_alloc(void *device, size_t bytes, uint64_t *addr){
+	void *mem = NULL;
+	(void)device;
+	if(posix_memalign(&mem, MLP_DMA_ALIGN, bytes) != 0)
+		return NULL;
+	*addr = (uintptr_t)mem;
+	return mem;
+}
+
+static void sim_free(void *device, void *mem){
+	(void)device;
+	free(mem);
+}
+
+static void sim_start(void *device, int channel, uint64_t first, uint64_t tail){
+	Dma_Sim *sim = (Dma_Sim *)device;
+	pthread_mutex_lock(&sim->lock);
+	if(!sim->started[channel]){
+		sim->first[channel] = first;
+		sim->started[channel] = 1;
+	}
+	sim->tail[channel] = tail;
+	pthread_cond_broadcast(&sim->work);
+	pthread_mutex_unlock(&sim->lock);
+}
+
+static void sim_stop(void *device){
+	Dma_Sim *sim = (Dma_Sim *)device;
+	pthread_mutex_lock(&sim->lock);
+	sim->started[MLP_DMA_MM2S] = sim->started[MLP_DMA_S2MM] = 0;
+	sim->done[MLP_DMA_MM2S] = sim->done[MLP_DMA_S2MM] = 0;
+	pthread_mutex_unlock(&sim->lock);
+}
+
+static int sim_wait(void *device, int timeout_ms){
+	Dma_Sim *sim = (Dma_Sim *)device;
+	struct timespec until;
+	int result = 0;
+	clock_gettime(CLOCK_REALTIME, &until);
+	until.tv_sec += timeout_ms / 1000;
+	until.tv_nsec += (timeout_ms % 1000) * 1000000L;
+	if(until.tv_nsec >= 1000000000L){
+		until.tv_sec++;
+		until.tv_nsec -= 1000000000L;
+	}
+	pthread_mutex_lock(&sim->lock);
+	while(result == 0 && sim->irqs == sim->irqs_seen)
+		result = (timeout_ms < 0) ? pthread_cond_wait(&sim->irq, &sim->lock)
+				: pthread_cond_timedwait(&sim->irq, &sim->lock, &until);
+	sim->irqs_seen = sim->irqs;
+	pthread_mutex_unlock(&sim->lock);
+	return result == 0 ? 0 : -1;
+}
+
+extern "C" {
+
+const MLP_Dma_Backend MLP_Dma_Sim_Backend = {
+	"simulated myip_v1_0_HLS",
+	sim_alloc,
+	sim_free,
+	NULL,
+	NULL,
+	sim_start,
+	sim_stop,
+	sim_wait
+};
+
+void *MLP_Dma_Sim_Open(double clock_hz){
+	Dma_Sim *sim = (Dma_Sim *)calloc(1, sizeof(Dma_Sim));
+	if(sim == NULL)
+		return NULL;
+	sim->ns_per_clock = (clock_hz > 0) ? 1e9/clock_hz : 0;
+	pthread_mutex_init(&sim->lock, NULL);
+	pthread_cond_init(&sim->work, NULL);
+	pthread_cond_init(&sim->irq, NULL);
+	if(pthread_create(&sim->thread, NULL, sim_thread, sim) != 0){
+		free(sim);
+		return NULL;
+	}
+	return sim;
+}
+
+void MLP_Dma_Sim_Close(void *device){
+	Dma_Sim *sim = (Dma_Sim *)device;
+	pthread_mutex_lock(&sim->lock);
+	sim->quit = 1;
+	pthread_cond_broadcast(&sim->work);
+	pthread_mutex_unlock(&sim->lock);
+	pthread_join(sim->thread, NULL);
+	pthread_mutex_destroy(&sim->lock);
+	pthread_cond_destroy(&sim->work);
+	pthread_cond_destroy(&sim->irq);
+	free(sim);
+}
+
+double MLP_Dma_Sim_Busy(void *device){
+	Dma_Sim *sim = (Dma_Sim *)device;
+	double busy;
+	pthread_mutex_lock(&sim->lock);
+	busy = sim->busy;
+	pthread_mutex_unlock(&sim->lock);
+	return busy;
+}
+
+}
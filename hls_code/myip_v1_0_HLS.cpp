@@ -1,7 +1,7 @@
 /*
 ----------------------------------------------------------------------------------
 --	(c) Rajesh C Panicker, NUS,
---  Description : AXI Stream Coprocessor (HLS), implementing the sum of 4 numbers
+--  Description : AXI Stream Coprocessor (HLS), implementing MLP inference (see myip_v1_0_HLS.h)
 --	License terms :
 --	You are free to use this code as long as you
 --		(i) DO NOT post a modified version of this on any public repository;
@@ -13,187 +13,57 @@
 ----------------------------------------------------------------------------------
 */
 
-//#include "ap_axi_sdata.h" // ap_axis can also be used, but it will include all sideband signals which we don't need
-#include "hls_stream.h"
-//#include "ap_int.h"
+#include "myip_v1_0_HLS.h"
 
-// Creating a custom structure which includes the data word and TLAST signal.
-// ACLK, ARESETN, TREADY, TDATA, TVALID are essential signals for AXIS.
-// TLAST is a sideband signal which is optional in AXIS.
-// However, it is necessary for us since we connecting M_AXIS to AXI Stream FIFO / AXI DMA.
-// So, we create a struct with data (TDATA) and last (TLAST). The rest of the essential AXIS signals are automatically dealt with by the HLS tool.
-
-#define NUMBER_OF_INPUT_WORDS 723  // length of an input vector
-#define A_SIZE 448 	//size of A
-#define B_SIZE 8	//size of B
-#define C_SIZE 3	//size of C
-#define SIG_SIZE 256 //size of sigmoid
-#define RES_SIZE 64
+// Input vector lengths of the 7-2-1 model
+#define NUMBER_OF_MODEL_WORDS (19+SIG_WORDS)  // B (16) + C (3) + SIG (256, SIGMOID_TABLE only)
+#define NUMBER_OF_INPUT_WORDS (1+NUMBER_OF_MODEL_WORDS+448)  // length of an input vector with CMD_LOAD_MODEL (header + model + A (448)) : 724, or 468 without SIG
+#define NUMBER_OF_INFER_WORDS 449  // length of an input vector with CMD_INFER_ONLY (header + A (448))
 #define NUMBER_OF_OUTPUT_WORDS 64  // length of an output vector
+#define MM_MAX_ROWS 1000  // rows of X / RES assumed by C/RTL co-simulation of myip_mm_HLS (depth of the m_axi ports)
 
-struct AXIS_wLAST{
-	int data;
-	bool last;
-};
-
+// Each function below is a separate top function (set it as the top of the HLS solution).
+// The kernel itself is mlp_kernel in myip_v1_0_HLS.h.
 
 void myip_v1_0_HLS(hls::stream<AXIS_wLAST>& S_AXIS, hls::stream<AXIS_wLAST>& M_AXIS){
 #pragma HLS INTERFACE ap_ctrl_none port=return
 #pragma HLS INTERFACE axis port=S_AXIS
 #pragma HLS INTERFACE axis port=M_AXIS
+	mlp_kernel<7, 2, 1, ap_uint<8>, ap_int<32> >(S_AXIS, M_AXIS);
+}
 
+void myip_mlp_16_8_1_HLS(hls::stream<AXIS_wLAST>& S_AXIS, hls::stream<AXIS_wLAST>& M_AXIS){
+#pragma HLS INTERFACE ap_ctrl_none port=return
+#pragma HLS INTERFACE axis port=S_AXIS
+#pragma HLS INTERFACE axis port=M_AXIS
+	mlp_kernel<16, 8, 1, ap_uint<8>, ap_int<32> >(S_AXIS, M_AXIS);
+}
 
+void myip_mlp_64_32_2_HLS(hls::stream<AXIS_wLAST>& S_AXIS, hls::stream<AXIS_wLAST>& M_AXIS){
+#pragma HLS INTERFACE ap_ctrl_none port=return
+#pragma HLS INTERFACE axis port=S_AXIS
+#pragma HLS INTERFACE axis port=M_AXIS
+	mlp_kernel<64, 32, 2, ap_uint<8>, ap_int<32> >(S_AXIS, M_AXIS);
+}
 
-	int word_cnt = 0, word_cnt2 = 0, word_cnt3 = 0;
-	//ap_uint<8> sum = 0; // using arbitrary precision
-	int sum = 0;		 // using 32 bit precision
-	int input_memory_A[A_SIZE];
-#pragma HLS array_partition variable=input_memory_A cyclic factor=8
-	int input_memory_B[B_SIZE];
-#pragma HLS array_partition variable=input_memory_B cyclic factor=2
-	int input_memory_B_1[B_SIZE];
-#pragma HLS array_partition variable=input_memory_B_1 cyclic factor=2
-	int input_memory_B_2[B_SIZE];
-#pragma HLS array_partition variable=input_memory_B_2 cyclic factor=2
-	int input_memory_C[C_SIZE];
-	int input_memory_RES1[RES_SIZE];
-#pragma HLS array_partition variable=input_memory_RES1 cyclic factor=8
-	int input_memory_RES2[RES_SIZE];
-#pragma HLS array_partition variable=input_memory_RES2 cyclic factor=8
-	int input_memory_N[RES_SIZE*2];
-#pragma HLS array_partition variable=input_memory_N cyclic factor=8
-	int input_memory_SIG[256];
-#pragma HLS array_partition variable=input_memory_SIG cyclic factor=8
-	int res_memory[NUMBER_OF_OUTPUT_WORDS];
-#pragma HLS array_partition variable=res_memory cyclic factor=8
-
-	AXIS_wLAST read_input, write_output;
-
-		myip_v1_0_HLS_for1:for(word_cnt = 0; word_cnt < A_SIZE; word_cnt++){
-//#pragma HLS unroll factor=8
-			read_input = S_AXIS.read();
-			// read_input is the element (data + other signals) received by our ip through S_AXIS in one clock cycle (which contains one word).
-			// read() extracts it from the stream. Overloaded operator >> can also be used.
-			input_memory_A[word_cnt] = read_input.data;
-			// We are not making using of S_AXIS_TLAST in this example.
-			// S_AXIS_TLAST is required only when we are receiving an unknown number of words.
-		}
-
-		myip_v1_0_HLS_for2:for(word_cnt = 0; word_cnt < B_SIZE; word_cnt++){
-//#pragma HLS unroll factor=2
-			read_input = S_AXIS.read();
-			// read_input is the element (data + other signals) received by our ip through S_AXIS in one clock cycle (which contains one word).
-			// read() extracts it from the stream. Overloaded operator >> can also be used.
-			input_memory_B[word_cnt] = read_input.data;
-			// We are not making using of S_AXIS_TLAST in this example.
-			// S_AXIS_TLAST is required only when we are receiving an unknown number of words.
-		}
-
-		myip_v1_0_HLS_for3:for(word_cnt = 0; word_cnt < C_SIZE; word_cnt++){
-//#pragma HLS unroll factor=1
-			read_input = S_AXIS.read();
-			// read_input is the element (data + other signals) received by our ip through S_AXIS in one clock cycle (which contains one word).
-			// read() extracts it from the stream. Overloaded operator >> can also be used.
-			input_memory_C[word_cnt] = read_input.data;
-			// We are not making using of S_AXIS_TLAST in this example.
-			// S_AXIS_TLAST is required only when we are receiving an unknown number of words.
-		}
-
-		myip_v1_0_HLS_for4:for(word_cnt = 0; word_cnt < SIG_SIZE; word_cnt++){
-//#pragma HLS unroll factor=8
-			read_input = S_AXIS.read();
-			// read_input is the element (data + other signals) received by our ip through S_AXIS in one clock cycle (which contains one word).
-			// read() extracts it from the stream. Overloaded operator >> can also be used.
-			input_memory_SIG[word_cnt] = read_input.data;
-			// We are not making using of S_AXIS_TLAST in this example.
-			// S_AXIS_TLAST is required only when we are receiving an unknown number of words.
-		}
-
-		int a=0, b=0;
-		myip_v1_0_HLS_for5:for(word_cnt = 0; word_cnt < B_SIZE; word_cnt++){
-#pragma HLS pipeline II=1
-			if(word_cnt%2==0){
-				input_memory_B_1[a] = input_memory_B[word_cnt];
-				a++;
-			}
-			else{
-				input_memory_B_2[b] = input_memory_B[word_cnt];
-				b++;
-			}
-		}
-
-		int i=0,j=0,k=0;
-		sum=0;
-		myip_v1_0_HLS_for6:for(;i<A_SIZE;){
-			for(j=0;j<B_SIZE;j++){
-				if(j==0){
-					sum += 1*input_memory_B_1[j];
-				}else{
-					sum += input_memory_A[i]*input_memory_B_1[j];
-					i++;
-				}
-			}
-			input_memory_RES1[k] = sum/256;
-			sum = 0;
-			k++;
-		}
-		i=0,j=0,k=0,sum=0;
-		myip_v1_0_HLS_for7:for(;i<A_SIZE;){
-			for(j=0;j<B_SIZE;j++){
-				if(j==0){
-					sum += 1*input_memory_B_1[j];
-				}else{
-					sum += input_memory_A[i]*input_memory_B_2[j];
-					i++;
-				}
-			}
-			input_memory_RES2[k] = sum/256;
-			sum = 0;
-			k++;
-		}
-		i=0, j=0;
-		myip_v1_0_HLS_for8:for(;i<RES_SIZE;i++){
-			j=input_memory_RES1[i];
-			if(j>256)
-				j=256;
-			input_memory_N[i]=input_memory_SIG[j];
-		}
-		j=0;
-		myip_v1_0_HLS_for9:for(;i<RES_SIZE*2;i++){
-			j=input_memory_RES2[i];
-			if(j>256)
-				j=256;
-			input_memory_N[i]=input_memory_SIG[j];
-		}
-
-		i=0,j=0,k=0,sum=0;
-		myip_v1_0_HLS_for10:for(;i<128;){
-			for(j=0;j<C_SIZE;j++){
-				if(j==0){
-					sum += 1*input_memory_C[j];
-				}else{
-					sum += input_memory_N[i]*input_memory_C[j];
-					i++;
-				}
-			}
-			res_memory[k] = sum/256;
-			sum = 0;
-			k++;
-		}
+// start / done / idle (ap_ctrl_hs), the base addresses, rows and command are registers of the AXI-Lite slave "control".
+// model and X share one AXI master, RES has its own so that the reads and writes overlap.
+void myip_mm_HLS(const int *model, const int *X, int *RES, int rows, int command){
+#pragma HLS INTERFACE m_axi port=model offset=slave bundle=gmem0 depth=NUMBER_OF_MODEL_WORDS
+#pragma HLS INTERFACE m_axi port=X offset=slave bundle=gmem0 depth=MM_MAX_ROWS*7 max_read_burst_length=256
+#pragma HLS INTERFACE m_axi port=RES offset=slave bundle=gmem1 depth=MM_MAX_ROWS max_write_burst_length=256
+#pragma HLS INTERFACE s_axilite port=model bundle=control
+#pragma HLS INTERFACE s_axilite port=X bundle=control
+#pragma HLS INTERFACE s_axilite port=RES bundle=control
+#pragma HLS INTERFACE s_axilite port=rows bundle=control
+#pragma HLS INTERFACE s_axilite port=command bundle=control
+#pragma HLS INTERFACE s_axilite port=return bundle=control
+	mlp_mm_kernel<7, 2, 1, ap_uint<8>, ap_int<32> >(model, X, RES, rows, command);
+}
 
-		myip_v1_0_HLS_for11:for(word_cnt = 0; word_cnt < NUMBER_OF_OUTPUT_WORDS; word_cnt++){
-//#pragma HLS unroll factor=8
-			//write_output.data = sum.to_int();	// using arbitrary precision
-			write_output.data = res_memory[word_cnt];			// using 32 bit precision
-			// write_output is the element sent by our ip through M_AXIS in one clock cycle.
-			write_output.last = 0;
-			if(word_cnt==NUMBER_OF_OUTPUT_WORDS-1)
-			{
-				write_output.last = 1;
-				// M_AXIS_TLAST is required to be asserted for the last word.
-				// Else, the AXI Stream FIFO / AXI DMA will not know if all the words have been received from the co-processor.
-			}
-			M_AXIS.write(write_output);
-			// write() inserts it into the stream. Overloaded operator << can also be used.
-		}
+void myip_rows_HLS(hls::stream<AXIS_ROWS_IN>& S_AXIS, hls::stream<AXIS_ROWS_OUT>& M_AXIS){
+#pragma HLS INTERFACE ap_ctrl_none port=return
+#pragma HLS INTERFACE axis port=S_AXIS
+#pragma HLS INTERFACE axis port=M_AXIS
+	mlp_rows_kernel<ROWS_PER_CYCLE, 7, 2, 1, ap_uint<8>, ap_int<32> >(S_AXIS, M_AXIS);
 }
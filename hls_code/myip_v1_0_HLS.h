@@ -0,0 +1,818 @@
+/*
+----------------------------------------------------------------------------------
+--	(c) Rajesh C Panicker, NUS,
+--  Description : AXI Stream Coprocessor (HLS), MLP inference kernel template
+--	License terms :
+--	You are free to use this code as long as you
+--		(i) DO NOT post a modified version of this on any public repository;
+--		(ii) use it only for educational purposes;
+--		(iii) accept the responsibility to ensure that your implementation does not violate any intellectual property of any entity.
+--		(iv) accept that the program is provided "as is" without warranty of any kind or assurance regarding its suitability for any particular purpose;
+--		(v) send an email to rajesh.panicker@ieee.org briefly mentioning its use (except when used for the course EE4218 at the National University of Singapore);
+--		(vi) retain this notice in this file or any files derived from this.
+----------------------------------------------------------------------------------
+*/
+
+#ifndef MYIP_V1_0_HLS_H
+#define MYIP_V1_0_HLS_H
+
+//#include "ap_axi_sdata.h" // ap_axis can also be used, but it will include all sideband signals which we don't need
+#include "hls_stream.h"
+#include "ap_int.h"
+
+// Creating a custom structure which includes the data word and TLAST signal.
+// ACLK, ARESETN, TREADY, TDATA, TVALID are essential signals for AXIS.
+// TLAST is a sideband signal which is optional in AXIS.
+// However, it is necessary for us since we connecting M_AXIS to AXI Stream FIFO / AXI DMA.
+// So, we create a struct with data (TDATA) and last (TLAST). The rest of the essential AXIS signals are automatically dealt with by the HLS tool.
+
+struct AXIS_wLAST{
+	int data;
+	bool last;
+};
+
+// Command / header word, always the first word of the input stream. The bits can be combined.
+// CMD_LOAD_MODEL  : header, B, C, SIG (SIGMOID_TABLE only), then A. The model is kept on-chip for later calls.
+// CMD_INFER_ONLY  : header, then A. The model loaded by the last CMD_LOAD_MODEL call is reused.
+// CMD_STREAM_ROWS : A is any number of rows, terminated by S_AXIS TLAST on the last value of the last row.
+//                   The results of a row are written as soon as the row is in, with M_AXIS TLAST on the last row.
+// CMD_PACKED      : A is packed (32 / data bits) values per word, and so are the results (saturated to the data bits).
+//                   The first value is in the lowest bits. Unused lanes of the last word are ignored / zero.
+//                   The model words (CMD_LOAD_MODEL) are still one value per word.
+// CMD_LABELS      : one label per row instead of the OUTPUTS results. With one output, the label is 1 if the result is
+//                   above the threshold in the header bits 31:LABEL_THRESHOLD_SHIFT (signed), else the label is the
+//                   output with the largest result (the first one on a tie). The labels are packed 32 / LABEL_BITS
+//                   per word, first label in the lowest bits, whether CMD_PACKED is set or not (it still packs A).
+// CMD_TELEMETRY   : (TELEMETRY 1, mlp_kernel only) the results are followed by TELEMETRY_WORDS words of counters, with
+//                   M_AXIS TLAST on the last of them (see TELEMETRY).
+#define CMD_INFER_ONLY 0
+#define CMD_LOAD_MODEL 1
+#define CMD_STREAM_ROWS 2
+#define CMD_PACKED 4
+#define CMD_LABELS 8
+#define CMD_TELEMETRY 16
+#define LABEL_THRESHOLD_SHIFT 16
+
+// TELEMETRY 1 : performance counters in mlp_kernel, 32 bits since the start (wrapping), sent after the results of a batch
+// with CMD_TELEMETRY in this order (the same as simple_ML_IP_v1_0 with TELEMETRY = 1; c_code/mlp_telemetry.h decodes them) :
+//   TELEMETRY_MAGIC, clocks, S_AXIS TVALID without TREADY, S_AXIS TREADY without TVALID, M_AXIS TVALID without TREADY,
+//   clocks of the hidden layer, clocks of the output layer, headers read.
+// Each stage then polls its stream (one try per clock) instead of waiting on it, to count the clocks it had nothing to
+// do. The clocks are the header and model words, then the clocks of write_stage, which polls from the start of the
+// batch to its last result. The S_AXIS stalls are those of read_stage : no word, or a word it can not pass on as
+// x_stream is full. In C simulation the stages run one after the other : there are no stalls, and the clocks of the
+// batch are those of its longest stage.
+#ifndef TELEMETRY
+#define TELEMETRY 0
+#endif
+#define TELEMETRY_WORDS 8
+#define TELEMETRY_MAGIC 0x544C4D01	// "TLM", version 1
+enum { TEL_MAGIC, TEL_CYCLES, TEL_IN_NO_READY, TEL_IN_NO_VALID, TEL_OUT_NO_READY, TEL_HID, TEL_OUT, TEL_BATCHES };
+
+// Bits of a label : 1 for a threshold (one output), else ceil(log2(OUTPUTS)).
+template<int N>
+struct CLOG2{ enum { value = 1 + CLOG2<(N+1)/2>::value }; };
+template<>
+struct CLOG2<1>{ enum { value = 0 }; };
+#define LABEL_BITS(OUTPUTS) ((OUTPUTS) == 1 ? 1 : CLOG2<(OUTPUTS)>::value)
+
+// Model layout, all row-major, one value per word:
+//   B   : (FEATURES+1) x HIDDEN, the first row is the bias of each hidden neuron
+//   C   : (HIDDEN+1) x OUTPUTS, the first row is the bias of each output neuron
+//   SIG : SIG_SIZE entries, indexed by (hidden sum)/256 clamped to 0..SIG_SIZE-1
+// A is the X matrix, FEATURES values per row. Each row gives OUTPUTS results of (output sum)/256.
+#define SIG_SIZE 256 //size of sigmoid
+
+// Sigmoid unit of all the kernels, selected by SIGMOID_MODE:
+//   SIGMOID_TABLE : SIG comes with the model (CMD_LOAD_MODEL) into RAM
+//   SIGMOID_ROM   : SIG is sigmoid.csv, built into the kernel. The model has no SIG words.
+//   SIGMOID_PWL   : linear between knots, every 2^SIGMOID_PWL_STEP_BITS-th entry of sigmoid.csv.
+//                   The knots are constants in the logic (no RAM / ROM). The model has no SIG words.
+//                   SIGMOID_PWL_STEP_BITS 0 gives sigmoid.csv exactly, each step up halves the knots.
+#define SIGMOID_TABLE 0
+#define SIGMOID_ROM 1
+#define SIGMOID_PWL 2
+#ifndef SIGMOID_MODE
+#define SIGMOID_MODE SIGMOID_TABLE
+#endif
+#ifndef SIGMOID_PWL_STEP_BITS
+#define SIGMOID_PWL_STEP_BITS 4
+#endif
+#define SIG_WORDS ((SIGMOID_MODE == SIGMOID_TABLE) ? SIG_SIZE : 0)	// SIG words of a CMD_LOAD_MODEL model
+
+static const int SIGMOID_ROM_TABLE[SIG_SIZE] = {
+#include "../sigmoid.csv"
+};
+#define BATCH_ROWS 64	// rows in a fixed (non CMD_STREAM_ROWS) batch
+#define FIFO_DEPTH 16	// depth of the hls::stream FIFOs between the dataflow stages
+
+// One value of the X stream between the dataflow stages. last is set on the last value of the batch.
+template<typename T>
+struct VAL_wLAST{
+	T data;
+	bool last;
+};
+
+// Values of all neurons of a layer for one row. last is set for the last row of the batch.
+template<typename T, int N>
+struct ROW_wLAST{
+	T v[N];
+	bool last;
+};
+
+
+/***************** Sigmoid unit *********************/
+// (hidden sum)/256 is clamped to 0..SIG_SIZE-1 : it is negative with negative weights / data, and can be past the table.
+inline int sigmoid_index(int j){
+	if(j>SIG_SIZE-1)
+		j=SIG_SIZE-1;
+	if(j<0)
+		j=0;
+	return j;
+}
+
+// Knots k0 and k1 around j (the last segment ends at the last entry), then k0 + (k1-k0)*(j-knot of k0)/step.
+// Once the loop is unrolled the knot indices are constants, so the knots are too.
+inline int sigmoid_pwl(int j){
+	const int step = 1<<SIGMOID_PWL_STEP_BITS;
+	int m, k0 = 0, k1 = 0, next;
+	sigmoid_pwl_knots:for(m = 0; m < SIG_SIZE/step; m++){
+#pragma HLS unroll
+		next = (m+1)*step > SIG_SIZE-1 ? SIG_SIZE-1 : (m+1)*step;
+		if(m == j/step){
+			k0 = SIGMOID_ROM_TABLE[m*step];
+			k1 = SIGMOID_ROM_TABLE[next];
+		}
+	}
+	return k0 + (((k1-k0)*(j%step)) >> SIGMOID_PWL_STEP_BITS);
+}
+
+// SIG is only read with SIGMOID_TABLE.
+template<typename data_t>
+data_t sigmoid_lookup(int j, const data_t SIG[SIG_SIZE]){
+#pragma HLS inline
+	j = sigmoid_index(j);
+	if(SIGMOID_MODE == SIGMOID_ROM)
+		return SIGMOID_ROM_TABLE[j];
+	else if(SIGMOID_MODE == SIGMOID_PWL)
+		return sigmoid_pwl(j);
+	else
+		return SIG[j];
+}
+
+
+/***************** Dataflow stages *********************/
+// Each stage handles one input word (read, hidden_mac) or one row (the others) per loop iteration, and the stages
+// run concurrently. Their II and the latency of a batch are left to csynth, which has not been run on mlp_kernel or
+// mlp_mm_kernel.
+
+// Forwards the X values of the batch. rows == 0 means "until S_AXIS TLAST" (CMD_STREAM_ROWS).
+// last is set on the last value of the last row. With packed, a word is read every (32 / data bits) values.
+// TELEMETRY : no_valid / no_ready are the clocks without a word on S_AXIS / with one held back by a full x_stream.
+template<int FEATURES, typename data_t>
+void read_stage(hls::stream<AXIS_wLAST>& S_AXIS, hls::stream<VAL_wLAST<data_t> >& x_stream, int rows, bool packed,
+		int &no_valid, int &no_ready){
+	const int lanes = 32 / data_t::width;
+	AXIS_wLAST read_input;
+	VAL_wLAST<data_t> x;
+	int f = 0, row = 0, lane = 0, word = 0, stall_valid = 0, stall_ready = 0;
+	bool tlast_seen = 0, last = 0;
+	read_stage_loop:do{
+#pragma HLS pipeline II=1
+		if(lane == 0){
+			if(TELEMETRY){
+				if(x_stream.full()){
+					stall_ready += !S_AXIS.empty();
+					continue;
+				}
+				if(!S_AXIS.read_nb(read_input)){
+					stall_valid++;
+					continue;
+				}
+			}
+			else
+				read_input = S_AXIS.read();
+			word = read_input.data;
+			tlast_seen = tlast_seen | read_input.last;	// TLAST is expected on the word holding the last value of the row
+		}
+		if(packed){
+			x.data = (word >> (data_t::width*lane)) & ((1<<data_t::width)-1);
+			lane = (lane == lanes-1) ? 0 : lane+1;
+		}
+		else
+			x.data = word;
+		x.last = 0;
+		if(f == FEATURES-1){
+			last = (rows == 0) ? tlast_seen : (row == rows-1);
+			x.last = last;
+			f = 0;
+			row++;
+		}
+		else
+			f++;
+		x_stream.write(x);
+	}while(!last);
+	no_valid = stall_valid;
+	no_ready = stall_ready;
+}
+
+// All hidden neurons are accumulated in the same pass over X, HIDDEN multipliers per X value.
+// clocks : the X values taken (one per clock).
+template<int FEATURES, int HIDDEN, typename data_t, typename acc_t>
+void hidden_mac(hls::stream<VAL_wLAST<data_t> >& x_stream, hls::stream<ROW_wLAST<acc_t, HIDDEN> >& sum_stream,
+		const data_t B[FEATURES+1][HIDDEN], int &clocks){
+	VAL_wLAST<data_t> x;
+	ROW_wLAST<acc_t, HIDDEN> sum;
+	acc_t acc[HIDDEN];
+#pragma HLS array_partition variable=acc complete
+	int f = 0, h, count = 0;
+	bool last = 0;
+	hidden_mac_init:for(h = 0; h < HIDDEN; h++)
+		acc[h] = B[0][h];	// start from the bias
+	hidden_mac_loop:do{
+#pragma HLS pipeline II=1
+		x = x_stream.read();
+		count++;
+		hidden_mac_neurons:for(h = 0; h < HIDDEN; h++){
+#pragma HLS unroll
+			acc[h] += x.data*B[f+1][h];
+		}
+		if(f == FEATURES-1){
+			hidden_mac_scale:for(h = 0; h < HIDDEN; h++){
+#pragma HLS unroll
+				sum.v[h] = acc[h]/256;
+				acc[h] = B[0][h];
+			}
+			sum.last = x.last;
+			sum_stream.write(sum);
+			last = x.last;
+			f = 0;
+		}
+		else
+			f++;
+	}while(!last);
+	clocks = count;
+}
+
+// SIG has one copy per two hidden neurons (two reads per copy), so the lookups of a row do not share a port.
+template<int HIDDEN, typename data_t, typename acc_t>
+void sigmoid_stage(hls::stream<ROW_wLAST<acc_t, HIDDEN> >& sum_stream, hls::stream<ROW_wLAST<data_t, HIDDEN> >& act_stream,
+		const data_t SIG[(HIDDEN+1)/2][SIG_SIZE]){
+	ROW_wLAST<acc_t, HIDDEN> sum;
+	ROW_wLAST<data_t, HIDDEN> act;
+	int h;
+	sigmoid_stage_loop:do{
+#pragma HLS pipeline II=1
+		sum = sum_stream.read();
+		sigmoid_stage_neurons:for(h = 0; h < HIDDEN; h++){
+#pragma HLS unroll
+			act.v[h] = sigmoid_lookup<data_t>(sum.v[h], SIG[h/2]);
+		}
+		act.last = sum.last;
+		act_stream.write(act);
+	}while(!act.last);
+}
+
+// clocks : OUTPUTS per row (II=OUTPUTS).
+template<int HIDDEN, int OUTPUTS, typename data_t, typename acc_t>
+void output_mac(hls::stream<ROW_wLAST<data_t, HIDDEN> >& act_stream, hls::stream<AXIS_wLAST>& res_stream,
+		const data_t C[HIDDEN+1][OUTPUTS], int &clocks){
+	ROW_wLAST<data_t, HIDDEN> act;
+	AXIS_wLAST res;
+	acc_t sum;
+	int h, o, count = 0;
+	output_mac_loop:do{
+#pragma HLS pipeline II=OUTPUTS
+		act = act_stream.read();
+		count += OUTPUTS;
+		output_mac_outputs:for(o = 0; o < OUTPUTS; o++){
+			// bias, then the hidden neurons of the row
+			sum = C[0][o];
+			output_mac_neurons:for(h = 0; h < HIDDEN; h++){
+#pragma HLS unroll
+				sum += act.v[h]*C[h+1][o];
+			}
+			res.data = sum/256;
+			res.last = act.last && (o == OUTPUTS-1);
+			res_stream.write(res);
+		}
+	}while(!act.last);
+	clocks = count;
+}
+
+// With labels, the OUTPUTS results of each row become its label (see CMD_LABELS). Else the results are passed on.
+template<int OUTPUTS>
+void label_stage(hls::stream<AXIS_wLAST>& res_stream, hls::stream<AXIS_wLAST>& label_stream, bool labels, int threshold){
+	AXIS_wLAST res, label;
+	int o = 0, best = 0, best_value = 0;
+	label_stage_loop:do{
+#pragma HLS pipeline II=1
+		res = res_stream.read();
+		if(labels){
+			if(o == 0 || res.data > best_value){
+				best = o;
+				best_value = res.data;
+			}
+			if(o == OUTPUTS-1){
+				label.data = (OUTPUTS == 1) ? (res.data > threshold) : best;
+				label.last = res.last;
+				label_stream.write(label);
+				o = 0;
+			}
+			else
+				o++;
+		}
+		else
+			label_stream.write(res);
+	}while(!res.last);
+}
+
+// With packed, (32 / data bits) results go into one word, which is written when full or after the last row.
+// With labels, so do (32 / LABEL_BITS) labels. With trailer, the last word is not the last of M_AXIS (no TLAST).
+// TELEMETRY : clocks are the clocks of the stage, no_ready the clocks M_AXIS was full.
+template<int OUTPUTS, typename data_t>
+void write_stage(hls::stream<AXIS_wLAST>& res_stream, hls::stream<AXIS_wLAST>& M_AXIS, bool packed, bool labels,
+		bool trailer, int &clocks, int &no_ready){
+	const int bits = labels ? LABEL_BITS(OUTPUTS) : data_t::width;
+	const int lanes = 32 / bits;
+	const int max_value = (1<<bits)-1;
+	AXIS_wLAST res, write_output;
+	int lane = 0, word = 0, value, count = 0, stall_ready = 0;
+	res.last = 0;
+	write_stage_loop:do{
+#pragma HLS pipeline II=1
+		if(TELEMETRY){
+			count++;
+			if(M_AXIS.full()){
+				stall_ready++;
+				continue;
+			}
+			if(!res_stream.read_nb(res))
+				continue;
+		}
+		else
+			res = res_stream.read();
+		// M_AXIS_TLAST is required to be asserted for the last word.
+		// Else, the AXI Stream FIFO / AXI DMA will not know if all the words have been received from the co-processor.
+		if(packed || labels){
+			value = res.data;
+			if(value > max_value)
+				value = max_value;
+			if(value < 0)
+				value = 0;
+			word = ((lane == 0) ? 0 : word) | (value << (bits*lane));
+			if(lane == lanes-1 || res.last){
+				write_output.data = word;
+				write_output.last = res.last && !trailer;
+				M_AXIS.write(write_output);
+				lane = 0;
+			}
+			else
+				lane++;
+		}
+		else{
+			write_output.data = res.data;
+			write_output.last = res.last && !trailer;
+			M_AXIS.write(write_output);
+		}
+	}while(!res.last);
+	clocks = count;
+	no_ready = stall_ready;
+}
+
+// read -> hidden MAC (all neurons) -> sigmoid -> output MAC -> labels -> write, connected by FIFOs
+// in_no_valid ... out_no_ready : the counters of the batch from the stages (TELEMETRY).
+template<int FEATURES, int HIDDEN, int OUTPUTS, typename data_t, typename acc_t>
+void compute_rows(hls::stream<AXIS_wLAST>& S_AXIS, hls::stream<AXIS_wLAST>& M_AXIS, int rows, bool packed,
+		bool labels, int threshold, bool trailer, const data_t B[FEATURES+1][HIDDEN], const data_t C[HIDDEN+1][OUTPUTS],
+		const data_t SIG[(HIDDEN+1)/2][SIG_SIZE], int &in_no_valid, int &in_no_ready, int &hid_clocks, int &out_clocks,
+		int &clocks, int &out_no_ready){
+#pragma HLS DATAFLOW
+	hls::stream<VAL_wLAST<data_t> > x_stream("x_stream");
+	hls::stream<ROW_wLAST<acc_t, HIDDEN> > sum_stream("sum_stream");
+	hls::stream<ROW_wLAST<data_t, HIDDEN> > act_stream("act_stream");
+	hls::stream<AXIS_wLAST> res_stream("res_stream");
+	hls::stream<AXIS_wLAST> label_stream("label_stream");
+#pragma HLS STREAM variable=x_stream depth=FIFO_DEPTH
+#pragma HLS STREAM variable=sum_stream depth=FIFO_DEPTH
+#pragma HLS STREAM variable=act_stream depth=FIFO_DEPTH
+#pragma HLS STREAM variable=res_stream depth=FIFO_DEPTH
+#pragma HLS STREAM variable=label_stream depth=FIFO_DEPTH
+
+	read_stage<FEATURES, data_t>(S_AXIS, x_stream, rows, packed, in_no_valid, in_no_ready);
+	hidden_mac<FEATURES, HIDDEN, data_t, acc_t>(x_stream, sum_stream, B, hid_clocks);
+	sigmoid_stage<HIDDEN, data_t, acc_t>(sum_stream, act_stream, SIG);
+	output_mac<HIDDEN, OUTPUTS, data_t, acc_t>(act_stream, res_stream, C, out_clocks);
+	label_stage<OUTPUTS>(res_stream, label_stream, labels, threshold);
+	write_stage<OUTPUTS, data_t>(label_stream, M_AXIS, packed, labels, trailer, clocks, out_no_ready);
+}
+
+
+/***************** Kernel template *********************/
+// FEATURES-HIDDEN-OUTPUTS network. data_t holds X, the weights, the sigmoid table and the packed results
+// (ap_uint<8> for our data); acc_t holds the sums (ap_int<32>).
+// Array partitioning and unrolling follow from FEATURES, HIDDEN and OUTPUTS:
+// HIDDEN multipliers in the hidden layer, HIDDEN*OUTPUTS in the output layer, (HIDDEN+1)/2 copies of SIG.
+// What the copies of SIG cost has not been synthesized.
+// Every instantiation has its own resident model.
+template<int FEATURES, int HIDDEN, int OUTPUTS, typename data_t, typename acc_t>
+void mlp_kernel(hls::stream<AXIS_wLAST>& S_AXIS, hls::stream<AXIS_wLAST>& M_AXIS){
+	// The model (B, C, SIG) is static so that it stays resident between invocations (weight-stationary).
+	static data_t input_memory_B[FEATURES+1][HIDDEN];
+#pragma HLS array_partition variable=input_memory_B complete dim=2
+	static data_t input_memory_C[HIDDEN+1][OUTPUTS];
+#pragma HLS array_partition variable=input_memory_C complete dim=1
+	static data_t input_memory_SIG[(HIDDEN+1)/2][SIG_SIZE];
+#pragma HLS array_partition variable=input_memory_SIG complete dim=1
+#pragma HLS RESOURCE variable=input_memory_SIG core=RAM_2P_BRAM	// two lookups per copy
+
+	// Counters since the start (TELEMETRY), by TEL_ index
+	static unsigned telemetry[TELEMETRY_WORDS];
+
+	AXIS_wLAST read_input, write_output;
+	int command, word_cnt, copy;
+	int in_no_valid, in_no_ready, hid_clocks, out_clocks, clocks, out_no_ready;
+	bool trailer;
+
+	read_input = S_AXIS.read();
+	// The first word is the command / header word, which selects whether a new model follows.
+	command = read_input.data;
+	trailer = TELEMETRY && (command & CMD_TELEMETRY);
+
+	if(command & CMD_LOAD_MODEL){
+		myip_v1_0_HLS_for2:for(word_cnt = 0; word_cnt < (FEATURES+1)*HIDDEN; word_cnt++){
+#pragma HLS pipeline II=1
+			read_input = S_AXIS.read();
+			// read_input is the element (data + other signals) received by our ip through S_AXIS in one clock cycle (which contains one word).
+			// read() extracts it from the stream. Overloaded operator >> can also be used.
+			input_memory_B[word_cnt/HIDDEN][word_cnt%HIDDEN] = read_input.data;
+		}
+
+		myip_v1_0_HLS_for3:for(word_cnt = 0; word_cnt < (HIDDEN+1)*OUTPUTS; word_cnt++){
+#pragma HLS pipeline II=1
+			read_input = S_AXIS.read();
+			input_memory_C[word_cnt/OUTPUTS][word_cnt%OUTPUTS] = read_input.data;
+		}
+
+		myip_v1_0_HLS_for4:for(word_cnt = 0; word_cnt < SIG_WORDS; word_cnt++){
+#pragma HLS pipeline II=1
+			read_input = S_AXIS.read();
+			myip_v1_0_HLS_for5:for(copy = 0; copy < (HIDDEN+1)/2; copy++){
+#pragma HLS unroll
+				input_memory_SIG[copy][word_cnt] = read_input.data;
+			}
+		}
+	}
+
+	// A fixed batch is BATCH_ROWS rows; CMD_STREAM_ROWS runs until TLAST.
+	// Only one row is held on-chip either way, so memory does not grow with the batch.
+	compute_rows<FEATURES, HIDDEN, OUTPUTS, data_t, acc_t>(S_AXIS, M_AXIS, (command & CMD_STREAM_ROWS) ? 0 : BATCH_ROWS,
+			(command & CMD_PACKED) != 0, (command & CMD_LABELS) != 0, command >> LABEL_THRESHOLD_SHIFT, trailer,
+			input_memory_B, input_memory_C, input_memory_SIG,
+			in_no_valid, in_no_ready, hid_clocks, out_clocks, clocks, out_no_ready);
+
+	if(TELEMETRY){
+		if(clocks < hid_clocks)
+			clocks = hid_clocks;
+		if(clocks < out_clocks)
+			clocks = out_clocks;
+		telemetry[TEL_CYCLES] += 1 + ((command & CMD_LOAD_MODEL) ? (FEATURES+1)*HIDDEN + (HIDDEN+1)*OUTPUTS + SIG_WORDS : 0) + clocks;
+		telemetry[TEL_IN_NO_READY] += in_no_ready;
+		telemetry[TEL_IN_NO_VALID] += in_no_valid;
+		telemetry[TEL_OUT_NO_READY] += out_no_ready;
+		telemetry[TEL_HID] += hid_clocks;
+		telemetry[TEL_OUT] += out_clocks;
+		telemetry[TEL_BATCHES]++;
+	}
+	// the trailer, after the results
+	if(trailer){
+		myip_v1_0_HLS_trailer:for(word_cnt = 0; word_cnt < TELEMETRY_WORDS; word_cnt++){
+#pragma HLS pipeline II=1
+			write_output.data = (word_cnt == TEL_MAGIC) ? TELEMETRY_MAGIC : (int)telemetry[word_cnt];
+			write_output.last = (word_cnt == TELEMETRY_WORDS-1);
+			M_AXIS.write(write_output);
+		}
+	}
+}
+
+
+/***************** Memory-mapped (m_axi) kernel template *********************/
+// Same model and commands as mlp_kernel, but the words are read from / written to memory instead of the AXI streams:
+//   model : B, C, SIG (SIGMOID_TABLE only), one value per word (only read with CMD_LOAD_MODEL)
+//   X     : rows rows of A, one value per word, or packed like the stream with CMD_PACKED
+//   RES   : rows*OUTPUTS results, one per word, or packed like the stream with CMD_PACKED, or rows labels with CMD_LABELS
+// CMD_STREAM_ROWS is ignored, as the number of rows is always given. The label threshold is in command, as in the header.
+
+// Burst-reads the words of the rows rows of X into the dataflow, with last on the last word.
+template<int FEATURES, typename data_t>
+void mm_read(const int *X, hls::stream<AXIS_wLAST>& x_words, int rows, bool packed){
+	const int lanes = 32 / data_t::width;
+	AXIS_wLAST read_input;
+	int words = packed ? (rows*FEATURES+lanes-1)/lanes : rows*FEATURES, word_cnt;
+	mm_read_loop:for(word_cnt = 0; word_cnt < words; word_cnt++){
+#pragma HLS pipeline II=1
+		read_input.data = X[word_cnt];
+		read_input.last = (word_cnt == words-1);
+		x_words.write(read_input);
+	}
+}
+
+// Burst-writes the result words to RES.
+template<int OUTPUTS, typename data_t>
+void mm_write(hls::stream<AXIS_wLAST>& res_words, int *RES, int rows, bool packed, bool labels){
+	const int lanes = 32 / data_t::width;
+	const int label_lanes = 32 / LABEL_BITS(OUTPUTS);
+	int words = labels ? (rows+label_lanes-1)/label_lanes : packed ? (rows*OUTPUTS+lanes-1)/lanes : rows*OUTPUTS, word_cnt;
+	mm_write_loop:for(word_cnt = 0; word_cnt < words; word_cnt++){
+#pragma HLS pipeline II=1
+		RES[word_cnt] = res_words.read().data;
+	}
+}
+
+// memory -> read -> hidden MAC -> sigmoid -> output MAC -> labels -> write -> memory, the stages of compute_rows
+template<int FEATURES, int HIDDEN, int OUTPUTS, typename data_t, typename acc_t>
+void compute_mm(const int *X, int *RES, int rows, bool packed, bool labels, int threshold,
+		const data_t B[FEATURES+1][HIDDEN], const data_t C[HIDDEN+1][OUTPUTS], const data_t SIG[(HIDDEN+1)/2][SIG_SIZE]){
+#pragma HLS DATAFLOW
+	hls::stream<AXIS_wLAST> x_words("x_words");
+	hls::stream<VAL_wLAST<data_t> > x_stream("x_stream");
+	hls::stream<ROW_wLAST<acc_t, HIDDEN> > sum_stream("sum_stream");
+	hls::stream<ROW_wLAST<data_t, HIDDEN> > act_stream("act_stream");
+	hls::stream<AXIS_wLAST> res_stream("res_stream");
+	hls::stream<AXIS_wLAST> label_stream("label_stream");
+	hls::stream<AXIS_wLAST> res_words("res_words");
+#pragma HLS STREAM variable=x_words depth=FIFO_DEPTH
+#pragma HLS STREAM variable=x_stream depth=FIFO_DEPTH
+#pragma HLS STREAM variable=sum_stream depth=FIFO_DEPTH
+#pragma HLS STREAM variable=act_stream depth=FIFO_DEPTH
+#pragma HLS STREAM variable=res_stream depth=FIFO_DEPTH
+#pragma HLS STREAM variable=label_stream depth=FIFO_DEPTH
+#pragma HLS STREAM variable=res_words depth=FIFO_DEPTH
+	int in_no_valid, in_no_ready, hid_clocks, out_clocks, clocks, out_no_ready;	// counters of the stages, not used here
+
+	mm_read<FEATURES, data_t>(X, x_words, rows, packed);
+	read_stage<FEATURES, data_t>(x_words, x_stream, rows, packed, in_no_valid, in_no_ready);
+	hidden_mac<FEATURES, HIDDEN, data_t, acc_t>(x_stream, sum_stream, B, hid_clocks);
+	sigmoid_stage<HIDDEN, data_t, acc_t>(sum_stream, act_stream, SIG);
+	output_mac<HIDDEN, OUTPUTS, data_t, acc_t>(act_stream, res_stream, C, out_clocks);
+	label_stage<OUTPUTS>(res_stream, label_stream, labels, threshold);
+	write_stage<OUTPUTS, data_t>(label_stream, res_words, packed, labels, false, clocks, out_no_ready);
+	mm_write<OUTPUTS, data_t>(res_words, RES, rows, packed, labels);
+}
+
+// One call processes all rows rows (the whole data set) without a DMA.
+template<int FEATURES, int HIDDEN, int OUTPUTS, typename data_t, typename acc_t>
+void mlp_mm_kernel(const int *model, const int *X, int *RES, int rows, int command){
+	static data_t input_memory_B[FEATURES+1][HIDDEN];
+#pragma HLS array_partition variable=input_memory_B complete dim=2
+	static data_t input_memory_C[HIDDEN+1][OUTPUTS];
+#pragma HLS array_partition variable=input_memory_C complete dim=1
+	static data_t input_memory_SIG[(HIDDEN+1)/2][SIG_SIZE];
+#pragma HLS array_partition variable=input_memory_SIG complete dim=1
+#pragma HLS RESOURCE variable=input_memory_SIG core=RAM_2P_BRAM
+
+	int word_cnt, copy;
+
+	if(command & CMD_LOAD_MODEL){
+		myip_mm_HLS_for2:for(word_cnt = 0; word_cnt < (FEATURES+1)*HIDDEN; word_cnt++){
+#pragma HLS pipeline II=1
+			input_memory_B[word_cnt/HIDDEN][word_cnt%HIDDEN] = model[word_cnt];
+		}
+
+		myip_mm_HLS_for3:for(word_cnt = 0; word_cnt < (HIDDEN+1)*OUTPUTS; word_cnt++){
+#pragma HLS pipeline II=1
+			input_memory_C[word_cnt/OUTPUTS][word_cnt%OUTPUTS] = model[(FEATURES+1)*HIDDEN+word_cnt];
+		}
+
+		myip_mm_HLS_for4:for(word_cnt = 0; word_cnt < SIG_WORDS; word_cnt++){
+#pragma HLS pipeline II=1
+			myip_mm_HLS_for5:for(copy = 0; copy < (HIDDEN+1)/2; copy++){
+#pragma HLS unroll
+				input_memory_SIG[copy][word_cnt] = model[(FEATURES+1)*HIDDEN+(HIDDEN+1)*OUTPUTS+word_cnt];
+			}
+		}
+	}
+
+	if(rows > 0)
+		compute_mm<FEATURES, HIDDEN, OUTPUTS, data_t, acc_t>(X, RES, rows, (command & CMD_PACKED) != 0,
+				(command & CMD_LABELS) != 0, command >> LABEL_THRESHOLD_SHIFT, input_memory_B, input_memory_C, input_memory_SIG);
+}
+
+
+/***************** Row-parallel kernel template *********************/
+// Same model and commands as mlp_kernel, but ROWS rows are computed per word, so the streams are wider:
+//   S_AXIS : ROWS*FEATURES values per word, row r value f at bits (r*FEATURES+f)*data bits (the first value in the lowest bits).
+//            The header and the model words (CMD_LOAD_MODEL) are one value per word, in the lowest bits.
+//   M_AXIS : ROWS*OUTPUTS results per word in the same order, saturated to the data bits.
+// X is always packed, so CMD_PACKED is ignored, and so is CMD_LABELS. A fixed batch is BATCH_ROWS/ROWS words.
+// With CMD_STREAM_ROWS the last word is the one with TLAST; pad it with rows of 0s and drop their results.
+
+// Data of one word of the wide streams
+template<int BITS>
+struct AXIS_WIDE_wLAST{
+	ap_uint<BITS> data;
+	bool last;
+};
+
+// Values of all neurons of a layer for the ROWS rows of a word. last is set for the last word of the batch.
+template<typename T, int ROWS, int N>
+struct GROUP_wLAST{
+	T v[ROWS][N];
+	bool last;
+};
+
+// Each stage handles one word (ROWS rows) per loop iteration. The II is left to csynth, which has not been run on
+// mlp_rows_kernel.
+template<int ROWS, int FEATURES, typename data_t>
+void read_groups(hls::stream<AXIS_WIDE_wLAST<ROWS*FEATURES*data_t::width> >& S_AXIS, hls::stream<GROUP_wLAST<data_t, ROWS, FEATURES> >& x_stream,
+		int groups){
+	AXIS_WIDE_wLAST<ROWS*FEATURES*data_t::width> read_input;
+	GROUP_wLAST<data_t, ROWS, FEATURES> x;
+	int group = 0, r, f, lsb;
+	read_groups_loop:do{
+#pragma HLS pipeline II=1
+		read_input = S_AXIS.read();
+		read_groups_rows:for(r = 0; r < ROWS; r++){
+#pragma HLS unroll
+			read_groups_features:for(f = 0; f < FEATURES; f++){
+#pragma HLS unroll
+				lsb = (r*FEATURES+f)*data_t::width;
+				x.v[r][f] = read_input.data.range(lsb+data_t::width-1, lsb);
+			}
+		}
+		x.last = (groups == 0) ? read_input.last : (group == groups-1);
+		x_stream.write(x);
+		group++;
+	}while(!x.last);
+}
+
+// ROWS*HIDDEN neurons, all features at once: ROWS*HIDDEN*FEATURES multipliers.
+template<int ROWS, int FEATURES, int HIDDEN, typename data_t, typename acc_t>
+void hidden_groups(hls::stream<GROUP_wLAST<data_t, ROWS, FEATURES> >& x_stream, hls::stream<GROUP_wLAST<acc_t, ROWS, HIDDEN> >& sum_stream,
+		const data_t B[FEATURES+1][HIDDEN]){
+	GROUP_wLAST<data_t, ROWS, FEATURES> x;
+	GROUP_wLAST<acc_t, ROWS, HIDDEN> sum;
+	acc_t acc;
+	int r, h, f;
+	hidden_groups_loop:do{
+#pragma HLS pipeline II=1
+		x = x_stream.read();
+		hidden_groups_rows:for(r = 0; r < ROWS; r++){
+#pragma HLS unroll
+			hidden_groups_neurons:for(h = 0; h < HIDDEN; h++){
+#pragma HLS unroll
+				acc = B[0][h];	// bias
+				hidden_groups_features:for(f = 0; f < FEATURES; f++){
+#pragma HLS unroll
+					acc += x.v[r][f]*B[f+1][h];
+				}
+				sum.v[r][h] = acc/256;
+			}
+		}
+		sum.last = x.last;
+		sum_stream.write(sum);
+	}while(!sum.last);
+}
+
+// SIG has (HIDDEN+1)/2 copies per row lane: lane r, neuron h reads copy r*((HIDDEN+1)/2)+h/2.
+template<int ROWS, int HIDDEN, typename data_t, typename acc_t>
+void sigmoid_groups(hls::stream<GROUP_wLAST<acc_t, ROWS, HIDDEN> >& sum_stream, hls::stream<GROUP_wLAST<data_t, ROWS, HIDDEN> >& act_stream,
+		const data_t SIG[ROWS*((HIDDEN+1)/2)][SIG_SIZE]){
+	GROUP_wLAST<acc_t, ROWS, HIDDEN> sum;
+	GROUP_wLAST<data_t, ROWS, HIDDEN> act;
+	int r, h;
+	sigmoid_groups_loop:do{
+#pragma HLS pipeline II=1
+		sum = sum_stream.read();
+		sigmoid_groups_rows:for(r = 0; r < ROWS; r++){
+#pragma HLS unroll
+			sigmoid_groups_neurons:for(h = 0; h < HIDDEN; h++){
+#pragma HLS unroll
+				act.v[r][h] = sigmoid_lookup<data_t>(sum.v[r][h], SIG[r*((HIDDEN+1)/2)+h/2]);
+			}
+		}
+		act.last = sum.last;
+		act_stream.write(act);
+	}while(!act.last);
+}
+
+// ROWS*OUTPUTS neurons: ROWS*OUTPUTS*HIDDEN multipliers. The results are saturated and packed into M_AXIS words here.
+template<int ROWS, int HIDDEN, int OUTPUTS, typename data_t, typename acc_t>
+void output_groups(hls::stream<GROUP_wLAST<data_t, ROWS, HIDDEN> >& act_stream, hls::stream<AXIS_WIDE_wLAST<ROWS*OUTPUTS*data_t::width> >& M_AXIS,
+		const data_t C[HIDDEN+1][OUTPUTS]){
+	const int max_value = (1<<data_t::width)-1;
+	GROUP_wLAST<data_t, ROWS, HIDDEN> act;
+	AXIS_WIDE_wLAST<ROWS*OUTPUTS*data_t::width> write_output;
+	acc_t sum;
+	int r, o, h, value, lsb;
+	output_groups_loop:do{
+#pragma HLS pipeline II=1
+		act = act_stream.read();
+		output_groups_rows:for(r = 0; r < ROWS; r++){
+#pragma HLS unroll
+			output_groups_outputs:for(o = 0; o < OUTPUTS; o++){
+#pragma HLS unroll
+				sum = C[0][o];	// bias
+				output_groups_neurons:for(h = 0; h < HIDDEN; h++){
+#pragma HLS unroll
+					sum += act.v[r][h]*C[h+1][o];
+				}
+				value = sum/256;
+				if(value > max_value)
+					value = max_value;
+				if(value < 0)
+					value = 0;
+				lsb = (r*OUTPUTS+o)*data_t::width;
+				write_output.data.range(lsb+data_t::width-1, lsb) = value;
+			}
+		}
+		write_output.last = act.last;
+		M_AXIS.write(write_output);
+	}while(!act.last);
+}
+
+template<int ROWS, int FEATURES, int HIDDEN, int OUTPUTS, typename data_t, typename acc_t>
+void compute_groups(hls::stream<AXIS_WIDE_wLAST<ROWS*FEATURES*data_t::width> >& S_AXIS, hls::stream<AXIS_WIDE_wLAST<ROWS*OUTPUTS*data_t::width> >& M_AXIS,
+		int groups, const data_t B[FEATURES+1][HIDDEN], const data_t C[HIDDEN+1][OUTPUTS], const data_t SIG[ROWS*((HIDDEN+1)/2)][SIG_SIZE]){
+#pragma HLS DATAFLOW
+	hls::stream<GROUP_wLAST<data_t, ROWS, FEATURES> > x_stream("x_stream");
+	hls::stream<GROUP_wLAST<acc_t, ROWS, HIDDEN> > sum_stream("sum_stream");
+	hls::stream<GROUP_wLAST<data_t, ROWS, HIDDEN> > act_stream("act_stream");
+#pragma HLS STREAM variable=x_stream depth=FIFO_DEPTH
+#pragma HLS STREAM variable=sum_stream depth=FIFO_DEPTH
+#pragma HLS STREAM variable=act_stream depth=FIFO_DEPTH
+
+	read_groups<ROWS, FEATURES, data_t>(S_AXIS, x_stream, groups);
+	hidden_groups<ROWS, FEATURES, HIDDEN, data_t, acc_t>(x_stream, sum_stream, B);
+	sigmoid_groups<ROWS, HIDDEN, data_t, acc_t>(sum_stream, act_stream, SIG);
+	output_groups<ROWS, HIDDEN, OUTPUTS, data_t, acc_t>(act_stream, M_AXIS, C);
+}
+
+// Per row lane: FEATURES*HIDDEN + HIDDEN*OUTPUTS multipliers and (HIDDEN+1)/2 copies of SIG (two lookups per copy).
+// The cost of this replication has not been synthesized.
+// B and C are in registers, shared by all lanes.
+template<int ROWS, int FEATURES, int HIDDEN, int OUTPUTS, typename data_t, typename acc_t>
+void mlp_rows_kernel(hls::stream<AXIS_WIDE_wLAST<ROWS*FEATURES*data_t::width> >& S_AXIS, hls::stream<AXIS_WIDE_wLAST<ROWS*OUTPUTS*data_t::width> >& M_AXIS){
+	static data_t input_memory_B[FEATURES+1][HIDDEN];
+#pragma HLS array_partition variable=input_memory_B complete dim=0
+	static data_t input_memory_C[HIDDEN+1][OUTPUTS];
+#pragma HLS array_partition variable=input_memory_C complete dim=0
+	static data_t input_memory_SIG[ROWS*((HIDDEN+1)/2)][SIG_SIZE];
+#pragma HLS array_partition variable=input_memory_SIG complete dim=1
+#pragma HLS RESOURCE variable=input_memory_SIG core=RAM_2P_BRAM
+
+	AXIS_WIDE_wLAST<ROWS*FEATURES*data_t::width> read_input;
+	int command, word_cnt, copy;
+
+	read_input = S_AXIS.read();
+	command = read_input.data.range(data_t::width-1, 0);
+
+	if(command & CMD_LOAD_MODEL){
+		myip_rows_HLS_for2:for(word_cnt = 0; word_cnt < (FEATURES+1)*HIDDEN; word_cnt++){
+#pragma HLS pipeline II=1
+			read_input = S_AXIS.read();
+			input_memory_B[word_cnt/HIDDEN][word_cnt%HIDDEN] = read_input.data.range(data_t::width-1, 0);
+		}
+
+		myip_rows_HLS_for3:for(word_cnt = 0; word_cnt < (HIDDEN+1)*OUTPUTS; word_cnt++){
+#pragma HLS pipeline II=1
+			read_input = S_AXIS.read();
+			input_memory_C[word_cnt/OUTPUTS][word_cnt%OUTPUTS] = read_input.data.range(data_t::width-1, 0);
+		}
+
+		myip_rows_HLS_for4:for(word_cnt = 0; word_cnt < SIG_WORDS; word_cnt++){
+#pragma HLS pipeline II=1
+			read_input = S_AXIS.read();
+			myip_rows_HLS_for5:for(copy = 0; copy < ROWS*((HIDDEN+1)/2); copy++){
+#pragma HLS unroll
+				input_memory_SIG[copy][word_cnt] = read_input.data.range(data_t::width-1, 0);
+			}
+		}
+	}
+
+	compute_groups<ROWS, FEATURES, HIDDEN, OUTPUTS, data_t, acc_t>(S_AXIS, M_AXIS, (command & CMD_STREAM_ROWS) ? 0 : BATCH_ROWS/ROWS,
+			input_memory_B, input_memory_C, input_memory_SIG);
+}
+
+
+/***************** Coprocessor functions (top functions) *********************/
+
+// Row lanes of myip_rows_HLS. 4 gives 4 rows per word (a 224-bit S_AXIS and a 32-bit M_AXIS for the 7-2-1 model).
+// BATCH_ROWS must be a multiple of it.
+#ifndef ROWS_PER_CYCLE
+#define ROWS_PER_CYCLE 4
+#endif
+typedef AXIS_WIDE_wLAST<ROWS_PER_CYCLE*7*8> AXIS_ROWS_IN;
+typedef AXIS_WIDE_wLAST<ROWS_PER_CYCLE*1*8> AXIS_ROWS_OUT;
+
+// 7-2-1 model of the project (X.csv, w_hid.csv, w_out.csv, sigmoid.csv)
+void myip_v1_0_HLS(hls::stream<AXIS_wLAST>& S_AXIS, hls::stream<AXIS_wLAST>& M_AXIS);
+// Larger models
+void myip_mlp_16_8_1_HLS(hls::stream<AXIS_wLAST>& S_AXIS, hls::stream<AXIS_wLAST>& M_AXIS);
+void myip_mlp_64_32_2_HLS(hls::stream<AXIS_wLAST>& S_AXIS, hls::stream<AXIS_wLAST>& M_AXIS);
+// 7-2-1 model, X and the results in memory (m_axi), controlled over AXI-Lite
+void myip_mm_HLS(const int *model, const int *X, int *RES, int rows, int command);
+// 7-2-1 model, ROWS_PER_CYCLE rows per S_AXIS word
+void myip_rows_HLS(hls::stream<AXIS_ROWS_IN>& S_AXIS, hls::stream<AXIS_ROWS_OUT>& M_AXIS);
+
+#endif
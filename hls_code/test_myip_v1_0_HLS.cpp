@@ -12,83 +12,447 @@
 --		(vi) retain this notice in this file or any files derived from this.
 ----------------------------------------------------------------------------------
 */
-/*NOTE: This simulation testbench will not work due to the sum being divided by 256!*/
-
 #include <stdio.h>
-#include "hls_stream.h"
+#include <stdlib.h>
+#include "myip_v1_0_HLS.h"	// AXIS with TLAST structure, commands and coprocessor function declarations
+#if TELEMETRY
+extern "C" {
+#include "../c_code/mlp_telemetry.h"	// with TELEMETRY 1, add ../c_code/mlp_telemetry.c to the testbench files
+}
+#endif
+
 
-/***************** AXIS with TLAST structure declaration *********************/
+/***************** Macros *********************/
+#define NUMBER_OF_INPUT_WORDS 724  // length of an input vector with CMD_LOAD_MODEL (468 without SIG, with SIGMOID_ROM / SIGMOID_PWL)
+#define NUMBER_OF_INFER_WORDS 449  // length of an input vector with CMD_INFER_ONLY
+#define NUMBER_OF_FILE_WORDS 723   // X.csv holds A, B, C and SIG, in that order
+#define A_SIZE 448
+#define B_SIZE 8	// rows of B (bias + 7 weights), two columns
+#define C_SIZE 3
+#define NUMBER_OF_OUTPUT_WORDS 64  // length of an output vector
+#define NUMBER_OF_TEST_VECTORS 2  // test case 0 loads the model, test case 1 reuses it
+
+#define FEATURES (B_SIZE-1)
+#define NUMBER_OF_STREAM_TESTS 8   // CMD_STREAM_ROWS / CMD_PACKED / CMD_LABELS batches, with the commands and lengths in stream_tests[]
+#define PACK_LANES 4	// 8-bit values per word with CMD_PACKED
+#define SHAPE_STREAM_ROWS 100	// rows of the CMD_STREAM_ROWS batch for the larger models
+#define NUMBER_OF_ROWS_TESTS 3	// myip_rows_HLS batches, with the commands and lengths in rows_tests[]
+#define NUMBER_OF_MM_TESTS 5	// myip_mm_HLS calls, with the commands and lengths in mm_tests[]
+#define MM_ROWS 1000	// size of the X / RES buffers of myip_mm_HLS
+#define DATA_THRESHOLD 39	// labels.csv is (result > 39) for the rows of X.csv (CMD_LABELS threshold)
+
+
+/************************** Function Definitions *****************************/
+
+// Reads up to count integers from a csv file. Empty fields (",,,") are skipped.
+int read_csv_words(const char *path, int out[], int count){
+	FILE *in_file = fopen(path,"r");
+	int c, value = 0, in_number = 0, n = 0;
+	if(in_file == NULL)
+		return -1;
+	while(n < count && (c = fgetc(in_file)) != EOF){
+		if(c >= '0' && c <= '9'){
+			value = value*10 + (c-'0');
+			in_number = 1;
+		}
+		else if(in_number){
+			out[n++] = value;
+			value = 0;
+			in_number = 0;
+		}
+	}
+	if(in_number && n < count)
+		out[n++] = value;
+	fclose(in_file);
+	return n;
+}
 
-struct AXIS_wLAST{
-	int data;
-	bool last;
-};
+// Software version of mlp_kernel for one row x of A, for any model shape. Writes outputs results to res[].
+void software_model_mlp(const int x[], const int B[], const int C[], const int SIG[],
+		int features, int hidden, int outputs, int res[]){
+	int f, n, o, sum, act[64];
+	for(n = 0; n < hidden; n++){
+		sum = B[n];	// bias is the first row of B
+		for(f = 0; f < features; f++)
+			sum += x[f]*B[(f+1)*hidden+n];
+		sum = sum/256;
+		if(sum > SIG_SIZE-1)
+			sum = SIG_SIZE-1;
+		if(sum < 0)
+			sum = 0;
+		act[n] = SIG[sum];
+	}
+	for(o = 0; o < outputs; o++){
+		sum = C[o];
+		for(n = 0; n < hidden; n++)
+			sum += act[n]*C[(n+1)*outputs+o];
+		res[o] = sum/256;
+	}
+}
 
-/***************** Coprocessor function declaration *********************/
+// Software version of the hardware function (7-2-1 model) for one row of A, used to fill test_result_expected_memory.
+int software_model_row(const int x[], const int B[], const int C[], const int SIG[]){
+	int res;
+	software_model_mlp(x, B, C, SIG, FEATURES, 2, 1, &res);
+	return res;
+}
 
-void myip_v1_0_HLS(hls::stream<AXIS_wLAST>& S_AXIS, hls::stream<AXIS_wLAST>& M_AXIS);
+void software_model(const int A[], const int B[], const int C[], const int SIG[], int RES[]){
+	int row;
+	for(row = 0; row < NUMBER_OF_OUTPUT_WORDS; row++)
+		RES[row] = software_model_row(A+row*FEATURES, B, C, SIG);
+}
 
+// Turns rows rows of outputs results into their labels (see CMD_LABELS), in place : res[row] is the label of row.
+void software_labels(int res[], int rows, int outputs, int threshold){
+	int row, o, best;
+	for(row = 0; row < rows; row++){
+		best = 0;
+		for(o = 1; o < outputs; o++)
+			if(res[row*outputs+o] > res[row*outputs+best])
+				best = o;
+		res[row] = (outputs == 1) ? (res[row] > threshold) : best;
+	}
+}
 
-/***************** Macros *********************/
-#define NUMBER_OF_INPUT_WORDS 723  // length of an input vector
-#define A_SIZE 448
-#define B_SIZE 8
-#define NUMBER_OF_OUTPUT_WORDS 64  // length of an input vector
-#define NUMBER_OF_TEST_VECTORS 1  // number of such test vectors (cases)
+// Sigmoid table used by the kernels, for the expected results : SIG of the model with SIGMOID_TABLE, else the built-in one.
+// The built-in one is sigmoid.csv, which is also the SIG of X.csv. With SIGMOID_PWL, it is interpolated here
+// between every 2^SIGMOID_PWL_STEP_BITS-th entry (the last segment ending at the last entry).
+int sigmoid_builtin[SIG_SIZE];
+
+void build_sigmoid_builtin(const int file_SIG[]){
+	int j, lo, hi;
+	for(j = 0; j < SIG_SIZE; j++){
+		lo = j >> SIGMOID_PWL_STEP_BITS << SIGMOID_PWL_STEP_BITS;
+		hi = lo + (1 << SIGMOID_PWL_STEP_BITS);
+		if(hi > SIG_SIZE-1)
+			hi = SIG_SIZE-1;
+		if(SIGMOID_MODE == SIGMOID_PWL)
+			sigmoid_builtin[j] = file_SIG[lo] + (((file_SIG[hi]-file_SIG[lo])*(j-lo)) >> SIGMOID_PWL_STEP_BITS);
+		else
+			sigmoid_builtin[j] = file_SIG[j];
+	}
+}
+
+const int *kernel_sigmoid(const int SIG[]){
+	return (SIGMOID_MODE == SIGMOID_TABLE) ? SIG : sigmoid_builtin;
+}
 
+// Sends the header word, followed by the model words (only with CMD_LOAD_MODEL).
+void send_header(hls::stream<AXIS_wLAST>& S_AXIS, int command, const int model[], int model_words){
+	AXIS_wLAST write_input;
+	int word_cnt;
+	write_input.data = command;
+	write_input.last = 0;
+	S_AXIS.write(write_input);
+	for (word_cnt=0 ; (command & CMD_LOAD_MODEL) && word_cnt < model_words ; word_cnt++){
+		write_input.data = model[word_cnt];
+		S_AXIS.write(write_input);
+	}
+}
 
-/************************** Variable Definitions *****************************/
+// Sends rows of A (rows taken cyclically from the a_rows rows of A), packed PACK_LANES values per word with CMD_PACKED.
+// TLAST is set on the last word.
+void send_rows(hls::stream<AXIS_wLAST>& S_AXIS, int command, const int A[], int a_rows, int features, int rows){
+	AXIS_wLAST write_input;
+	int value_cnt, values = rows*features, lanes = (command & CMD_PACKED) ? PACK_LANES : 1, lane;
+	for (value_cnt=0 ; value_cnt < values ; value_cnt+=lanes){
+		write_input.data = 0;
+		for (lane=0 ; lane < lanes && value_cnt+lane < values ; lane++)
+			write_input.data |= A[((value_cnt+lane)/features%a_rows)*features+(value_cnt+lane)%features] << (8*lane);
+		write_input.last = (value_cnt+lanes >= values);
+		S_AXIS.write(write_input);
+	}
+}
 
+// Receives count results (unpacked from PACK_LANES per word with CMD_PACKED) and compares them with expected[]
+// (saturated to 8 bits with CMD_PACKED). With CMD_LABELS, the results are labels of label_bits bits, 32 / label_bits per word.
+// TLAST must be set on the last word only. Returns 1 on success.
+int receive_results(hls::stream<AXIS_wLAST>& M_AXIS, int command, const int expected[], int count, int label_bits = 1){
+	AXIS_wLAST read_output;
+	int res_cnt, value, expected_value, success = 1;
+	int bits = (command & CMD_LABELS) ? label_bits : 8;
+	int lanes = (command & CMD_LABELS) ? 32/label_bits : (command & CMD_PACKED) ? PACK_LANES : 1, words = (count+lanes-1)/lanes;
+	read_output.data = 0;
+	read_output.last = 0;
+	for (res_cnt=0 ; res_cnt < count ; res_cnt++){
+		if(res_cnt%lanes == 0)
+			read_output = M_AXIS.read();
+		value = (lanes == 1) ? read_output.data : (read_output.data >> (bits*(res_cnt%lanes))) & ((1<<bits)-1);
+		expected_value = expected[res_cnt];
+		if(lanes != 1 && expected_value > 255)
+			expected_value = 255;
+		if(value != expected_value || read_output.last != (res_cnt/lanes == words-1)){
+			printf(" Mismatch at result %d : %d (expected %d), last %d\r\n", res_cnt, value, expected_value, read_output.last);
+			success = 0;
+		}
+	}
+	if(!M_AXIS.empty()){
+		printf(" Words left in M_AXIS after %d results\r\n", count);
+		success = 0;
+	}
+	return success;
+}
+
+// Two CMD_TELEMETRY batches of BATCH_ROWS rows of A. With TELEMETRY 1, each gives its results (without TLAST), then the
+// trailer (TLAST on its last word), and the counters of the second batch must be those of one batch :
+// one header, FEATURES clocks per row in the hidden layer, one per row in the output layer.
+// With TELEMETRY 0, CMD_TELEMETRY is ignored. Returns 1 on success.
+int test_telemetry(const int A[], const int B[], const int C[], const int SIG[]){
+	hls::stream<AXIS_wLAST> S_AXIS;
+	hls::stream<AXIS_wLAST> M_AXIS;
+	int expected[BATCH_ROWS];
+	int batch, row, success = 1;
+	for(row = 0; row < BATCH_ROWS; row++)
+		expected[row] = software_model_row(A+row*FEATURES, B, C, SIG);
+#if TELEMETRY
+	AXIS_wLAST read_output;
+	uint32_t words[MLP_TELEMETRY_WORDS];
+	MLP_Telemetry t[2], delta;
+	int word_cnt;
+	for(batch = 0; batch < 2; batch++){
+		send_header(S_AXIS, CMD_INFER_ONLY | CMD_TELEMETRY, B, 0);
+		send_rows(S_AXIS, CMD_INFER_ONLY, A, BATCH_ROWS, FEATURES, BATCH_ROWS);
+		myip_v1_0_HLS(S_AXIS, M_AXIS);
+		for(row = 0; row < BATCH_ROWS; row++){
+			read_output = M_AXIS.read();
+			if(read_output.data != expected[row] || read_output.last){
+				printf(" Mismatch at result %d : %d (expected %d), last %d\r\n", row, read_output.data, expected[row], read_output.last);
+				success = 0;
+			}
+		}
+		for(word_cnt = 0; word_cnt < MLP_TELEMETRY_WORDS; word_cnt++){
+			read_output = M_AXIS.read();
+			words[word_cnt] = read_output.data;
+			success &= (read_output.last == (word_cnt == MLP_TELEMETRY_WORDS-1));
+		}
+		if(MLP_Telemetry_Decode(words, &t[batch]) != 0){
+			printf(" No telemetry trailer after batch %d\r\n", batch);
+			return 0;
+		}
+	}
+	MLP_Telemetry_Delta(&t[1], &t[0], &delta);
+	MLP_Telemetry_Print(&delta, 1);
+	success &= (delta.batches == 1) && (delta.hid_cycles == BATCH_ROWS*FEATURES) && (delta.out_cycles == BATCH_ROWS)
+			&& (delta.cycles >= BATCH_ROWS*FEATURES);
+#else
+	for(batch = 0; batch < 2; batch++){
+		send_header(S_AXIS, CMD_INFER_ONLY | CMD_TELEMETRY, B, 0);
+		send_rows(S_AXIS, CMD_INFER_ONLY, A, BATCH_ROWS, FEATURES, BATCH_ROWS);
+		myip_v1_0_HLS(S_AXIS, M_AXIS);
+		success &= receive_results(M_AXIS, CMD_INFER_ONLY, expected, BATCH_ROWS);
+	}
+#endif
+	if(!success)
+		printf(" CMD_TELEMETRY failed\r\n");
+	return success;
+}
+
+// Runs a random FEATURES-HIDDEN-OUTPUTS model through kernel: a CMD_LOAD_MODEL batch of BATCH_ROWS rows,
+// then a packed CMD_STREAM_ROWS batch of SHAPE_STREAM_ROWS rows, and the same rows with CMD_LABELS. Returns 1 on success.
+template<int FEATURES_, int HIDDEN, int OUTPUTS>
+int test_shape(void (*kernel)(hls::stream<AXIS_wLAST>&, hls::stream<AXIS_wLAST>&), const char *name){
+	const int model_words = (FEATURES_+1)*HIDDEN + (HIDDEN+1)*OUTPUTS + SIG_WORDS;
+	static int model[model_words-SIG_WORDS+SIG_SIZE], A[BATCH_ROWS*FEATURES_], expected[SHAPE_STREAM_ROWS*OUTPUTS];
+	int *B = model, *C = B + (FEATURES_+1)*HIDDEN, *SIG = C + (HIDDEN+1)*OUTPUTS;
+	int i, row, command, threshold, success = 1;
+	hls::stream<AXIS_wLAST> S_AXIS;
+	hls::stream<AXIS_wLAST> M_AXIS;
+
+	printf(" Testing %s (%d-%d-%d) ... \r\n", name, FEATURES_, HIDDEN, OUTPUTS);
+	// hidden weights up to 1024/FEATURES keep the sigmoid indices spread over (and past) 0..255
+	for(i = 0; i < (FEATURES_+1)*HIDDEN; i++)
+		B[i] = rand() % (1024/FEATURES_+1);
+	for(i = 0; i < (HIDDEN+1)*OUTPUTS; i++)
+		C[i] = rand() % 256;
+	for(i = 0; i < SIG_SIZE; i++)
+		SIG[i] = i;
+	for(i = 0; i < BATCH_ROWS*FEATURES_; i++)
+		A[i] = rand() % 256;
+
+	// fixed batch, loading the model
+	command = CMD_LOAD_MODEL;
+	for(row = 0; row < BATCH_ROWS; row++)
+		software_model_mlp(A+row*FEATURES_, B, C, kernel_sigmoid(SIG), FEATURES_, HIDDEN, OUTPUTS, expected+row*OUTPUTS);
+	send_header(S_AXIS, command, model, model_words);
+	send_rows(S_AXIS, command, A, BATCH_ROWS, FEATURES_, BATCH_ROWS);
+	kernel(S_AXIS, M_AXIS);
+	success &= receive_results(M_AXIS, command, expected, BATCH_ROWS*OUTPUTS);
+
+	// packed streaming batch with the resident model
+	command = CMD_INFER_ONLY | CMD_STREAM_ROWS | CMD_PACKED;
+	for(row = 0; row < SHAPE_STREAM_ROWS; row++)
+		software_model_mlp(A+(row%BATCH_ROWS)*FEATURES_, B, C, kernel_sigmoid(SIG), FEATURES_, HIDDEN, OUTPUTS, expected+row*OUTPUTS);
+	send_header(S_AXIS, command, model, model_words);
+	send_rows(S_AXIS, command, A, BATCH_ROWS, FEATURES_, SHAPE_STREAM_ROWS);
+	kernel(S_AXIS, M_AXIS);
+	success &= receive_results(M_AXIS, command, expected, SHAPE_STREAM_ROWS*OUTPUTS);
+
+	// labels of the same rows, the threshold (one output) being the first result, so that there are labels of 0 and 1
+	threshold = expected[0];
+	command = CMD_INFER_ONLY | CMD_STREAM_ROWS | CMD_LABELS | (threshold << LABEL_THRESHOLD_SHIFT);
+	software_labels(expected, SHAPE_STREAM_ROWS, OUTPUTS, threshold);
+	send_header(S_AXIS, command, model, model_words);
+	send_rows(S_AXIS, command, A, BATCH_ROWS, FEATURES_, SHAPE_STREAM_ROWS);
+	kernel(S_AXIS, M_AXIS);
+	success &= receive_results(M_AXIS, command, expected, SHAPE_STREAM_ROWS, LABEL_BITS(OUTPUTS));
+
+	if(!S_AXIS.empty()){
+		printf(" Words left in S_AXIS\r\n");
+		success = 0;
+	}
+	return success;
+}
+
+// Runs a batch of rows through myip_rows_HLS (ROWS_PER_CYCLE rows per word, the last word padded with rows of 0s)
+// and compares the results with the 7-2-1 software model. Returns 1 on success.
+int test_rows(int command, const int A[], const int model[], int rows){
+	const int model_words = 2*B_SIZE+C_SIZE+SIG_WORDS;
+	const int *B = model, *C = B + 2*B_SIZE, *SIG = C + C_SIZE;
+	AXIS_ROWS_IN write_input;
+	AXIS_ROWS_OUT read_output;
+	int word_cnt, row, f, value, expected, success = 1;
+	int words = (rows+ROWS_PER_CYCLE-1)/ROWS_PER_CYCLE;
+	hls::stream<AXIS_ROWS_IN> S_AXIS;
+	hls::stream<AXIS_ROWS_OUT> M_AXIS;
+
+	printf(" Sending %d rows to myip_rows_HLS with command %d ... \r\n", rows, command);
+	write_input.data = command;
+	write_input.last = 0;
+	S_AXIS.write(write_input);
+	for (word_cnt=0 ; (command & CMD_LOAD_MODEL) && word_cnt < model_words ; word_cnt++){
+		write_input.data = model[word_cnt];
+		S_AXIS.write(write_input);
+	}
+	for (word_cnt=0 ; word_cnt < words ; word_cnt++){
+		write_input.data = 0;
+		for (row=word_cnt*ROWS_PER_CYCLE ; row < (word_cnt+1)*ROWS_PER_CYCLE && row < rows ; row++)
+			for (f=0 ; f < FEATURES ; f++)
+				write_input.data.range(((row%ROWS_PER_CYCLE)*FEATURES+f)*8+7, ((row%ROWS_PER_CYCLE)*FEATURES+f)*8) =
+						A[(row%NUMBER_OF_OUTPUT_WORDS)*FEATURES+f];
+		write_input.last = (word_cnt == words-1);
+		S_AXIS.write(write_input);
+	}
+
+	myip_rows_HLS(S_AXIS, M_AXIS);
+
+	for (word_cnt=0 ; word_cnt < words ; word_cnt++){
+		read_output = M_AXIS.read();
+		for (row=word_cnt*ROWS_PER_CYCLE ; row < (word_cnt+1)*ROWS_PER_CYCLE && row < rows ; row++){
+			value = read_output.data.range((row%ROWS_PER_CYCLE)*8+7, (row%ROWS_PER_CYCLE)*8);
+			expected = software_model_row(A+(row%NUMBER_OF_OUTPUT_WORDS)*FEATURES, B, C, kernel_sigmoid(SIG));
+			if(expected > 255)
+				expected = 255;
+			if(value != expected || read_output.last != (word_cnt == words-1)){
+				printf(" Mismatch at row %d : %d (expected %d), last %d\r\n", row, value, expected, read_output.last);
+				success = 0;
+			}
+		}
+	}
+	if(!S_AXIS.empty() || !M_AXIS.empty()){
+		printf(" Words left in S_AXIS / M_AXIS\r\n");
+		success = 0;
+	}
+	return success;
+}
+
+// Runs rows rows (taken cyclically from A) through myip_mm_HLS, with X and RES in memory buffers,
+// and compares the results with the 7-2-1 software model. Returns 1 on success.
+int test_mm(int command, const int A[], const int model[], int rows){
+	static int X[MM_ROWS*FEATURES], RES[MM_ROWS+1];
+	const int *B = model, *C = B + 2*B_SIZE, *SIG = C + C_SIZE;
+	int value_cnt, row, value, expected, success = 1;
+	int lanes = (command & CMD_PACKED) ? PACK_LANES : 1;
+	int res_lanes = (command & CMD_LABELS) ? 32 : lanes;
+
+	printf(" Running myip_mm_HLS on %d rows with command %d ... \r\n", rows, command);
+	for (value_cnt=0 ; value_cnt < MM_ROWS*FEATURES ; value_cnt++)
+		X[value_cnt] = 0;
+	for (value_cnt=0 ; value_cnt < rows*FEATURES ; value_cnt++)
+		X[value_cnt/lanes] |= A[(value_cnt/FEATURES%NUMBER_OF_OUTPUT_WORDS)*FEATURES+value_cnt%FEATURES] << (8*(value_cnt%lanes));
+	for (row=0 ; row < MM_ROWS+1 ; row++)
+		RES[row] = -1;
+
+	myip_mm_HLS(model, X, RES, rows, command);
+
+	for (row=0 ; row < rows ; row++){
+		value = (command & CMD_LABELS) ? (RES[row/res_lanes] >> (row%res_lanes)) & 1
+				: (lanes == 1) ? RES[row] : (RES[row/lanes] >> (8*(row%lanes))) & 0xFF;
+		expected = software_model_row(A+(row%NUMBER_OF_OUTPUT_WORDS)*FEATURES, B, C, kernel_sigmoid(SIG));
+		if(command & CMD_LABELS)
+			software_labels(&expected, 1, 1, command >> LABEL_THRESHOLD_SHIFT);
+		else if(lanes != 1 && expected > 255)
+			expected = 255;
+		if(value != expected){
+			printf(" Mismatch at row %d : %d (expected %d)\r\n", row, value, expected);
+			success = 0;
+		}
+	}
+	// nothing may be written past the results
+	if(RES[(rows+res_lanes-1)/res_lanes] != -1){
+		printf(" RES written past %d results\r\n", rows);
+		success = 0;
+	}
+	return success;
+}
 
 /*****************************************************************************
 * Main function
 ******************************************************************************/
 int main()
 {
+	int file_words[NUMBER_OF_FILE_WORDS];
 	int test_input_memory[NUMBER_OF_TEST_VECTORS*NUMBER_OF_INPUT_WORDS];
-	int test_result_expected_memory[NUMBER_OF_TEST_VECTORS*NUMBER_OF_OUTPUT_WORDS];// 4 outputs *2
+	int test_input_length[NUMBER_OF_TEST_VECTORS];
+	int test_result_expected_memory[NUMBER_OF_TEST_VECTORS*NUMBER_OF_OUTPUT_WORDS];
 	int result_memory[NUMBER_OF_TEST_VECTORS*NUMBER_OF_OUTPUT_WORDS]; // same size as test_result_expected_memory
-	int word_cnt, word_cnt2 = 512, test_case_cnt = 0, K = 0;
+	int word_cnt, test_case_cnt = 0;
 	int success;
 	AXIS_wLAST read_output, write_input;
 	hls::stream<AXIS_wLAST> S_AXIS;
 	hls::stream<AXIS_wLAST> M_AXIS;
 
-	/************** Run a software version of the hardware function to validate results ************/
-	// instead of hard-coding the results in test_result_expected_memory
-	/*
-	int sum = 0;
-	for(word_cnt = 0; word_cnt < A_SIZE; word_cnt++){
-		sum += test_input_memory[word_cnt]*test_input_memory[word_cnt2];
-		if((word_cnt+1)%B_SIZE==0){
-			test_result_expected_memory[K] = sum;
-			K++;
-			sum = 0;
-			word_cnt2 = 512;
-		}else{
-			word_cnt2++;
-		}
+	// X.csv (add it to the testbench files of the project) holds A, B, C and SIG in the order of the original 723-word stream
+	if(read_csv_words("X.csv", file_words, NUMBER_OF_FILE_WORDS) != NUMBER_OF_FILE_WORDS){
+		printf("Could not read %d words from X.csv\r\n", NUMBER_OF_FILE_WORDS);
+		return 1;
 	}
-	*/
+	int *A = file_words, *B = A + A_SIZE, *C = B + 2*B_SIZE, *SIG = C + C_SIZE;
+	build_sigmoid_builtin(SIG);
+
+	/************** Build the input vectors ************/
+	// test case 0 : CMD_LOAD_MODEL, B, C, SIG (SIGMOID_TABLE only), A
+	int *vec = test_input_memory;
+	vec[0] = CMD_LOAD_MODEL;
+	for(word_cnt = 0; word_cnt < 2*B_SIZE+C_SIZE+SIG_WORDS; word_cnt++)
+		vec[1+word_cnt] = B[word_cnt];
+	for(word_cnt = 0; word_cnt < A_SIZE; word_cnt++)
+		vec[1+2*B_SIZE+C_SIZE+SIG_WORDS+word_cnt] = A[word_cnt];
+	test_input_length[0] = NUMBER_OF_INPUT_WORDS-SIG_SIZE+SIG_WORDS;
+	// test case 1 : CMD_INFER_ONLY, A. The model must still be resident from test case 0
+	vec = test_input_memory + NUMBER_OF_INPUT_WORDS;
+	vec[0] = CMD_INFER_ONLY;
+	for(word_cnt = 0; word_cnt < A_SIZE; word_cnt++)
+		vec[1+word_cnt] = A[word_cnt];
+	test_input_length[1] = NUMBER_OF_INFER_WORDS;
 
-	FILE *in_file = fopen("C:\\Users\\thebo\\Downloads\\STUDYMATERIALS\\AY2021_SEM2\\EE4218\\project\\X.csv","r");
-	int i = 0;
-	for(i=0;i<NUMBER_OF_INPUT_WORDS;i++){
-		fscanf(in_file,"%d,",test_input_memory[i]);
-	}
+	/************** Run a software version of the hardware function to validate results ************/
+	// instead of hard-coding the results in test_result_expected_memory
+	for (test_case_cnt=0 ; test_case_cnt < NUMBER_OF_TEST_VECTORS ; test_case_cnt++)
+		software_model(A, B, C, kernel_sigmoid(SIG), test_result_expected_memory+test_case_cnt*NUMBER_OF_OUTPUT_WORDS);
 
 	for (test_case_cnt=0 ; test_case_cnt < NUMBER_OF_TEST_VECTORS ; test_case_cnt++){
 
 
 		/******************** Input to Coprocessor : Transmit the Data Stream ***********************/
 
-		printf(" Transmitting Data for test case %d ... \r\n", test_case_cnt);
+		printf(" Transmitting Data for test case %d (%d words) ... \r\n", test_case_cnt, test_input_length[test_case_cnt]);
 
-		for (word_cnt=0 ; word_cnt < NUMBER_OF_INPUT_WORDS ; word_cnt++){
+		for (word_cnt=0 ; word_cnt < test_input_length[test_case_cnt] ; word_cnt++){
 
 			write_input.data = test_input_memory[word_cnt+test_case_cnt*NUMBER_OF_INPUT_WORDS];
 			write_input.last = 0;
-			if(word_cnt==NUMBER_OF_INPUT_WORDS-1)
+			if(word_cnt==test_input_length[test_case_cnt]-1)
 			{
 				write_input.last = 1;
 				// S_AXIS_TLAST is asserted for the last word.
@@ -117,22 +481,76 @@ int main()
 		/* Reception Complete */
 	}
 
+	/************************** Streaming (CMD_STREAM_ROWS) and packed (CMD_PACKED) batches *****************************/
+	// Rows are taken cyclically from A. The model is still resident from test case 0.
+
+	int stream_tests[NUMBER_OF_STREAM_TESTS][2] = {	// command, rows
+		{CMD_STREAM_ROWS, 1}, {CMD_STREAM_ROWS, 13}, {CMD_STREAM_ROWS, 1000},
+		{CMD_PACKED, NUMBER_OF_OUTPUT_WORDS}, {CMD_STREAM_ROWS | CMD_PACKED, 13}, {CMD_STREAM_ROWS | CMD_PACKED, 1000},
+		{CMD_LABELS | (DATA_THRESHOLD << LABEL_THRESHOLD_SHIFT), NUMBER_OF_OUTPUT_WORDS},
+		{CMD_STREAM_ROWS | CMD_PACKED | CMD_LABELS | (DATA_THRESHOLD << LABEL_THRESHOLD_SHIFT), 1000}
+	};
+	int stream_success = 1, expected[1000];
+	for (test_case_cnt=0 ; test_case_cnt < NUMBER_OF_STREAM_TESTS ; test_case_cnt++){
+		printf(" Streaming %d rows with command %d ... \r\n", stream_tests[test_case_cnt][1], stream_tests[test_case_cnt][0]);
+		for (word_cnt=0 ; word_cnt < stream_tests[test_case_cnt][1] ; word_cnt++)
+			expected[word_cnt] = software_model_row(A+(word_cnt%NUMBER_OF_OUTPUT_WORDS)*FEATURES, B, C, kernel_sigmoid(SIG));
+		if(stream_tests[test_case_cnt][0] & CMD_LABELS)
+			software_labels(expected, stream_tests[test_case_cnt][1], 1, stream_tests[test_case_cnt][0] >> LABEL_THRESHOLD_SHIFT);
+		send_header(S_AXIS, CMD_INFER_ONLY | stream_tests[test_case_cnt][0], B, 0);
+		send_rows(S_AXIS, stream_tests[test_case_cnt][0], A, NUMBER_OF_OUTPUT_WORDS, FEATURES, stream_tests[test_case_cnt][1]);
+
+		myip_v1_0_HLS(S_AXIS, M_AXIS);
+
+		stream_success &= receive_results(M_AXIS, stream_tests[test_case_cnt][0], expected, stream_tests[test_case_cnt][1]);
+		if(!S_AXIS.empty()){
+			printf(" Words left in S_AXIS after %d rows\r\n", stream_tests[test_case_cnt][1]);
+			stream_success = 0;
+		}
+	}
+
+	/************************** Counters (CMD_TELEMETRY) *****************************/
+	stream_success &= test_telemetry(A, B, C, kernel_sigmoid(SIG));
+
+	/************************** Larger models (mlp_kernel instantiations) *****************************/
+	srand(1);
+	stream_success &= test_shape<16, 8, 1>(myip_mlp_16_8_1_HLS, "myip_mlp_16_8_1_HLS");
+	stream_success &= test_shape<64, 32, 2>(myip_mlp_64_32_2_HLS, "myip_mlp_64_32_2_HLS");
+
+	/************************** Row-parallel kernel (myip_rows_HLS) *****************************/
+	// The first batch loads the model, which is separate from that of myip_v1_0_HLS.
+	int rows_tests[NUMBER_OF_ROWS_TESTS][2] = {	// command, rows
+		{CMD_LOAD_MODEL, BATCH_ROWS}, {CMD_STREAM_ROWS, 13}, {CMD_STREAM_ROWS, 1000}
+	};
+	for (test_case_cnt=0 ; test_case_cnt < NUMBER_OF_ROWS_TESTS ; test_case_cnt++)
+		stream_success &= test_rows(rows_tests[test_case_cnt][0], A, B, rows_tests[test_case_cnt][1]);
+
+	/************************** Memory-mapped kernel (myip_mm_HLS) *****************************/
+	// The first call loads the model, which is separate from those of the stream kernels.
+	int mm_tests[NUMBER_OF_MM_TESTS][2] = {	// command, rows
+		{CMD_LOAD_MODEL, NUMBER_OF_OUTPUT_WORDS}, {CMD_INFER_ONLY, 1}, {CMD_INFER_ONLY, MM_ROWS}, {CMD_PACKED, 13},
+		{CMD_LABELS | (DATA_THRESHOLD << LABEL_THRESHOLD_SHIFT), MM_ROWS}
+	};
+	for (test_case_cnt=0 ; test_case_cnt < NUMBER_OF_MM_TESTS ; test_case_cnt++)
+		stream_success &= test_mm(mm_tests[test_case_cnt][0], A, B, mm_tests[test_case_cnt][1]);
+
 	/************************** Checking correctness of results *****************************/
-	printf("%d,",test_result_expected_memory[0]);
-	printf("%d,",test_result_expected_memory[1]);
-	printf("%d,",test_result_expected_memory[2]);
 
-	success = 1;
+	success = stream_success;
 
 	/* Compare the data send with the data received */
 	printf(" Comparing data ...\r\n");
 	for(word_cnt=0; word_cnt < NUMBER_OF_TEST_VECTORS*NUMBER_OF_OUTPUT_WORDS; word_cnt++){
 		success = success & (result_memory[word_cnt] == test_result_expected_memory[word_cnt]);
-		printf("%d,",result_memory[word_cnt]);
-		//printf("\n");
-		printf("%d,",test_result_expected_memory[word_cnt]);
+		if(result_memory[word_cnt] != test_result_expected_memory[word_cnt])
+			printf(" Mismatch at test case %d, word %d : %d (expected %d)\r\n", word_cnt/NUMBER_OF_OUTPUT_WORDS, word_cnt%NUMBER_OF_OUTPUT_WORDS,
+					result_memory[word_cnt], test_result_expected_memory[word_cnt]);
 	}
 
+	/* Both modes must give the same outputs */
+	for(word_cnt=0; word_cnt < NUMBER_OF_OUTPUT_WORDS; word_cnt++)
+		success = success & (result_memory[word_cnt] == result_memory[NUMBER_OF_OUTPUT_WORDS+word_cnt]);
+
 	if (success != 1){
 		printf("Test Failed\r\n");
 		return 1;